@@ -10,101 +10,178 @@
 #endif
 
 #include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
 
-#include "utf8.h"
 #include "base64.h"
 #include "private.h"
 #include "useful.h"
 
-#include <stdio.h>
+static const char base64_chars[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-LIB_EXPORT uint8_t *l_base64_decode(const char *in, size_t in_len,
-					size_t *n_written)
+/*
+ * Decoding table: 0x80 | value for the alphabet, B64_SPACE for what
+ * l_ascii_isspace() accepts, B64_PAD for '=' and 0 for anything else,
+ * including all bytes above 0x7f.
+ */
+#define B64_SPACE	0x40
+#define B64_PAD		0x41
+
+static const uint8_t base64_table[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x40, 0x40, 0x40, 0x40, 0x40, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0xbe, 0x00, 0x00, 0x00, 0xbf,
+	0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb,
+	0xbc, 0xbd, 0x00, 0x00, 0x00, 0x41, 0x00, 0x00,
+	0x00, 0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86,
+	0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e,
+	0x8f, 0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96,
+	0x97, 0x98, 0x99, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f, 0xa0,
+	0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8,
+	0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf, 0xb0,
+	0xb1, 0xb2, 0xb3, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/*
+ * Decodes in a single pass.  Whole 4 character groups without whitespace
+ * take a fast path that only needs one check for all four lookups.
+ */
+static ssize_t base64_decode(const char *in, size_t in_len,
+					uint8_t *out, size_t out_size)
 {
-	const char *ptr, *in_end = in + in_len;
-	const char *base64_end = NULL;
-	uint8_t *out_buf, *out;
-	int base64_len = 0, pad_len = 0;
-	uint16_t reg = 0;
-
-	for (ptr = in; ptr < in_end; ptr++) {
-		if (l_ascii_isspace(*ptr))
-			/* Whitespace */
+	const uint8_t *ptr = (const uint8_t *) in;
+	const uint8_t *in_end = ptr + in_len;
+	uint8_t *out_start = out;
+	uint8_t *out_end = out + out_size;
+	unsigned int n = 0, pad_len = 0;
+	uint32_t reg = 0;
+	uint8_t v;
+
+	while (ptr < in_end) {
+		while (!n && in_end - ptr >= 4 && out_end - out >= 3) {
+			uint8_t a = base64_table[ptr[0]];
+			uint8_t b = base64_table[ptr[1]];
+			uint8_t c = base64_table[ptr[2]];
+			uint8_t d = base64_table[ptr[3]];
+
+			if (!(a & b & c & d & 0x80))
+				break;
+
+			reg = (a & 0x3f) << 18 | (b & 0x3f) << 12 |
+				(c & 0x3f) << 6 | (d & 0x3f);
+			out[0] = reg >> 16;
+			out[1] = reg >> 8;
+			out[2] = reg;
+			out += 3;
+			ptr += 4;
+		}
+
+		if (ptr == in_end)
+			break;
+
+		v = base64_table[*ptr++];
+
+		if (v == B64_SPACE)
 			continue;
-		else if (*ptr == '=') {
-			/* Final padding */
-			if (!pad_len)
-				base64_end = ptr;
 
+		if (v == B64_PAD) {
+			/* Final padding */
 			pad_len++;
-		} else if (!pad_len && (l_ascii_isalnum(*ptr) || *ptr == '+' ||
-					*ptr == '/'))
-			/* Base64 character */
-			base64_len++;
-		else
+			continue;
+		}
+
+		if (!v || pad_len)
 			/* Bad character */
-			return NULL;
-	}
+			return -EINVAL;
 
-	if (ptr != in_end)
-		return NULL;
+		reg = reg << 6 | (v & 0x3f);
+		n++;
+
+		if (n == 1)
+			continue;
+
+		if (out == out_end)
+			return -ENOSPC;
 
-	if ((base64_len & 3) == 1)
+		*out++ = reg >> ((4 - n) * 2);
+		n &= 3;
+	}
+
+	if (n == 1)
 		/* Invalid length */
-		return NULL;
+		return -EINVAL;
 
-	if (pad_len != align_len(base64_len, 4) - base64_len)
-		return NULL;
+	if (pad_len != (4 - n) % 4)
+		return -EINVAL;
 
-	/* No padding */
-	if (!base64_end)
-		base64_end = ptr;
+	return out - out_start;
+}
 
-	*n_written = base64_len * 3 / 4;
-	out_buf = l_malloc(*n_written);
+LIB_EXPORT uint8_t *l_base64_decode(const char *in, size_t in_len,
+					size_t *n_written)
+{
+	uint8_t *out_buf;
+	ssize_t len;
 
-	out = out_buf;
-	base64_len = 0;
+	/* At least one in four characters doesn't produce a byte */
+	out_buf = l_malloc(in_len * 3 / 4);
+	len = base64_decode(in, in_len, out_buf, in_len * 3 / 4);
 
-	for (ptr = in; ptr < base64_end; ptr++) {
-		if (l_ascii_isspace(*ptr))
-			/* Whitespace */
-			continue;
+	if (len <= 0) {
+		l_free(out_buf);
 
-		/* Base64 character */
-		reg <<= 6;
-		if (l_ascii_isupper(*ptr))
-			reg |= *ptr - 'A' + 0;
-		else if (l_ascii_islower(*ptr))
-			reg |= *ptr - 'a' + 26;
-		else if (l_ascii_isdigit(*ptr))
-			reg |= *ptr - '0' + 52;
-		else if (*ptr == '+')
-			reg |= 62;
-		else if (*ptr == '/')
-			reg |= 63;
-
-		if ((base64_len & 3) == 1)
-			*out++ = reg >> 4;
-		else if ((base64_len & 3) == 2)
-			*out++ = reg >> 2;
-		else if ((base64_len & 3) == 3)
-			*out++ = reg >> 0;
-
-		base64_len++;
+		if (len == 0)
+			*n_written = 0;
+
+		return NULL;
 	}
 
+	*n_written = len;
 	return out_buf;
 }
 
+/**
+ * l_base64_decode_into:
+ * @in: base64 encoded text, whitespace is ignored
+ * @in_len: length of @in
+ * @out: buffer for the decoded data
+ * @out_size: size of @out, @in_len * 3 / 4 is always enough
+ *
+ * Decodes @in like l_base64_decode() without allocating.
+ *
+ * Returns: The number of bytes decoded, -EINVAL if @in isn't valid base64
+ * or -ENOSPC if @out is too small.
+ **/
+LIB_EXPORT ssize_t l_base64_decode_into(const char *in, size_t in_len,
+					uint8_t *out, size_t out_size)
+{
+	if (unlikely(!in && in_len))
+		return -EINVAL;
+
+	return base64_decode(in, in_len, out, out_size);
+}
+
+static char *base64_encode_group(char *out, uint32_t reg)
+{
+	out[0] = base64_chars[(reg >> 18) & 63];
+	out[1] = base64_chars[(reg >> 12) & 63];
+	out[2] = base64_chars[(reg >> 6) & 63];
+	out[3] = base64_chars[reg & 63];
+
+	return out + 4;
+}
+
 LIB_EXPORT char *l_base64_encode(const uint8_t *in, size_t in_len, int columns)
 {
 	const uint8_t *in_end = in + in_len;
 	char *out_buf, *out;
 	size_t out_len;
 	uint32_t reg;
-	uint8_t idx;
-	int i, pad = 4;
 	int col = 0;
 
 	/* For simplicity allow multiples of 4 only */
@@ -120,42 +197,33 @@ LIB_EXPORT char *l_base64_encode(const uint8_t *in, size_t in_len, int columns)
 
 	out = out_buf;
 
-	while (in < in_end) {
-		reg = *in++ << 16;
-
-		if (in < in_end)
-			reg |= *in++ << 8;
-		else
-			pad--;
-
-		if (in < in_end)
-			reg |= *in++ << 0;
-		else
-			pad--;
-
+	while (in_end - in >= 3) {
 		if (columns && col == columns) {
 			*out++ = '\n';
 			col = 0;
 		}
 		col += 4;
 
-		for (i = 0; i < pad; i++) {
-			idx = (reg >> 18) & 63;
-			reg <<= 6;
-
-			if (idx < 26)
-				*out++ = idx + 'A';
-			else if (idx < 52)
-				*out++ = idx - 26 + 'a';
-			else if (idx < 62)
-				*out++ = idx - 52 + '0';
-			else
-				*out++ = (idx == 62) ? '+' : '/';
-		}
+		reg = in[0] << 16 | in[1] << 8 | in[2];
+		out = base64_encode_group(out, reg);
+		in += 3;
 	}
 
-	for (; pad < 4; pad++)
-		*out++ = '=';
+	if (in < in_end) {
+		if (columns && col == columns)
+			*out++ = '\n';
+
+		reg = in[0] << 16;
+
+		if (in_end - in == 2)
+			reg |= in[1] << 8;
+
+		out = base64_encode_group(out, reg);
+		out[-1] = '=';
+
+		if (in_end - in == 1)
+			out[-2] = '=';
+	}
 
 	*out = '\0';
 
@@ -8,11 +8,16 @@
 #ifndef __ELL_BASE64_H
 #define __ELL_BASE64_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 uint8_t *l_base64_decode(const char *in, size_t in_len, size_t *n_written);
+ssize_t l_base64_decode_into(const char *in, size_t in_len,
+				uint8_t *out, size_t out_size);
 
 char *l_base64_encode(const uint8_t *in, size_t in_len, int columns);
 
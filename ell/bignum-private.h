@@ -0,0 +1,58 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Enough for 8192-bit moduli */
+#define BN_MAX_DIGITS	128
+
+/*
+ * Montgomery context for an odd modulus n of ndigits 64-bit words,
+ * least significant word first.  R = 2^(64 * ndigits).
+ */
+struct bn_mont {
+	unsigned int ndigits;
+	uint64_t n0;			/* -n^-1 mod 2^64 */
+	uint64_t n[BN_MAX_DIGITS];
+	uint64_t rr[BN_MAX_DIGITS];	/* R^2 mod n */
+};
+
+#define BN_COMB_TEETH	6
+
+/* Fixed-base table, 2^BN_COMB_TEETH entries of ndigits words */
+struct bn_comb {
+	unsigned int spacing;
+	uint64_t table[];
+};
+
+bool bn_from_be(uint64_t *r, unsigned int ndigits,
+				const uint8_t *buf, size_t len);
+void bn_to_be(uint8_t *buf, size_t len, const uint64_t *a,
+				unsigned int ndigits);
+int bn_cmp(const uint64_t *a, const uint64_t *b, unsigned int ndigits);
+
+bool bn_mont_init(struct bn_mont *mont, const uint8_t *mod, size_t len);
+void bn_mont_mul(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *a, const uint64_t *b);
+void bn_mont_to(const struct bn_mont *mont, uint64_t *r, const uint64_t *a);
+void bn_mont_from(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *a);
+
+void bn_mod_exp_vartime(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *base,
+				const uint8_t *exp, size_t exp_len);
+void bn_mod_exp_consttime(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *base,
+				const uint8_t *exp, size_t exp_len);
+
+size_t bn_comb_size(const struct bn_mont *mont);
+void bn_comb_init(const struct bn_mont *mont, struct bn_comb *comb,
+				const uint64_t *base, size_t max_exp_bits);
+bool bn_comb_exp(const struct bn_mont *mont, const struct bn_comb *comb,
+			uint64_t *r, const uint8_t *exp, size_t exp_len);
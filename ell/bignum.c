@@ -0,0 +1,466 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "private.h"
+#include "missing.h"
+#include "bignum-private.h"
+
+/* Returns the low word of a * b + c + *carry, the high word goes to carry */
+static inline uint64_t bn_mac(uint64_t a, uint64_t b, uint64_t c,
+				uint64_t *carry)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 t = (unsigned __int128) a * b + c + *carry;
+
+	*carry = t >> 64;
+	return t;
+#else
+	uint64_t a0 = a & 0xffffffffull;
+	uint64_t a1 = a >> 32;
+	uint64_t b0 = b & 0xffffffffull;
+	uint64_t b1 = b >> 32;
+	uint64_t p00 = a0 * b0;
+	uint64_t p01 = a0 * b1;
+	uint64_t p10 = a1 * b0;
+	uint64_t mid = (p00 >> 32) + (p01 & 0xffffffffull) +
+						(p10 & 0xffffffffull);
+	uint64_t lo = (p00 & 0xffffffffull) | (mid << 32);
+	uint64_t hi = a1 * b1 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+
+	lo += c;
+	hi += lo < c;
+	lo += *carry;
+	hi += lo < *carry;
+
+	*carry = hi;
+	return lo;
+#endif
+}
+
+static uint64_t bn_sub(uint64_t *r, const uint64_t *a, const uint64_t *b,
+				unsigned int ndigits)
+{
+	uint64_t borrow = 0;
+	unsigned int i;
+
+	for (i = 0; i < ndigits; i++) {
+		uint64_t d = a[i] - b[i] - borrow;
+
+		borrow = (a[i] < b[i]) | ((a[i] == b[i]) & borrow);
+		r[i] = d;
+	}
+
+	return borrow;
+}
+
+/* Loads a big-endian integer, fails if it doesn't fit in ndigits words */
+bool bn_from_be(uint64_t *r, unsigned int ndigits,
+				const uint8_t *buf, size_t len)
+{
+	unsigned int i;
+
+	while (len && !*buf) {
+		buf++;
+		len--;
+	}
+
+	if (len > ndigits * 8)
+		return false;
+
+	memset(r, 0, ndigits * 8);
+
+	for (i = 0; i < len; i++)
+		r[i / 8] |= (uint64_t) buf[len - 1 - i] << (8 * (i % 8));
+
+	return true;
+}
+
+/* Stores the low len bytes of @a as a big-endian integer */
+void bn_to_be(uint8_t *buf, size_t len, const uint64_t *a,
+				unsigned int ndigits)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[len - 1 - i] = i / 8 < ndigits ?
+					a[i / 8] >> (8 * (i % 8)) : 0;
+}
+
+int bn_cmp(const uint64_t *a, const uint64_t *b, unsigned int ndigits)
+{
+	unsigned int i = ndigits;
+
+	while (i--) {
+		if (a[i] > b[i])
+			return 1;
+
+		if (a[i] < b[i])
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * r = a * b * R^-1 mod n, coarsely integrated operand scanning.  Inputs
+ * must be below n.  The final subtraction is done with a mask so that
+ * the running time only depends on the modulus size.  @r may alias
+ * either input.
+ */
+void bn_mont_mul(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *a, const uint64_t *b)
+{
+	unsigned int k = mont->ndigits;
+	const uint64_t *n = mont->n;
+	uint64_t t[BN_MAX_DIGITS + 2];
+	uint64_t s[BN_MAX_DIGITS];
+	uint64_t carry, borrow, mask;
+	unsigned int i, j;
+
+	memset(t, 0, (k + 2) * 8);
+
+	for (i = 0; i < k; i++) {
+		uint64_t m;
+		uint64_t sum;
+
+		carry = 0;
+
+		for (j = 0; j < k; j++)
+			t[j] = bn_mac(a[j], b[i], t[j], &carry);
+
+		sum = t[k] + carry;
+		t[k + 1] = sum < carry;
+		t[k] = sum;
+
+		m = t[0] * mont->n0;
+		carry = 0;
+		bn_mac(m, n[0], t[0], &carry);
+
+		for (j = 1; j < k; j++)
+			t[j - 1] = bn_mac(m, n[j], t[j], &carry);
+
+		sum = t[k] + carry;
+		t[k] = t[k + 1] + (sum < carry);
+		t[k - 1] = sum;
+	}
+
+	/* t < 2n here, subtract n if t[k] is set or t >= n */
+	borrow = bn_sub(s, t, n, k);
+	mask = 0 - (t[k] | (borrow ^ 1));
+
+	for (i = 0; i < k; i++)
+		r[i] = (s[i] & mask) | (t[i] & ~mask);
+
+	explicit_bzero(t, sizeof(t));
+	explicit_bzero(s, sizeof(s));
+}
+
+void bn_mont_to(const struct bn_mont *mont, uint64_t *r, const uint64_t *a)
+{
+	bn_mont_mul(mont, r, a, mont->rr);
+}
+
+void bn_mont_from(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *a)
+{
+	uint64_t one[BN_MAX_DIGITS] = { 1 };
+
+	bn_mont_mul(mont, r, a, one);
+}
+
+/* x = 2 * x mod n for x < n */
+static void bn_mod_double(const struct bn_mont *mont, uint64_t *x)
+{
+	unsigned int k = mont->ndigits;
+	uint64_t top = x[k - 1] >> 63;
+	unsigned int i;
+
+	for (i = k - 1; i; i--)
+		x[i] = (x[i] << 1) | (x[i - 1] >> 63);
+
+	x[0] <<= 1;
+
+	if (top || bn_cmp(x, mont->n, k) >= 0)
+		bn_sub(x, x, mont->n, k);
+}
+
+/*
+ * Sets up the context for the big-endian modulus @mod, which must be odd
+ * and greater than one.
+ */
+bool bn_mont_init(struct bn_mont *mont, const uint8_t *mod, size_t len)
+{
+	unsigned int k;
+	unsigned int bits;
+	unsigned int c, m, i;
+	uint64_t inv;
+
+	while (len && !*mod) {
+		mod++;
+		len--;
+	}
+
+	if (!len || len > BN_MAX_DIGITS * 8 || !(mod[len - 1] & 1))
+		return false;
+
+	if (len == 1 && mod[0] == 1)
+		return false;
+
+	k = (len + 7) / 8;
+	mont->ndigits = k;
+	bn_from_be(mont->n, k, mod, len);
+
+	/* Newton iteration, each step doubles the number of correct bits */
+	inv = mont->n[0];
+
+	for (i = 0; i < 5; i++)
+		inv *= 2 - mont->n[0] * inv;
+
+	mont->n0 = -inv;
+
+	/*
+	 * R^2 mod n without a long division.  Write 64 * k = c * 2^m with c
+	 * odd, get 2^(64 * k + c) mod n, the Montgomery form of 2^c, with a
+	 * few doublings starting from the top bit of n and then square it
+	 * m times in Montgomery form to reach 2^(64 * k), i.e. R.
+	 */
+	bits = 64 * k - __builtin_clzll(mont->n[k - 1]);
+
+	for (c = 64 * k, m = 0; !(c & 1); c >>= 1)
+		m++;
+
+	memset(mont->rr, 0, k * 8);
+	mont->rr[(bits - 1) / 64] = 1ull << ((bits - 1) % 64);
+
+	for (i = bits - 1; i < 64 * k + c; i++)
+		bn_mod_double(mont, mont->rr);
+
+	while (m--)
+		bn_mont_mul(mont, mont->rr, mont->rr, mont->rr);
+
+	return true;
+}
+
+/*
+ * r = base^exp mod n for a public big-endian exponent, e.g. an RSA public
+ * key operation.  @base must be below n.  Left-to-right square and
+ * multiply, with e = 65537 taking the fixed 16 squarings and a multiply.
+ */
+void bn_mod_exp_vartime(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *base,
+				const uint8_t *exp, size_t exp_len)
+{
+	static const uint8_t f4[] = { 0x01, 0x00, 0x01 };
+	uint64_t b[BN_MAX_DIGITS];
+	uint64_t acc[BN_MAX_DIGITS];
+	bool started = false;
+	size_t i;
+	int bit;
+
+	while (exp_len && !*exp) {
+		exp++;
+		exp_len--;
+	}
+
+	bn_mont_to(mont, b, base);
+
+	if (exp_len == sizeof(f4) && !memcmp(exp, f4, sizeof(f4))) {
+		memcpy(acc, b, mont->ndigits * 8);
+
+		for (i = 0; i < 16; i++)
+			bn_mont_mul(mont, acc, acc, acc);
+
+		bn_mont_mul(mont, acc, acc, b);
+		bn_mont_from(mont, r, acc);
+		return;
+	}
+
+	/* Montgomery form of 1, for exp = 0 */
+	bn_mont_from(mont, acc, mont->rr);
+
+	for (i = 0; i < exp_len; i++) {
+		for (bit = 7; bit >= 0; bit--) {
+			if (started)
+				bn_mont_mul(mont, acc, acc, acc);
+
+			if (!((exp[i] >> bit) & 1))
+				continue;
+
+			if (started)
+				bn_mont_mul(mont, acc, acc, b);
+			else
+				memcpy(acc, b, mont->ndigits * 8);
+
+			started = true;
+		}
+	}
+
+	bn_mont_from(mont, r, acc);
+}
+
+/* Copies entry @idx of @count ndigits-word entries without indexing by it */
+static void bn_table_select(uint64_t *r, const uint64_t *table,
+				unsigned int count, unsigned int ndigits,
+				unsigned int idx)
+{
+	unsigned int i, j;
+
+	memset(r, 0, ndigits * 8);
+
+	for (i = 0; i < count; i++) {
+		uint64_t mask = 0 - (((uint64_t) (i ^ idx) - 1) >> 63);
+
+		for (j = 0; j < ndigits; j++)
+			r[j] |= table[i * ndigits + j] & mask;
+	}
+}
+
+/* Bit @pos of a big-endian integer, counting from the least significant */
+static unsigned int bn_be_bit(const uint8_t *buf, size_t len, size_t pos)
+{
+	if (pos >= len * 8)
+		return 0;
+
+	return (buf[len - 1 - pos / 8] >> (pos % 8)) & 1;
+}
+
+#define BN_WINDOW	5
+
+/*
+ * r = base^exp mod n for a secret big-endian exponent.  Fixed windows
+ * over all exp_len * 8 bits, leading zeros included, so the sequence of
+ * multiplications and memory accesses only depends on exp_len and the
+ * modulus size.  @base needs to fit in ndigits words but may be >= n.
+ */
+void bn_mod_exp_consttime(const struct bn_mont *mont, uint64_t *r,
+				const uint64_t *base,
+				const uint8_t *exp, size_t exp_len)
+{
+	unsigned int k = mont->ndigits;
+	uint64_t table[(1 << BN_WINDOW) * BN_MAX_DIGITS];
+	uint64_t acc[BN_MAX_DIGITS];
+	uint64_t t[BN_MAX_DIGITS];
+	size_t nbits = exp_len * 8;
+	size_t pos;
+	unsigned int i;
+
+	/* table[i] = base^i in Montgomery form, table[0] is R mod n */
+	bn_mont_from(mont, table, mont->rr);
+	bn_mont_to(mont, table + k, base);
+
+	for (i = 2; i < 1 << BN_WINDOW; i++)
+		bn_mont_mul(mont, table + i * k, table + (i - 1) * k,
+				table + k);
+
+	memcpy(acc, table, k * 8);
+	pos = (nbits + BN_WINDOW - 1) / BN_WINDOW * BN_WINDOW;
+
+	while (pos) {
+		unsigned int idx = 0;
+
+		pos -= BN_WINDOW;
+
+		for (i = 0; i < BN_WINDOW; i++) {
+			bn_mont_mul(mont, acc, acc, acc);
+			idx |= bn_be_bit(exp, exp_len, pos + i) << i;
+		}
+
+		bn_table_select(t, table, 1 << BN_WINDOW, k, idx);
+		bn_mont_mul(mont, acc, acc, t);
+	}
+
+	bn_mont_from(mont, r, acc);
+
+	explicit_bzero(table, sizeof(table));
+	explicit_bzero(acc, sizeof(acc));
+	explicit_bzero(t, sizeof(t));
+}
+
+size_t bn_comb_size(const struct bn_mont *mont)
+{
+	return sizeof(struct bn_comb) +
+			(1 << BN_COMB_TEETH) * mont->ndigits * 8;
+}
+
+/*
+ * Lim-Lee comb for a fixed base, e.g. a DH group generator.  With the
+ * exponent split into BN_COMB_TEETH rows of @spacing bits, table[i]
+ * is the product of base^(2^(j * spacing)) over the bits j set in i.
+ * An exponentiation then takes spacing squarings and multiplications
+ * instead of one squaring per exponent bit.  @comb must have
+ * bn_comb_size() bytes.
+ */
+void bn_comb_init(const struct bn_mont *mont, struct bn_comb *comb,
+				const uint64_t *base, size_t max_exp_bits)
+{
+	unsigned int k = mont->ndigits;
+	uint64_t rows[BN_COMB_TEETH][BN_MAX_DIGITS];
+	unsigned int i, j;
+
+	comb->spacing = (max_exp_bits + BN_COMB_TEETH - 1) / BN_COMB_TEETH;
+	bn_mont_to(mont, rows[0], base);
+
+	for (i = 1; i < BN_COMB_TEETH; i++) {
+		memcpy(rows[i], rows[i - 1], k * 8);
+
+		for (j = 0; j < comb->spacing; j++)
+			bn_mont_mul(mont, rows[i], rows[i], rows[i]);
+	}
+
+	bn_mont_from(mont, comb->table, mont->rr);
+
+	for (i = 1; i < 1 << BN_COMB_TEETH; i++)
+		bn_mont_mul(mont, comb->table + i * k,
+				comb->table + (i & (i - 1)) * k,
+				rows[__builtin_ctz(i)]);
+
+	explicit_bzero(rows, sizeof(rows));
+}
+
+/*
+ * r = base^exp mod n using a table from bn_comb_init().  Constant-time
+ * in the same sense as bn_mod_exp_consttime().  Returns false if @exp
+ * is longer than the max_exp_bits the table was built for.
+ */
+bool bn_comb_exp(const struct bn_mont *mont, const struct bn_comb *comb,
+			uint64_t *r, const uint8_t *exp, size_t exp_len)
+{
+	unsigned int k = mont->ndigits;
+	uint64_t acc[BN_MAX_DIGITS];
+	uint64_t t[BN_MAX_DIGITS];
+	unsigned int i, j;
+
+	if (exp_len * 8 > (size_t) comb->spacing * BN_COMB_TEETH)
+		return false;
+
+	memcpy(acc, comb->table, k * 8);
+
+	for (i = comb->spacing; i--;) {
+		unsigned int idx = 0;
+
+		bn_mont_mul(mont, acc, acc, acc);
+
+		for (j = 0; j < BN_COMB_TEETH; j++)
+			idx |= bn_be_bit(exp, exp_len,
+					j * comb->spacing + i) << j;
+
+		bn_table_select(t, comb->table, 1 << BN_COMB_TEETH, k, idx);
+		bn_mont_mul(mont, acc, acc, t);
+	}
+
+	bn_mont_from(mont, r, acc);
+
+	explicit_bzero(acc, sizeof(acc));
+	explicit_bzero(t, sizeof(t));
+	return true;
+}
@@ -24,6 +24,7 @@
 #include "missing.h"
 #include "cert.h"
 #include "cert-private.h"
+#include "bignum-private.h"
 
 /* RFC8018 section 5.1 */
 LIB_EXPORT bool l_cert_pkcs5_pbkdf1(enum l_checksum_type type,
@@ -785,3 +786,345 @@ struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 
 	return cipher;
 }
+
+static const struct cert_hash_oid {
+	enum l_checksum_type type;
+	struct asn1_oid oid;
+} cert_hash_oids[] = {
+	{ /* id-sha1 */
+		L_CHECKSUM_SHA1,
+		{ 5, { 0x2b, 0x0e, 0x03, 0x02, 0x1a } },
+	},
+	{ /* id-sha224 */
+		L_CHECKSUM_SHA224,
+		{ 9, { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x04 } },
+	},
+	{ /* id-sha256 */
+		L_CHECKSUM_SHA256,
+		{ 9, { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 } },
+	},
+	{ /* id-sha384 */
+		L_CHECKSUM_SHA384,
+		{ 9, { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02 } },
+	},
+	{ /* id-sha512 */
+		L_CHECKSUM_SHA512,
+		{ 9, { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03 } },
+	},
+};
+
+static struct asn1_oid pkcs1_mgf1_oid = {
+	9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x08 }
+};
+
+static bool cert_hash_from_oid(const uint8_t *oid, size_t oid_len,
+				enum l_checksum_type *out_type)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(cert_hash_oids); i++)
+		if (asn1_oid_eq(&cert_hash_oids[i].oid, oid_len, oid)) {
+			*out_type = cert_hash_oids[i].type;
+			return true;
+		}
+
+	return false;
+}
+
+/* RFC8017 Appendix A.2.3, the contents of RSASSA-PSS-params */
+bool cert_parse_pss_params(const uint8_t *params, size_t params_len,
+				enum l_checksum_type *out_hash,
+				enum l_checksum_type *out_mgf1_hash,
+				size_t *out_salt_len)
+{
+	const uint8_t *elem;
+	size_t elem_len;
+	size_t salt_len = 0;
+
+	/* Defaults: SHA1, MGF1 with SHA1 and a 20 byte salt */
+	*out_hash = L_CHECKSUM_SHA1;
+	*out_mgf1_hash = L_CHECKSUM_SHA1;
+	*out_salt_len = 20;
+
+	elem = asn1_der_find_elem_by_path(params, params_len,
+						ASN1_ID_OID, &elem_len,
+						ASN1_CONTEXT_EXPLICIT(0), 0,
+						-1);
+	if (elem && !cert_hash_from_oid(elem, elem_len, out_hash))
+		return false;
+
+	elem = asn1_der_find_elem_by_path(params, params_len,
+						ASN1_ID_OID, &elem_len,
+						ASN1_CONTEXT_EXPLICIT(1), 0,
+						-1);
+	if (elem) {
+		if (!asn1_oid_eq(&pkcs1_mgf1_oid, elem_len, elem))
+			return false;
+
+		elem = asn1_der_find_elem_by_path(params, params_len,
+						ASN1_ID_OID, &elem_len,
+						ASN1_CONTEXT_EXPLICIT(1), 1, 0,
+						-1);
+		if (!elem || !cert_hash_from_oid(elem, elem_len,
+							out_mgf1_hash))
+			return false;
+	}
+
+	elem = asn1_der_find_elem_by_path(params, params_len, ASN1_ID_INTEGER,
+						&elem_len,
+						ASN1_CONTEXT_EXPLICIT(2), -1);
+	if (elem) {
+		if (elem_len < 1 || elem_len > 2 || (*elem & 0x80))
+			return false;
+
+		while (elem_len--)
+			salt_len = (salt_len << 8) | *elem++;
+
+		*out_salt_len = salt_len;
+	}
+
+	/* Only trailerFieldBC (1) is defined */
+	elem = asn1_der_find_elem_by_path(params, params_len, ASN1_ID_INTEGER,
+						&elem_len,
+						ASN1_CONTEXT_EXPLICIT(3), -1);
+	if (elem && (elem_len != 1 || *elem != 1))
+		return false;
+
+	return true;
+}
+
+/*
+ * RSAVP1 from RFC8017 section 5.2.2 on an RSAPublicKey structure.  The
+ * encoded message is written to @em, left-padded to the modulus length
+ * which is returned in @out_len along with the modulus size in bits.
+ */
+static bool cert_rsa_public(const uint8_t *key, size_t key_len,
+				const uint8_t *sig, size_t sig_len,
+				uint8_t *em, size_t *out_len,
+				unsigned int *out_bits)
+{
+	const uint8_t *n;
+	const uint8_t *e;
+	size_t n_len;
+	size_t e_len;
+	struct bn_mont mont;
+	uint64_t s[BN_MAX_DIGITS];
+	unsigned int bits;
+
+	n = asn1_der_find_elem_by_path(key, key_len, ASN1_ID_INTEGER, &n_len,
+					0, 0, -1);
+	e = asn1_der_find_elem_by_path(key, key_len, ASN1_ID_INTEGER, &e_len,
+					0, 1, -1);
+	if (!n || !e)
+		return false;
+
+	while (n_len && !*n) {
+		n++;
+		n_len--;
+	}
+
+	/* Nothing below 1024 bits is worth verifying */
+	if (n_len < 128)
+		return false;
+
+	/* Step 1 of both 8.1.2 and 8.2.2, exactly the modulus length */
+	if (sig_len != n_len)
+		return false;
+
+	if (!bn_mont_init(&mont, n, n_len))
+		return false;
+
+	if (!bn_from_be(s, mont.ndigits, sig, sig_len) ||
+			bn_cmp(s, mont.n, mont.ndigits) >= 0)
+		return false;
+
+	bn_mod_exp_vartime(&mont, s, s, e, e_len);
+	bn_to_be(em, n_len, s, mont.ndigits);
+
+	for (bits = 8 * n_len; !(n[0] & (0x80 >> (8 * n_len - bits))); bits--);
+
+	*out_len = n_len;
+	*out_bits = bits;
+
+	return true;
+}
+
+/* DER DigestInfo prefixes, RFC8017 section 9.2 note 1 */
+static const struct pkcs1_digest_info {
+	enum l_checksum_type type;
+	uint8_t len;
+	uint8_t prefix[19];
+} pkcs1_digest_infos[] = {
+	{
+		L_CHECKSUM_SHA1, 15,
+		{ 0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02,
+			0x1a, 0x05, 0x00, 0x04, 0x14 },
+	},
+	{
+		L_CHECKSUM_SHA224, 19,
+		{ 0x30, 0x2d, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+			0x65, 0x03, 0x04, 0x02, 0x04, 0x05, 0x00, 0x04, 0x1c },
+	},
+	{
+		L_CHECKSUM_SHA256, 19,
+		{ 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+			0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 },
+	},
+	{
+		L_CHECKSUM_SHA384, 19,
+		{ 0x30, 0x41, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+			0x65, 0x03, 0x04, 0x02, 0x02, 0x05, 0x00, 0x04, 0x30 },
+	},
+	{
+		L_CHECKSUM_SHA512, 19,
+		{ 0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+			0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04, 0x40 },
+	},
+};
+
+/* RSASSA-PKCS1-v1_5-VERIFY, RFC8017 section 8.2.2 */
+bool cert_rsa_pkcs1_verify(const uint8_t *key, size_t key_len,
+				enum l_checksum_type hash,
+				const uint8_t *digest, size_t digest_len,
+				const uint8_t *sig, size_t sig_len)
+{
+	const struct pkcs1_digest_info *info = NULL;
+	uint8_t em[BN_MAX_DIGITS * 8];
+	size_t em_len;
+	size_t ps_len;
+	unsigned int bits;
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(pkcs1_digest_infos); i++)
+		if (pkcs1_digest_infos[i].type == hash)
+			info = &pkcs1_digest_infos[i];
+
+	if (!info || !cert_rsa_public(key, key_len, sig, sig_len,
+					em, &em_len, &bits))
+		return false;
+
+	/* EM = 0x00 || 0x01 || PS || 0x00 || T, PS at least 8 bytes */
+	if (em_len < info->len + digest_len + 11)
+		return false;
+
+	ps_len = em_len - info->len - digest_len - 3;
+
+	if (em[0] != 0x00 || em[1] != 0x01 || em[2 + ps_len] != 0x00)
+		return false;
+
+	for (i = 0; i < ps_len; i++)
+		if (em[2 + i] != 0xff)
+			return false;
+
+	return !memcmp(em + 3 + ps_len, info->prefix, info->len) &&
+		!memcmp(em + 3 + ps_len + info->len, digest, digest_len);
+}
+
+/* XORs MGF1(@seed) into @out, RFC8017 appendix B.2.1 */
+static bool cert_mgf1_xor(enum l_checksum_type type,
+				const uint8_t *seed, size_t seed_len,
+				uint8_t *out, size_t len)
+{
+	struct l_checksum *checksum = l_checksum_new(type);
+	uint8_t t[64];
+	uint8_t counter[4];
+	uint32_t i;
+	size_t pos;
+
+	if (!checksum)
+		return false;
+
+	for (i = 0, pos = 0; pos < len; i++) {
+		ssize_t t_len;
+		size_t j;
+
+		l_put_be32(i, counter);
+		l_checksum_update(checksum, seed, seed_len);
+		l_checksum_update(checksum, counter, 4);
+		t_len = l_checksum_get_digest(checksum, t, sizeof(t));
+
+		if (t_len <= 0)
+			break;
+
+		for (j = 0; j < (size_t) t_len && pos < len; j++)
+			out[pos++] ^= t[j];
+	}
+
+	l_checksum_free(checksum);
+	return pos == len;
+}
+
+/* RSASSA-PSS-VERIFY, RFC8017 section 8.1.2 and EMSA-PSS-VERIFY 9.1.2 */
+bool cert_rsa_pss_verify(const uint8_t *key, size_t key_len,
+				enum l_checksum_type hash,
+				enum l_checksum_type mgf1_hash,
+				size_t salt_len,
+				const uint8_t *digest, size_t digest_len,
+				const uint8_t *sig, size_t sig_len)
+{
+	static const uint8_t zeros[8];
+	uint8_t buf[BN_MAX_DIGITS * 8];
+	uint8_t h[64];
+	uint8_t *em = buf;
+	uint8_t *db;
+	size_t em_len;
+	size_t db_len;
+	unsigned int bits;
+	unsigned int top_mask;
+	struct l_checksum *checksum;
+	size_t i;
+
+	if (!cert_rsa_public(key, key_len, sig, sig_len, buf, &em_len, &bits))
+		return false;
+
+	/* emBits = modBits - 1, drop the leading zero byte if any */
+	if ((bits - 1) % 8 == 0) {
+		if (em[0])
+			return false;
+
+		em++;
+		em_len--;
+	}
+
+	top_mask = 0xff >> (8 * em_len - (bits - 1));
+
+	if (em_len < digest_len + salt_len + 2 || em[em_len - 1] != 0xbc)
+		return false;
+
+	db = em;
+	db_len = em_len - digest_len - 1;
+
+	if (db[0] & ~top_mask)
+		return false;
+
+	if (!cert_mgf1_xor(mgf1_hash, db + db_len, digest_len, db, db_len))
+		return false;
+
+	db[0] &= top_mask;
+
+	for (i = 0; i < db_len - salt_len - 1; i++)
+		if (db[i])
+			return false;
+
+	if (db[db_len - salt_len - 1] != 0x01)
+		return false;
+
+	/* H' = Hash(0x00 x 8 || mHash || salt) */
+	checksum = l_checksum_new(hash);
+	if (!checksum)
+		return false;
+
+	l_checksum_update(checksum, zeros, sizeof(zeros));
+	l_checksum_update(checksum, digest, digest_len);
+	l_checksum_update(checksum, db + db_len - salt_len, salt_len);
+
+	if (l_checksum_get_digest(checksum, h, sizeof(h)) !=
+						(ssize_t) digest_len) {
+		l_checksum_free(checksum);
+		return false;
+	}
+
+	l_checksum_free(checksum);
+
+	return !memcmp(h, db + db_len, digest_len);
+}
@@ -6,13 +6,32 @@
  */
 
 struct asn1_oid;
+struct l_cert_store;
+struct cert_arena;
 
 struct l_certchain *certchain_new_from_leaf(struct l_cert *leaf);
 void certchain_link_issuer(struct l_certchain *chain, struct l_cert *ca);
 
+const uint8_t *cert_der_get_extension(const uint8_t *der, size_t der_len,
+					const struct asn1_oid *ext_id,
+					bool *out_critical, size_t *out_len);
 const uint8_t *cert_get_extension(struct l_cert *cert,
 					const struct asn1_oid *ext_id,
 					bool *out_critical, size_t *out_len);
+const uint8_t *cert_der_get_dn(const uint8_t *der, size_t der_len,
+				size_t *out_len);
+const uint8_t *cert_get_issuer_dn(struct l_cert *cert, size_t *out_len);
+const uint8_t *cert_der_get_subject_key_id(const uint8_t *der, size_t der_len,
+						size_t *out_len);
+const uint8_t *cert_get_authority_key_id(struct l_cert *cert, size_t *out_len);
+
+struct cert_arena *cert_arena_new(unsigned int max_certs, size_t max_der_len);
+uint8_t *cert_arena_get_space(struct cert_arena *arena);
+struct l_cert *cert_arena_add(struct cert_arena *arena, size_t der_len);
+void cert_arena_done(struct cert_arena *arena);
+
+struct l_queue *cert_store_get_trusted(struct l_cert_store *store,
+					struct l_certchain *chain);
 
 struct l_key *cert_key_from_pkcs8_private_key_info(const uint8_t *der,
 							size_t der_len);
@@ -40,3 +59,18 @@ struct l_cipher *cert_cipher_from_pkcs_alg_id(const uint8_t *id_asn1,
 						size_t id_asn1_len,
 						const char *password,
 						bool *out_is_block);
+
+bool cert_parse_pss_params(const uint8_t *params, size_t params_len,
+				enum l_checksum_type *out_hash,
+				enum l_checksum_type *out_mgf1_hash,
+				size_t *out_salt_len);
+bool cert_rsa_pkcs1_verify(const uint8_t *key, size_t key_len,
+				enum l_checksum_type hash,
+				const uint8_t *digest, size_t digest_len,
+				const uint8_t *sig, size_t sig_len);
+bool cert_rsa_pss_verify(const uint8_t *key, size_t key_len,
+				enum l_checksum_type hash,
+				enum l_checksum_type mgf1_hash,
+				size_t salt_len,
+				const uint8_t *digest, size_t digest_len,
+				const uint8_t *sig, size_t sig_len);
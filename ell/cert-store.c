@@ -0,0 +1,592 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "private.h"
+#include "useful.h"
+#include "queue.h"
+#include "hashmap.h"
+#include "base64.h"
+#include "random.h"
+#include "asn1-private.h"
+#include "checksum.h"
+#include "cert.h"
+#include "cert-private.h"
+#include "pem-private.h"
+#include "siphash-private.h"
+#include "missing.h"
+
+/*
+ * The store keeps the DER of each certificate, decoded once on load,
+ * and indexes it by its subject DN and Subject Key Identifier.  An
+ * l_cert is only created when a certificate is first looked up, so a
+ * system CA bundle with hundreds of entries costs little memory and
+ * finding the issuer of a certificate takes a hash lookup instead of
+ * a walk over all CAs.
+ */
+
+struct cert_store_file {
+	dev_t dev;
+	ino_t ino;
+};
+
+struct cert_store_key {
+	const uint8_t *data;
+	size_t len;
+	unsigned int hash;
+};
+
+struct cert_store_entry {
+	size_t der_len;
+	uint64_t der_hash;
+	struct l_cert *cert;	/* Created on first use */
+	struct cert_store_key dn;
+	struct cert_store_key key_id;
+	struct cert_store_entry *next_dn;
+	struct cert_store_entry *next_key_id;
+	uint8_t der[];		/* The DN and key ID point into it */
+};
+
+struct l_cert_store {
+	uint8_t hash_key[16];
+	struct l_queue *files;
+	struct l_queue *entries;
+	struct l_hashmap *by_dn;
+	struct l_hashmap *by_key_id;
+};
+
+static unsigned int cert_store_key_hash(const void *p)
+{
+	const struct cert_store_key *key = p;
+
+	return key->hash;
+}
+
+static int cert_store_key_compare(const void *a, const void *b)
+{
+	const struct cert_store_key *key_a = a;
+	const struct cert_store_key *key_b = b;
+
+	if (key_a->len != key_b->len)
+		return key_a->len < key_b->len ? -1 : 1;
+
+	return memcmp(key_a->data, key_b->data, key_a->len);
+}
+
+static uint64_t cert_store_hash(const struct l_cert_store *store,
+				const uint8_t *data, size_t len)
+{
+	uint64_t hash;
+
+	_siphash24((uint8_t *) &hash, data, len, store->hash_key);
+	return hash;
+}
+
+static void cert_store_key_init(const struct l_cert_store *store,
+				struct cert_store_key *key,
+				const uint8_t *data, size_t len)
+{
+	key->data = data;
+	key->len = len;
+	key->hash = cert_store_hash(store, data, len);
+}
+
+static struct l_hashmap *cert_store_map_new(void)
+{
+	struct l_hashmap *map = l_hashmap_new();
+
+	l_hashmap_set_hash_function(map, cert_store_key_hash);
+	l_hashmap_set_compare_function(map, cert_store_key_compare);
+	return map;
+}
+
+static void cert_store_entry_free(void *data)
+{
+	struct cert_store_entry *entry = data;
+
+	l_cert_free(entry->cert);
+	l_free(entry);
+}
+
+LIB_EXPORT struct l_cert_store *l_cert_store_new(void)
+{
+	struct l_cert_store *store = l_new(struct l_cert_store, 1);
+
+	/* Only used for hashing, a failure here costs no security */
+	l_getrandom(store->hash_key, sizeof(store->hash_key));
+
+	store->files = l_queue_new();
+	store->entries = l_queue_new();
+	store->by_dn = cert_store_map_new();
+	store->by_key_id = cert_store_map_new();
+
+	return store;
+}
+
+LIB_EXPORT void l_cert_store_free(struct l_cert_store *store)
+{
+	if (unlikely(!store))
+		return;
+
+	l_hashmap_destroy(store->by_dn, NULL);
+	l_hashmap_destroy(store->by_key_id, NULL);
+	l_queue_destroy(store->entries, cert_store_entry_free);
+	l_queue_destroy(store->files, l_free);
+	l_free(store);
+}
+
+static struct cert_store_entry *cert_store_entry_new(
+					const struct l_cert_store *store,
+					const char *data, size_t data_len,
+					bool pem)
+{
+	struct cert_store_entry *entry;
+	ssize_t der_len;
+	const uint8_t *dn;
+	size_t dn_len;
+	const uint8_t *key_id;
+	size_t key_id_len = 0;
+
+	if (pem) {
+		/* Decode straight into the entry, then trim it */
+		entry = l_malloc(sizeof(*entry) + data_len * 3 / 4);
+		der_len = l_base64_decode_into(data, data_len, entry->der,
+						data_len * 3 / 4);
+		if (der_len < 0) {
+			l_free(entry);
+			return NULL;
+		}
+
+		entry = l_realloc(entry, sizeof(*entry) + der_len);
+	} else {
+		der_len = data_len;
+		entry = l_malloc(sizeof(*entry) + der_len);
+		memcpy(entry->der, data, der_len);
+	}
+
+	if (der_len < 2 || entry->der[0] != ASN1_ID_SEQUENCE)
+		goto error;
+
+	dn = cert_der_get_dn(entry->der, der_len, &dn_len);
+	if (!dn)
+		goto error;
+
+	key_id = cert_der_get_subject_key_id(entry->der, der_len,
+						&key_id_len);
+	if (!key_id)
+		key_id_len = 0;
+
+	entry->der_len = der_len;
+	entry->der_hash = cert_store_hash(store, entry->der, der_len);
+	entry->cert = NULL;
+	entry->next_dn = NULL;
+	entry->next_key_id = NULL;
+	cert_store_key_init(store, &entry->dn, dn, dn_len);
+	cert_store_key_init(store, &entry->key_id, key_id, key_id_len);
+	return entry;
+
+error:
+	l_free(entry);
+	return NULL;
+}
+
+static struct l_cert *cert_store_entry_get_cert(struct cert_store_entry *entry)
+{
+	if (!entry->cert)
+		entry->cert = l_cert_new_from_der(entry->der, entry->der_len);
+
+	return entry->cert;
+}
+
+static void cert_store_insert(struct l_cert_store *store,
+				struct cert_store_entry *entry)
+{
+	struct cert_store_entry *head;
+	struct cert_store_entry *other;
+
+	head = l_hashmap_lookup(store->by_dn, &entry->dn);
+
+	/* The same file may be found both in a bundle and on its own */
+	for (other = head; other; other = other->next_dn)
+		if (other->der_len == entry->der_len &&
+				other->der_hash == entry->der_hash) {
+			cert_store_entry_free(entry);
+			return;
+		}
+
+	l_queue_push_tail(store->entries, entry);
+
+	if (head) {
+		entry->next_dn = head->next_dn;
+		head->next_dn = entry;
+	} else
+		l_hashmap_insert(store->by_dn, &entry->dn, entry);
+
+	if (!entry->key_id.len)
+		return;
+
+	head = l_hashmap_lookup(store->by_key_id, &entry->key_id);
+	if (head) {
+		entry->next_key_id = head->next_key_id;
+		head->next_key_id = entry;
+	} else
+		l_hashmap_insert(store->by_key_id, &entry->key_id, entry);
+}
+
+/* Index every certificate in @data, either all of them or none */
+static bool cert_store_index_file(struct l_cert_store *store,
+					const char *data, size_t len)
+{
+	const char *ptr = data;
+	const char *end = ptr + len;
+	struct l_queue *list;
+	struct cert_store_entry *entry;
+
+	/* A single DER certificate */
+	if ((uint8_t) *ptr == ASN1_ID_SEQUENCE) {
+		entry = cert_store_entry_new(store, ptr, len, false);
+		if (!entry)
+			return false;
+
+		cert_store_insert(store, entry);
+		return true;
+	}
+
+	list = l_queue_new();
+
+	while (ptr && ptr < end) {
+		char *label;
+		const char *base64;
+		size_t base64_len;
+		bool is_certificate;
+
+		base64 = pem_next(ptr, end - ptr, &label, &base64_len,
+					&ptr, false);
+		if (!base64) {
+			if (!ptr)
+				break;
+
+			goto error;
+		}
+
+		is_certificate = !strcmp(label, "CERTIFICATE");
+		l_free(label);
+
+		if (!is_certificate)
+			goto error;
+
+		entry = cert_store_entry_new(store, base64, base64_len, true);
+		if (!entry)
+			goto error;
+
+		l_queue_push_tail(list, entry);
+	}
+
+	if (l_queue_isempty(list))
+		goto error;
+
+	while ((entry = l_queue_pop_head(list)))
+		cert_store_insert(store, entry);
+
+	l_queue_destroy(list, NULL);
+	return true;
+
+error:
+	l_queue_destroy(list, cert_store_entry_free);
+	return false;
+}
+
+static bool cert_store_file_match(const void *a, const void *b)
+{
+	const struct cert_store_file *file = a;
+	const struct stat *st = b;
+
+	return file->dev == st->st_dev && file->ino == st->st_ino;
+}
+
+/*
+ * Reads at most @size bytes.  The file is read rather than mapped, a
+ * mapping would fault if the file was truncated while in use.
+ */
+static ssize_t cert_store_read(int fd, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	while (len < size) {
+		ssize_t r = read(fd, buf + len, size - len);
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		if (!r)
+			break;
+
+		len += r;
+	}
+
+	return len;
+}
+
+static int cert_store_load_fd(struct l_cert_store *store, int fd)
+{
+	struct stat st;
+	struct cert_store_file *file;
+	_auto_(l_free) char *data = NULL;
+	ssize_t len;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (!S_ISREG(st.st_mode) || !st.st_size)
+		return -EINVAL;
+
+	/* Already loaded, e.g. through a symlink */
+	if (l_queue_find(store->files, cert_store_file_match, &st))
+		return 0;
+
+	data = l_malloc(st.st_size);
+	len = cert_store_read(fd, data, st.st_size);
+	if (len < 0)
+		return len;
+
+	if (!len || !cert_store_index_file(store, data, len))
+		return -EBADMSG;
+
+	file = l_new(struct cert_store_file, 1);
+	file->dev = st.st_dev;
+	file->ino = st.st_ino;
+	l_queue_push_tail(store->files, file);
+	return 0;
+}
+
+/**
+ * l_cert_store_load_file:
+ * @store: certificate store
+ * @filename: PEM bundle or single DER certificate
+ *
+ * Adds all certificates from @filename to @store.  Their DER is kept in
+ * memory, the file isn't used after this returns.
+ *
+ * Returns: true on success, false if the file can't be read or contains
+ * anything other than certificates, in which case nothing is added.
+ **/
+LIB_EXPORT bool l_cert_store_load_file(struct l_cert_store *store,
+					const char *filename)
+{
+	int fd;
+	int r;
+
+	if (unlikely(!store || !filename))
+		return false;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	r = cert_store_load_fd(store, fd);
+	close(fd);
+
+	return r == 0;
+}
+
+/**
+ * l_cert_store_load_dir:
+ * @store: certificate store
+ * @dirname: directory of certificate files such as /etc/ssl/certs
+ *
+ * Adds the certificates from every file in @dirname that parses as a
+ * PEM bundle or a DER certificate, other files are ignored.  Files
+ * reached more than once through symlinks and certificates already in
+ * the store are only added once.
+ *
+ * Returns: false if @dirname can't be opened.
+ **/
+LIB_EXPORT bool l_cert_store_load_dir(struct l_cert_store *store,
+					const char *dirname)
+{
+	DIR *dir;
+	struct dirent *dirent;
+
+	if (unlikely(!store || !dirname))
+		return false;
+
+	dir = opendir(dirname);
+	if (!dir)
+		return false;
+
+	while ((dirent = readdir(dir))) {
+		int fd;
+
+		if (dirent->d_name[0] == '.')
+			continue;
+
+		fd = openat(dirfd(dir), dirent->d_name, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		cert_store_load_fd(store, fd);
+		close(fd);
+	}
+
+	closedir(dir);
+	return true;
+}
+
+LIB_EXPORT unsigned int l_cert_store_get_count(struct l_cert_store *store)
+{
+	if (unlikely(!store))
+		return 0;
+
+	return l_queue_length(store->entries);
+}
+
+static struct cert_store_entry *cert_store_lookup_dn(
+					const struct l_cert_store *store,
+					const uint8_t *dn, size_t dn_len)
+{
+	struct cert_store_key key;
+
+	cert_store_key_init(store, &key, dn, dn_len);
+	return l_hashmap_lookup(store->by_dn, &key);
+}
+
+static bool cert_store_entry_dn_eq(const struct cert_store_entry *entry,
+					const uint8_t *dn, size_t dn_len)
+{
+	return entry->dn.len == dn_len && !memcmp(entry->dn.data, dn, dn_len);
+}
+
+/**
+ * l_cert_store_find_issuer:
+ * @store: certificate store
+ * @cert: certificate whose issuer to look up
+ *
+ * Finds a certificate in @store whose subject matches the issuer name of
+ * @cert.  If @cert has an Authority Key Identifier the CA with the same
+ * Subject Key Identifier is preferred.  The signature is not checked.
+ *
+ * Returns: a certificate owned by @store, or NULL if none matches.
+ **/
+LIB_EXPORT struct l_cert *l_cert_store_find_issuer(struct l_cert_store *store,
+							struct l_cert *cert)
+{
+	const uint8_t *dn;
+	size_t dn_len;
+	const uint8_t *key_id;
+	size_t key_id_len;
+	struct cert_store_entry *entry;
+	struct l_cert *issuer;
+
+	if (unlikely(!store || !cert))
+		return NULL;
+
+	dn = cert_get_issuer_dn(cert, &dn_len);
+	if (!dn)
+		return NULL;
+
+	key_id = cert_get_authority_key_id(cert, &key_id_len);
+	if (key_id) {
+		struct cert_store_key key;
+
+		cert_store_key_init(store, &key, key_id, key_id_len);
+		entry = l_hashmap_lookup(store->by_key_id, &key);
+
+		for (; entry; entry = entry->next_key_id) {
+			if (!cert_store_entry_dn_eq(entry, dn, dn_len))
+				continue;
+
+			issuer = cert_store_entry_get_cert(entry);
+			if (issuer)
+				return issuer;
+		}
+	}
+
+	for (entry = cert_store_lookup_dn(store, dn, dn_len); entry;
+			entry = entry->next_dn) {
+		issuer = cert_store_entry_get_cert(entry);
+		if (issuer)
+			return issuer;
+	}
+
+	return NULL;
+}
+
+struct cert_store_trusted_data {
+	struct l_cert_store *store;
+	struct l_queue *trusted;
+};
+
+static bool cert_store_ptr_match(const void *a, const void *b)
+{
+	return a == b;
+}
+
+static void cert_store_add_by_dn(struct cert_store_trusted_data *data,
+					const uint8_t *dn, size_t dn_len)
+{
+	struct cert_store_entry *entry;
+
+	if (!dn)
+		return;
+
+	for (entry = cert_store_lookup_dn(data->store, dn, dn_len); entry;
+			entry = entry->next_dn) {
+		struct l_cert *cert = cert_store_entry_get_cert(entry);
+
+		if (cert && !l_queue_find(data->trusted,
+						cert_store_ptr_match, cert))
+			l_queue_push_tail(data->trusted, cert);
+	}
+}
+
+static bool cert_store_collect_trusted(struct l_cert *cert, void *user_data)
+{
+	struct cert_store_trusted_data *data = user_data;
+	const uint8_t *dn;
+	size_t dn_len;
+
+	/* Possible issuers, plus the CA itself if it's in the chain */
+	dn = cert_get_issuer_dn(cert, &dn_len);
+	cert_store_add_by_dn(data, dn, dn_len);
+
+	dn = l_cert_get_dn(cert, &dn_len);
+	cert_store_add_by_dn(data, dn, dn_len);
+
+	return false;
+}
+
+/*
+ * The subset of the store that can matter when verifying @chain, i.e.
+ * the certificates named as the subject or the issuer of any of the
+ * certificates in @chain.  The l_certs remain owned by @store.
+ */
+struct l_queue *cert_store_get_trusted(struct l_cert_store *store,
+					struct l_certchain *chain)
+{
+	struct cert_store_trusted_data data = {
+		.store = store,
+		.trusted = l_queue_new(),
+	};
+
+	l_certchain_walk_from_ca(chain, cert_store_collect_trusted, &data);
+	return data.trusted;
+}
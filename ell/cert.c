@@ -28,6 +28,11 @@
 #include "cert-private.h"
 #include "tls.h"
 #include "tls-private.h"
+#include "checksum.h"
+#include "ecc.h"
+#include "ecc-private.h"
+#include "random.h"
+#include "siphash-private.h"
 #include "missing.h"
 
 #define X509_CERTIFICATE_POS			0
@@ -53,8 +58,33 @@ struct l_cert {
 	enum l_cert_key_type pubkey_type;
 	struct l_cert *issuer;
 	struct l_cert *issued;
+	uint64_t tag[2];	/* Keyed hash of asn1 for the verify cache */
+	bool has_tag;
+	struct cert_arena *arena;	/* Holds asn1 if set */
+	unsigned int arena_idx;
 	size_t asn1_len;
-	uint8_t asn1[];
+	const uint8_t *asn1;
+	uint8_t buf[];
+};
+
+/*
+ * The DER data of a whole list of certificates as loaded from a bundle,
+ * in a single allocation that each l_cert points into.  Once less than
+ * an eighth of the data is still in use, the remaining certificates are
+ * given their own copies and the arena is freed, so that a few
+ * certificates kept from a large CA bundle don't pin all of it.  The
+ * DER returned by l_cert_get_der_data() can thus move when another
+ * certificate from the same list is freed.
+ */
+struct cert_arena {
+	bool loading;
+	unsigned int max_certs;
+	unsigned int n_certs;
+	size_t der_size;
+	size_t der_used;
+	size_t der_live;
+	struct l_cert **certs;
+	uint8_t *der;
 };
 
 struct l_certchain {
@@ -80,6 +110,71 @@ static const struct pkcs1_encryption_oid {
 	},
 };
 
+static const struct cert_signature_alg {
+	enum l_cert_key_type key_type;
+	enum l_checksum_type hash;	/* NONE for RSASSA-PSS, see params */
+	struct asn1_oid oid;
+} cert_signature_algs[] = {
+	{ /* sha1WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA1,
+		{ 9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x05 } },
+	},
+	{ /* sha224WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA224,
+		{ 9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0e } },
+	},
+	{ /* sha256WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA256,
+		{ 9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0b } },
+	},
+	{ /* sha384WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA384,
+		{ 9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0c } },
+	},
+	{ /* sha512WithRSAEncryption */
+		L_CERT_KEY_RSA, L_CHECKSUM_SHA512,
+		{ 9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0d } },
+	},
+	{ /* id-RSASSA-PSS */
+		L_CERT_KEY_RSA, L_CHECKSUM_NONE,
+		{ 9, { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x0a } },
+	},
+	{ /* ecdsa-with-SHA1 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA1,
+		{ 7, { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x01 } },
+	},
+	{ /* ecdsa-with-SHA224 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA224,
+		{ 8, { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x01 } },
+	},
+	{ /* ecdsa-with-SHA256 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA256,
+		{ 8, { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02 } },
+	},
+	{ /* ecdsa-with-SHA384 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA384,
+		{ 8, { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x03 } },
+	},
+	{ /* ecdsa-with-SHA512 */
+		L_CERT_KEY_ECC, L_CHECKSUM_SHA512,
+		{ 8, { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x04 } },
+	},
+};
+
+static const struct cert_ec_curve_oid {
+	const char *name;
+	struct asn1_oid oid;
+} cert_ec_curve_oids[] = {
+	{ /* prime256v1 */
+		"secp256r1",
+		{ 8, { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 } },
+	},
+	{ /* secp384r1 */
+		"secp384r1",
+		{ 5, { 0x2b, 0x81, 0x04, 0x00, 0x22 } },
+	},
+};
+
 static bool cert_set_pubkey_type(struct l_cert *cert)
 {
 	const uint8_t *key_type;
@@ -110,21 +205,44 @@ static bool cert_set_pubkey_type(struct l_cert *cert)
 	return true;
 }
 
-LIB_EXPORT struct l_cert *l_cert_new_from_der(const uint8_t *buf,
-						size_t buf_len)
+static bool cert_der_check(const uint8_t *buf, size_t buf_len)
 {
 	const uint8_t *seq = buf;
 	size_t seq_len = buf_len;
 	size_t content_len;
-	struct l_cert *cert;
 
 	/* Sanity check: outer element is a SEQUENCE */
 	if (seq_len-- < 1 || *seq++ != ASN1_ID_SEQUENCE)
-		return NULL;
+		return false;
 
 	/* Sanity check: the SEQUENCE spans the whole buffer */
 	content_len = asn1_parse_definite_length(&seq, &seq_len);
 	if (content_len < 64 || content_len != seq_len)
+		return false;
+
+	return true;
+}
+
+static bool cert_init(struct l_cert *cert, const uint8_t *der, size_t der_len,
+			struct cert_arena *arena)
+{
+	cert->issuer = NULL;
+	cert->issued = NULL;
+	cert->has_tag = false;
+	cert->arena = arena;
+	cert->asn1 = der;
+	cert->asn1_len = der_len;
+
+	/* Sanity check: structure is correct up to the Public Key Algorithm */
+	return cert_set_pubkey_type(cert);
+}
+
+LIB_EXPORT struct l_cert *l_cert_new_from_der(const uint8_t *buf,
+						size_t buf_len)
+{
+	struct l_cert *cert;
+
+	if (!cert_der_check(buf, buf_len))
 		return NULL;
 
 	/*
@@ -135,22 +253,110 @@ LIB_EXPORT struct l_cert *l_cert_new_from_der(const uint8_t *buf,
 	 */
 
 	cert = l_malloc(sizeof(struct l_cert) + buf_len);
-	cert->issuer = NULL;
-	cert->issued = NULL;
-	cert->asn1_len = buf_len;
-	memcpy(cert->asn1, buf, buf_len);
+	memcpy(cert->buf, buf, buf_len);
 
-	/* Sanity check: structure is correct up to the Public Key Algorithm */
-	if (!cert_set_pubkey_type(cert)) {
+	if (!cert_init(cert, cert->buf, buf_len, NULL)) {
+		l_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+/* Room for @max_certs certificates totalling at most @max_der_len bytes */
+struct cert_arena *cert_arena_new(unsigned int max_certs, size_t max_der_len)
+{
+	struct cert_arena *arena;
+
+	arena = l_malloc(sizeof(struct cert_arena) +
+				max_certs * sizeof(struct l_cert *) +
+				max_der_len);
+	arena->loading = true;
+	arena->max_certs = max_certs;
+	arena->n_certs = 0;
+	arena->der_size = max_der_len;
+	arena->der_used = 0;
+	arena->der_live = 0;
+	arena->certs = (void *) (arena + 1);
+	arena->der = (uint8_t *) (arena->certs + max_certs);
+
+	return arena;
+}
+
+/* Where the DER for the next cert_arena_add call is to be written */
+uint8_t *cert_arena_get_space(struct cert_arena *arena)
+{
+	return arena->der + arena->der_used;
+}
+
+struct l_cert *cert_arena_add(struct cert_arena *arena, size_t der_len)
+{
+	uint8_t *der = arena->der + arena->der_used;
+	struct l_cert *cert;
+
+	if (arena->n_certs == arena->max_certs ||
+			der_len > arena->der_size - arena->der_used ||
+			!cert_der_check(der, der_len))
+		return NULL;
+
+	cert = l_malloc(sizeof(struct l_cert));
+
+	if (!cert_init(cert, der, der_len, arena)) {
 		l_free(cert);
 		return NULL;
 	}
 
+	cert->arena_idx = arena->n_certs;
+	arena->certs[arena->n_certs++] = cert;
+	arena->der_used += der_len;
+	arena->der_live += der_len;
 	return cert;
 }
 
+static void cert_arena_check(struct cert_arena *arena)
+{
+	unsigned int i;
+
+	if (arena->loading || arena->der_live * 8 > arena->der_used)
+		return;
+
+	for (i = 0; i < arena->n_certs; i++) {
+		struct l_cert *cert = arena->certs[i];
+
+		if (!cert)
+			continue;
+
+		cert->asn1 = l_memdup(cert->asn1, cert->asn1_len);
+		cert->arena = NULL;
+	}
+
+	l_free(arena);
+}
+
+/* Called by the loader once it no longer adds to or uses the arena */
+void cert_arena_done(struct cert_arena *arena)
+{
+	arena->loading = false;
+	cert_arena_check(arena);
+}
+
+static void cert_arena_remove(struct cert_arena *arena, struct l_cert *cert)
+{
+	arena->certs[cert->arena_idx] = NULL;
+	arena->der_live -= cert->asn1_len;
+	cert_arena_check(arena);
+}
+
 LIB_EXPORT void l_cert_free(struct l_cert *cert)
 {
+	if (!cert)
+		return;
+
+	if (cert->arena)
+		cert_arena_remove(cert->arena, cert);
+	else if (cert->asn1 != cert->buf)
+		l_free((void *) cert->asn1);
+
 	l_free(cert);
 }
 
@@ -164,16 +370,32 @@ LIB_EXPORT const uint8_t *l_cert_get_der_data(struct l_cert *cert,
 	return cert->asn1;
 }
 
+const uint8_t *cert_der_get_dn(const uint8_t *der, size_t der_len,
+				size_t *out_len)
+{
+	return asn1_der_find_elem_by_path(der, der_len,
+						ASN1_ID_SEQUENCE, out_len,
+						X509_CERTIFICATE_POS,
+						X509_TBSCERTIFICATE_POS,
+						X509_TBSCERT_SUBJECT_DN_POS,
+						-1);
+}
+
 LIB_EXPORT const uint8_t *l_cert_get_dn(struct l_cert *cert, size_t *out_len)
 {
 	if (unlikely(!cert))
 		return NULL;
 
+	return cert_der_get_dn(cert->asn1, cert->asn1_len, out_len);
+}
+
+const uint8_t *cert_get_issuer_dn(struct l_cert *cert, size_t *out_len)
+{
 	return asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
 						ASN1_ID_SEQUENCE, out_len,
 						X509_CERTIFICATE_POS,
 						X509_TBSCERTIFICATE_POS,
-						X509_TBSCERT_SUBJECT_DN_POS,
+						X509_TBSCERT_ISSUER_DN_POS,
 						-1);
 }
 
@@ -359,17 +581,14 @@ LIB_EXPORT bool l_cert_get_valid_times(struct l_cert *cert,
 	return true;
 }
 
-const uint8_t *cert_get_extension(struct l_cert *cert,
+const uint8_t *cert_der_get_extension(const uint8_t *der, size_t der_len,
 					const struct asn1_oid *ext_id,
 					bool *out_critical, size_t *out_len)
 {
 	const uint8_t *ext, *end;
 	size_t ext_len;
 
-	if (unlikely(!cert))
-		return NULL;
-
-	ext = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+	ext = asn1_der_find_elem_by_path(der, der_len,
 						ASN1_ID_SEQUENCE, &ext_len,
 						X509_CERTIFICATE_POS,
 						X509_TBSCERTIFICATE_POS,
@@ -425,6 +644,62 @@ const uint8_t *cert_get_extension(struct l_cert *cert,
 	return NULL;
 }
 
+const uint8_t *cert_get_extension(struct l_cert *cert,
+					const struct asn1_oid *ext_id,
+					bool *out_critical, size_t *out_len)
+{
+	if (unlikely(!cert))
+		return NULL;
+
+	return cert_der_get_extension(cert->asn1, cert->asn1_len, ext_id,
+					out_critical, out_len);
+}
+
+static const struct asn1_oid subject_key_id_oid =
+	{ 3, { 0x55, 0x1d, 0x0e } };
+static const struct asn1_oid authority_key_id_oid =
+	{ 3, { 0x55, 0x1d, 0x23 } };
+
+/* The keyIdentifier from the Subject Key Identifier extension */
+const uint8_t *cert_der_get_subject_key_id(const uint8_t *der, size_t der_len,
+						size_t *out_len)
+{
+	const uint8_t *ext;
+	size_t ext_len;
+	uint8_t tag;
+	const uint8_t *id;
+
+	ext = cert_der_get_extension(der, der_len, &subject_key_id_oid,
+					NULL, &ext_len);
+	if (!ext)
+		return NULL;
+
+	id = asn1_der_find_elem(ext, ext_len, 0, &tag, out_len);
+	if (!id || tag != ASN1_ID_OCTET_STRING || !*out_len)
+		return NULL;
+
+	return id;
+}
+
+/* The keyIdentifier from the Authority Key Identifier extension, if any */
+const uint8_t *cert_get_authority_key_id(struct l_cert *cert, size_t *out_len)
+{
+	const uint8_t *ext;
+	size_t ext_len;
+	const uint8_t *id;
+
+	ext = cert_get_extension(cert, &authority_key_id_oid, NULL, &ext_len);
+	if (!ext)
+		return NULL;
+
+	id = asn1_der_find_elem_by_path(ext, ext_len, 0, out_len,
+					0, ASN1_CONTEXT_IMPLICIT(0), -1);
+	if (!id || !*out_len)
+		return NULL;
+
+	return id;
+}
+
 LIB_EXPORT enum l_cert_key_type l_cert_get_pubkey_type(struct l_cert *cert)
 {
 	if (unlikely(!cert))
@@ -652,6 +927,456 @@ static struct l_key *cert_try_link(struct l_cert *cert, struct l_keyring *ring)
 	return NULL;
 }
 
+/* The signed part of the certificate, tag and length included */
+static const uint8_t *cert_get_tbs(struct l_cert *cert, size_t *out_len)
+{
+	const uint8_t *ptr = cert->asn1 + 1;
+	size_t len = cert->asn1_len - 1;
+	const uint8_t *tbs;
+	int tbs_len;
+
+	if (asn1_parse_definite_length(&ptr, &len) < 0)
+		return NULL;
+
+	tbs = ptr;
+
+	if (len < 2 || *ptr++ != ASN1_ID_SEQUENCE)
+		return NULL;
+
+	len--;
+	tbs_len = asn1_parse_definite_length(&ptr, &len);
+	if (tbs_len < 0 || (size_t) tbs_len > len)
+		return NULL;
+
+	*out_len = ptr + tbs_len - tbs;
+	return tbs;
+}
+
+static bool cert_ecdsa_verify(struct l_cert *issuer,
+				const uint8_t *key, size_t key_len,
+				const uint8_t *digest, size_t digest_len,
+				const uint8_t *sig, size_t sig_len)
+{
+	const struct l_ecc_curve *curve = NULL;
+	const uint8_t *curve_oid;
+	size_t curve_oid_len;
+	const uint8_t *r;
+	const uint8_t *s;
+	size_t r_len;
+	size_t s_len;
+	struct l_ecc_point *point;
+	bool ret;
+	unsigned int i;
+
+	curve_oid = asn1_der_find_elem_by_path(issuer->asn1, issuer->asn1_len,
+						ASN1_ID_OID, &curve_oid_len,
+						X509_CERTIFICATE_POS,
+						X509_TBSCERTIFICATE_POS,
+						X509_TBSCERT_SUBJECT_KEY_POS,
+						X509_SUBJECT_KEY_ALGORITHM_POS,
+						X509_ALGORITHM_ID_PARAMS_POS,
+						-1);
+	if (!curve_oid)
+		return false;
+
+	for (i = 0; i < L_ARRAY_SIZE(cert_ec_curve_oids); i++) {
+		const struct cert_ec_curve_oid *entry = &cert_ec_curve_oids[i];
+
+		if (asn1_oid_eq(&entry->oid, curve_oid_len, curve_oid))
+			curve = l_ecc_curve_from_name(entry->name);
+	}
+
+	/* Uncompressed or compressed SEC 1 point */
+	if (!curve || key_len < 1)
+		return false;
+
+	switch (key[0]) {
+	case 0x04:
+		point = l_ecc_point_from_data(curve, L_ECC_POINT_TYPE_FULL,
+						key + 1, key_len - 1);
+		break;
+	case 0x02:
+		point = l_ecc_point_from_data(curve,
+					L_ECC_POINT_TYPE_COMPRESSED_BIT0,
+					key + 1, key_len - 1);
+		break;
+	case 0x03:
+		point = l_ecc_point_from_data(curve,
+					L_ECC_POINT_TYPE_COMPRESSED_BIT1,
+					key + 1, key_len - 1);
+		break;
+	default:
+		return false;
+	}
+
+	if (!point)
+		return false;
+
+	/* Ecdsa-Sig-Value ::= SEQUENCE { r INTEGER, s INTEGER } */
+	r = asn1_der_find_elem_by_path(sig, sig_len, ASN1_ID_INTEGER, &r_len,
+					0, 0, -1);
+	s = asn1_der_find_elem_by_path(sig, sig_len, ASN1_ID_INTEGER, &s_len,
+					0, 1, -1);
+
+	ret = r && s && _ecc_ecdsa_verify(point, digest, digest_len,
+						r, r_len, s, s_len);
+	l_ecc_point_free(point);
+	return ret;
+}
+
+/*
+ * Check the signature on @cert using the public key from @issuer,
+ * entirely in-process.
+ */
+static bool cert_verify_signature(struct l_cert *cert, struct l_cert *issuer)
+{
+	const struct cert_signature_alg *alg = NULL;
+	const uint8_t *alg_oid;
+	size_t alg_oid_len;
+	const uint8_t *sig;
+	size_t sig_len;
+	const uint8_t *tbs;
+	size_t tbs_len = 0;
+	const uint8_t *key;
+	size_t key_len;
+	enum l_checksum_type hash;
+	enum l_checksum_type mgf1_hash = L_CHECKSUM_NONE;
+	size_t salt_len = 0;
+	struct l_checksum *checksum;
+	uint8_t digest[64];
+	ssize_t digest_len;
+	unsigned int i;
+
+	alg_oid = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+						ASN1_ID_OID, &alg_oid_len,
+						X509_CERTIFICATE_POS,
+						X509_SIGNATURE_ALGORITHM_POS,
+						X509_ALGORITHM_ID_ALGORITHM_POS,
+						-1);
+	if (!alg_oid)
+		return false;
+
+	for (i = 0; i < L_ARRAY_SIZE(cert_signature_algs); i++)
+		if (asn1_oid_eq(&cert_signature_algs[i].oid,
+					alg_oid_len, alg_oid))
+			alg = &cert_signature_algs[i];
+
+	if (!alg || alg->key_type != issuer->pubkey_type)
+		return false;
+
+	hash = alg->hash;
+
+	if (hash == L_CHECKSUM_NONE) {
+		const uint8_t *params;
+		size_t params_len;
+
+		params = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+						ASN1_ID_SEQUENCE, &params_len,
+						X509_CERTIFICATE_POS,
+						X509_SIGNATURE_ALGORITHM_POS,
+						X509_ALGORITHM_ID_PARAMS_POS,
+						-1);
+		if (!params || !cert_parse_pss_params(params, params_len,
+							&hash, &mgf1_hash,
+							&salt_len))
+			return false;
+	}
+
+	/* Both BIT STRINGs must have no unused bits */
+	sig = asn1_der_find_elem_by_path(cert->asn1, cert->asn1_len,
+						ASN1_ID_BIT_STRING, &sig_len,
+						X509_CERTIFICATE_POS,
+						X509_SIGNATURE_VALUE_POS,
+						-1);
+	key = asn1_der_find_elem_by_path(issuer->asn1, issuer->asn1_len,
+						ASN1_ID_BIT_STRING, &key_len,
+						X509_CERTIFICATE_POS,
+						X509_TBSCERTIFICATE_POS,
+						X509_TBSCERT_SUBJECT_KEY_POS,
+						X509_SUBJECT_KEY_VALUE_POS,
+						-1);
+	tbs = cert_get_tbs(cert, &tbs_len);
+
+	if (!sig || sig_len < 2 || sig[0] || !key || key_len < 2 || key[0] ||
+			!tbs)
+		return false;
+
+	checksum = l_checksum_new(hash);
+	if (!checksum)
+		return false;
+
+	l_checksum_update(checksum, tbs, tbs_len);
+	digest_len = l_checksum_get_digest(checksum, digest, sizeof(digest));
+	l_checksum_free(checksum);
+
+	if (digest_len <= 0)
+		return false;
+
+	switch (alg->key_type) {
+	case L_CERT_KEY_RSA:
+		if (alg->hash == L_CHECKSUM_NONE)
+			return cert_rsa_pss_verify(key + 1, key_len - 1, hash,
+							mgf1_hash, salt_len,
+							digest, digest_len,
+							sig + 1, sig_len - 1);
+
+		return cert_rsa_pkcs1_verify(key + 1, key_len - 1, hash,
+						digest, digest_len,
+						sig + 1, sig_len - 1);
+	case L_CERT_KEY_ECC:
+		return cert_ecdsa_verify(issuer, key + 1, key_len - 1,
+						digest, digest_len,
+						sig + 1, sig_len - 1);
+	case L_CERT_KEY_UNKNOWN:
+		break;
+	}
+
+	return false;
+}
+
+/*
+ * Direct-mapped cache of issuer/subject pairs whose signature has been
+ * verified, so that the CA and intermediate links shared by many chains
+ * are only checked once.  Certificates are identified by a 128-bit
+ * SipHash of their DER encoding under a random per-process key, which
+ * makes crafting a colliding certificate impractical.  Each entry is
+ * only good for the intersection of the two validity periods.
+ *
+ * Unlike the D-Bus signature cache and the ECC generator tables, the
+ * cache has no locking or atomic publication.  Certificate chains must
+ * only be verified from one thread.
+ */
+#define CERT_CACHE_SIZE		256
+
+struct cert_cache_entry {
+	uint64_t issuer[2];
+	uint64_t subject[2];
+	uint64_t not_before;
+	uint64_t not_after;	/* 0 for no expiry */
+	bool used;
+};
+
+static struct {
+	uint8_t key[2][16];
+	bool keyed;
+	struct cert_cache_entry *entries;
+	uint64_t hits;
+	uint64_t misses;
+} cert_cache;
+
+static bool cert_cache_init(void)
+{
+	if (cert_cache.entries)
+		return true;
+
+	/* Keep the key across clears, certificates cache their tags */
+	if (!cert_cache.keyed) {
+		if (!l_getrandom(cert_cache.key, sizeof(cert_cache.key)))
+			return false;
+
+		cert_cache.keyed = true;
+	}
+
+	cert_cache.entries = l_new(struct cert_cache_entry, CERT_CACHE_SIZE);
+	return true;
+}
+
+static const uint64_t *cert_get_tag(struct l_cert *cert)
+{
+	if (!cert->has_tag) {
+		_siphash24((uint8_t *) &cert->tag[0], cert->asn1,
+				cert->asn1_len, cert_cache.key[0]);
+		_siphash24((uint8_t *) &cert->tag[1], cert->asn1,
+				cert->asn1_len, cert_cache.key[1]);
+		cert->has_tag = true;
+	}
+
+	return cert->tag;
+}
+
+static struct cert_cache_entry *cert_cache_slot(const uint64_t *issuer,
+						const uint64_t *subject)
+{
+	return &cert_cache.entries[(issuer[0] ^ subject[1]) %
+					CERT_CACHE_SIZE];
+}
+
+static bool cert_cache_lookup(struct l_cert *issuer, struct l_cert *cert,
+				uint64_t now)
+{
+	const uint64_t *issuer_tag;
+	const uint64_t *subject_tag;
+	const struct cert_cache_entry *entry;
+
+	if (!cert_cache_init())
+		return false;
+
+	issuer_tag = cert_get_tag(issuer);
+	subject_tag = cert_get_tag(cert);
+	entry = cert_cache_slot(issuer_tag, subject_tag);
+
+	if (!entry->used || memcmp(entry->issuer, issuer_tag, 16) ||
+			memcmp(entry->subject, subject_tag, 16) ||
+			now < entry->not_before ||
+			(entry->not_after && now > entry->not_after)) {
+		cert_cache.misses++;
+		return false;
+	}
+
+	cert_cache.hits++;
+	return true;
+}
+
+static void cert_cache_add(struct l_cert *issuer, struct l_cert *cert)
+{
+	struct cert_cache_entry *entry;
+	uint64_t issuer_not_before, issuer_not_after;
+	uint64_t not_before, not_after;
+
+	if (!cert_cache_init())
+		return;
+
+	if (!l_cert_get_valid_times(issuer, &issuer_not_before,
+					&issuer_not_after) ||
+			!l_cert_get_valid_times(cert, &not_before, &not_after))
+		return;
+
+	entry = cert_cache_slot(cert_get_tag(issuer), cert_get_tag(cert));
+	memcpy(entry->issuer, issuer->tag, 16);
+	memcpy(entry->subject, cert->tag, 16);
+	entry->not_before = not_before > issuer_not_before ?
+					not_before : issuer_not_before;
+
+	if (!not_after || (issuer_not_after && issuer_not_after < not_after))
+		entry->not_after = issuer_not_after;
+	else
+		entry->not_after = not_after;
+
+	entry->used = true;
+}
+
+static bool cert_verify_cached(struct l_cert *cert, struct l_cert *issuer,
+				uint64_t now)
+{
+	if (cert_cache_lookup(issuer, cert, now))
+		return true;
+
+	if (!cert_verify_signature(cert, issuer))
+		return false;
+
+	cert_cache_add(issuer, cert);
+	return true;
+}
+
+static bool cert_issuer_dn_matches(struct l_cert *cert, struct l_cert *issuer)
+{
+	const uint8_t *issuer_dn;
+	size_t issuer_dn_len;
+	const uint8_t *dn;
+	size_t dn_len;
+
+	issuer_dn = cert_get_issuer_dn(cert, &issuer_dn_len);
+	dn = l_cert_get_dn(issuer, &dn_len);
+
+	return issuer_dn && dn && dn_len == issuer_dn_len &&
+		!memcmp(dn, issuer_dn, dn_len);
+}
+
+/*
+ * Returns the only CA in @set that could have issued @cert by name, if
+ * there is exactly one.  The kernel picks the CA by key ID rather than
+ * name, so its result says nothing about this CA.
+ */
+static struct l_cert *cert_find_unique_issuer(struct l_cert *cert,
+						struct l_cert **set)
+{
+	struct l_cert *found = NULL;
+
+	for (; *set; set++) {
+		if (!cert_issuer_dn_matches(cert, *set))
+			continue;
+
+		if (found)
+			return NULL;
+
+		found = *set;
+	}
+
+	return found;
+}
+
+static bool cert_cache_lookup_trusted(struct l_cert *cert,
+					struct l_cert **set, uint64_t now)
+{
+	for (; *set; set++)
+		if (cert_issuer_dn_matches(cert, *set) &&
+				cert_cache_lookup(*set, cert, now))
+			return true;
+
+	return false;
+}
+
+LIB_EXPORT void l_certchain_verify_cache_get_stats(uint64_t *out_hits,
+							uint64_t *out_misses)
+{
+	if (out_hits)
+		*out_hits = cert_cache.hits;
+
+	if (out_misses)
+		*out_misses = cert_cache.misses;
+}
+
+LIB_EXPORT void l_certchain_verify_cache_clear(void)
+{
+	l_free(cert_cache.entries);
+	cert_cache.entries = NULL;
+	cert_cache.hits = 0;
+	cert_cache.misses = 0;
+}
+
+/*
+ * Find the trusted CA that issued @cert.  Only CAs whose subject matches
+ * the issuer name are tried, following RFC5280 name chaining, so that
+ * a large CA set doesn't mean one signature check per CA.
+ */
+static bool cert_verify_by_trusted(struct l_cert *cert, struct l_cert **set,
+					uint64_t now)
+{
+	for (; *set; set++)
+		if (cert_issuer_dn_matches(cert, *set) &&
+				cert_verify_cached(cert, *set, now))
+			return true;
+
+	return false;
+}
+
+/*
+ * In-process counterpart of the keyring logic in l_certchain_verify: the
+ * top certificate either has to be issued by one of @trusted or is taken
+ * as is, then every certificate has to be signed by the one above.
+ * @verified is updated the same way as there for the error message.
+ */
+static bool certchain_verify_signatures(struct l_certchain *chain,
+					struct l_cert **trusted,
+					uint64_t now, int *verified)
+{
+	struct l_cert *cert = chain->ca;
+
+	if (trusted && !cert_verify_by_trusted(cert, trusted, now))
+		return false;
+
+	for (cert = cert->issued; cert; cert = cert->issued) {
+		(*verified)++;
+
+		if (!cert_verify_cached(cert, cert->issuer, now))
+			return false;
+	}
+
+	return true;
+}
+
+static char error_buf[1024];
+
 #define RETURN_ERROR(msg, args...)	\
 	do {	\
 		if (error) {	\
@@ -661,18 +1386,22 @@ static struct l_key *cert_try_link(struct l_cert *cert, struct l_keyring *ring)
 		return false;	\
 	} while (0)
 
-LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
-					struct l_queue *ca_certs,
-					const char **error)
+static bool certchain_verify(struct l_certchain *chain,
+				struct l_queue *ca_certs, bool in_process,
+				const char **error)
 {
 	struct l_keyring *ca_ring = NULL;
 	_auto_(l_keyring_free) struct l_keyring *verify_ring = NULL;
 	struct l_cert *cert;
+	struct l_cert *issuer;
 	struct l_key *prev_key = NULL;
+	bool anchored;
+	bool cached = false;
 	int verified = 0;
 	int ca_match = 0;
 	int i;
-	static char error_buf[1024];
+	char str1[100];
+	char str2[100] = "";
 	int total = 0;
 	uint64_t now;
 	_auto_(l_free) struct l_cert **ca_certs_valid = NULL;
@@ -742,12 +1471,41 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 			}
 	}
 
+	if (in_process) {
+		if (certchain_verify_signatures(chain,
+					ca_certs && !ca_match ?
+					ca_certs_valid : NULL,
+					now, &verified))
+			return true;
+
+		goto link_failed;
+	}
+
+	/*
+	 * Links at the top of the chain that were verified before against
+	 * the same trust anchor don't need to go through the kernel again,
+	 * start from the lowest such certificate as if it was trusted.
+	 */
+	cert = chain->ca;
+	anchored = !ca_certs || ca_match;
+
+	if (!anchored && cert_cache_lookup_trusted(cert, ca_certs_valid, now))
+		anchored = cached = true;
+
+	while (anchored && cert->issued &&
+			cert_cache_lookup(cert, cert->issued, now)) {
+		cert = cert->issued;
+		cached = true;
+		verified++;
+	}
+
+	if (cached && !cert->issued)
+		return true;
+
 	verify_ring = l_keyring_new();
 	if (!verify_ring)
 		RETURN_ERROR("Can't create verify keyring");
 
-	cert = chain->ca;
-
 	/*
 	 * For TLS compatibility the trusted root CA certificate is
 	 * optionally present in the chain.
@@ -773,9 +1531,10 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 	 * from being linked to a restricted keyring.  That issue would
 	 * have affected us if the trusted CA set included such
 	 * certificate and the same certificate was at the root of
-	 * the chain.
+	 * the chain.  The same goes for a certificate already known to
+	 * chain up to a trusted CA through the verify cache.
 	 */
-	if (ca_certs && !ca_match) {
+	if (!anchored) {
 		ca_ring = cert_set_to_keyring(ca_certs_valid, error_buf);
 		if (!ca_ring) {
 			if (error)
@@ -809,6 +1568,14 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 		 */
 		prev_key = cert_try_link(cert, verify_ring);
 		l_keyring_free(ca_ring);
+
+		/*
+		 * We can't tell which CA the kernel used, the link is only
+		 * cached once checked against the CA matching by name.
+		 */
+		issuer = cert_find_unique_issuer(cert, ca_certs_valid);
+		if (prev_key && issuer && cert_verify_signature(cert, issuer))
+			cert_cache_add(issuer, cert);
 	}
 
 	cert = cert->issued;
@@ -817,6 +1584,9 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 	while (prev_key && cert) {
 		struct l_key *new_key = cert_try_link(cert, verify_ring);
 
+		if (new_key)
+			cert_cache_add(cert->issuer, cert);
+
 		/*
 		 * Free and revoke the issuer's public key again leaving only
 		 * new_key in verify_ring to ensure the next certificate linked
@@ -828,33 +1598,81 @@ LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
 		verified++;
 	}
 
-	if (!prev_key) {
-		char str1[100];
-		char str2[100] = "";
+	if (prev_key) {
+		l_key_free(prev_key);
+		return true;
+	}
 
-		if (ca_match)
-			snprintf(str1, sizeof(str1), "%i / %i matched a trusted"
-					" certificate, root not verified",
-					ca_match, total);
-		else
-			snprintf(str1, sizeof(str1), "root %sverified against "
-					"trusted CA(s)",
-					ca_certs && verified ? "" : "not ");
-
-		if (ca_certs && !ca_match && !verified &&
-				ca_certs_valid_count < ca_certs_total_count)
-			snprintf(str2, sizeof(str2), ", %i out of %i trused "
-					"CA(s) were expired or not-yet-valid",
-					ca_certs_total_count -
-					ca_certs_valid_count,
-					ca_certs_total_count);
-
-		RETURN_ERROR("Linking certificate %i / %i failed, %s%s",
-				verified + 1, total, str1, str2);
+link_failed:
+	if (ca_match)
+		snprintf(str1, sizeof(str1), "%i / %i matched a trusted"
+				" certificate, root not verified",
+				ca_match, total);
+	else
+		snprintf(str1, sizeof(str1), "root %sverified against "
+				"trusted CA(s)",
+				ca_certs && verified ? "" : "not ");
+
+	if (ca_certs && !ca_match && !verified &&
+			ca_certs_valid_count < ca_certs_total_count)
+		snprintf(str2, sizeof(str2), ", %i out of %i trused "
+				"CA(s) were expired or not-yet-valid",
+				ca_certs_total_count -
+				ca_certs_valid_count,
+				ca_certs_total_count);
+
+	RETURN_ERROR("Linking certificate %i / %i failed, %s%s",
+			verified + 1, total, str1, str2);
+}
+
+LIB_EXPORT bool l_certchain_verify(struct l_certchain *chain,
+					struct l_queue *ca_certs,
+					const char **error)
+{
+	return certchain_verify(chain, ca_certs, false, error);
+}
+
+/*
+ * Same as l_certchain_verify but the signatures are checked in-process
+ * instead of through a restricted kernel keyring, so no key objects are
+ * created and no keyctl support is needed.  RSA PKCS#1 v1.5 and PSS as
+ * well as ECDSA P-256 and P-384 signatures are supported.
+ */
+LIB_EXPORT bool l_certchain_verify_userspace(struct l_certchain *chain,
+						struct l_queue *ca_certs,
+						const char **error)
+{
+	return certchain_verify(chain, ca_certs, true, error);
+}
+
+/*
+ * Same as l_certchain_verify_userspace with the trusted CAs taken from
+ * @store.  Only the CAs whose name appears in @chain are looked up and
+ * loaded.
+ */
+LIB_EXPORT bool l_certchain_verify_store(struct l_certchain *chain,
+						struct l_cert_store *store,
+						const char **error)
+{
+	struct l_queue *trusted;
+	bool r;
+
+	if (unlikely(!store))
+		RETURN_ERROR("No trusted CA store");
+
+	if (unlikely(!chain || !chain->leaf))
+		RETURN_ERROR("Chain empty");
+
+	trusted = cert_store_get_trusted(store, chain);
+
+	if (l_queue_isempty(trusted)) {
+		l_queue_destroy(trusted, NULL);
+		RETURN_ERROR("No trusted CA matches the chain");
 	}
 
-	l_key_free(prev_key);
-	return true;
+	r = certchain_verify(chain, trusted, true, error);
+	l_queue_destroy(trusted, NULL);
+	return r;
 }
 
 struct l_key *cert_key_from_pkcs8_private_key_info(const uint8_t *der,
@@ -18,6 +18,7 @@ extern "C" {
 struct l_queue;
 struct l_cert;
 struct l_certchain;
+struct l_cert_store;
 
 enum l_cert_key_type {
 	L_CERT_KEY_RSA,
@@ -49,6 +50,26 @@ void l_certchain_walk_from_ca(struct l_certchain *chain,
 
 bool l_certchain_verify(struct l_certchain *chain, struct l_queue *ca_certs,
 			const char **error);
+bool l_certchain_verify_userspace(struct l_certchain *chain,
+					struct l_queue *ca_certs,
+					const char **error);
+void l_certchain_verify_cache_get_stats(uint64_t *out_hits,
+						uint64_t *out_misses);
+void l_certchain_verify_cache_clear(void);
+
+struct l_cert_store *l_cert_store_new(void);
+void l_cert_store_free(struct l_cert_store *store);
+DEFINE_CLEANUP_FUNC(l_cert_store_free);
+
+bool l_cert_store_load_file(struct l_cert_store *store, const char *filename);
+bool l_cert_store_load_dir(struct l_cert_store *store, const char *dirname);
+unsigned int l_cert_store_get_count(struct l_cert_store *store);
+struct l_cert *l_cert_store_find_issuer(struct l_cert_store *store,
+					struct l_cert *cert);
+
+bool l_certchain_verify_store(struct l_certchain *chain,
+				struct l_cert_store *store,
+				const char **error);
 
 bool l_cert_load_container_file(const char *filename, const char *password,
 				struct l_certchain **out_certchain,
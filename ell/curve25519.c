@@ -0,0 +1,320 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "private.h"
+#include "ecc-private.h"
+#include "useful.h"
+#include "missing.h"
+
+#ifdef __SIZEOF_INT128__
+
+/*
+ * X25519 (RFC 7748) over GF(2^255 - 19).  Field elements are kept in five
+ * 51-bit limbs so that a full product of two elements fits in 128-bit
+ * accumulators without intermediate carries.  Limbs are only loosely
+ * reduced (below 2^52) between operations, fe_to_words() produces the
+ * canonical value.
+ */
+
+#define FE_MASK		((1ull << 51) - 1)
+
+typedef unsigned __int128 fe_wide;
+
+static void fe_from_words(uint64_t h[5], const uint64_t *w)
+{
+	h[0] = w[0] & FE_MASK;
+	h[1] = ((w[0] >> 51) | (w[1] << 13)) & FE_MASK;
+	h[2] = ((w[1] >> 38) | (w[2] << 26)) & FE_MASK;
+	h[3] = ((w[2] >> 25) | (w[3] << 39)) & FE_MASK;
+	/* The top bit of the u-coordinate is ignored */
+	h[4] = (w[3] >> 12) & FE_MASK;
+}
+
+static void fe_carry(uint64_t h[5])
+{
+	h[1] += h[0] >> 51;
+	h[0] &= FE_MASK;
+	h[2] += h[1] >> 51;
+	h[1] &= FE_MASK;
+	h[3] += h[2] >> 51;
+	h[2] &= FE_MASK;
+	h[4] += h[3] >> 51;
+	h[3] &= FE_MASK;
+	h[0] += (h[4] >> 51) * 19;
+	h[4] &= FE_MASK;
+	h[1] += h[0] >> 51;
+	h[0] &= FE_MASK;
+}
+
+static void fe_to_words(uint64_t *w, const uint64_t f[5])
+{
+	uint64_t h[5];
+	uint64_t q;
+
+	/* Twice, so that every limb ends up strictly below 2^51 */
+	memcpy(h, f, sizeof(h));
+	fe_carry(h);
+	fe_carry(h);
+
+	/* q = 1 if h >= p, computed without branches */
+	q = (h[0] + 19) >> 51;
+	q = (h[1] + q) >> 51;
+	q = (h[2] + q) >> 51;
+	q = (h[3] + q) >> 51;
+	q = (h[4] + q) >> 51;
+
+	h[0] += 19 * q;
+	h[1] += h[0] >> 51;
+	h[0] &= FE_MASK;
+	h[2] += h[1] >> 51;
+	h[1] &= FE_MASK;
+	h[3] += h[2] >> 51;
+	h[2] &= FE_MASK;
+	h[4] += h[3] >> 51;
+	h[3] &= FE_MASK;
+	h[4] &= FE_MASK;
+
+	w[0] = h[0] | (h[1] << 51);
+	w[1] = (h[1] >> 13) | (h[2] << 38);
+	w[2] = (h[2] >> 26) | (h[3] << 25);
+	w[3] = (h[3] >> 39) | (h[4] << 12);
+}
+
+static void fe_add(uint64_t h[5], const uint64_t f[5], const uint64_t g[5])
+{
+	unsigned int i;
+
+	for (i = 0; i < 5; i++)
+		h[i] = f[i] + g[i];
+
+	fe_carry(h);
+}
+
+/* h = f - g, adding 4p first so that no limb goes negative */
+static void fe_sub(uint64_t h[5], const uint64_t f[5], const uint64_t g[5])
+{
+	h[0] = f[0] + 0x1fffffffffffb4ull - g[0];
+	h[1] = f[1] + 0x1ffffffffffffcull - g[1];
+	h[2] = f[2] + 0x1ffffffffffffcull - g[2];
+	h[3] = f[3] + 0x1ffffffffffffcull - g[3];
+	h[4] = f[4] + 0x1ffffffffffffcull - g[4];
+
+	fe_carry(h);
+}
+
+static void fe_reduce_wide(uint64_t h[5], fe_wide r0, fe_wide r1, fe_wide r2,
+				fe_wide r3, fe_wide r4)
+{
+	r1 += (uint64_t) (r0 >> 51);
+	h[0] = (uint64_t) r0 & FE_MASK;
+	r2 += (uint64_t) (r1 >> 51);
+	h[1] = (uint64_t) r1 & FE_MASK;
+	r3 += (uint64_t) (r2 >> 51);
+	h[2] = (uint64_t) r2 & FE_MASK;
+	r4 += (uint64_t) (r3 >> 51);
+	h[3] = (uint64_t) r3 & FE_MASK;
+	h[0] += (uint64_t) (r4 >> 51) * 19;
+	h[4] = (uint64_t) r4 & FE_MASK;
+	h[1] += h[0] >> 51;
+	h[0] &= FE_MASK;
+}
+
+static void fe_mul(uint64_t h[5], const uint64_t f[5], const uint64_t g[5])
+{
+	uint64_t g1_19 = g[1] * 19;
+	uint64_t g2_19 = g[2] * 19;
+	uint64_t g3_19 = g[3] * 19;
+	uint64_t g4_19 = g[4] * 19;
+	fe_wide r0, r1, r2, r3, r4;
+
+	r0 = (fe_wide) f[0] * g[0] + (fe_wide) f[1] * g4_19 +
+		(fe_wide) f[2] * g3_19 + (fe_wide) f[3] * g2_19 +
+		(fe_wide) f[4] * g1_19;
+	r1 = (fe_wide) f[0] * g[1] + (fe_wide) f[1] * g[0] +
+		(fe_wide) f[2] * g4_19 + (fe_wide) f[3] * g3_19 +
+		(fe_wide) f[4] * g2_19;
+	r2 = (fe_wide) f[0] * g[2] + (fe_wide) f[1] * g[1] +
+		(fe_wide) f[2] * g[0] + (fe_wide) f[3] * g4_19 +
+		(fe_wide) f[4] * g3_19;
+	r3 = (fe_wide) f[0] * g[3] + (fe_wide) f[1] * g[2] +
+		(fe_wide) f[2] * g[1] + (fe_wide) f[3] * g[0] +
+		(fe_wide) f[4] * g4_19;
+	r4 = (fe_wide) f[0] * g[4] + (fe_wide) f[1] * g[3] +
+		(fe_wide) f[2] * g[2] + (fe_wide) f[3] * g[1] +
+		(fe_wide) f[4] * g[0];
+
+	fe_reduce_wide(h, r0, r1, r2, r3, r4);
+}
+
+static void fe_sq(uint64_t h[5], const uint64_t f[5])
+{
+	uint64_t f0_2 = f[0] * 2;
+	uint64_t f1_2 = f[1] * 2;
+	uint64_t f1_38 = f[1] * 38;
+	uint64_t f2_38 = f[2] * 38;
+	uint64_t f3_38 = f[3] * 38;
+	uint64_t f3_19 = f[3] * 19;
+	uint64_t f4_19 = f[4] * 19;
+	fe_wide r0, r1, r2, r3, r4;
+
+	r0 = (fe_wide) f[0] * f[0] + (fe_wide) f1_38 * f[4] +
+		(fe_wide) f2_38 * f[3];
+	r1 = (fe_wide) f0_2 * f[1] + (fe_wide) f2_38 * f[4] +
+		(fe_wide) f3_19 * f[3];
+	r2 = (fe_wide) f0_2 * f[2] + (fe_wide) f[1] * f[1] +
+		(fe_wide) f3_38 * f[4];
+	r3 = (fe_wide) f0_2 * f[3] + (fe_wide) f1_2 * f[2] +
+		(fe_wide) f4_19 * f[4];
+	r4 = (fe_wide) f0_2 * f[4] + (fe_wide) f1_2 * f[3] +
+		(fe_wide) f[2] * f[2];
+
+	fe_reduce_wide(h, r0, r1, r2, r3, r4);
+}
+
+static void fe_sq_n(uint64_t h[5], const uint64_t f[5], unsigned int n)
+{
+	fe_sq(h, f);
+
+	while (--n)
+		fe_sq(h, h);
+}
+
+static void fe_mul_121665(uint64_t h[5], const uint64_t f[5])
+{
+	fe_reduce_wide(h, (fe_wide) f[0] * 121665, (fe_wide) f[1] * 121665,
+				(fe_wide) f[2] * 121665,
+				(fe_wide) f[3] * 121665,
+				(fe_wide) f[4] * 121665);
+}
+
+static void fe_cswap(uint64_t f[5], uint64_t g[5], uint64_t swap)
+{
+	uint64_t mask = -swap;
+	unsigned int i;
+
+	for (i = 0; i < 5; i++) {
+		uint64_t x = mask & (f[i] ^ g[i]);
+
+		f[i] ^= x;
+		g[i] ^= x;
+	}
+}
+
+/* h = z^(p - 2) using the usual fixed addition chain, 254 S + 11 M */
+static void fe_invert(uint64_t h[5], const uint64_t z[5])
+{
+	uint64_t z2[5], z9[5], z11[5], z2_5_0[5], z2_10_0[5];
+	uint64_t z2_20_0[5], z2_50_0[5], z2_100_0[5], t[5];
+
+	fe_sq(z2, z);
+	fe_sq_n(t, z2, 2);
+	fe_mul(z9, t, z);
+	fe_mul(z11, z9, z2);
+	fe_sq(t, z11);
+	fe_mul(z2_5_0, t, z9);
+	fe_sq_n(t, z2_5_0, 5);
+	fe_mul(z2_10_0, t, z2_5_0);
+	fe_sq_n(t, z2_10_0, 10);
+	fe_mul(z2_20_0, t, z2_10_0);
+	fe_sq_n(t, z2_20_0, 20);
+	fe_mul(t, t, z2_20_0);
+	fe_sq_n(t, t, 10);
+	fe_mul(z2_50_0, t, z2_10_0);
+	fe_sq_n(t, z2_50_0, 50);
+	fe_mul(z2_100_0, t, z2_50_0);
+	fe_sq_n(t, z2_100_0, 100);
+	fe_mul(t, t, z2_100_0);
+	fe_sq_n(t, t, 50);
+	fe_mul(t, t, z2_50_0);
+	fe_sq_n(t, t, 5);
+	fe_mul(h, t, z11);
+}
+
+/*
+ * result = X25519(scalar, u), all values as four little-endian 64-bit
+ * words.  The scalar is clamped here as required by RFC 7748, Section 5.
+ * Montgomery ladder with constant-time conditional swaps.
+ */
+void _x25519_mult(uint64_t *result, const uint64_t *scalar, const uint64_t *u)
+{
+	uint64_t k[4];
+	uint64_t x1[5], x2[5], z2[5], x3[5], z3[5];
+	uint64_t a[5], aa[5], b[5], bb[5], e[5], c[5], d[5], da[5], cb[5];
+	uint64_t swap = 0;
+	int t;
+
+	memcpy(k, scalar, sizeof(k));
+	k[0] &= ~7ull;
+	k[3] &= ~(1ull << 63);
+	k[3] |= 1ull << 62;
+
+	fe_from_words(x1, u);
+	memset(x2, 0, sizeof(x2));
+	x2[0] = 1;
+	memset(z2, 0, sizeof(z2));
+	memcpy(x3, x1, sizeof(x3));
+	memset(z3, 0, sizeof(z3));
+	z3[0] = 1;
+
+	for (t = 254; t >= 0; t--) {
+		uint64_t bit = (k[t / 64] >> (t % 64)) & 1;
+
+		swap ^= bit;
+		fe_cswap(x2, x3, swap);
+		fe_cswap(z2, z3, swap);
+		swap = bit;
+
+		fe_add(a, x2, z2);
+		fe_sq(aa, a);
+		fe_sub(b, x2, z2);
+		fe_sq(bb, b);
+		fe_sub(e, aa, bb);
+		fe_add(c, x3, z3);
+		fe_sub(d, x3, z3);
+		fe_mul(da, d, a);
+		fe_mul(cb, c, b);
+
+		fe_add(x3, da, cb);
+		fe_sq(x3, x3);
+		fe_sub(z3, da, cb);
+		fe_sq(z3, z3);
+		fe_mul(z3, z3, x1);
+		fe_mul(x2, aa, bb);
+		fe_mul_121665(z2, e);
+		fe_add(z2, z2, aa);
+		fe_mul(z2, z2, e);
+	}
+
+	fe_cswap(x2, x3, swap);
+	fe_cswap(z2, z3, swap);
+
+	fe_invert(z2, z2);
+	fe_mul(x2, x2, z2);
+	fe_to_words(result, x2);
+
+	explicit_bzero(k, sizeof(k));
+	explicit_bzero(x2, sizeof(x2));
+	explicit_bzero(z2, sizeof(z2));
+	explicit_bzero(x3, sizeof(x3));
+	explicit_bzero(z3, sizeof(z3));
+}
+
+#else
+
+/* Curve25519 is not registered without 128-bit arithmetic */
+void _x25519_mult(uint64_t *result, const uint64_t *scalar, const uint64_t *u)
+{
+	memset(result, 0, 32);
+}
+
+#endif /* __SIZEOF_INT128__ */
@@ -58,9 +58,13 @@ struct l_dbus_message {
 	char *sender;
 	int fds[16];
 	uint32_t num_fds;
+	struct dbus_signature_info *sig_info;
+	struct _dbus_message_pool *pool;
 
 	bool sealed : 1;
 	bool signature_free : 1;
+	bool header_pooled : 1;
+	bool body_pooled : 1;
 };
 
 struct l_dbus_message_builder {
@@ -76,6 +80,186 @@ static inline bool _dbus_message_is_gvariant(struct l_dbus_message *msg)
 	return hdr->version == 2;
 }
 
+/*
+ * Per-connection cache of message memory.  Message structures, received
+ * headers and bodies and reply headers are carved from power-of-two size
+ * classes and recycled instead of going back to the allocator.  Replies
+ * to the same caller with the same signature also share a header template
+ * so that their header does not need to be marshalled field by field.
+ *
+ * The pool is reference counted by its connection and by every message
+ * allocated from it, so messages may safely outlive the connection.  Like
+ * the rest of l_dbus it is meant to be used from a single main loop.
+ */
+#define POOL_MIN_SHIFT		6
+#define POOL_N_CLASSES		7
+#define POOL_CLASS_DEPTH	16
+#define POOL_N_TEMPLATES	4
+
+struct reply_template {
+	uint8_t type;
+	uint8_t flags;
+	char *destination;
+	char *error_name;
+	char *signature;
+	void *header;
+	size_t header_size;
+	size_t header_end;
+	size_t reply_serial_offset;
+};
+
+struct _dbus_message_pool {
+	int refcount;
+	void *free[POOL_N_CLASSES][POOL_CLASS_DEPTH];
+	unsigned int n_free[POOL_N_CLASSES];
+	struct reply_template templates[POOL_N_TEMPLATES];
+	unsigned int next_template;
+	unsigned int allocs;
+	unsigned int reuses;
+	unsigned int template_hits;
+	unsigned int template_misses;
+};
+
+static int pool_size_class(size_t size)
+{
+	int class = 0;
+
+	while ((size_t) 1 << (class + POOL_MIN_SHIFT) < size) {
+		if (++class == POOL_N_CLASSES)
+			return -1;
+	}
+
+	return class;
+}
+
+struct _dbus_message_pool *_dbus_message_pool_new(void)
+{
+	struct _dbus_message_pool *pool = l_new(struct _dbus_message_pool, 1);
+
+	pool->refcount = 1;
+
+	return pool;
+}
+
+static struct _dbus_message_pool *pool_ref(struct _dbus_message_pool *pool)
+{
+	if (pool)
+		pool->refcount++;
+
+	return pool;
+}
+
+static void reply_template_clear(struct reply_template *t)
+{
+	l_free(t->destination);
+	l_free(t->error_name);
+	l_free(t->signature);
+	l_free(t->header);
+	memset(t, 0, sizeof(*t));
+}
+
+void _dbus_message_pool_unref(struct _dbus_message_pool *pool)
+{
+	unsigned int i, j;
+
+	if (!pool || --pool->refcount)
+		return;
+
+	for (i = 0; i < POOL_N_CLASSES; i++)
+		for (j = 0; j < pool->n_free[i]; j++)
+			l_free(pool->free[i][j]);
+
+	for (i = 0; i < POOL_N_TEMPLATES; i++)
+		reply_template_clear(&pool->templates[i]);
+
+	l_free(pool);
+}
+
+void *_dbus_message_pool_alloc(struct _dbus_message_pool *pool, size_t size)
+{
+	int class;
+
+	if (!pool)
+		return l_malloc(size);
+
+	class = pool_size_class(size);
+	if (class < 0)
+		return l_malloc(size);
+
+	if (pool->n_free[class]) {
+		pool->reuses++;
+		return pool->free[class][--pool->n_free[class]];
+	}
+
+	pool->allocs++;
+
+	return l_malloc((size_t) 1 << (class + POOL_MIN_SHIFT));
+}
+
+void _dbus_message_pool_free(struct _dbus_message_pool *pool, void *buf,
+				size_t size)
+{
+	int class;
+
+	if (!pool || !buf) {
+		l_free(buf);
+		return;
+	}
+
+	class = pool_size_class(size);
+	if (class < 0 || pool->n_free[class] == POOL_CLASS_DEPTH) {
+		l_free(buf);
+		return;
+	}
+
+	pool->free[class][pool->n_free[class]++] = buf;
+}
+
+void _dbus_message_pool_debug(struct _dbus_message_pool *pool,
+				l_dbus_debug_func_t function, void *user_data)
+{
+	if (!pool)
+		return;
+
+	l_util_debug(function, user_data,
+			"message pool: %u allocs, %u reuses, "
+			"%u reply header hits, %u misses", pool->allocs,
+			pool->reuses, pool->template_hits,
+			pool->template_misses);
+}
+
+static struct l_dbus_message *message_alloc(struct _dbus_message_pool *pool)
+{
+	struct l_dbus_message *message;
+
+	message = _dbus_message_pool_alloc(pool, sizeof(*message));
+	memset(message, 0, sizeof(*message));
+	message->refcount = 1;
+	message->pool = pool_ref(pool);
+
+	return message;
+}
+
+static void message_free(struct l_dbus_message *message)
+{
+	struct _dbus_message_pool *pool = message->pool;
+
+	if (message->header_pooled)
+		_dbus_message_pool_free(pool, message->header,
+						message->header_size);
+	else
+		l_free(message->header);
+
+	if (message->body_pooled)
+		_dbus_message_pool_free(pool, message->body,
+						message->body_size);
+	else
+		l_free(message->body);
+
+	_dbus_message_pool_free(pool, message, sizeof(*message));
+	_dbus_message_pool_unref(pool);
+}
+
 void *_dbus_message_get_header(struct l_dbus_message *msg, size_t *out_size)
 {
 	if (out_size)
@@ -198,14 +382,15 @@ LIB_EXPORT bool l_dbus_message_get_no_autostart(struct l_dbus_message *msg)
 
 }
 
-static struct l_dbus_message *message_new_common(uint8_t type, uint8_t flags,
-						uint8_t version)
+static struct l_dbus_message *message_new_common(
+					struct _dbus_message_pool *pool,
+					uint8_t type, uint8_t flags,
+					uint8_t version)
 {
 	struct l_dbus_message *message;
 	struct dbus_header *hdr;
 
-	message = l_new(struct l_dbus_message, 1);
-	message->refcount = 1;
+	message = message_alloc(pool);
 
 	/*
 	 * We allocate the header with the initial 12 bytes (up to the field
@@ -214,7 +399,13 @@ static struct l_dbus_message *message_new_common(uint8_t type, uint8_t flags,
 	 */
 	message->header_size = version == 1 ? 12 : 16;
 	message->header_end = message->header_size;
-	message->header = l_realloc(NULL, message->header_size);
+
+	if (pool) {
+		message->header = _dbus_message_pool_alloc(pool,
+							message->header_size);
+		message->header_pooled = true;
+	} else
+		message->header = l_realloc(NULL, message->header_size);
 
 	hdr = message->header;
 	hdr->endian = DBUS_NATIVE_ENDIAN;
@@ -225,15 +416,18 @@ static struct l_dbus_message *message_new_common(uint8_t type, uint8_t flags,
 	return message;
 }
 
-struct l_dbus_message *_dbus_message_new_method_call(uint8_t version,
-							const char *destination,
-							const char *path,
-							const char *interface,
-							const char *method)
+static struct l_dbus_message *message_new_method_call(
+					struct _dbus_message_pool *pool,
+					uint8_t version,
+					const char *destination,
+					const char *path,
+					const char *interface,
+					const char *method)
 {
 	struct l_dbus_message *message;
 
-	message = message_new_common(DBUS_MESSAGE_TYPE_METHOD_CALL, 0, version);
+	message = message_new_common(pool, DBUS_MESSAGE_TYPE_METHOD_CALL, 0,
+					version);
 
 	message->destination = l_strdup(destination);
 	message->path = l_strdup(path);
@@ -243,6 +437,16 @@ struct l_dbus_message *_dbus_message_new_method_call(uint8_t version,
 	return message;
 }
 
+struct l_dbus_message *_dbus_message_new_method_call(uint8_t version,
+							const char *destination,
+							const char *path,
+							const char *interface,
+							const char *method)
+{
+	return message_new_method_call(NULL, version, destination, path,
+						interface, method);
+}
+
 LIB_EXPORT struct l_dbus_message *l_dbus_message_new_method_call(
 							struct l_dbus *dbus,
 							const char *destination,
@@ -257,18 +461,19 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_new_method_call(
 
 	version = _dbus_get_version(dbus);
 
-	return _dbus_message_new_method_call(version, destination, path,
-						interface, method);
+	return message_new_method_call(_dbus_get_message_pool(dbus), version,
+					destination, path, interface, method);
 }
 
-struct l_dbus_message *_dbus_message_new_signal(uint8_t version,
-						const char *path,
-						const char *interface,
-						const char *name)
+static struct l_dbus_message *message_new_signal(
+					struct _dbus_message_pool *pool,
+					uint8_t version, const char *path,
+					const char *interface,
+					const char *name)
 {
 	struct l_dbus_message *message;
 
-	message = message_new_common(DBUS_MESSAGE_TYPE_SIGNAL,
+	message = message_new_common(pool, DBUS_MESSAGE_TYPE_SIGNAL,
 					DBUS_MESSAGE_FLAG_NO_REPLY_EXPECTED,
 					version);
 
@@ -279,6 +484,14 @@ struct l_dbus_message *_dbus_message_new_signal(uint8_t version,
 	return message;
 }
 
+struct l_dbus_message *_dbus_message_new_signal(uint8_t version,
+						const char *path,
+						const char *interface,
+						const char *name)
+{
+	return message_new_signal(NULL, version, path, interface, name);
+}
+
 LIB_EXPORT struct l_dbus_message *l_dbus_message_new_signal(struct l_dbus *dbus,
 							const char *path,
 							const char *interface,
@@ -291,7 +504,8 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_new_signal(struct l_dbus *dbus,
 
 	version = _dbus_get_version(dbus);
 
-	return _dbus_message_new_signal(version, path, interface, name);
+	return message_new_signal(_dbus_get_message_pool(dbus), version,
+					path, interface, name);
 }
 
 LIB_EXPORT struct l_dbus_message *l_dbus_message_new_method_return(
@@ -301,7 +515,8 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_new_method_return(
 	struct dbus_header *hdr = method_call->header;
 	const char *sender;
 
-	message = message_new_common(DBUS_MESSAGE_TYPE_METHOD_RETURN,
+	message = message_new_common(method_call->pool,
+					DBUS_MESSAGE_TYPE_METHOD_RETURN,
 					DBUS_MESSAGE_FLAG_NO_REPLY_EXPECTED,
 					hdr->version);
 
@@ -315,18 +530,20 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_new_method_return(
 	return message;
 }
 
-struct l_dbus_message *_dbus_message_new_error(uint8_t version,
-						uint32_t reply_serial,
-						const char *destination,
-						const char *name,
-						const char *error)
+static struct l_dbus_message *message_new_error(
+					struct _dbus_message_pool *pool,
+					uint8_t version,
+					uint32_t reply_serial,
+					const char *destination,
+					const char *name,
+					const char *error)
 {
 	struct l_dbus_message *reply;
 
 	if (!_dbus_valid_interface(name))
 		return NULL;
 
-	reply = message_new_common(DBUS_MESSAGE_TYPE_ERROR,
+	reply = message_new_common(pool, DBUS_MESSAGE_TYPE_ERROR,
 					DBUS_MESSAGE_FLAG_NO_REPLY_EXPECTED,
 					version);
 
@@ -342,6 +559,16 @@ struct l_dbus_message *_dbus_message_new_error(uint8_t version,
 	return reply;
 }
 
+struct l_dbus_message *_dbus_message_new_error(uint8_t version,
+						uint32_t reply_serial,
+						const char *destination,
+						const char *name,
+						const char *error)
+{
+	return message_new_error(NULL, version, reply_serial, destination,
+					name, error);
+}
+
 LIB_EXPORT struct l_dbus_message *l_dbus_message_new_error_valist(
 					struct l_dbus_message *method_call,
 					const char *name,
@@ -356,7 +583,8 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_new_error_valist(
 	if (!l_dbus_message_get_no_reply(method_call))
 		reply_serial = _dbus_message_get_serial(method_call);
 
-	return _dbus_message_new_error(hdr->version, reply_serial,
+	return message_new_error(method_call->pool, hdr->version,
+					reply_serial,
 					l_dbus_message_get_sender(method_call),
 					name, str);
 }
@@ -412,9 +640,56 @@ LIB_EXPORT void l_dbus_message_unref(struct l_dbus_message *message)
 	if (message->signature_free)
 		l_free(message->signature);
 
-	l_free(message->header);
-	l_free(message->body);
-	l_free(message);
+	_dbus_signature_info_unref(message->sig_info);
+	message_free(message);
+}
+
+/*
+ * Returns the compiled type information for the @len signature characters
+ * starting at @sig if they are part of the body signature of @message,
+ * compiling the signature on first use.  Returns NULL otherwise, e.g. for
+ * variant contents or header signatures.
+ */
+const struct dbus_type_info *_dbus_message_get_type_info(
+					struct l_dbus_message *message,
+					const char *sig, size_t len)
+{
+	size_t offset;
+
+	if (!message || !message->sealed || !message->signature)
+		return NULL;
+
+	if ((uintptr_t) sig < (uintptr_t) message->signature)
+		return NULL;
+
+	offset = sig - message->signature;
+
+	if (!message->sig_info) {
+		if (offset + len > strlen(message->signature))
+			return NULL;
+
+		message->sig_info = _dbus_signature_compile(message->signature);
+		if (!message->sig_info)
+			return NULL;
+	}
+
+	if (offset + len > message->sig_info->len)
+		return NULL;
+
+	return message->sig_info->types + offset;
+}
+
+/*
+ * Lets a message reuse type information compiled ahead of time for a
+ * matching signature, e.g. the in-signature of a registered method.
+ */
+void _dbus_message_set_signature_info(struct l_dbus_message *message,
+					struct dbus_signature_info *info)
+{
+	if (message->sig_info || !info)
+		return;
+
+	message->sig_info = _dbus_signature_info_ref(info);
 }
 
 const char *_dbus_message_get_nth_string_argument(
@@ -465,13 +740,33 @@ const char *_dbus_message_get_nth_string_argument(
 	return value;
 }
 
+/*
+ * Returns a pointer past the complete type starting at @sig, using the
+ * compiled @types for the signature at @base when @sig lies within it.
+ */
+static const char *complete_type_end(const struct dbus_type_info *types,
+					const char *base, size_t len,
+					const char *sig)
+{
+	const char *end;
+
+	if (types && sig >= base && sig < base + len)
+		return sig + types[sig - base].len;
+
+	end = _dbus_signature_end(sig);
+	if (!end)
+		return NULL;
+
+	return end + 1;
+}
+
 static bool message_iter_next_entry_valist(struct l_dbus_message_iter *orig,
 						va_list args)
 {
 	static const char *simple_types = "sogybnqiuxtd";
 	struct l_dbus_message_iter *iter = orig;
 	const char *signature = orig->sig_start + orig->sig_pos;
-	const char *end;
+	const struct dbus_type_info *types;
 	struct l_dbus_message_iter *sub_iter;
 	struct l_dbus_message_iter stack[DBUS_MAX_NESTING];
 	unsigned int indent = 0;
@@ -498,6 +793,9 @@ static bool message_iter_next_entry_valist(struct l_dbus_message_iter *orig,
 		enter_variant = _dbus1_iter_enter_variant;
 	}
 
+	types = _dbus_message_get_type_info(orig->message, orig->sig_start,
+						orig->sig_len);
+
 	while (signature < orig->sig_start + orig->sig_len) {
 		if (strchr(simple_types, *signature)) {
 			arg = va_arg(args, void *);
@@ -559,8 +857,12 @@ static bool message_iter_next_entry_valist(struct l_dbus_message_iter *orig,
 			if (!enter_array(iter, sub_iter))
 				return false;
 
-			end = _dbus_signature_end(signature + 1);
-			signature = end + 1;
+			signature = complete_type_end(types, orig->sig_start,
+							orig->sig_len,
+							signature);
+			if (!signature)
+				return false;
+
 			break;
 		case 'v':
 			sub_iter = va_arg(args, void *);
@@ -685,6 +987,7 @@ unsigned int _dbus_message_unix_fds_from_header(const void *data, size_t size)
 	struct l_dbus_message message;
 	uint32_t unix_fds;
 
+	memset(&message, 0, sizeof(message));
 	message.header = (uint8_t *) data;
 	message.header_size = size;
 	message.body_size = 0;
@@ -795,7 +1098,12 @@ free:
 	return NULL;
 }
 
-struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
+/*
+ * If @pool is given @header and @body must have been allocated from it
+ * with their exact sizes, the message then returns them to the pool.
+ */
+struct l_dbus_message *dbus_message_build(struct _dbus_message_pool *pool,
+						void *header, size_t header_size,
 						void *body, size_t body_size,
 						int fds[], uint32_t num_fds)
 {
@@ -816,13 +1124,14 @@ struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
 	if (unlikely(hdr->version != 1))
 		return NULL;
 
-	message = l_new(struct l_dbus_message, 1);
+	message = message_alloc(pool);
 
-	message->refcount = 1;
 	message->header_size = header_size;
 	message->header = header;
+	message->header_pooled = pool != NULL;
 	message->body_size = body_size;
 	message->body = body;
+	message->body_pooled = pool != NULL;
 	message->sealed = true;
 
 	if (num_fds) {
@@ -830,7 +1139,10 @@ struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
 
 		if (!get_header_field(message, DBUS_MESSAGE_FIELD_UNIX_FDS,
 					'u', &unix_fds)) {
-			l_free(message);
+			/* The buffers remain owned by the caller */
+			message->header = NULL;
+			message->body = NULL;
+			message_free(message);
 			return NULL;
 		}
 
@@ -889,6 +1201,8 @@ done:
 
 struct builder_driver {
 	bool (*append_basic)(struct dbus_builder *, char, const void *);
+	bool (*append_fixed_array)(struct dbus_builder *, char, const void *,
+					uint32_t);
 	bool (*enter_struct)(struct dbus_builder *, const char *);
 	bool (*leave_struct)(struct dbus_builder *);
 	bool (*enter_dict)(struct dbus_builder *, const char *);
@@ -906,6 +1220,7 @@ struct builder_driver {
 
 static struct builder_driver dbus1_driver = {
 	.append_basic = _dbus1_builder_append_basic,
+	.append_fixed_array = _dbus1_builder_append_fixed_array,
 	.enter_struct = _dbus1_builder_enter_struct,
 	.leave_struct = _dbus1_builder_leave_struct,
 	.enter_dict = _dbus1_builder_enter_dict,
@@ -923,6 +1238,7 @@ static struct builder_driver dbus1_driver = {
 
 static struct builder_driver gvariant_driver = {
 	.append_basic = _gvariant_builder_append_basic,
+	.append_fixed_array = _gvariant_builder_append_fixed_array,
 	.enter_struct = _gvariant_builder_enter_struct,
 	.leave_struct = _gvariant_builder_leave_struct,
 	.enter_dict = _gvariant_builder_enter_dict,
@@ -957,6 +1273,127 @@ static void add_field(struct dbus_builder *builder,
 	driver->leave_struct(builder);
 }
 
+/* Returns the offset of the value of @field in a D-Bus 1 header or 0 */
+static size_t find_header_field(const void *header, size_t header_end,
+					uint8_t field)
+{
+	const uint8_t *p = header;
+	size_t pos = DBUS_HEADER_SIZE;
+
+	while (pos < header_end) {
+		uint8_t code;
+		char type;
+
+		pos = align_len(pos, 8);
+		code = p[pos];
+		type = p[pos + 2];
+		pos += 2 + p[pos + 1] + 1;
+
+		switch (type) {
+		case 'u':
+		case 's':
+		case 'o':
+			pos = align_len(pos, 4);
+
+			if (code == field)
+				return pos;
+
+			if (type == 'u')
+				pos += 4;
+			else
+				pos += 4 + l_get_u32(p + pos) + 1;
+
+			break;
+		case 'g':
+			if (code == field)
+				return pos;
+
+			pos += 1 + p[pos] + 1;
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Replies only differ from earlier replies to the same caller by their
+ * reply serial and body length, so their headers are cached per pool.
+ */
+static bool reply_header_cacheable(struct l_dbus_message *message)
+{
+	struct dbus_header *hdr = message->header;
+
+	if (!message->pool || _dbus_message_is_gvariant(message))
+		return false;
+
+	if (hdr->message_type != DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+			hdr->message_type != DBUS_MESSAGE_TYPE_ERROR)
+		return false;
+
+	return message->reply_serial && !message->path && !message->member &&
+		!message->interface && !message->sender && !message->num_fds;
+}
+
+static struct reply_template *reply_template_find(
+					struct l_dbus_message *message,
+					const char *signature)
+{
+	struct _dbus_message_pool *pool = message->pool;
+	struct dbus_header *hdr = message->header;
+	unsigned int i;
+
+	for (i = 0; i < POOL_N_TEMPLATES; i++) {
+		struct reply_template *t = &pool->templates[i];
+
+		if (!t->header || t->type != hdr->message_type ||
+				t->flags != hdr->flags)
+			continue;
+
+		if (!l_streq0(t->destination, message->destination) ||
+				!l_streq0(t->error_name, message->error_name) ||
+				strcmp(t->signature, signature))
+			continue;
+
+		return t;
+	}
+
+	return NULL;
+}
+
+static void build_header_from_template(struct l_dbus_message *message,
+					const struct reply_template *t)
+{
+	struct _dbus_message_pool *pool = message->pool;
+	struct dbus_header *hdr;
+
+	if (message->header_pooled)
+		_dbus_message_pool_free(pool, message->header,
+						message->header_size);
+	else
+		l_free(message->header);
+
+	message->header = _dbus_message_pool_alloc(pool, t->header_size);
+	message->header_pooled = true;
+	message->header_size = t->header_size;
+	message->header_end = t->header_end;
+	memcpy(message->header, t->header, t->header_size);
+
+	memcpy(message->header + t->reply_serial_offset,
+			&message->reply_serial, sizeof(uint32_t));
+	message->reply_serial = 0;
+
+	hdr = message->header;
+	hdr->dbus1.body_length = message->body_size;
+
+	l_free(message->destination);
+	message->destination = NULL;
+	l_free(message->error_name);
+	message->error_name = NULL;
+}
+
 static void build_header(struct l_dbus_message *message, const char *signature)
 {
 	struct dbus_builder *builder;
@@ -964,6 +1401,7 @@ static void build_header(struct l_dbus_message *message, const char *signature)
 	char *generated_signature;
 	size_t header_size;
 	bool gvariant;
+	struct reply_template *t = NULL;
 
 	gvariant = _dbus_message_is_gvariant(message);
 
@@ -972,6 +1410,38 @@ static void build_header(struct l_dbus_message *message, const char *signature)
 	else
 		driver = &dbus1_driver;
 
+	if (reply_header_cacheable(message)) {
+		struct _dbus_message_pool *pool = message->pool;
+		struct dbus_header *hdr = message->header;
+
+		t = reply_template_find(message, signature);
+		if (t) {
+			pool->template_hits++;
+			build_header_from_template(message, t);
+			return;
+		}
+
+		pool->template_misses++;
+
+		t = &pool->templates[pool->next_template++ % POOL_N_TEMPLATES];
+		reply_template_clear(t);
+		t->type = hdr->message_type;
+		t->flags = hdr->flags;
+		t->destination = l_strdup(message->destination);
+		t->error_name = l_strdup(message->error_name);
+		t->signature = l_strdup(signature);
+	}
+
+	/* The builder grows the header with realloc, take it off the pool */
+	if (message->header_pooled) {
+		void *header = l_memdup(message->header, message->header_size);
+
+		_dbus_message_pool_free(message->pool, message->header,
+						message->header_size);
+		message->header = header;
+		message->header_pooled = false;
+	}
+
 	builder = driver->new(message->header, message->header_size);
 
 	driver->enter_array(builder, gvariant ? "(tv)" : "(yv)");
@@ -1062,6 +1532,21 @@ static void build_header(struct l_dbus_message *message, const char *signature)
 	memset(message->header + header_size, 0,
 			message->header_size - header_size);
 	message->header_end = header_size;
+
+	if (!t)
+		return;
+
+	t->reply_serial_offset = find_header_field(message->header,
+					message->header_end,
+					DBUS_MESSAGE_FIELD_REPLY_SERIAL);
+	if (!t->reply_serial_offset) {
+		reply_template_clear(t);
+		return;
+	}
+
+	t->header = l_memdup(message->header, message->header_size);
+	t->header_size = message->header_size;
+	t->header_end = message->header_end;
 }
 
 struct container {
@@ -1228,6 +1713,46 @@ LIB_EXPORT bool l_dbus_message_set_arguments_valist(
 	return result;
 }
 
+/**
+ * l_dbus_message_set_fixed_array:
+ * @message: message to receive the arguments
+ * @type: element type, one of "ynqiuxtd"
+ * @data: array of @n_elem elements in native byte order
+ * @n_elem: number of elements
+ *
+ * Set the body of @message to a single array of fixed size elements,
+ * equivalent to l_dbus_message_set_arguments with signature "a@type" but
+ * without passing each element separately.
+ *
+ * Returns: whether the arguments were set
+ **/
+LIB_EXPORT bool l_dbus_message_set_fixed_array(struct l_dbus_message *message,
+						char type, const void *data,
+						uint32_t n_elem)
+{
+	struct l_dbus_message_builder *builder;
+	bool ret;
+
+	if (unlikely(!message))
+		return false;
+
+	if (unlikely(message->sealed))
+		return false;
+
+	builder = l_dbus_message_builder_new(message);
+	if (!builder)
+		return false;
+
+	ret = l_dbus_message_builder_append_fixed_array(builder, type,
+							data, n_elem);
+	if (ret)
+		l_dbus_message_builder_finalize(builder);
+
+	l_dbus_message_builder_destroy(builder);
+
+	return ret;
+}
+
 LIB_EXPORT const char *l_dbus_message_get_path(struct l_dbus_message *message)
 {
 	if (unlikely(!message))
@@ -1480,6 +2005,45 @@ LIB_EXPORT bool l_dbus_message_builder_append_basic(
 	return builder->driver->append_basic(builder->builder, type, value);
 }
 
+/**
+ * l_dbus_message_builder_append_fixed_array:
+ * @builder: message builder to receive a new value
+ * @type: element type, one of "ynqiuxtd"
+ * @data: array of @n_elem elements in native byte order
+ * @n_elem: number of elements
+ *
+ * Append a complete array of fixed size elements with signature "a@type"
+ * in one step instead of appending every element individually.
+ *
+ * Returns: whether the array was appended
+ **/
+LIB_EXPORT bool l_dbus_message_builder_append_fixed_array(
+					struct l_dbus_message_builder *builder,
+					char type, const void *data,
+					uint32_t n_elem)
+{
+	char signature[2] = { type, '\0' };
+
+	if (unlikely(!builder))
+		return false;
+
+	if (unlikely(!data && n_elem))
+		return false;
+
+	/* Check the type first to not leave an unterminated array behind */
+	if (!type || !strchr("ynqiuxtd", type))
+		return false;
+
+	if (!builder->driver->enter_array(builder->builder, signature))
+		return false;
+
+	if (!builder->driver->append_fixed_array(builder->builder, type,
+							data, n_elem))
+		return false;
+
+	return builder->driver->leave_array(builder->builder);
+}
+
 LIB_EXPORT bool l_dbus_message_builder_enter_container(
 					struct l_dbus_message_builder *builder,
 					char container_type,
@@ -1722,6 +2286,9 @@ LIB_EXPORT bool l_dbus_message_builder_append_from_valist(
 	struct builder_driver *driver;
 	char subsig[256];
 	const char *sigend;
+	size_t sig_len;
+	struct dbus_type_info buf[255];
+	const struct dbus_type_info *types;
 	/* Nesting requires an extra stack entry for the base level */
 	struct container stack[DBUS_MAX_NESTING + 1];
 	unsigned int stack_index = 0;
@@ -1731,9 +2298,18 @@ LIB_EXPORT bool l_dbus_message_builder_append_from_valist(
 
 	driver = builder->driver;
 
+	/*
+	 * Look up the compiled signature once up front so that container
+	 * boundaries do not need to be rediscovered each time one is entered
+	 */
+	sig_len = strlen(signature);
+	types = _dbus_signature_get_types(signature, sig_len, buf);
+	if (!types)
+		return false;
+
 	stack[stack_index].type = DBUS_CONTAINER_TYPE_STRUCT;
 	stack[stack_index].sig_start = signature;
-	stack[stack_index].sig_end = signature + strlen(signature);
+	stack[stack_index].sig_end = signature + sig_len;
 	stack[stack_index].n_items = 0;
 
 	while (stack_index != 0 || stack[0].sig_start != stack[0].sig_end) {
@@ -1863,7 +2439,12 @@ LIB_EXPORT bool l_dbus_message_builder_append_from_valist(
 			if (stack_index == DBUS_MAX_NESTING)
 				return false;
 
-			sigend = _dbus_signature_end(s);
+			sigend = complete_type_end(types, signature, sig_len, s);
+			if (!sigend)
+				return false;
+
+			/* Point at the closing parenthesis or brace */
+			sigend -= 1;
 			memcpy(subsig, s + 1, sigend - s - 1);
 			subsig[sigend - s - 1] = '\0';
 
@@ -1911,7 +2492,10 @@ LIB_EXPORT bool l_dbus_message_builder_append_from_valist(
 			if (stack_index == DBUS_MAX_NESTING)
 				return false;
 
-			sigend = _dbus_signature_end(s + 1) + 1;
+			sigend = complete_type_end(types, signature, sig_len, s);
+			if (!sigend)
+				return false;
+
 			memcpy(subsig, s + 1, sigend - s - 1);
 			subsig[sigend - s - 1] = '\0';
 
@@ -1957,6 +2541,44 @@ LIB_EXPORT struct l_dbus_message *l_dbus_message_builder_finalize(
 	return builder->message;
 }
 
+/*
+ * Build a method return to @method_call carrying a copy of the already
+ * serialized body of @reply, e.g. a cached reply to an earlier call.
+ */
+struct l_dbus_message *_dbus_message_new_method_return_copy(
+					struct l_dbus_message *method_call,
+					struct l_dbus_message *reply)
+{
+	struct l_dbus_message *message;
+	const char *signature = reply->signature ?: "";
+	size_t size = reply->body_size;
+
+	if (unlikely(reply->num_fds))
+		return NULL;
+
+	message = l_dbus_message_new_method_return(method_call);
+
+	if (_dbus_message_get_version(message) !=
+			_dbus_message_get_version(reply)) {
+		l_dbus_message_unref(message);
+		return NULL;
+	}
+
+	/* GVariant bodies are followed by the signature footer */
+	if (_dbus_message_is_gvariant(reply))
+		size += 3 + strlen(signature) + 8;
+
+	message->body = l_memdup(reply->body, size);
+	message->body_size = reply->body_size;
+
+	build_header(message, signature);
+	message->sealed = true;
+	message->signature = l_strdup(signature);
+	message->signature_free = true;
+
+	return message;
+}
+
 bool _dbus_message_builder_mark(struct l_dbus_message_builder *builder)
 {
 	if (unlikely(!builder))
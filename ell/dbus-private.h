@@ -45,6 +45,26 @@ struct dbus_header {
 } __attribute__ ((packed));
 #define DBUS_HEADER_SIZE 16
 
+/*
+ * Compiled form of a signature: one entry per signature character, so the
+ * entry for any complete type can be found by its offset in the string.
+ * Only entries that start a complete type are meaningful, closing
+ * parentheses and braces get a dummy entry.
+ */
+struct dbus_type_info {
+	char type;
+	uint8_t len;			/* Length of the complete type */
+	uint8_t alignment;		/* D-Bus 1 alignment */
+	uint8_t gvariant_alignment;
+	uint16_t gvariant_size;		/* 0 if not fixed size */
+};
+
+struct dbus_signature_info {
+	int refcount;
+	uint8_t len;
+	struct dbus_type_info types[];
+};
+
 struct dbus_builder;
 struct l_string;
 struct l_dbus_interface;
@@ -54,6 +74,7 @@ struct _dbus_property;
 struct l_dbus_message_iter;
 struct l_dbus_message;
 struct l_dbus;
+struct _dbus_message_pool;
 struct _dbus_filter;
 struct _dbus_filter_condition;
 struct _dbus_filter_ops;
@@ -78,6 +99,9 @@ struct dbus_builder *_dbus1_builder_new(void *body, size_t body_size);
 void _dbus1_builder_free(struct dbus_builder *builder);
 bool _dbus1_builder_append_basic(struct dbus_builder *builder,
 					char type, const void *value);
+bool _dbus1_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data,
+					uint32_t n_elem);
 bool _dbus1_builder_enter_struct(struct dbus_builder *builder,
 					const char *signature);
 bool _dbus1_builder_leave_struct(struct dbus_builder *builder);
@@ -124,6 +148,9 @@ struct l_dbus_message *_dbus_message_new_signal(uint8_t version,
 						const char *path,
 						const char *interface,
 						const char *name);
+struct l_dbus_message *_dbus_message_new_method_return_copy(
+					struct l_dbus_message *method_call,
+					struct l_dbus_message *reply);
 struct l_dbus_message *_dbus_message_new_error(uint8_t version,
 						uint32_t reply_serial,
 						const char *destination,
@@ -132,7 +159,8 @@ struct l_dbus_message *_dbus_message_new_error(uint8_t version,
 
 struct l_dbus_message *dbus_message_from_blob(const void *data, size_t size,
 						int fds[], uint32_t num_fds);
-struct l_dbus_message *dbus_message_build(void *header, size_t header_size,
+struct l_dbus_message *dbus_message_build(struct _dbus_message_pool *pool,
+						void *header, size_t header_size,
 						void *body, size_t body_size,
 						int fds[], uint32_t num_fds);
 bool dbus_message_compare(struct l_dbus_message *message,
@@ -141,9 +169,32 @@ bool dbus_message_compare(struct l_dbus_message *message,
 bool _dbus_message_builder_mark(struct l_dbus_message_builder *builder);
 bool _dbus_message_builder_rewind(struct l_dbus_message_builder *builder);
 
+struct _dbus_message_pool *_dbus_message_pool_new(void);
+void _dbus_message_pool_unref(struct _dbus_message_pool *pool);
+void *_dbus_message_pool_alloc(struct _dbus_message_pool *pool, size_t size);
+void _dbus_message_pool_free(struct _dbus_message_pool *pool, void *buf,
+				size_t size);
+void _dbus_message_pool_debug(struct _dbus_message_pool *pool,
+				l_dbus_debug_func_t function, void *user_data);
+
+const struct dbus_type_info *_dbus_message_get_type_info(
+					struct l_dbus_message *message,
+					const char *sig, size_t len);
+void _dbus_message_set_signature_info(struct l_dbus_message *message,
+					struct dbus_signature_info *info);
+
 unsigned int _dbus_message_unix_fds_from_header(const void *data, size_t size);
 
 const char *_dbus_signature_end(const char *signature);
+bool _dbus_signature_compile_types(const char *sig, size_t len,
+					struct dbus_type_info *types);
+const struct dbus_type_info *_dbus_signature_get_types(const char *sig,
+						size_t len,
+						struct dbus_type_info *buf);
+struct dbus_signature_info *_dbus_signature_compile(const char *sig);
+struct dbus_signature_info *_dbus_signature_info_ref(
+					struct dbus_signature_info *info);
+void _dbus_signature_info_unref(struct dbus_signature_info *info);
 
 bool _dbus_valid_object_path(const char *path);
 bool _dbus_valid_signature(const char *sig);
@@ -218,6 +269,8 @@ struct l_dbus_message *_dbus_object_tree_get_objects(
 					struct l_dbus *dbus,
 					const char *path,
 					struct l_dbus_message *message);
+bool _dbus_object_tree_set_objects_cache(struct _dbus_object_tree *tree,
+						const char *path, bool enable);
 
 bool _dbus_object_tree_property_changed(struct l_dbus *dbus,
 					const char *path,
@@ -232,6 +285,7 @@ typedef void (*_dbus_name_owner_change_func_t)(const char *name,
 						void *user_data);
 
 uint8_t _dbus_get_version(struct l_dbus *dbus);
+struct _dbus_message_pool *_dbus_get_message_pool(struct l_dbus *dbus);
 int _dbus_get_fd(struct l_dbus *dbus);
 struct _dbus_object_tree *_dbus_get_tree(struct l_dbus *dbus);
 
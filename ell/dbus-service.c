@@ -36,6 +36,7 @@ static const char *static_introspectable =
 
 struct _dbus_method {
 	l_dbus_interface_method_cb_t cb;
+	struct dbus_signature_info *param_info;
 	uint32_t flags;
 	unsigned char name_len;
 	char metainfo[];
@@ -61,6 +62,7 @@ struct l_dbus_interface {
 	struct l_queue *properties;
 	bool handle_old_style_properties;
 	void (*instance_destroy)(void *);
+	char *introspection;
 	char name[];
 };
 
@@ -88,6 +90,9 @@ struct object_manager {
 	struct l_dbus *dbus;
 	struct l_queue *announce_added;
 	struct l_queue *announce_removed;
+	bool cache_objects;
+	unsigned int generation;
+	struct l_dbus_message *objects_reply;
 };
 
 struct interface_add_record {
@@ -231,6 +236,11 @@ void _dbus_property_introspection(struct _dbus_property *info,
 void _dbus_interface_introspection(struct l_dbus_interface *interface,
 						struct l_string *buf)
 {
+	if (interface->introspection) {
+		l_string_append(buf, interface->introspection);
+		return;
+	}
+
 	l_string_append_printf(buf, "\t<interface name=\"%s\">\n",
 				interface->name);
 
@@ -312,6 +322,10 @@ LIB_EXPORT bool l_dbus_interface_method(struct l_dbus_interface *interface,
 					param_info_len + strlen(name) + 1);
 	info->cb = cb;
 	info->flags = flags;
+
+	/* Compiled once here so dispatched calls can share the result */
+	info->param_info = param_sig[0] ? _dbus_signature_compile(param_sig) :
+									NULL;
 	info->name_len = strlen(name);
 	strcpy(info->metainfo, name);
 
@@ -423,18 +437,28 @@ struct l_dbus_interface *_dbus_interface_new(const char *name)
 	interface->methods = l_queue_new();
 	interface->signals = l_queue_new();
 	interface->properties = l_queue_new();
+	interface->introspection = NULL;
 
 	strcpy(interface->name, name);
 
 	return interface;
 }
 
+static void method_free(void *data)
+{
+	struct _dbus_method *method = data;
+
+	_dbus_signature_info_unref(method->param_info);
+	l_free(method);
+}
+
 void _dbus_interface_free(struct l_dbus_interface *interface)
 {
-	l_queue_destroy(interface->methods, l_free);
+	l_queue_destroy(interface->methods, method_free);
 	l_queue_destroy(interface->signals, l_free);
 	l_queue_destroy(interface->properties, l_free);
 
+	l_free(interface->introspection);
 	l_free(interface);
 }
 
@@ -605,9 +629,47 @@ static void object_manager_free(void *data)
 	l_queue_destroy(manager->announce_added, interface_add_record_free);
 	l_queue_destroy(manager->announce_removed,
 						interface_removed_record_free);
+	l_dbus_message_unref(manager->objects_reply);
 	l_free(manager);
 }
 
+static bool object_manager_covers(const struct object_manager *manager,
+					const char *path)
+{
+	size_t path_len = strlen(manager->path);
+
+	if (strncmp(path, manager->path, path_len))
+		return false;
+
+	return path[path_len] == '\0' || path[path_len] == '/' ||
+		path_len == 1;
+}
+
+/*
+ * Drop the cached GetManagedObjects reply of every object manager whose
+ * subtree contains @path.  The generation counter also catches changes
+ * made by property getters while a reply is being generated.
+ */
+static void invalidate_managed_objects(struct _dbus_object_tree *tree,
+					const char *path)
+{
+	const struct l_queue_entry *entry;
+	struct object_manager *manager;
+
+	for (entry = l_queue_get_entries(tree->object_managers); entry;
+			entry = entry->next) {
+		manager = entry->data;
+
+		if (!object_manager_covers(manager, path))
+			continue;
+
+		manager->generation += 1;
+
+		l_dbus_message_unref(manager->objects_reply);
+		manager->objects_reply = NULL;
+	}
+}
+
 void _dbus_object_tree_free(struct _dbus_object_tree *tree)
 {
 	subtree_free(tree->root);
@@ -1191,6 +1253,8 @@ bool _dbus_object_tree_property_changed(struct l_dbus *dbus,
 	if (!property)
 		return false;
 
+	invalidate_managed_objects(tree, path);
+
 	rec = l_queue_find(tree->property_changes,
 				match_property_changes_instance, instance);
 
@@ -1359,6 +1423,7 @@ bool _dbus_object_tree_register_interface(struct _dbus_object_tree *tree,
 				bool old_style_properties)
 {
 	struct l_dbus_interface *dbi;
+	struct l_string *buf;
 
 	if (!_dbus_valid_interface(interface))
 		return false;
@@ -1390,6 +1455,11 @@ bool _dbus_object_tree_register_interface(struct _dbus_object_tree *tree,
 
 	setup_func(dbi);
 
+	/* The interface is immutable from here on, cache its XML fragment */
+	buf = l_string_new(512);
+	_dbus_interface_introspection(dbi, buf);
+	dbi->introspection = l_string_unwrap(buf);
+
 	l_hashmap_insert(tree->interfaces, dbi->name, dbi);
 
 	return true;
@@ -1493,7 +1563,6 @@ bool _dbus_object_tree_add_interface(struct _dbus_object_tree *tree,
 	struct interface_instance *instance;
 	const struct l_queue_entry *entry;
 	struct object_manager *manager;
-	size_t path_len;
 	struct interface_add_record *change_rec;
 
 	dbi = l_hashmap_lookup(tree->interfaces, interface);
@@ -1521,14 +1590,13 @@ bool _dbus_object_tree_add_interface(struct _dbus_object_tree *tree,
 
 	l_queue_push_tail(object->instances, instance);
 
+	invalidate_managed_objects(tree, path);
+
 	for (entry = l_queue_get_entries(tree->object_managers); entry;
 			entry = entry->next) {
 		manager = entry->data;
-		path_len = strlen(manager->path);
 
-		if (strncmp(path, manager->path, path_len) ||
-				(path[path_len] != '\0' &&
-				 path[path_len] != '/' && path_len > 1))
+		if (!object_manager_covers(manager, path))
 			continue;
 
 		change_rec = l_queue_find(manager->announce_added,
@@ -1601,7 +1669,6 @@ bool _dbus_object_tree_remove_interface(struct _dbus_object_tree *tree,
 	struct interface_instance *instance;
 	const struct l_queue_entry *entry;
 	struct object_manager *manager;
-	size_t path_len;
 	struct interface_add_record *interfaces_added_rec;
 	struct interface_remove_record *interfaces_removed_rec;
 	struct property_change_record *property_change_rec;
@@ -1624,14 +1691,13 @@ bool _dbus_object_tree_remove_interface(struct _dbus_object_tree *tree,
 			object_manager_free(manager);
 	}
 
+	invalidate_managed_objects(tree, path);
+
 	for (entry = l_queue_get_entries(tree->object_managers); entry;
 			entry = entry->next) {
 		manager = entry->data;
-		path_len = strlen(manager->path);
 
-		if (strncmp(path, manager->path, path_len) ||
-				(path[path_len] != '\0' &&
-				 path[path_len] != '/' && path_len > 1))
+		if (!object_manager_covers(manager, path))
 			continue;
 
 		interfaces_added_rec = l_queue_find(manager->announce_added,
@@ -1797,6 +1863,8 @@ bool _dbus_object_tree_dispatch(struct _dbus_object_tree *tree,
 	if (strcmp(msg_sig, sig))
 		return false;
 
+	_dbus_message_set_signature_info(message, method->param_info);
+
 	reply = method->cb(dbus, message, instance->user_data);
 	if (reply)
 		l_dbus_send(dbus, reply);
@@ -2084,6 +2152,24 @@ struct l_dbus_message *_dbus_object_tree_get_objects(
 	const struct object_node *node;
 	struct l_dbus_message *reply;
 	struct l_dbus_message_builder *builder;
+	struct object_manager *manager;
+	unsigned int generation = 0;
+
+	manager = l_queue_find(tree->object_managers,
+				match_object_manager_path, path);
+	if (manager && !manager->cache_objects)
+		manager = NULL;
+
+	if (manager) {
+		if (manager->objects_reply) {
+			reply = _dbus_message_new_method_return_copy(message,
+							manager->objects_reply);
+			if (reply)
+				return reply;
+		}
+
+		generation = manager->generation;
+	}
 
 	node = l_hashmap_lookup(tree->objects, path);
 
@@ -2108,9 +2194,39 @@ struct l_dbus_message *_dbus_object_tree_get_objects(
 	l_dbus_message_builder_finalize(builder);
 	l_dbus_message_builder_destroy(builder);
 
+	/*
+	 * With caching enabled, property values are promised to only change
+	 * along with a l_dbus_property_changed call, which invalidates the
+	 * cached reply, and to not depend on the caller
+	 */
+	if (manager && manager->generation == generation) {
+		l_dbus_message_unref(manager->objects_reply);
+		manager->objects_reply = l_dbus_message_ref(reply);
+	}
+
 	return reply;
 }
 
+bool _dbus_object_tree_set_objects_cache(struct _dbus_object_tree *tree,
+						const char *path, bool enable)
+{
+	struct object_manager *manager;
+
+	manager = l_queue_find(tree->object_managers,
+				match_object_manager_path, path);
+	if (!manager)
+		return false;
+
+	manager->cache_objects = enable;
+
+	if (!enable) {
+		l_dbus_message_unref(manager->objects_reply);
+		manager->objects_reply = NULL;
+	}
+
+	return true;
+}
+
 static struct l_dbus_message *get_managed_objects(struct l_dbus *dbus,
 						struct l_dbus_message *message,
 						void *user_data)
@@ -408,6 +408,294 @@ const char *_dbus_signature_end(const char *signature)
 	return NULL;
 }
 
+static const char *compile_next_type(const char *sig, const char *end,
+					struct dbus_type_info *info)
+{
+	const char *p = sig + 1;
+	struct dbus_type_info *child;
+	unsigned int n_children = 0;
+	unsigned int size = 0;
+	bool fixed = true;
+	char close;
+
+	if (sig >= end)
+		return NULL;
+
+	info->type = *sig;
+	info->alignment = get_alignment(*sig);
+
+	switch (*sig) {
+	case 'b':
+		/* GVariant booleans are a single byte, unlike D-Bus 1 */
+		info->gvariant_alignment = 1;
+		info->gvariant_size = 1;
+		break;
+	case 'y':
+	case 'n':
+	case 'q':
+	case 'i':
+	case 'u':
+	case 'x':
+	case 't':
+	case 'd':
+	case 'h':
+		info->gvariant_alignment = get_basic_size(*sig);
+		info->gvariant_size = info->gvariant_alignment;
+		break;
+	case 's':
+	case 'o':
+	case 'g':
+		info->gvariant_alignment = 1;
+		info->gvariant_size = 0;
+		break;
+	case 'v':
+		info->gvariant_alignment = 8;
+		info->gvariant_size = 0;
+		break;
+	case 'a':
+		p = compile_next_type(p, end, info + 1);
+		if (!p)
+			return NULL;
+
+		info->gvariant_alignment = info[1].gvariant_alignment;
+		info->gvariant_size = 0;
+		break;
+	case '(':
+	case '{':
+		close = *sig == '(' ? ')' : '}';
+
+		/* Dictionary keys can only be simple types */
+		if (*sig == '{' && (p >= end || !strchr(simple_types, *p)))
+			return NULL;
+
+		info->gvariant_alignment = 1;
+
+		while (p < end && *p != close) {
+			child = info + (p - sig);
+
+			p = compile_next_type(p, end, child);
+			if (!p)
+				return NULL;
+
+			n_children += 1;
+
+			if (child->gvariant_alignment >
+					info->gvariant_alignment)
+				info->gvariant_alignment =
+					child->gvariant_alignment;
+
+			if (!child->gvariant_size)
+				fixed = false;
+			else
+				size = align_len(size,
+						child->gvariant_alignment) +
+					child->gvariant_size;
+		}
+
+		if (p >= end)
+			return NULL;
+
+		if (*sig == '{' && n_children != 2)
+			return NULL;
+
+		child = info + (p - sig);
+		child->type = close;
+		child->len = 1;
+		child->alignment = 1;
+		child->gvariant_alignment = 1;
+		child->gvariant_size = 0;
+		p += 1;
+
+		/* Handle special case of unit type */
+		if (!n_children)
+			info->gvariant_size = 1;
+		else if (fixed)
+			info->gvariant_size = align_len(size,
+						info->gvariant_alignment);
+		else
+			info->gvariant_size = 0;
+
+		break;
+	default:
+		return NULL;
+	}
+
+	info->len = p - sig;
+
+	return p;
+}
+
+/*
+ * Compiles the sequence of complete types in the first @len characters of
+ * @sig into @types, which must have room for @len entries.  This performs
+ * the structural checks only, the caller is expected to validate the
+ * signature according to the rules of the wire format in use.
+ */
+bool _dbus_signature_compile_types(const char *sig, size_t len,
+					struct dbus_type_info *types)
+{
+	const char *end = sig + len;
+	const char *p = sig;
+
+	if (len > 255)
+		return false;
+
+	while (p < end) {
+		p = compile_next_type(p, end, types + (p - sig));
+		if (!p)
+			return false;
+	}
+
+	return true;
+}
+
+struct dbus_signature_info *_dbus_signature_compile(const char *sig)
+{
+	struct dbus_signature_info *info;
+	size_t len = strlen(sig);
+
+	if (len > 255)
+		return NULL;
+
+	info = l_malloc(sizeof(*info) + len * sizeof(struct dbus_type_info));
+	info->refcount = 1;
+	info->len = len;
+
+	if (!_dbus_signature_compile_types(sig, len, info->types)) {
+		l_free(info);
+		return NULL;
+	}
+
+	return info;
+}
+
+/*
+ * Compiled signatures for builders and iterators that have no message
+ * body signature to go by, e.g. l_dbus_message_set_arguments() and
+ * variant contents.  Slots are filled once, published with a
+ * compare-and-swap and never evicted, so entries can be used without
+ * a reference.  Up to four slots are probed per signature.
+ */
+#define SIGNATURE_CACHE_SIZE	64
+#define SIGNATURE_CACHE_PROBES	4
+
+struct signature_cache_entry {
+	size_t len;
+	const char *sig;
+	struct dbus_type_info types[];
+};
+
+static struct signature_cache_entry *signature_cache[SIGNATURE_CACHE_SIZE];
+
+static unsigned int signature_hash(const char *sig, size_t len)
+{
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (uint8_t) sig[i]) * 16777619u;
+
+	return hash;
+}
+
+static bool signature_cache_match(const struct signature_cache_entry *entry,
+					const char *sig, size_t len)
+{
+	return entry->len == len && !memcmp(entry->sig, sig, len);
+}
+
+/*
+ * Returns the compiled types for the first @len characters of @sig.
+ * Signatures that don't find a free slot are compiled into @buf, which
+ * must have room for @len entries.
+ */
+const struct dbus_type_info *_dbus_signature_get_types(const char *sig,
+						size_t len,
+						struct dbus_type_info *buf)
+{
+	unsigned int hash = signature_hash(sig, len);
+	struct signature_cache_entry *entry;
+	struct signature_cache_entry *expected;
+	unsigned int i;
+	unsigned int slot;
+
+	if (len > 255)
+		return NULL;
+
+	for (i = 0; i < SIGNATURE_CACHE_PROBES; i++) {
+		slot = (hash + i) % SIGNATURE_CACHE_SIZE;
+		entry = __atomic_load_n(&signature_cache[slot],
+					__ATOMIC_ACQUIRE);
+
+		if (!entry)
+			break;
+
+		if (signature_cache_match(entry, sig, len))
+			return entry->types;
+	}
+
+	if (i == SIGNATURE_CACHE_PROBES) {
+		if (!_dbus_signature_compile_types(sig, len, buf))
+			return NULL;
+
+		return buf;
+	}
+
+	entry = l_malloc(sizeof(*entry) +
+				len * sizeof(struct dbus_type_info) + len);
+
+	if (!_dbus_signature_compile_types(sig, len, entry->types)) {
+		l_free(entry);
+		return NULL;
+	}
+
+	entry->len = len;
+	entry->sig = memcpy(entry->types + len, sig, len);
+
+	for (; i < SIGNATURE_CACHE_PROBES; i++) {
+		slot = (hash + i) % SIGNATURE_CACHE_SIZE;
+		expected = NULL;
+
+		if (__atomic_compare_exchange_n(&signature_cache[slot],
+						&expected, entry, false,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE))
+			return entry->types;
+
+		/* Lost the race, possibly to the same signature */
+		if (signature_cache_match(expected, sig, len)) {
+			l_free(entry);
+			return expected->types;
+		}
+	}
+
+	memcpy(buf, entry->types, len * sizeof(struct dbus_type_info));
+	l_free(entry);
+	return buf;
+}
+
+struct dbus_signature_info *_dbus_signature_info_ref(
+					struct dbus_signature_info *info)
+{
+	if (unlikely(!info))
+		return NULL;
+
+	__atomic_fetch_add(&info->refcount, 1, __ATOMIC_SEQ_CST);
+
+	return info;
+}
+
+void _dbus_signature_info_unref(struct dbus_signature_info *info)
+{
+	if (unlikely(!info))
+		return;
+
+	if (__atomic_sub_fetch(&info->refcount, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	l_free(info);
+}
+
 bool _dbus1_header_is_valid(void *data, size_t size)
 {
 	struct dbus_header *hdr;
@@ -991,6 +1279,43 @@ bool _dbus1_builder_append_basic(struct dbus_builder *builder,
 	return true;
 }
 
+/*
+ * Append @n_elem elements of fixed size @type to the current array in a
+ * single step.  @data must already be in the wire representation, which
+ * rules out booleans and file descriptors.
+ */
+bool _dbus1_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data,
+					uint32_t n_elem)
+{
+	struct container *container = l_queue_peek_head(builder->containers);
+	size_t start;
+	size_t len;
+
+	if (unlikely(!builder))
+		return false;
+
+	if (unlikely(type == 'b' || type == 'h'))
+		return false;
+
+	len = get_basic_size(type);
+	if (!len)
+		return false;
+
+	if (container->type != DBUS_CONTAINER_TYPE_ARRAY ||
+			container->signature[0] != type ||
+			container->signature[1] != '\0')
+		return false;
+
+	len *= n_elem;
+	start = grow_body(builder, len, get_alignment(type));
+
+	if (len)
+		memcpy(builder->body + start, data, len);
+
+	return true;
+}
+
 static bool enter_struct_dict_common(struct dbus_builder *builder,
 					const char *signature,
 					enum dbus_container_type type,
@@ -24,12 +24,16 @@
 #include "util.h"
 #include "io.h"
 #include "idle.h"
+#include "timeout.h"
+#include "time.h"
 #include "queue.h"
 #include "hashmap.h"
+#include "random.h"
 #include "dbus.h"
 #include "private.h"
 #include "useful.h"
 #include "dbus-private.h"
+#include "pcap-private.h"
 
 #define DEFAULT_SYSTEM_BUS_ADDRESS "unix:path=/var/run/dbus/system_bus_socket"
 
@@ -39,9 +43,21 @@
 
 #define DBUS_MAXIMUM_MATCH_RULE_LENGTH	1024
 
+/*
+ * The timeout is the auth_timeout default of dbus-daemon.  Its 64
+ * max_incomplete_connections would take up half of the file descriptors
+ * the main loop can watch, so fewer clients may authenticate at a time.
+ */
+#define SERVER_AUTH_TIMEOUT_MS		30000
+#define SERVER_MAX_PENDING		16
+
 enum auth_state {
 	WAITING_FOR_OK,
 	WAITING_FOR_AGREE_UNIX_FD,
+	WAITING_FOR_NUL_BYTE,
+	WAITING_FOR_AUTH,
+	WAITING_FOR_DATA,
+	WAITING_FOR_BEGIN,
 	SETUP_DONE
 };
 
@@ -57,6 +73,8 @@ struct l_dbus_ops {
 				bool allow_replacement, bool replace_existing,
 				bool queue, l_dbus_name_acquire_func_t callback,
 				void *user_data);
+	bool (*handle_bus_call)(struct l_dbus *dbus,
+				struct l_dbus_message *message);
 };
 
 struct l_dbus {
@@ -80,10 +98,12 @@ struct l_dbus {
 	l_dbus_debug_func_t debug_handler;
 	l_dbus_destroy_func_t debug_destroy;
 	void *debug_data;
+	struct l_pcap *pcap;
 	struct _dbus_object_tree *tree;
 	struct _dbus_name_cache *name_cache;
 	struct _dbus_filter *filter;
 	bool name_notify_enabled;
+	struct _dbus_message_pool *pool;
 
 	const struct l_dbus_ops *driver;
 };
@@ -95,6 +115,23 @@ struct l_dbus_classic {
 	struct l_hashmap *match_strings;
 	int *fd_buf;
 	unsigned int num_fds;
+	struct l_dbus_server *server;
+	uint64_t auth_deadline;
+	char *peer_name;
+};
+
+struct l_dbus_server {
+	struct l_io *io;
+	char *guid;
+	char *path;
+	struct l_queue *pending;
+	struct l_timeout *auth_timer;
+	unsigned int auth_timeout;
+	unsigned int max_pending;
+	unsigned int next_peer_id;
+	l_dbus_server_connect_func_t connect_handler;
+	l_dbus_destroy_func_t connect_destroy;
+	void *connect_data;
 };
 
 struct message_callback {
@@ -139,13 +176,29 @@ static void signal_list_destroy(void *value)
 	l_free(callback);
 }
 
+static void trace_message(struct l_dbus *dbus, bool in,
+				struct l_dbus_message *message)
+{
+	const void *header, *body;
+	size_t header_size, body_size;
+
+	header = _dbus_message_get_header(message, &header_size);
+	body = _dbus_message_get_body(message, &body_size);
+
+	if (dbus->debug_handler)
+		l_util_hexdump_two(in, header, header_size, body, body_size,
+					dbus->debug_handler, dbus->debug_data);
+
+	if (dbus->pcap)
+		pcap_write_dbus(dbus->pcap, header, header_size,
+					body, body_size);
+}
+
 static bool message_write_handler(struct l_io *io, void *user_data)
 {
 	struct l_dbus *dbus = user_data;
 	struct l_dbus_message *message;
 	struct message_callback *callback;
-	const void *header, *body;
-	size_t header_size, body_size;
 
 	callback = l_queue_pop_head(dbus->message_queue);
 	if (!callback)
@@ -163,10 +216,8 @@ static bool message_write_handler(struct l_io *io, void *user_data)
 		return false;
 	}
 
-	header = _dbus_message_get_header(message, &header_size);
-	body = _dbus_message_get_body(message, &body_size);
-	l_util_hexdump_two(false, header, header_size, body, body_size,
-				dbus->debug_handler, dbus->debug_data);
+	if (unlikely(dbus->debug_handler || dbus->pcap))
+		trace_message(dbus, false, message);
 
 	if (callback->callback == NULL) {
 		message_queue_destroy(callback);
@@ -243,18 +294,14 @@ static bool message_read_handler(struct l_io *io, void *user_data)
 {
 	struct l_dbus *dbus = user_data;
 	struct l_dbus_message *message;
-	const void *header, *body;
-	size_t header_size, body_size;
 	enum dbus_message_type msgtype;
 
 	message = dbus->driver->recv_message(dbus);
 	if (!message)
 		return true;
 
-	header = _dbus_message_get_header(message, &header_size);
-	body = _dbus_message_get_body(message, &body_size);
-	l_util_hexdump_two(true, header, header_size, body, body_size,
-				dbus->debug_handler, dbus->debug_data);
+	if (unlikely(dbus->debug_handler || dbus->pcap))
+		trace_message(dbus, true, message);
 
 	msgtype = _dbus_message_get_type(message);
 
@@ -269,6 +316,10 @@ static bool message_read_handler(struct l_io *io, void *user_data)
 		handle_signal(dbus, message);
 		break;
 	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+		if (dbus->driver->handle_bus_call &&
+				dbus->driver->handle_bus_call(dbus, message))
+			break;
+
 		if (!_dbus_object_tree_dispatch(dbus->tree, dbus, message)) {
 			struct l_dbus_message *error;
 
@@ -525,6 +576,10 @@ static bool auth_read_handler(struct l_io *io, void *user_data)
 		}
 		break;
 
+	case WAITING_FOR_NUL_BYTE:
+	case WAITING_FOR_AUTH:
+	case WAITING_FOR_DATA:
+	case WAITING_FOR_BEGIN:
 	case SETUP_DONE:
 		break;
 	}
@@ -561,6 +616,7 @@ static void dbus_init(struct l_dbus *dbus, int fd)
 	dbus->signal_list = l_hashmap_new();
 
 	dbus->tree = _dbus_object_tree_new();
+	dbus->pool = _dbus_message_pool_new();
 }
 
 static void classic_free(struct l_dbus *dbus)
@@ -574,6 +630,7 @@ static void classic_free(struct l_dbus *dbus)
 	l_free(classic->fd_buf);
 
 	l_free(classic->auth_command);
+	l_free(classic->peer_name);
 	l_hashmap_destroy(classic->match_strings, l_free);
 	l_free(classic);
 }
@@ -669,10 +726,10 @@ static struct l_dbus_message *classic_recv_message(struct l_dbus *dbus)
 		return NULL;
 
 	header_size = align_len(DBUS_HEADER_SIZE + hdr.dbus1.field_length, 8);
-	header = l_malloc(header_size);
+	header = _dbus_message_pool_alloc(dbus->pool, header_size);
 
 	body_size = hdr.dbus1.body_length;
-	body = l_malloc(body_size);
+	body = _dbus_message_pool_alloc(dbus->pool, body_size);
 
 	iov[0].iov_base = header;
 	iov[0].iov_len  = header_size;
@@ -756,7 +813,8 @@ static struct l_dbus_message *classic_recv_message(struct l_dbus *dbus)
 	if (num_fds > classic->num_fds)
 		goto bad_msg;
 
-	message = dbus_message_build(header, header_size, body, body_size,
+	message = dbus_message_build(dbus->pool, header, header_size,
+					body, body_size,
 					classic->fd_buf, num_fds);
 
 	if (message && num_fds) {
@@ -785,8 +843,8 @@ cmsg_fail:
 	classic->fd_buf = NULL;
 	classic->num_fds = 0;
 
-	l_free(header);
-	l_free(body);
+	_dbus_message_pool_free(dbus->pool, header, header_size);
+	_dbus_message_pool_free(dbus->pool, body, body_size);
 
 	return NULL;
 }
@@ -1065,13 +1123,12 @@ static struct l_dbus *setup_dbus1(int fd, const char *guid)
 	return dbus;
 }
 
-static struct l_dbus *setup_unix(char *params)
+static bool parse_unix_address(char *params, struct sockaddr_un *addr,
+				socklen_t *out_len, char **out_guid)
 {
 	char *path = NULL, *guid = NULL;
 	bool abstract = false;
-	struct sockaddr_un addr;
 	size_t len;
-	int fd;
 
 	while (params) {
 		char *key = strsep(&params, ",");
@@ -1097,37 +1154,50 @@ static struct l_dbus *setup_unix(char *params)
 	}
 
 	if (!path)
-		return NULL;
-
-	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
-	if (fd < 0)
-		return NULL;
+		return false;
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
 
 	len = strlen(path);
 
 	if (abstract) {
-		if (len > sizeof(addr.sun_path) - 1) {
-			close(fd);
-			return NULL;
-		}
+		if (len > sizeof(addr->sun_path) - 1)
+			return false;
 
-		addr.sun_path[0] = '\0';
-		strncpy(addr.sun_path + 1, path, sizeof(addr.sun_path) - 2);
+		addr->sun_path[0] = '\0';
+		strncpy(addr->sun_path + 1, path, sizeof(addr->sun_path) - 2);
 		len++;
 	} else {
-		if (len > sizeof(addr.sun_path)) {
-			close(fd);
-			return NULL;
-		}
+		if (len > sizeof(addr->sun_path))
+			return false;
 
-		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+		strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
 	}
 
-	if (connect(fd, (struct sockaddr *) &addr,
-				sizeof(addr.sun_family) + len) < 0) {
+	*out_len = sizeof(addr->sun_family) + len;
+
+	if (out_guid)
+		*out_guid = guid;
+
+	return true;
+}
+
+static struct l_dbus *setup_unix(char *params)
+{
+	char *guid = NULL;
+	struct sockaddr_un addr;
+	socklen_t len;
+	int fd;
+
+	if (!parse_unix_address(params, &addr, &len, &guid))
+		return NULL;
+
+	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (connect(fd, (struct sockaddr *) &addr, len) < 0) {
 		close(fd);
 		return NULL;
 	}
@@ -1320,6 +1390,10 @@ LIB_EXPORT void l_dbus_destroy(struct l_dbus *dbus)
 
 	l_io_destroy(dbus->io);
 
+	_dbus_message_pool_debug(dbus->pool, dbus->debug_handler,
+					dbus->debug_data);
+	_dbus_message_pool_unref(dbus->pool);
+
 	if (dbus->disconnect_destroy)
 		dbus->disconnect_destroy(dbus->disconnect_data);
 
@@ -1387,6 +1461,45 @@ LIB_EXPORT bool l_dbus_set_debug(struct l_dbus *dbus,
 	return true;
 }
 
+/**
+ * l_dbus_debug_stats:
+ * @dbus: D-Bus connection
+ *
+ * Reports the message pool counters of @dbus, i.e. buffer allocations,
+ * reuses and reply header cache hits, through the function set with
+ * l_dbus_set_debug().  The same report is made when @dbus is destroyed.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_debug_stats(struct l_dbus *dbus)
+{
+	if (unlikely(!dbus))
+		return false;
+
+	_dbus_message_pool_debug(dbus->pool, dbus->debug_handler,
+					dbus->debug_data);
+	return true;
+}
+
+/**
+ * l_dbus_set_pcap:
+ * @dbus: D-Bus connection
+ * @pcap: capture file created for %L_PCAP_LINK_DBUS or NULL
+ *
+ * Writes all messages sent and received to @pcap, which is not owned by
+ * @dbus.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_dbus_set_pcap(struct l_dbus *dbus, struct l_pcap *pcap)
+{
+	if (unlikely(!dbus))
+		return false;
+
+	dbus->pcap = pcap;
+	return true;
+}
+
 LIB_EXPORT uint32_t l_dbus_send_with_reply(struct l_dbus *dbus,
 						struct l_dbus_message *message,
 						l_dbus_message_func_t function,
@@ -1509,6 +1622,11 @@ uint8_t _dbus_get_version(struct l_dbus *dbus)
 	return dbus->driver->version;
 }
 
+struct _dbus_message_pool *_dbus_get_message_pool(struct l_dbus *dbus)
+{
+	return dbus->pool;
+}
+
 int _dbus_get_fd(struct l_dbus *dbus)
 {
 	return l_io_get_fd(dbus->io);
@@ -1708,6 +1826,32 @@ LIB_EXPORT bool l_dbus_object_manager_enable(struct l_dbus *dbus,
 						dbus);
 }
 
+/**
+ * l_dbus_object_manager_set_cache:
+ * @dbus: D-Bus connection
+ * @root: path of an object manager enabled with l_dbus_object_manager_enable
+ * @enable: whether to cache GetManagedObjects replies
+ *
+ * Lets the object manager at @root answer GetManagedObjects calls with the
+ * previous reply until an interface is added or removed in its subtree or
+ * l_dbus_property_changed is called for one of its properties.  Only enable
+ * this if all property getters below @root return the same values for every
+ * caller and values never change without l_dbus_property_changed.
+ *
+ * Returns: true on success, false if there is no object manager at @root
+ **/
+LIB_EXPORT bool l_dbus_object_manager_set_cache(struct l_dbus *dbus,
+						const char *root, bool enable)
+{
+	if (unlikely(!dbus || !root))
+		return false;
+
+	if (unlikely(!dbus->tree))
+		return false;
+
+	return _dbus_object_tree_set_objects_cache(dbus->tree, root, enable);
+}
+
 LIB_EXPORT unsigned int l_dbus_add_disconnect_watch(struct l_dbus *dbus,
 					const char *name,
 					l_dbus_watch_func_t disconnect_func,
@@ -1905,3 +2049,660 @@ LIB_EXPORT uint32_t l_dbus_name_acquire(struct l_dbus *dbus, const char *name,
 						replace_existing, queue,
 						callback, user_data);
 }
+
+static bool peer_get_name_owner(struct l_dbus *bus, const char *name)
+{
+	/* There is no bus to resolve names on a peer-to-peer connection */
+	return false;
+}
+
+static bool peer_add_match(struct l_dbus *dbus, unsigned int id,
+				const struct _dbus_filter_condition *rule,
+				int rule_len)
+{
+	/* All signals are delivered to a peer, filtering is done locally */
+	return true;
+}
+
+static bool peer_remove_match(struct l_dbus *dbus, unsigned int id)
+{
+	return true;
+}
+
+static uint32_t peer_name_acquire(struct l_dbus *dbus, const char *name,
+					bool allow_replacement,
+					bool replace_existing, bool queue,
+					l_dbus_name_acquire_func_t callback,
+					void *user_data)
+{
+	return 0;
+}
+
+/*
+ * Clients written against a bus, including our own, say Hello to the bus
+ * driver before doing anything else.  Answer on its behalf and turn away
+ * any other call addressed to it.
+ */
+static bool peer_handle_bus_call(struct l_dbus *dbus,
+					struct l_dbus_message *message)
+{
+	struct l_dbus_classic *classic =
+		l_container_of(dbus, struct l_dbus_classic, super);
+	const char *destination = l_dbus_message_get_destination(message);
+	const char *member = l_dbus_message_get_member(message);
+	struct l_dbus_message *reply;
+
+	if (!destination || strcmp(destination, DBUS_SERVICE_DBUS))
+		return false;
+
+	if (member && !strcmp(member, "Hello")) {
+		reply = l_dbus_message_new_method_return(message);
+		l_dbus_message_set_arguments(reply, "s", classic->peer_name);
+		l_dbus_send(dbus, reply);
+		return true;
+	}
+
+	if (l_dbus_message_get_no_reply(message))
+		return true;
+
+	reply = l_dbus_message_new_error(message,
+				"org.freedesktop.DBus.Error.NotSupported",
+				"No message bus on peer-to-peer connection");
+	l_dbus_send(dbus, reply);
+
+	return true;
+}
+
+static const struct l_dbus_ops peer_ops = {
+	.version = 1,
+	.send_message = classic_send_message,
+	.recv_message = classic_recv_message,
+	.free = classic_free,
+	.name_ops = {
+		.get_name_owner = peer_get_name_owner,
+	},
+	.filter_ops = {
+		.add_match = peer_add_match,
+		.remove_match = peer_remove_match,
+	},
+	.name_acquire = peer_name_acquire,
+	.handle_bus_call = peer_handle_bus_call,
+};
+
+static void server_pending_destroy(void *user_data)
+{
+	l_dbus_destroy(user_data);
+}
+
+/*
+ * Drops a connection that failed or gave up authenticating.  The l_dbus
+ * is destroyed from idle since this runs from within its own io handlers.
+ */
+static void server_pending_drop(struct l_dbus_classic *classic)
+{
+	struct l_dbus *dbus = &classic->super;
+
+	if (!classic->server ||
+			!l_queue_remove(classic->server->pending, dbus))
+		return;
+
+	classic->server = NULL;
+	l_idle_oneshot(server_pending_destroy, dbus, NULL);
+}
+
+static void server_pending_disconnect(void *user_data)
+{
+	server_pending_drop(user_data);
+}
+
+static void server_auth_timer_cb(struct l_timeout *timeout, void *user_data);
+
+/* One timer for all pending connections, set to the earliest deadline */
+static void server_auth_timer_update(struct l_dbus_server *server)
+{
+	const struct l_queue_entry *entry;
+	uint64_t deadline = 0;
+	uint64_t now;
+
+	for (entry = l_queue_get_entries(server->pending); entry;
+			entry = entry->next) {
+		struct l_dbus_classic *classic = l_container_of(entry->data,
+						struct l_dbus_classic, super);
+
+		uint64_t t = classic->auth_deadline;
+
+		if (t && (!deadline || l_time_before(t, deadline)))
+			deadline = t;
+	}
+
+	if (!deadline) {
+		l_timeout_remove(server->auth_timer);
+		server->auth_timer = NULL;
+		return;
+	}
+
+	now = l_time_now();
+	deadline = l_time_after(deadline, now) ?
+				(l_time_diff(now, deadline) + 999) / 1000 : 1;
+
+	if (server->auth_timer)
+		l_timeout_modify_ms(server->auth_timer, deadline);
+	else
+		server->auth_timer = l_timeout_create_ms(deadline,
+							server_auth_timer_cb,
+							server, NULL);
+}
+
+static bool server_auth_expired(const void *data, const void *user_data)
+{
+	const struct l_dbus_classic *classic = l_container_of(data,
+						struct l_dbus_classic, super);
+	const uint64_t *now = user_data;
+
+	return classic->auth_deadline &&
+				!l_time_after(classic->auth_deadline, *now);
+}
+
+static void server_auth_timer_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct l_dbus_server *server = user_data;
+	uint64_t now = l_time_now();
+	struct l_dbus *dbus;
+
+	while ((dbus = l_queue_find(server->pending, server_auth_expired,
+								&now)))
+		server_pending_drop(l_container_of(dbus,
+						struct l_dbus_classic, super));
+
+	server_auth_timer_update(server);
+}
+
+static bool server_auth_read_handler(struct l_io *io, void *user_data);
+
+static bool server_auth_write_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus_classic *classic = user_data;
+	struct l_dbus *dbus = &classic->super;
+	ssize_t written, len;
+
+	if (!classic->auth_command)
+		return false;
+
+	len = strlen(classic->auth_command);
+
+	written = L_TFR(send(l_io_get_fd(io), classic->auth_command, len,
+				MSG_NOSIGNAL));
+	if (written < 0) {
+		server_pending_drop(classic);
+		return false;
+	}
+
+	l_util_hexdump(false, classic->auth_command, written,
+					dbus->debug_handler, dbus->debug_data);
+
+	if (written < len) {
+		memmove(classic->auth_command, classic->auth_command + written,
+				len + 1 - written);
+		return true;
+	}
+
+	l_free(classic->auth_command);
+	classic->auth_command = NULL;
+
+	l_io_set_read_handler(io, server_auth_read_handler, classic, NULL);
+
+	return false;
+}
+
+/*
+ * Reading stops until the response is written.  Clients such as sd-bus
+ * send NEGOTIATE_UNIX_FD and BEGIN without waiting, and this keeps BEGIN
+ * from switching to the message handlers while a response is still
+ * queued.
+ */
+static void server_auth_respond(struct l_dbus_classic *classic,
+					const char *response)
+{
+	char *command;
+
+	if (classic->auth_command) {
+		command = l_strdup_printf("%s%s",
+					(char *) classic->auth_command,
+					response);
+		l_free(classic->auth_command);
+	} else
+		command = l_strdup(response);
+
+	classic->auth_command = command;
+
+	l_io_set_read_handler(classic->super.io, NULL, NULL, NULL);
+	l_io_set_write_handler(classic->super.io, server_auth_write_handler,
+							classic, NULL);
+}
+
+/*
+ * EXTERNAL authentication succeeds if the peer runs as our own user and,
+ * when it sent an authorization identity, that identity is its real uid.
+ */
+static bool server_auth_external(struct l_dbus_classic *classic,
+					const char *hexuid)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	char uid[12];
+	unsigned char *identity;
+	size_t identity_len;
+	bool r;
+
+	if (getsockopt(l_io_get_fd(classic->super.io), SOL_SOCKET,
+					SO_PEERCRED, &cred, &len) < 0)
+		return false;
+
+	if (cred.uid != geteuid())
+		return false;
+
+	if (!hexuid || !*hexuid)
+		return true;
+
+	identity = l_util_from_hexstring(hexuid, &identity_len);
+	if (!identity)
+		return false;
+
+	snprintf(uid, sizeof(uid), "%u", cred.uid);
+	r = identity_len == strlen(uid) &&
+				!memcmp(identity, uid, identity_len);
+	l_free(identity);
+
+	return r;
+}
+
+static void server_auth_ok(struct l_dbus_classic *classic, const char *hexuid)
+{
+	struct l_dbus *dbus = &classic->super;
+	char *response;
+
+	if (!server_auth_external(classic, hexuid)) {
+		server_auth_respond(classic, "REJECTED EXTERNAL\r\n");
+		classic->auth_state = WAITING_FOR_AUTH;
+		return;
+	}
+
+	response = l_strdup_printf("OK %s\r\n", dbus->guid);
+	server_auth_respond(classic, response);
+	l_free(response);
+
+	classic->auth_state = WAITING_FOR_BEGIN;
+}
+
+static void server_auth_done(struct l_dbus_classic *classic)
+{
+	struct l_dbus *dbus = &classic->super;
+	struct l_dbus_server *server = classic->server;
+
+	l_queue_remove(server->pending, dbus);
+	classic->server = NULL;
+	classic->auth_state = SETUP_DONE;
+
+
+	dbus->disconnect_handler = NULL;
+	dbus->disconnect_data = NULL;
+
+	bus_ready(dbus);
+
+	if (server->connect_handler)
+		server->connect_handler(server, dbus, server->connect_data);
+	else
+		l_idle_oneshot(server_pending_destroy, dbus, NULL);
+}
+
+static bool server_auth_read_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus_classic *classic = user_data;
+	struct l_dbus *dbus = &classic->super;
+	int fd = l_io_get_fd(io);
+	char buffer[256];
+	char *end, *arg;
+	ssize_t len;
+
+	if (classic->auth_state == WAITING_FOR_NUL_BYTE) {
+		len = L_TFR(recv(fd, buffer, 1, MSG_DONTWAIT));
+		if (len < 0 && errno == EAGAIN)
+			return true;
+
+		/* Credentials are taken from the socket, not the NUL byte */
+		if (len != 1 || buffer[0] != '\0')
+			goto fail;
+
+		classic->auth_state = WAITING_FOR_AUTH;
+	}
+
+	/*
+	 * Consume one line at a time, a client may send its first message
+	 * right behind BEGIN and that has to stay in the socket.
+	 */
+	len = L_TFR(recv(fd, buffer, sizeof(buffer) - 1,
+						MSG_PEEK | MSG_DONTWAIT));
+	if (len < 0 && errno == EAGAIN)
+		return true;
+
+	if (len <= 0)
+		goto fail;
+
+	buffer[len] = '\0';
+
+	end = strstr(buffer, "\r\n");
+	if (!end) {
+		if (len == sizeof(buffer) - 1)
+			goto fail;
+
+		return true;
+	}
+
+	len = end - buffer + 2;
+
+	if (L_TFR(recv(fd, buffer, len, MSG_DONTWAIT)) != len)
+		goto fail;
+
+	l_util_hexdump(true, buffer, len, dbus->debug_handler,
+							dbus->debug_data);
+
+	*end = '\0';
+
+	arg = strchr(buffer, ' ');
+	if (arg)
+		*arg++ = '\0';
+
+	if (!strcmp(buffer, "CANCEL") || !strcmp(buffer, "ERROR")) {
+		server_auth_respond(classic, "REJECTED EXTERNAL\r\n");
+		classic->auth_state = WAITING_FOR_AUTH;
+		return true;
+	}
+
+	switch (classic->auth_state) {
+	case WAITING_FOR_AUTH:
+		if (!strcmp(buffer, "BEGIN"))
+			goto fail;
+
+		if (strcmp(buffer, "AUTH")) {
+			server_auth_respond(classic, "ERROR\r\n");
+			break;
+		}
+
+		if (!arg || strncmp(arg, "EXTERNAL", 8) ||
+				(arg[8] != '\0' && arg[8] != ' ')) {
+			server_auth_respond(classic, "REJECTED EXTERNAL\r\n");
+			break;
+		}
+
+		if (arg[8] == ' ') {
+			server_auth_ok(classic, arg + 9);
+			break;
+		}
+
+		server_auth_respond(classic, "DATA\r\n");
+		classic->auth_state = WAITING_FOR_DATA;
+		break;
+
+	case WAITING_FOR_DATA:
+		if (strcmp(buffer, "DATA")) {
+			server_auth_respond(classic, "ERROR\r\n");
+			break;
+		}
+
+		server_auth_ok(classic, arg);
+		break;
+
+	case WAITING_FOR_BEGIN:
+		if (!strcmp(buffer, "NEGOTIATE_UNIX_FD")) {
+			dbus->support_unix_fd = true;
+			server_auth_respond(classic, "AGREE_UNIX_FD\r\n");
+			break;
+		}
+
+		if (strcmp(buffer, "BEGIN")) {
+			server_auth_respond(classic, "ERROR\r\n");
+			break;
+		}
+
+		server_auth_done(classic);
+		return true;
+
+	case WAITING_FOR_OK:
+	case WAITING_FOR_AGREE_UNIX_FD:
+	case WAITING_FOR_NUL_BYTE:
+	case SETUP_DONE:
+		goto fail;
+	}
+
+	return true;
+
+fail:
+	server_pending_drop(classic);
+	return false;
+}
+
+static bool server_accept_handler(struct l_io *io, void *user_data)
+{
+	struct l_dbus_server *server = user_data;
+	struct l_dbus_classic *classic;
+	struct l_dbus *dbus;
+	int fd;
+
+	fd = L_TFR(accept4(l_io_get_fd(io), NULL, NULL, SOCK_CLOEXEC));
+	if (fd < 0)
+		return true;
+
+	/* Like dbus-daemon, refuse new clients while too many authenticate */
+	if (server->max_pending && l_queue_length(server->pending) >=
+							server->max_pending) {
+		close(fd);
+		return true;
+	}
+
+	classic = l_new(struct l_dbus_classic, 1);
+	dbus = &classic->super;
+	dbus->driver = &peer_ops;
+
+	dbus_init(dbus, fd);
+	dbus->guid = l_strdup(server->guid);
+	dbus->negotiate_unix_fd = false;
+	dbus->support_unix_fd = false;
+	dbus->disconnect_handler = server_pending_disconnect;
+	dbus->disconnect_data = classic;
+
+	classic->server = server;
+	classic->auth_state = WAITING_FOR_NUL_BYTE;
+	classic->peer_name = l_strdup_printf(":1.%u", server->next_peer_id++);
+
+	if (server->auth_timeout)
+		classic->auth_deadline = l_time_offset(l_time_now(),
+						server->auth_timeout * 1000ULL);
+
+	l_queue_push_tail(server->pending, dbus);
+
+	if (classic->auth_deadline)
+		server_auth_timer_update(server);
+
+	l_io_set_read_handler(dbus->io, server_auth_read_handler,
+							classic, NULL);
+
+	return true;
+}
+
+/**
+ * l_dbus_server_new:
+ * @address: D-Bus address to listen on, e.g. "unix:path=/run/foo"
+ *
+ * Creates a server for direct peer-to-peer D-Bus connections, with no
+ * message bus in between.  Only unix socket addresses are supported and
+ * clients are authenticated with the EXTERNAL mechanism, which accepts
+ * peers running as the same user as the server.
+ *
+ * Each accepted and authenticated connection is handed to the connect
+ * handler as a new #l_dbus object, which is then owned by the caller.
+ * By default at most 16 connections can be authenticating at a time,
+ * further ones are closed right away, and connections that don't
+ * complete authentication within 30 seconds are closed.  See
+ * l_dbus_server_set_auth_limits().
+ *
+ * Returns: a newly allocated #l_dbus_server object or NULL on failure
+ **/
+LIB_EXPORT struct l_dbus_server *l_dbus_server_new(const char *address)
+{
+	struct l_dbus_server *server;
+	struct sockaddr_un addr;
+	socklen_t len;
+	uint8_t guid[16];
+	char *params;
+	int fd;
+
+	if (unlikely(!address))
+		return NULL;
+
+	if (strncmp(address, "unix:", 5))
+		return NULL;
+
+	params = strdupa(address + 5);
+
+	if (!parse_unix_address(params, &addr, &len, NULL))
+		return NULL;
+
+	if (!l_getrandom(guid, sizeof(guid)))
+		return NULL;
+
+	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (bind(fd, (struct sockaddr *) &addr, len) < 0 ||
+			listen(fd, SOMAXCONN) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	server = l_new(struct l_dbus_server, 1);
+	server->guid = l_util_hexstring(guid, sizeof(guid));
+	server->pending = l_queue_new();
+	server->auth_timeout = SERVER_AUTH_TIMEOUT_MS;
+	server->max_pending = SERVER_MAX_PENDING;
+
+	if (addr.sun_path[0])
+		server->path = l_strdup(addr.sun_path);
+
+	server->io = l_io_new(fd);
+	l_io_set_close_on_destroy(server->io, true);
+	l_io_set_read_handler(server->io, server_accept_handler, server, NULL);
+
+	return server;
+}
+
+/**
+ * l_dbus_server_destroy:
+ * @server: D-Bus server
+ *
+ * Stops listening and frees @server, removing its socket from the file
+ * system.  Connections already handed to the connect handler are not
+ * affected.
+ **/
+LIB_EXPORT void l_dbus_server_destroy(struct l_dbus_server *server)
+{
+	struct l_dbus_classic *classic;
+	struct l_dbus *dbus;
+
+	if (unlikely(!server))
+		return;
+
+	l_io_destroy(server->io);
+
+	if (server->path)
+		unlink(server->path);
+
+	/* Detached first, their disconnect handler would drop them again */
+	while ((dbus = l_queue_pop_head(server->pending))) {
+		classic = l_container_of(dbus, struct l_dbus_classic, super);
+		classic->server = NULL;
+		l_dbus_destroy(dbus);
+	}
+
+	l_queue_destroy(server->pending, NULL);
+	l_timeout_remove(server->auth_timer);
+
+	if (server->connect_destroy)
+		server->connect_destroy(server->connect_data);
+
+	l_free(server->path);
+	l_free(server->guid);
+	l_free(server);
+}
+
+/**
+ * l_dbus_server_set_connect_handler:
+ * @server: D-Bus server
+ * @function: function called for each new connection
+ * @user_data: user data passed to @function
+ * @destroy: function called to destroy @user_data
+ *
+ * Sets the handler that receives newly authenticated connections.  The
+ * connection is ready for use when @function is called.  Connections
+ * accepted while no handler is set are closed.
+ *
+ * Returns: true on success, false otherwise
+ **/
+LIB_EXPORT bool l_dbus_server_set_connect_handler(
+				struct l_dbus_server *server,
+				l_dbus_server_connect_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy)
+{
+	if (unlikely(!server))
+		return false;
+
+	if (server->connect_destroy)
+		server->connect_destroy(server->connect_data);
+
+	server->connect_handler = function;
+	server->connect_destroy = destroy;
+	server->connect_data = user_data;
+
+	return true;
+}
+
+/**
+ * l_dbus_server_set_auth_limits:
+ * @server: D-Bus server
+ * @timeout_ms: time allowed for authentication in milliseconds, 0 for
+ *	no limit
+ * @max_pending: number of connections that may be authenticating at a
+ *	time, 0 for no limit
+ *
+ * Sets how long a client may take to authenticate before its connection
+ * is closed, and how many clients may do so at once.  The timeout
+ * applies to connections accepted from now on.
+ *
+ * Returns: true on success, false if @server is NULL
+ **/
+LIB_EXPORT bool l_dbus_server_set_auth_limits(struct l_dbus_server *server,
+						unsigned int timeout_ms,
+						unsigned int max_pending)
+{
+	if (unlikely(!server))
+		return false;
+
+	server->auth_timeout = timeout_ms;
+	server->max_pending = max_pending;
+
+	return true;
+}
+
+/**
+ * l_dbus_server_get_guid:
+ * @server: D-Bus server
+ *
+ * Returns: the GUID @server sends to clients during authentication
+ **/
+LIB_EXPORT const char *l_dbus_server_get_guid(struct l_dbus_server *server)
+{
+	if (unlikely(!server))
+		return NULL;
+
+	return server->guid;
+}
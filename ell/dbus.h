@@ -40,6 +40,7 @@ enum l_dbus_match_type {
 #define L_DBUS_MATCH_ARGUMENT(i)	(L_DBUS_MATCH_ARG0 + (i))
 
 struct l_dbus;
+struct l_dbus_server;
 struct l_dbus_interface;
 struct l_dbus_message_builder;
 
@@ -55,6 +56,10 @@ typedef void (*l_dbus_watch_func_t) (struct l_dbus *dbus, void *user_data);
 typedef void (*l_dbus_name_acquire_func_t) (struct l_dbus *dbus, bool success,
 						bool queued, void *user_data);
 
+typedef void (*l_dbus_server_connect_func_t) (struct l_dbus_server *server,
+						struct l_dbus *dbus,
+						void *user_data);
+
 struct l_dbus *l_dbus_new(const char *address);
 struct l_dbus *l_dbus_new_default(enum l_dbus_bus bus);
 void l_dbus_destroy(struct l_dbus *dbus);
@@ -67,6 +72,21 @@ bool l_dbus_set_disconnect_handler(struct l_dbus *dbus,
 
 bool l_dbus_set_debug(struct l_dbus *dbus, l_dbus_debug_func_t function,
 				void *user_data, l_dbus_destroy_func_t destroy);
+bool l_dbus_debug_stats(struct l_dbus *dbus);
+
+struct l_pcap;
+
+bool l_dbus_set_pcap(struct l_dbus *dbus, struct l_pcap *pcap);
+
+struct l_dbus_server *l_dbus_server_new(const char *address);
+void l_dbus_server_destroy(struct l_dbus_server *server);
+bool l_dbus_server_set_connect_handler(struct l_dbus_server *server,
+				l_dbus_server_connect_func_t function,
+				void *user_data, l_dbus_destroy_func_t destroy);
+bool l_dbus_server_set_auth_limits(struct l_dbus_server *server,
+					unsigned int timeout_ms,
+					unsigned int max_pending);
+const char *l_dbus_server_get_guid(struct l_dbus_server *server);
 
 struct l_dbus_message;
 
@@ -164,6 +184,9 @@ bool l_dbus_message_set_arguments(struct l_dbus_message *message,
 						const char *signature, ...);
 bool l_dbus_message_set_arguments_valist(struct l_dbus_message *message,
 					 const char *signature, va_list args);
+bool l_dbus_message_set_fixed_array(struct l_dbus_message *message,
+					char type, const void *data,
+					uint32_t n_elem);
 
 struct l_dbus_message_builder *l_dbus_message_builder_new(
 						struct l_dbus_message *message);
@@ -172,6 +195,11 @@ void l_dbus_message_builder_destroy(struct l_dbus_message_builder *builder);
 bool l_dbus_message_builder_append_basic(struct l_dbus_message_builder *builder,
 					char type, const void *value);
 
+bool l_dbus_message_builder_append_fixed_array(
+					struct l_dbus_message_builder *builder,
+					char type, const void *data,
+					uint32_t n_elem);
+
 bool l_dbus_message_builder_enter_container(
 					struct l_dbus_message_builder *builder,
 					char container_type,
@@ -229,6 +257,8 @@ void *l_dbus_object_get_data(struct l_dbus *dbus, const char *object,
 				const char *interface);
 
 bool l_dbus_object_manager_enable(struct l_dbus *dbus, const char *root);
+bool l_dbus_object_manager_set_cache(struct l_dbus *dbus, const char *root,
+					bool enable);
 
 unsigned int l_dbus_add_service_watch(struct l_dbus *dbus,
 					const char *name,
@@ -41,6 +41,14 @@ typedef struct {
 	uint64_t m_high;
 } uint128_t;
 
+/*
+ * The basic operations are always inlined so that the curve specific
+ * callers, which pass a constant ndigits, get fully unrolled code without
+ * any loop control.  The exported _vli_* versions are thin wrappers.
+ */
+#define VLI_INLINE static inline __attribute__((always_inline))
+#define VLI_UNROLL _Pragma("GCC unroll 6")
+
 static void vli_clear(uint64_t *vli, unsigned int ndigits)
 {
 	unsigned int i;
@@ -69,39 +77,57 @@ static uint64_t vli_test_bit(const uint64_t *vli, unsigned int bit)
 }
 
 /* Sets dest = src. */
-static void vli_set(uint64_t *dest, const uint64_t *src, unsigned int ndigits)
+VLI_INLINE void vli_set(uint64_t *dest, const uint64_t *src,
+				unsigned int ndigits)
 {
 	unsigned int i;
 
+	VLI_UNROLL
 	for (i = 0; i < ndigits; i++)
 		dest[i] = src[i];
 }
 
-/* Returns sign of left - right. */
-int _vli_cmp(const uint64_t *left, const uint64_t *right, unsigned int ndigits)
+/*
+ * Returns sign of left - right.  All digits are always looked at: the
+ * sign comes from the borrow of left - right and whether any digit
+ * differs.
+ */
+VLI_INLINE int vli_cmp(const uint64_t *left, const uint64_t *right,
+				unsigned int ndigits)
 {
-	int i;
+	uint64_t differ = 0;
+	uint64_t borrow = 0;
+	unsigned int i;
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++) {
+		uint64_t l = left[i];
+		uint64_t r = right[i];
+		uint64_t diff = l - borrow;
 
-	for (i = ndigits - 1; i >= 0; i--) {
-		if (left[i] > right[i])
-			return 1;
-		if (left[i] < right[i])
-			return -1;
+		borrow = (diff > l) | (diff < r);
+		differ |= l ^ r;
 	}
 
-	return 0;
+	return (int) ((differ | (0 - differ)) >> 63) - 2 * (int) borrow;
+}
+
+int _vli_cmp(const uint64_t *left, const uint64_t *right, unsigned int ndigits)
+{
+	return vli_cmp(left, right, ndigits);
 }
 
 /* Computes result = in << c, returning carry. Can modify in place
  * (if result == in). 0 < shift < 64.
  */
-static uint64_t vli_lshift(uint64_t *result, const uint64_t *in,
+VLI_INLINE uint64_t vli_lshift(uint64_t *result, const uint64_t *in,
 							unsigned int shift,
 							unsigned int ndigits)
 {
 	uint64_t carry = 0;
 	unsigned int i;
 
+	VLI_UNROLL
 	for (i = 0; i < ndigits; i++) {
 		uint64_t temp = in[i];
 
@@ -128,18 +154,20 @@ void _vli_rshift1(uint64_t *vli, unsigned int ndigits)
 }
 
 /* Computes result = left + right, returning carry. Can modify in place. */
-uint64_t _vli_add(uint64_t *result, const uint64_t *left,
+VLI_INLINE uint64_t vli_add(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, unsigned int ndigits)
 {
 	uint64_t carry = 0;
 	unsigned int i;
 
+	VLI_UNROLL
 	for (i = 0; i < ndigits; i++) {
-		uint64_t sum;
+		uint64_t sum = left[i] + carry;
+		uint64_t r = right[i];
 
-		sum = left[i] + right[i] + carry;
-		if (sum != left[i])
-			carry = (sum < left[i]);
+		carry = sum < carry;
+		sum += r;
+		carry |= sum < r;
 
 		result[i] = sum;
 	}
@@ -147,28 +175,50 @@ uint64_t _vli_add(uint64_t *result, const uint64_t *left,
 	return carry;
 }
 
+uint64_t _vli_add(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, unsigned int ndigits)
+{
+	return vli_add(result, left, right, ndigits);
+}
+
 /* Computes result = left - right, returning borrow. Can modify in place. */
-uint64_t _vli_sub(uint64_t *result, const uint64_t *left,
+VLI_INLINE uint64_t vli_sub(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, unsigned int ndigits)
 {
 	uint64_t borrow = 0;
 	unsigned int i;
 
+	VLI_UNROLL
 	for (i = 0; i < ndigits; i++) {
-		uint64_t diff;
+		uint64_t l = left[i];
+		uint64_t r = right[i];
+		uint64_t diff = l - borrow;
 
-		diff = left[i] - right[i] - borrow;
-		if (diff != left[i])
-			borrow = (diff > left[i]);
+		borrow = (diff > l) | (diff < r);
 
-		result[i] = diff;
+		result[i] = diff - r;
 	}
 
 	return borrow;
 }
 
-static uint128_t mul_64_64(uint64_t left, uint64_t right)
+uint64_t _vli_sub(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, unsigned int ndigits)
+{
+	return vli_sub(result, left, right, ndigits);
+}
+
+VLI_INLINE uint128_t mul_64_64(uint64_t left, uint64_t right)
 {
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 m = (unsigned __int128) left * right;
+	uint128_t result;
+
+	result.m_low = m;
+	result.m_high = m >> 64;
+
+	return result;
+#else
 	uint64_t a0 = left & 0xffffffffull;
 	uint64_t a1 = left >> 32;
 	uint64_t b0 = right & 0xffffffffull;
@@ -190,9 +240,10 @@ static uint128_t mul_64_64(uint64_t left, uint64_t right)
 	result.m_high = m3 + (m2 >> 32);
 
 	return result;
+#endif
 }
 
-static uint128_t add_128_128(uint128_t a, uint128_t b)
+VLI_INLINE uint128_t add_128_128(uint128_t a, uint128_t b)
 {
 	uint128_t result;
 
@@ -202,7 +253,84 @@ static uint128_t add_128_128(uint128_t a, uint128_t b)
 	return result;
 }
 
-static void vli_mult(uint64_t *result, const uint64_t *left,
+#ifdef __SIZEOF_INT128__
+/*
+ * With a native 128-bit type use operand scanning, which the compiler turns
+ * into straight MUL/ADD/ADC sequences once the loops are unrolled.
+ */
+VLI_INLINE void vli_mult(uint64_t *result, const uint64_t *left,
+							const uint64_t *right,
+							unsigned int ndigits)
+{
+	unsigned int i, j;
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++)
+		result[i] = 0;
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++) {
+		uint64_t carry = 0;
+
+		VLI_UNROLL
+		for (j = 0; j < ndigits; j++) {
+			unsigned __int128 t = (unsigned __int128) left[i] *
+						right[j] + result[i + j] + carry;
+
+			result[i + j] = t;
+			carry = t >> 64;
+		}
+
+		result[i + ndigits] = carry;
+	}
+}
+
+VLI_INLINE void vli_square(uint64_t *result, const uint64_t *left,
+				unsigned int ndigits)
+{
+	uint64_t carry;
+	unsigned int i, j;
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits * 2; i++)
+		result[i] = 0;
+
+	/* Cross products left[i] * left[j], i < j */
+	VLI_UNROLL
+	for (i = 0; i < ndigits - 1; i++) {
+		carry = 0;
+
+		VLI_UNROLL
+		for (j = i + 1; j < ndigits; j++) {
+			unsigned __int128 t = (unsigned __int128) left[i] *
+						left[j] + result[i + j] + carry;
+
+			result[i + j] = t;
+			carry = t >> 64;
+		}
+
+		result[i + ndigits] = carry;
+	}
+
+	/* Double them */
+	vli_lshift(result, result, 1, ndigits * 2);
+
+	/* And add the squares on the diagonal */
+	carry = 0;
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++) {
+		unsigned __int128 t = (unsigned __int128) left[i] * left[i] +
+						result[2 * i] + carry;
+
+		result[2 * i] = t;
+		t = (unsigned __int128) result[2 * i + 1] + (uint64_t) (t >> 64);
+		result[2 * i + 1] = t;
+		carry = t >> 64;
+	}
+}
+#else
+VLI_INLINE void vli_mult(uint64_t *result, const uint64_t *left,
 							const uint64_t *right,
 							unsigned int ndigits)
 {
@@ -239,7 +367,7 @@ static void vli_mult(uint64_t *result, const uint64_t *left,
 	result[ndigits * 2 - 1] = r01.m_low;
 }
 
-static void vli_square(uint64_t *result, const uint64_t *left,
+VLI_INLINE void vli_square(uint64_t *result, const uint64_t *left,
 			unsigned int ndigits)
 {
 	uint128_t r01 = { 0, 0 };
@@ -278,40 +406,89 @@ static void vli_square(uint64_t *result, const uint64_t *left,
 
 	result[ndigits * 2 - 1] = r01.m_low;
 }
+#endif
 
 /* Computes result = (left + right) % mod.
  * Assumes that left < mod and right < mod, result != mod.
  */
-void _vli_mod_add(uint64_t *result, const uint64_t *left,
+VLI_INLINE void vli_mod_add(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, const uint64_t *mod,
 				unsigned int ndigits)
 {
+	uint64_t tmp[L_ECC_MAX_DIGITS];
 	uint64_t carry;
+	uint64_t borrow;
+	uint64_t mask;
+	unsigned int i;
 
-	carry = _vli_add(result, left, right, ndigits);
+	carry = vli_add(result, left, right, ndigits);
+	borrow = vli_sub(tmp, result, mod, ndigits);
 
-	/* result > mod (result = mod + remainder), so subtract mod to
-	 * get remainder.
+	/* result >= mod (result = mod + remainder) unless subtracting mod
+	 * borrowed without a carry to cancel it, keep the remainder then.
 	 */
-	if (carry || _vli_cmp(result, mod, ndigits) >= 0)
-		_vli_sub(result, result, mod, ndigits);
+	mask = 0 - (carry | (borrow ^ 1));
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++)
+		result[i] = (tmp[i] & mask) | (result[i] & ~mask);
+}
+
+void _vli_mod_add(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, const uint64_t *mod,
+				unsigned int ndigits)
+{
+	switch (ndigits) {
+	case 4:
+		vli_mod_add(result, left, right, mod, 4);
+		break;
+	case 6:
+		vli_mod_add(result, left, right, mod, 6);
+		break;
+	default:
+		vli_mod_add(result, left, right, mod, ndigits);
+		break;
+	}
 }
 
 /* Computes result = (left - right) % mod.
  * Assumes that left < mod and right < mod, result != mod.
  */
-void _vli_mod_sub(uint64_t *result, const uint64_t *left,
+VLI_INLINE void vli_mod_sub(uint64_t *result, const uint64_t *left,
 				const uint64_t *right, const uint64_t *mod,
 				unsigned int ndigits)
 {
-	uint64_t borrow = _vli_sub(result, left, right, ndigits);
+	uint64_t tmp[L_ECC_MAX_DIGITS];
+	uint64_t borrow = vli_sub(result, left, right, ndigits);
+	uint64_t mask = 0 - borrow;
+	unsigned int i;
 
-	/* In this case, p_result == -diff == (max int) - diff.
+	/* On a borrow, p_result == -diff == (max int) - diff.
 	 * Since -x % d == d - x, we can get the correct result from
-	 * result + mod (with overflow).
+	 * result + mod (with overflow).  Always add, keep it on a borrow.
 	 */
-	if (borrow)
-		_vli_add(result, result, mod, ndigits);
+	vli_add(tmp, result, mod, ndigits);
+
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++)
+		result[i] = (tmp[i] & mask) | (result[i] & ~mask);
+}
+
+void _vli_mod_sub(uint64_t *result, const uint64_t *left,
+				const uint64_t *right, const uint64_t *mod,
+				unsigned int ndigits)
+{
+	switch (ndigits) {
+	case 4:
+		vli_mod_sub(result, left, right, mod, 4);
+		break;
+	case 6:
+		vli_mod_sub(result, left, right, mod, 6);
+		break;
+	default:
+		vli_mod_sub(result, left, right, mod, ndigits);
+		break;
+	}
 }
 
 /* Counts the number of 64-bit "digits" in vli. */
@@ -402,224 +579,129 @@ static void vli_mmod_fast_192(uint64_t *result, const uint64_t *product,
 	vli_set(result, product, ndigits);
 
 	vli_set(tmp, &product[3], ndigits);
-	carry = _vli_add(result, result, tmp, ndigits);
+	carry = vli_add(result, result, tmp, ndigits);
 
 	tmp[0] = 0;
 	tmp[1] = product[3];
 	tmp[2] = product[4];
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
 	tmp[0] = tmp[1] = product[5];
 	tmp[2] = 0;
-	carry += _vli_add(result, result, tmp, ndigits);
+	carry += vli_add(result, result, tmp, ndigits);
 
-	while (carry || _vli_cmp(curve_prime, result, ndigits) != 1)
-		carry -= _vli_sub(result, result, curve_prime, ndigits);
+	while (carry || vli_cmp(curve_prime, result, ndigits) != 1)
+		carry -= vli_sub(result, result, curve_prime, ndigits);
 }
 
-/* Computes result = product % curve_prime
- * from http://www.nsa.gov/ia/_files/nist-routines.pdf
+/*
+ * The NIST reductions below (http://www.nsa.gov/ia/_files/nist-routines.pdf)
+ * are written in terms of the 32-bit words c0 ... cN of the product.  Each
+ * word of the result is accumulated as a signed 64-bit sum of product words
+ * and the carries are propagated once at the end, which avoids building and
+ * adding the intermediate S and D values one multi-digit number at a time.
  */
-static void vli_mmod_fast_256(uint64_t *result, const uint64_t *product,
-				const uint64_t *curve_prime, uint64_t *tmp)
-{
-	int carry;
-	const unsigned int ndigits = 4;
+#define C32(prod, i) \
+	((int64_t) (((prod)[(i) / 2] >> (32 * ((i) & 1))) & 0xffffffffull))
 
-	/* t */
-	vli_set(result, product, ndigits);
+/* Stores the low 32 bits of acc into r[i], carrying the rest on */
+#define STORE32(r, i, acc) do {		\
+	(r)[i] = (uint32_t) (acc);	\
+	(acc) >>= 32;			\
+} while (0)
 
-	/* s1 */
-	tmp[0] = 0;
-	tmp[1] = product[5] & 0xffffffff00000000ull;
-	tmp[2] = product[6];
-	tmp[3] = product[7];
-	carry = vli_lshift(tmp, tmp, 1, ndigits);
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s2 */
-	tmp[1] = product[6] << 32;
-	tmp[2] = (product[6] >> 32) | (product[7] << 32);
-	tmp[3] = product[7] >> 32;
-	carry += vli_lshift(tmp, tmp, 1, ndigits);
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s3 */
-	tmp[0] = product[4];
-	tmp[1] = product[5] & 0xffffffff;
-	tmp[2] = 0;
-	tmp[3] = product[7];
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s4 */
-	tmp[0] = (product[4] >> 32) | (product[5] << 32);
-	tmp[1] = (product[5] >> 32) | (product[6] & 0xffffffff00000000ull);
-	tmp[2] = product[7];
-	tmp[3] = (product[6] >> 32) | (product[4] << 32);
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* d1 */
-	tmp[0] = (product[5] >> 32) | (product[6] << 32);
-	tmp[1] = (product[6] >> 32);
-	tmp[2] = 0;
-	tmp[3] = (product[4] & 0xffffffff) | (product[5] << 32);
-	carry -= _vli_sub(result, result, tmp, ndigits);
+VLI_INLINE void vli_mmod_finish(uint64_t *result, const uint32_t *r,
+				int64_t carry, const uint64_t *curve_prime,
+				unsigned int ndigits)
+{
+	unsigned int i;
 
-	/* d2 */
-	tmp[0] = product[6];
-	tmp[1] = product[7];
-	tmp[2] = 0;
-	tmp[3] = (product[4] >> 32) | (product[5] & 0xffffffff00000000ull);
-	carry -= _vli_sub(result, result, tmp, ndigits);
-
-	/* d3 */
-	tmp[0] = (product[6] >> 32) | (product[7] << 32);
-	tmp[1] = (product[7] >> 32) | (product[4] << 32);
-	tmp[2] = (product[4] >> 32) | (product[5] << 32);
-	tmp[3] = (product[6] << 32);
-	carry -= _vli_sub(result, result, tmp, ndigits);
-
-	/* d4 */
-	tmp[0] = product[7];
-	tmp[1] = product[4] & 0xffffffff00000000ull;
-	tmp[2] = product[5];
-	tmp[3] = product[6] & 0xffffffff00000000ull;
-	carry -= _vli_sub(result, result, tmp, ndigits);
+	VLI_UNROLL
+	for (i = 0; i < ndigits; i++)
+		result[i] = r[2 * i] | (uint64_t) r[2 * i + 1] << 32;
 
 	if (carry < 0) {
 		do {
-			carry += _vli_add(result, result, curve_prime, ndigits);
+			carry += vli_add(result, result, curve_prime, ndigits);
 		} while (carry < 0);
 	} else {
-		while (carry || _vli_cmp(curve_prime, result, ndigits) != 1)
-			carry -= _vli_sub(result, result, curve_prime, ndigits);
+		while (carry || vli_cmp(curve_prime, result, ndigits) != 1)
+			carry -= vli_sub(result, result, curve_prime, ndigits);
 	}
 }
 
-/*
- * The NIST algorithms define S values, which are comprised of 32 bit C values
- * of the original product we are trying to reduce. Since we are working with
- * 64 bit 'digits', we need to convert these C values into 64 bit chunks. This
- * macro mainly makes code readability easier since we can directly pass the
- * two C indexes (h and l). Some of these C values are zero, which is also a
- * value C index. In this case -1 should be passed to indicate zero.
- */
-#define ECC_SET_S(prod, h, l) ({ 				\
-	uint64_t r = 0;						\
-	if (h == -1) {						\
-		/* zero, don't do anything */			\
-	} else if (h & 1)					\
-		r |= (prod[h / 2] & 0xffffffff00000000ull);	\
-	else							\
-		r |= (prod[h / 2] << 32);			\
-	if (l == -1) {						\
-		/* zero, don't do anything */			\
-	} else if (l & 1)					\
-		r |= (prod[l / 2] >> 32);			\
-	else							\
-		r |= (prod[l / 2] & 0xffffffff);		\
-	r;							\
-})
-
-static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
-				const uint64_t *curve_prime, uint64_t *tmp)
+/* Computes result = product % curve_prime for P-256 */
+static void vli_mmod_fast_256(uint64_t *result, const uint64_t *product,
+				const uint64_t *curve_prime)
 {
-	int carry;
-	const unsigned int ndigits = 6;
+	int64_t c[16];
+	uint32_t r[8];
+	int64_t acc;
+	unsigned int i;
 
-	/* t */
-	vli_set(result, product, ndigits);
+	for (i = 0; i < 16; i++)
+		c[i] = C32(product, i);
+
+	acc = c[0] + c[8] + c[9] - c[11] - c[12] - c[13] - c[14];
+	STORE32(r, 0, acc);
+	acc += c[1] + c[9] + c[10] - c[12] - c[13] - c[14] - c[15];
+	STORE32(r, 1, acc);
+	acc += c[2] + c[10] + c[11] - c[13] - c[14] - c[15];
+	STORE32(r, 2, acc);
+	acc += c[3] - c[8] - c[9] + 2 * c[11] + 2 * c[12] + c[13] - c[15];
+	STORE32(r, 3, acc);
+	acc += c[4] - c[9] - c[10] + 2 * c[12] + 2 * c[13] + c[14];
+	STORE32(r, 4, acc);
+	acc += c[5] - c[10] - c[11] + 2 * c[13] + 2 * c[14] + c[15];
+	STORE32(r, 5, acc);
+	acc += c[6] - c[8] - c[9] + c[13] + 3 * c[14] + 2 * c[15];
+	STORE32(r, 6, acc);
+	acc += c[7] + c[8] - c[10] - c[11] - c[12] - c[13] + 3 * c[15];
+	STORE32(r, 7, acc);
+
+	vli_mmod_finish(result, r, acc, curve_prime, 4);
+}
 
-	/* s1 */
-	tmp[0] = 0;
-	tmp[1] = 0;
-	tmp[2] = ECC_SET_S(product, 22, 21);
-	tmp[3] = ECC_SET_S(product, -1, 23);
-	tmp[4] = 0;
-	tmp[5] = 0;
-	carry = vli_lshift(tmp, tmp, 1, ndigits);
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s2 */
-	tmp[0] = product[6];
-	tmp[1] = product[7];
-	tmp[2] = product[8];
-	tmp[3] = product[9];
-	tmp[4] = product[10];
-	tmp[5] = product[11];
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s3 */
-	tmp[0] = ECC_SET_S(product, 22, 21);
-	tmp[1] = ECC_SET_S(product, 12, 23);
-	tmp[2] = ECC_SET_S(product, 14, 13);
-	tmp[3] = ECC_SET_S(product, 16, 15);
-	tmp[4] = ECC_SET_S(product, 18, 17);
-	tmp[5] = ECC_SET_S(product, 20, 19);
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s4 */
-	tmp[0] = ECC_SET_S(product, 23, -1);
-	tmp[1] = ECC_SET_S(product, 20, -1);
-	tmp[2] = ECC_SET_S(product, 13, 12);
-	tmp[3] = ECC_SET_S(product, 15, 14);
-	tmp[4] = ECC_SET_S(product, 17, 16);
-	tmp[5] = ECC_SET_S(product, 19, 18);
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s5 */
-	tmp[0] = 0;
-	tmp[1] = 0;
-	tmp[2] = ECC_SET_S(product, 21, 20);
-	tmp[3] = ECC_SET_S(product, 23, 22);
-	tmp[4] = 0;
-	tmp[5] = 0;
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s6 */
-	tmp[0] = ECC_SET_S(product, -1, 20);
-	tmp[1] = ECC_SET_S(product, 21, -1);
-	tmp[2] = ECC_SET_S(product, 23, 22);
-	tmp[3] = 0;
-	tmp[4] = 0;
-	tmp[5] = 0;
-	carry += _vli_add(result, result, tmp, ndigits);
-
-	/* s7 */
-	tmp[0] = ECC_SET_S(product, 12, 23);
-	tmp[1] = ECC_SET_S(product, 14, 13);
-	tmp[2] = ECC_SET_S(product, 16, 15);
-	tmp[3] = ECC_SET_S(product, 18, 17);
-	tmp[4] = ECC_SET_S(product, 20, 19);
-	tmp[5] = ECC_SET_S(product, 22, 21);
-	carry -= _vli_sub(result, result, tmp, ndigits);
-
-	/* s8 */
-	tmp[0] = ECC_SET_S(product, 20, -1);
-	tmp[1] = ECC_SET_S(product, 22, 21);
-	tmp[2] = ECC_SET_S(product, -1, 23);
-	tmp[3] = 0;
-	tmp[4] = 0;
-	tmp[5] = 0;
-	carry -= _vli_sub(result, result, tmp, ndigits);
-
-	/* s9 */
-	tmp[0] = 0;
-	tmp[1] = ECC_SET_S(product, 23, -1);
-	tmp[2] = ECC_SET_S(product, -1, 23);
-	tmp[3] = 0;
-	tmp[4] = 0;
-	tmp[5] = 0;
-	carry -= _vli_sub(result, result, tmp, ndigits);
+/* Computes result = product % curve_prime for P-384 */
+static void vli_mmod_fast_384(uint64_t *result, const uint64_t *product,
+				const uint64_t *curve_prime)
+{
+	int64_t c[24];
+	uint32_t r[12];
+	int64_t acc;
+	unsigned int i;
 
-	if (carry < 0) {
-		do {
-			carry += _vli_add(result, result, curve_prime, ndigits);
-		} while (carry < 0);
-	} else {
-		while (carry || _vli_cmp(curve_prime, result, ndigits) != 1)
-			carry -= _vli_sub(result, result, curve_prime, ndigits);
-	}
+	for (i = 0; i < 24; i++)
+		c[i] = C32(product, i);
+
+	acc = c[0] + c[12] + c[20] + c[21] - c[23];
+	STORE32(r, 0, acc);
+	acc += c[1] - c[12] + c[13] - c[20] + c[22] + c[23];
+	STORE32(r, 1, acc);
+	acc += c[2] - c[13] + c[14] - c[21] + c[23];
+	STORE32(r, 2, acc);
+	acc += c[3] + c[12] - c[14] + c[15] + c[20] + c[21] - c[22] - c[23];
+	STORE32(r, 3, acc);
+	acc += c[4] + c[12] + c[13] - c[15] + c[16] + c[20] + 2 * c[21] +
+		c[22] - 2 * c[23];
+	STORE32(r, 4, acc);
+	acc += c[5] + c[13] + c[14] - c[16] + c[17] + c[21] + 2 * c[22] +
+		c[23];
+	STORE32(r, 5, acc);
+	acc += c[6] + c[14] + c[15] - c[17] + c[18] + c[22] + 2 * c[23];
+	STORE32(r, 6, acc);
+	acc += c[7] + c[15] + c[16] - c[18] + c[19] + c[23];
+	STORE32(r, 7, acc);
+	acc += c[8] + c[16] + c[17] - c[19] + c[20];
+	STORE32(r, 8, acc);
+	acc += c[9] + c[17] + c[18] - c[20] + c[21];
+	STORE32(r, 9, acc);
+	acc += c[10] + c[18] + c[19] - c[21] + c[22];
+	STORE32(r, 10, acc);
+	acc += c[11] + c[19] + c[20] - c[22] + c[23];
+	STORE32(r, 11, acc);
+
+	vli_mmod_finish(result, r, acc, curve_prime, 6);
 }
 
 /* Computes result = product % curve_prime
@@ -635,10 +717,10 @@ bool _vli_mmod_fast(uint64_t *result, const uint64_t *product,
 		vli_mmod_fast_192(result, product, curve_prime, tmp);
 		break;
 	case 4:
-		vli_mmod_fast_256(result, product, curve_prime, tmp);
+		vli_mmod_fast_256(result, product, curve_prime);
 		break;
 	case 6:
-		vli_mmod_fast_384(result, product, curve_prime, tmp);
+		vli_mmod_fast_384(result, product, curve_prime);
 		break;
 	default:
 		return false;
@@ -647,15 +729,30 @@ bool _vli_mmod_fast(uint64_t *result, const uint64_t *product,
 	return true;
 }
 
-/* Computes result = (left * right) % curve_p. */
+/*
+ * Computes result = (left * right) % curve_p.  P-256 and P-384 get their own
+ * unrolled multiplication feeding straight into the matching reduction.
+ */
 void _vli_mod_mult_fast(uint64_t *result, const uint64_t *left,
 			const uint64_t *right, const uint64_t *curve_prime,
 			unsigned int ndigits)
 {
 	uint64_t product[2 * L_ECC_MAX_DIGITS];
 
-	vli_mult(product, left, right, ndigits);
-	_vli_mmod_fast(result, product, curve_prime, ndigits);
+	switch (ndigits) {
+	case 4:
+		vli_mult(product, left, right, 4);
+		vli_mmod_fast_256(result, product, curve_prime);
+		break;
+	case 6:
+		vli_mult(product, left, right, 6);
+		vli_mmod_fast_384(result, product, curve_prime);
+		break;
+	default:
+		vli_mult(product, left, right, ndigits);
+		_vli_mmod_fast(result, product, curve_prime, ndigits);
+		break;
+	}
 }
 
 /* Computes result = left^2 % curve_p. */
@@ -665,8 +762,59 @@ void _vli_mod_square_fast(uint64_t *result, const uint64_t *left,
 {
 	uint64_t product[2 * L_ECC_MAX_DIGITS];
 
-	vli_square(product, left, ndigits);
-	_vli_mmod_fast(result, product, curve_prime, ndigits);
+	switch (ndigits) {
+	case 4:
+		vli_square(product, left, 4);
+		vli_mmod_fast_256(result, product, curve_prime);
+		break;
+	case 6:
+		vli_square(product, left, 6);
+		vli_mmod_fast_384(result, product, curve_prime);
+		break;
+	default:
+		vli_square(product, left, ndigits);
+		_vli_mmod_fast(result, product, curve_prime, ndigits);
+		break;
+	}
+}
+
+/* Computes result = (left * right) % mod, for moduli other than the prime */
+void _vli_mod_mult_slow(uint64_t *result, const uint64_t *left,
+			const uint64_t *right, const uint64_t *mod,
+			unsigned int ndigits)
+{
+	uint64_t product[2 * L_ECC_MAX_DIGITS];
+
+	vli_mult(product, left, right, ndigits);
+	_vli_mmod_slow(result, product, mod, ndigits);
+}
+
+/*
+ * Computes result = (1 / input) % curve_prime as input^(p - 2).  Unlike
+ * _vli_mod_inv the sequence of operations only depends on the (public)
+ * prime, not on input.
+ */
+void _vli_mod_inv_prime(uint64_t *result, const uint64_t *input,
+				const uint64_t *curve_prime,
+				unsigned int ndigits)
+{
+	uint64_t exp[L_ECC_MAX_DIGITS];
+	uint64_t r[L_ECC_MAX_DIGITS];
+	uint64_t two[L_ECC_MAX_DIGITS] = { 2 };
+	int i;
+
+	vli_sub(exp, curve_prime, two, ndigits);
+	vli_set(r, input, ndigits);
+
+	/* The top bit of every supported prime is set */
+	for (i = ndigits * 64 - 2; i >= 0; i--) {
+		_vli_mod_square_fast(r, r, curve_prime, ndigits);
+
+		if (vli_test_bit(exp, i))
+			_vli_mod_mult_fast(r, r, input, curve_prime, ndigits);
+	}
+
+	vli_set(result, r, ndigits);
 }
 
 #define EVEN(vli) (!(vli[0] & 1))
@@ -756,7 +904,7 @@ void _vli_mod_inv(uint64_t *result, const uint64_t *input,
  */
 
 /* Double in place */
-static void ecc_point_double_jacobian(uint64_t *x1, uint64_t *y1, uint64_t *z1,
+void _ecc_point_double_jacobian(uint64_t *x1, uint64_t *y1, uint64_t *z1,
 					const uint64_t *curve_prime,
 					unsigned int ndigits)
 {
@@ -849,7 +997,7 @@ static void xycz_initial_double(uint64_t *x1, uint64_t *y1, uint64_t *x2,
 
 	apply_z(x1, y1, z, curve_prime, ndigits);
 
-	ecc_point_double_jacobian(x1, y1, z, curve_prime, ndigits);
+	_ecc_point_double_jacobian(x1, y1, z, curve_prime, ndigits);
 
 	apply_z(x2, y2, z, curve_prime, ndigits);
 }
@@ -952,15 +1100,22 @@ static void xycz_add_c(uint64_t *x1, uint64_t *y1, uint64_t *x2, uint64_t *y2,
 	vli_set(x1, t7, ndigits);
 }
 
-void _ecc_point_mult(struct l_ecc_point *result,
-			const struct l_ecc_point *point, const uint64_t *scalar,
-			uint64_t *initial_z, const uint64_t *curve_prime)
+/*
+ * Montgomery ladder, the result is left in affine form unless result_z is
+ * given, in which case the final inversion is skipped and result_z receives
+ * the Jacobian Z coordinate.
+ */
+static void ecc_point_mult(struct l_ecc_point *result,
+				const struct l_ecc_point *point,
+				const uint64_t *scalar, uint64_t *initial_z,
+				const uint64_t *curve_prime, uint64_t *result_z)
 {
 	/* R0 and R1 */
 	const struct l_ecc_curve *curve = point->curve;
 	uint64_t rx[2][L_ECC_MAX_DIGITS];
 	uint64_t ry[2][L_ECC_MAX_DIGITS];
 	uint64_t z[L_ECC_MAX_DIGITS];
+	uint64_t num[L_ECC_MAX_DIGITS];
 	uint64_t sk[2][L_ECC_MAX_DIGITS];
 	int i, nb;
 	unsigned int ndigits = curve->ndigits;
@@ -998,23 +1153,47 @@ void _ecc_point_mult(struct l_ecc_point *result,
 	/* xP * Yb * (X1 - X0) */
 	_vli_mod_mult_fast(z, z, point->x, curve_prime, ndigits);
 
-	/* 1 / (xP * Yb * (X1 - X0)) */
-	_vli_mod_inv(z, z, curve_prime, ndigits);
-
-	/* yP / (xP * Yb * (X1 - X0)) */
-	_vli_mod_mult_fast(z, z, point->y, curve_prime, ndigits);
-	/* Xb * yP / (xP * Yb * (X1 - X0)) */
-	_vli_mod_mult_fast(z, z, rx[1 - nb], curve_prime, ndigits);
-	/* End 1/Z calculation */
+	/* Xb * yP */
+	_vli_mod_mult_fast(num, point->y, rx[1 - nb], curve_prime, ndigits);
 
 	xycz_add(rx[nb], ry[nb], rx[1 - nb], ry[1 - nb], curve_prime, ndigits);
 
-	apply_z(rx[0], ry[0], z, curve_prime, ndigits);
+	if (result_z) {
+		/*
+		 * 1/Z = Xb * yP / (xP * Yb * (X1 - X0)), so scaling by
+		 * Xb * yP leaves xP * Yb * (X1 - X0) as the Jacobian Z
+		 */
+		apply_z(rx[0], ry[0], num, curve_prime, ndigits);
+		vli_set(result_z, z, ndigits);
+	} else {
+		/* 1 / (xP * Yb * (X1 - X0)) */
+		_vli_mod_inv_prime(z, z, curve_prime, ndigits);
+		/* Xb * yP / (xP * Yb * (X1 - X0)) */
+		_vli_mod_mult_fast(z, z, num, curve_prime, ndigits);
+		/* End 1/Z calculation */
+
+		apply_z(rx[0], ry[0], z, curve_prime, ndigits);
+	}
 
 	vli_set(result->x, rx[0], ndigits);
 	vli_set(result->y, ry[0], ndigits);
 }
 
+void _ecc_point_mult(struct l_ecc_point *result,
+			const struct l_ecc_point *point, const uint64_t *scalar,
+			uint64_t *initial_z, const uint64_t *curve_prime)
+{
+	ecc_point_mult(result, point, scalar, initial_z, curve_prime, NULL);
+}
+
+void _ecc_point_mult_jacobian(struct l_ecc_point *result,
+				const struct l_ecc_point *point,
+				const uint64_t *scalar)
+{
+	ecc_point_mult(result, point, scalar, NULL, point->curve->p,
+			result->z);
+}
+
 /* Returns true if p_point is the point at infinity, false otherwise. */
 bool _ecc_point_is_zero(const struct l_ecc_point *point)
 {
@@ -12,10 +12,18 @@
 #include "util.h"
 
 struct l_ecc_curve;
+struct ecc_g_table;
 
+/*
+ * Points are kept in affine form unless projective is set, in which case
+ * (x, y, z) are Jacobian coordinates (x / z^2, y / z^3) waiting for
+ * normalization.  z = 0 is the point at infinity.
+ */
 struct l_ecc_point {
 	uint64_t x[L_ECC_MAX_DIGITS];
 	uint64_t y[L_ECC_MAX_DIGITS];
+	uint64_t z[L_ECC_MAX_DIGITS];
+	bool projective;
 	const struct l_ecc_curve *curve;
 };
 
@@ -29,6 +37,9 @@ struct l_ecc_curve {
 	uint64_t n[L_ECC_MAX_DIGITS];
 	uint64_t b[L_ECC_MAX_DIGITS];
 	int z;
+	struct ecc_g_table *g_table;
+	/* Montgomery curve, only x-coordinate (u) operations are valid */
+	bool montgomery;
 };
 
 struct l_ecc_scalar {
@@ -78,6 +89,10 @@ void _ecc_native2be(uint64_t *dest, const uint64_t *native,
 void _vli_mod_inv(uint64_t *result, const uint64_t *input, const uint64_t *mod,
 			unsigned int ndigits);
 
+void _vli_mod_inv_prime(uint64_t *result, const uint64_t *input,
+				const uint64_t *curve_prime,
+				unsigned int ndigits);
+
 void _vli_mod_sub(uint64_t *result, const uint64_t *left, const uint64_t *right,
 		const uint64_t *mod, unsigned int ndigits);
 
@@ -95,6 +110,9 @@ bool _vli_mmod_fast(uint64_t *result, const uint64_t *product,
 void _vli_mod_mult_fast(uint64_t *result, const uint64_t *left,
 		const uint64_t *right, const uint64_t *curve_prime,
 		unsigned int ndigits);
+void _vli_mod_mult_slow(uint64_t *result, const uint64_t *left,
+			const uint64_t *right, const uint64_t *mod,
+			unsigned int ndigits);
 void _vli_mod_square_fast(uint64_t *result, const uint64_t *left,
 					const uint64_t *curve_prime,
 					unsigned int ndigits);
@@ -112,6 +130,8 @@ uint64_t _vli_sub(uint64_t *result, const uint64_t *left,
 int _vli_legendre(uint64_t *val, const uint64_t *p, unsigned int ndigits);
 
 bool _ecc_point_is_zero(const struct l_ecc_point *point);
+const struct l_ecc_point *_ecc_point_affine(const struct l_ecc_point *p,
+						struct l_ecc_point *tmp);
 
 void _ecc_calculate_p2(const struct l_ecc_curve *curve, uint64_t *p2);
 
@@ -121,8 +141,26 @@ bool _ecc_compute_y(const struct l_ecc_curve *curve, uint64_t *y,
 void _ecc_point_mult(struct l_ecc_point *result,
 			const struct l_ecc_point *point, const uint64_t *scalar,
 			uint64_t *initial_z, const uint64_t *curve_prime);
+void _ecc_point_mult_jacobian(struct l_ecc_point *result,
+				const struct l_ecc_point *point,
+				const uint64_t *scalar);
+void _ecc_point_double_jacobian(uint64_t *x1, uint64_t *y1, uint64_t *z1,
+					const uint64_t *curve_prime,
+					unsigned int ndigits);
+void _ecc_point_mult_g(struct l_ecc_point *result,
+			const struct l_ecc_curve *curve,
+			const uint64_t *scalar);
+void _ecc_point_mult_g_jacobian(struct l_ecc_point *result,
+				const uint64_t *scalar);
 void _ecc_point_add(struct l_ecc_point *ret, const struct l_ecc_point *p,
 			const struct l_ecc_point *q,
 			const uint64_t *curve_prime);
 struct l_ecc_scalar *_ecc_constant_new(const struct l_ecc_curve *curve,
 						const void *buf, size_t len);
+
+bool _ecc_ecdsa_verify(const struct l_ecc_point *q,
+			const uint8_t *hash, size_t hash_len,
+			const uint8_t *r, size_t r_len,
+			const uint8_t *s, size_t s_len);
+
+void _x25519_mult(uint64_t *result, const uint64_t *scalar, const uint64_t *u);
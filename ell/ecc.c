@@ -24,6 +24,25 @@
 #include "private.h"
 #include "missing.h"
 
+/*
+ * Fixed-base multiplication tables for the curve generator.  Window w holds
+ * the affine points j * 16^w * G for j = 1 ... 15, stored as x followed by
+ * y.  The tables are generated on first use and published with an atomic
+ * pointer swap, so concurrent first users never see a partial table.
+ */
+#define G_WINDOW_BITS		4
+#define G_WINDOW_POINTS		((1 << G_WINDOW_BITS) - 1)
+#define G_NUM_WINDOWS(ndigits)	((ndigits) * 64 / G_WINDOW_BITS)
+#define G_TABLE_SIZE(ndigits)	\
+	(G_NUM_WINDOWS(ndigits) * G_WINDOW_POINTS * 2 * (ndigits))
+
+struct ecc_g_table {
+	uint64_t *points;
+};
+
+static struct ecc_g_table p256_g_table;
+static struct ecc_g_table p384_g_table;
+
 /*
  * RFC 5114 - Section 2.6 256-bit Random ECP Group
  */
@@ -52,6 +71,7 @@ static const struct l_ecc_curve p256 = {
 	.n = P256_CURVE_N,
 	.b = P256_CURVE_B,
 	.z = -10,
+	.g_table = &p256_g_table,
 };
 
 /*
@@ -87,11 +107,39 @@ static const struct l_ecc_curve p384 = {
 	.n = P384_CURVE_N,
 	.b = P384_CURVE_B,
 	.z = -12,
+	.g_table = &p384_g_table,
 };
 
+#ifdef __SIZEOF_INT128__
+/*
+ * RFC 7748 - Section 4.1 Curve25519, only usable for X25519 key exchange.
+ * There is no IKE group since none of the IKE/SAE users can handle it.
+ */
+#define X25519_CURVE_P { 0xFFFFFFFFFFFFFFEDull, 0xFFFFFFFFFFFFFFFFull, \
+			0xFFFFFFFFFFFFFFFFull, 0x7FFFFFFFFFFFFFFFull }
+#define X25519_CURVE_N { 0x5812631A5CF5D3EDull, 0x14DEF9DEA2F79CD6ull, \
+			0x0000000000000000ull, 0x1000000000000000ull }
+
+static const struct l_ecc_curve x25519 = {
+	.name = "x25519",
+	.tls_group = 29,
+	.ndigits = 4,
+	.g = {
+		.x = { 9 },
+		.curve = &x25519
+	},
+	.p = X25519_CURVE_P,
+	.n = X25519_CURVE_N,
+	.montgomery = true,
+};
+#endif
+
 static const struct l_ecc_curve *curves[] = {
 	&p384,
 	&p256,
+#ifdef __SIZEOF_INT128__
+	&x25519,
+#endif
 };
 
 /* Returns supported IKE groups, sorted by the highest effective key size */
@@ -101,12 +149,16 @@ LIB_EXPORT const unsigned int *l_ecc_supported_ike_groups(void)
 	static bool ike_first = true;
 
 	if (ike_first) {
-		unsigned int i;
+		unsigned int i, n = 0;
 
-		for (i = 0; i < L_ARRAY_SIZE(curves); i++)
-			supported_ike_groups[i] = curves[i]->ike_group;
+		for (i = 0; i < L_ARRAY_SIZE(curves); i++) {
+			if (!curves[i]->ike_group)
+				continue;
 
-		supported_ike_groups[i] = 0;
+			supported_ike_groups[n++] = curves[i]->ike_group;
+		}
+
+		supported_ike_groups[n] = 0;
 		ike_first = false;
 	}
 
@@ -134,12 +186,12 @@ LIB_EXPORT const unsigned int *l_ecc_supported_tls_groups(void)
 
 LIB_EXPORT const struct l_ecc_curve *l_ecc_curve_from_name(const char *name)
 {
-	int i;
+	unsigned int i;
 
 	if (unlikely(!name))
 		return NULL;
 
-	for (i = 0; curves[i]; i++) {
+	for (i = 0; i < L_ARRAY_SIZE(curves); i++) {
 		if (!strcmp(curves[i]->name, name))
 			return curves[i];
 	}
@@ -152,6 +204,9 @@ LIB_EXPORT const struct l_ecc_curve *l_ecc_curve_from_ike_group(
 {
 	unsigned int i;
 
+	if (!group)
+		return NULL;
+
 	for (i = 0; i < L_ARRAY_SIZE(curves); i++) {
 		if (curves[i]->ike_group == group)
 			return curves[i];
@@ -279,6 +334,25 @@ void _ecc_native2be(uint64_t *dest, const uint64_t *native,
 	memcpy(dest, tmp, ndigits * 8);
 }
 
+/* Montgomery curves (RFC 7748) use little-endian encodings throughout */
+static void ecc_le2native(uint64_t *dest, const uint8_t *bytes,
+				unsigned int ndigits)
+{
+	unsigned int i;
+
+	for (i = 0; i < ndigits; i++)
+		dest[i] = l_get_le64(bytes + i * 8);
+}
+
+static void ecc_native2le(uint8_t *dest, const uint64_t *native,
+				unsigned int ndigits)
+{
+	unsigned int i;
+
+	for (i = 0; i < ndigits; i++)
+		l_put_le64(native[i], dest + i * 8);
+}
+
 static void ecc_compute_y_sqr(const struct l_ecc_curve *curve,
 					uint64_t *y_sqr, const uint64_t *x)
 {
@@ -414,7 +488,7 @@ void _ecc_point_add(struct l_ecc_point *ret, const struct l_ecc_point *p,
 	/* kp2 = px - qx */
 	_vli_mod_sub(kp2, q->x, p->x, curve_prime, ndigits);
 	/* s = kp1/kp2 */
-	_vli_mod_inv(kp2, kp2, curve_prime, ndigits);
+	_vli_mod_inv_prime(kp2, kp2, curve_prime, ndigits);
 	_vli_mod_mult_fast(s, kp1, kp2, curve_prime, ndigits);
 	/* rx = s^2 - px - qx */
 	_vli_mod_mult_fast(kp1, s, s, curve_prime, ndigits);
@@ -429,6 +503,796 @@ void _ecc_point_add(struct l_ecc_point *ret, const struct l_ecc_point *p,
 	memcpy(ret->y, resy, ndigits * 8);
 }
 
+/* Point in homogeneous projective coordinates, (0:1:0) is the identity */
+struct ecc_proj_point {
+	uint64_t x[L_ECC_MAX_DIGITS];
+	uint64_t y[L_ECC_MAX_DIGITS];
+	uint64_t z[L_ECC_MAX_DIGITS];
+};
+
+/*
+ * r = p + q using the complete addition formula for a = -3 curves from
+ * Renes, Costello, Batina: "Complete addition formulas for prime order
+ * elliptic curves", Algorithm 4.  There are no exceptional cases, doubling
+ * and the identity are handled by the same sequence of operations.
+ */
+static void ecc_proj_point_add(struct ecc_proj_point *r,
+				const struct ecc_proj_point *p,
+				const struct ecc_proj_point *q,
+				const struct l_ecc_curve *curve)
+{
+	const uint64_t *prime = curve->p;
+	unsigned int nd = curve->ndigits;
+	uint64_t t0[L_ECC_MAX_DIGITS];
+	uint64_t t1[L_ECC_MAX_DIGITS];
+	uint64_t t2[L_ECC_MAX_DIGITS];
+	uint64_t t3[L_ECC_MAX_DIGITS];
+	uint64_t t4[L_ECC_MAX_DIGITS];
+	uint64_t x3[L_ECC_MAX_DIGITS];
+	uint64_t y3[L_ECC_MAX_DIGITS];
+	uint64_t z3[L_ECC_MAX_DIGITS];
+
+	_vli_mod_mult_fast(t0, p->x, q->x, prime, nd);
+	_vli_mod_mult_fast(t1, p->y, q->y, prime, nd);
+	_vli_mod_mult_fast(t2, p->z, q->z, prime, nd);
+	_vli_mod_add(t3, p->x, p->y, prime, nd);
+	_vli_mod_add(t4, q->x, q->y, prime, nd);
+	_vli_mod_mult_fast(t3, t3, t4, prime, nd);
+	_vli_mod_add(t4, t0, t1, prime, nd);
+	_vli_mod_sub(t3, t3, t4, prime, nd);
+	_vli_mod_add(t4, p->y, p->z, prime, nd);
+	_vli_mod_add(x3, q->y, q->z, prime, nd);
+	_vli_mod_mult_fast(t4, t4, x3, prime, nd);
+	_vli_mod_add(x3, t1, t2, prime, nd);
+	_vli_mod_sub(t4, t4, x3, prime, nd);
+	_vli_mod_add(x3, p->x, p->z, prime, nd);
+	_vli_mod_add(y3, q->x, q->z, prime, nd);
+	_vli_mod_mult_fast(x3, x3, y3, prime, nd);
+	_vli_mod_add(y3, t0, t2, prime, nd);
+	_vli_mod_sub(y3, x3, y3, prime, nd);
+	_vli_mod_mult_fast(z3, curve->b, t2, prime, nd);
+	_vli_mod_sub(x3, y3, z3, prime, nd);
+	_vli_mod_add(z3, x3, x3, prime, nd);
+	_vli_mod_add(x3, x3, z3, prime, nd);
+	_vli_mod_sub(z3, t1, x3, prime, nd);
+	_vli_mod_add(x3, t1, x3, prime, nd);
+	_vli_mod_mult_fast(y3, curve->b, y3, prime, nd);
+	_vli_mod_add(t1, t2, t2, prime, nd);
+	_vli_mod_add(t2, t1, t2, prime, nd);
+	_vli_mod_sub(y3, y3, t2, prime, nd);
+	_vli_mod_sub(y3, y3, t0, prime, nd);
+	_vli_mod_add(t1, y3, y3, prime, nd);
+	_vli_mod_add(y3, t1, y3, prime, nd);
+	_vli_mod_add(t1, t0, t0, prime, nd);
+	_vli_mod_add(t0, t1, t0, prime, nd);
+	_vli_mod_sub(t0, t0, t2, prime, nd);
+	_vli_mod_mult_fast(t1, t4, y3, prime, nd);
+	_vli_mod_mult_fast(t2, t0, y3, prime, nd);
+	_vli_mod_mult_fast(y3, x3, z3, prime, nd);
+	_vli_mod_add(y3, y3, t2, prime, nd);
+	_vli_mod_mult_fast(x3, x3, t3, prime, nd);
+	_vli_mod_sub(x3, x3, t1, prime, nd);
+	_vli_mod_mult_fast(z3, z3, t4, prime, nd);
+	_vli_mod_mult_fast(t1, t3, t0, prime, nd);
+	_vli_mod_add(z3, z3, t1, prime, nd);
+
+	memcpy(r->x, x3, nd * 8);
+	memcpy(r->y, y3, nd * 8);
+	memcpy(r->z, z3, nd * 8);
+}
+
+static const uint64_t *ecc_g_table_init(const struct l_ecc_curve *curve)
+{
+	struct ecc_g_table *table = curve->g_table;
+	unsigned int nd = curve->ndigits;
+	uint64_t *points;
+	uint64_t *expected = NULL;
+	unsigned int n_points = G_NUM_WINDOWS(nd) * G_WINDOW_POINTS;
+	uint64_t (*z)[L_ECC_MAX_DIGITS];
+	uint64_t (*acc)[L_ECC_MAX_DIGITS];
+	uint64_t inv[L_ECC_MAX_DIGITS];
+	uint64_t zinv[L_ECC_MAX_DIGITS];
+	struct ecc_proj_point base;
+	struct ecc_proj_point p;
+	unsigned int w, j, k;
+
+	points = l_malloc(G_TABLE_SIZE(nd) * sizeof(uint64_t));
+	z = l_malloc(n_points * sizeof(*z));
+	acc = l_malloc(n_points * sizeof(*acc));
+
+	memset(&base, 0, sizeof(base));
+	memcpy(base.x, curve->g.x, nd * 8);
+	memcpy(base.y, curve->g.y, nd * 8);
+	base.z[0] = 1;
+
+	for (w = 0, k = 0; w < G_NUM_WINDOWS(nd); w++) {
+		p = base;
+
+		for (j = 0; j < G_WINDOW_POINTS; j++, k++) {
+			uint64_t *entry = points + k * 2 * nd;
+
+			memcpy(entry, p.x, nd * 8);
+			memcpy(entry + nd, p.y, nd * 8);
+			memcpy(z[k], p.z, nd * 8);
+
+			ecc_proj_point_add(&p, &p, &base, curve);
+		}
+
+		/* p is now 16 * base */
+		base = p;
+	}
+
+	/* Convert all the points to affine with a single inversion */
+	memcpy(acc[0], z[0], nd * 8);
+
+	for (k = 1; k < n_points; k++)
+		_vli_mod_mult_fast(acc[k], acc[k - 1], z[k], curve->p, nd);
+
+	_vli_mod_inv(inv, acc[n_points - 1], curve->p, nd);
+
+	for (k = n_points; k-- > 0;) {
+		uint64_t *entry = points + k * 2 * nd;
+
+		if (k) {
+			_vli_mod_mult_fast(zinv, inv, acc[k - 1], curve->p, nd);
+			_vli_mod_mult_fast(inv, inv, z[k], curve->p, nd);
+		} else
+			memcpy(zinv, inv, nd * 8);
+
+		_vli_mod_mult_fast(entry, entry, zinv, curve->p, nd);
+		_vli_mod_mult_fast(entry + nd, entry + nd, zinv, curve->p, nd);
+	}
+
+	l_free(z);
+	l_free(acc);
+
+	/* Another thread may have won the race, use its table then */
+	if (!__atomic_compare_exchange_n(&table->points, &expected, points,
+						false, __ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE)) {
+		l_free(points);
+		return expected;
+	}
+
+	return points;
+}
+
+/*
+ * result = scalar * G using the precomputed tables.  Every window adds
+ * exactly one table point which is selected by scanning the whole window,
+ * so neither the memory access pattern nor the sequence of field operations
+ * depends on the scalar.
+ */
+static void ecc_point_mult_g(struct l_ecc_point *result,
+				const struct l_ecc_curve *curve,
+				const uint64_t *scalar, uint64_t *result_z)
+{
+	const uint64_t *points;
+	unsigned int nd = curve->ndigits;
+	struct ecc_proj_point r;
+	struct ecc_proj_point q;
+	uint64_t zinv[L_ECC_MAX_DIGITS];
+	unsigned int w, j, i;
+
+	points = __atomic_load_n(&curve->g_table->points, __ATOMIC_ACQUIRE);
+	if (!points)
+		points = ecc_g_table_init(curve);
+
+	memset(&r, 0, sizeof(r));
+	r.y[0] = 1;
+
+	memset(&q, 0, sizeof(q));
+
+	for (w = 0; w < G_NUM_WINDOWS(nd); w++) {
+		const uint64_t *entries = points +
+					w * G_WINDOW_POINTS * 2 * nd;
+		unsigned int shift = (w * G_WINDOW_BITS) % 64;
+		uint64_t d = (scalar[w * G_WINDOW_BITS / 64] >> shift) &
+					G_WINDOW_POINTS;
+		uint64_t is_zero = (d - 1) >> 63;
+
+		memset(q.x, 0, nd * 8);
+		memset(q.y, 0, nd * 8);
+
+		for (j = 0; j < G_WINDOW_POINTS; j++) {
+			const uint64_t *entry = entries + j * 2 * nd;
+			uint64_t mask = -(((d ^ (j + 1)) - 1) >> 63);
+
+			for (i = 0; i < nd; i++) {
+				q.x[i] |= entry[i] & mask;
+				q.y[i] |= entry[nd + i] & mask;
+			}
+		}
+
+		/* A zero digit selects the identity (0:1:0) */
+		q.y[0] |= is_zero;
+		q.z[0] = is_zero ^ 1;
+
+		ecc_proj_point_add(&r, &r, &q, curve);
+	}
+
+	if (result_z) {
+		/* (X : Y : Z) => Jacobian (X * Z, Y * Z^2, Z) */
+		_vli_mod_mult_fast(result->x, r.x, r.z, curve->p, nd);
+		_vli_mod_mult_fast(result->y, r.y, r.z, curve->p, nd);
+		_vli_mod_mult_fast(result->y, result->y, r.z, curve->p, nd);
+		memcpy(result_z, r.z, nd * 8);
+		return;
+	}
+
+	_vli_mod_inv_prime(zinv, r.z, curve->p, nd);
+	_vli_mod_mult_fast(result->x, r.x, zinv, curve->p, nd);
+	_vli_mod_mult_fast(result->y, r.y, zinv, curve->p, nd);
+}
+
+void _ecc_point_mult_g(struct l_ecc_point *result,
+			const struct l_ecc_curve *curve,
+			const uint64_t *scalar)
+{
+	ecc_point_mult_g(result, curve, scalar, NULL);
+}
+
+void _ecc_point_mult_g_jacobian(struct l_ecc_point *result,
+				const uint64_t *scalar)
+{
+	ecc_point_mult_g(result, result->curve, scalar, result->z);
+}
+
+/*
+ * Convert points to affine form sharing a single inversion between all of
+ * them (Montgomery's trick).  Points at infinity are mapped to x = y = 0
+ * without branching on their coordinates.
+ */
+static void ecc_points_normalize(struct l_ecc_point **points, unsigned int n)
+{
+	const struct l_ecc_curve *curve = points[0]->curve;
+	unsigned int nd = curve->ndigits;
+	uint64_t (*z)[L_ECC_MAX_DIGITS];
+	uint64_t (*acc)[L_ECC_MAX_DIGITS];
+	uint64_t *infinity;
+	uint64_t inv[L_ECC_MAX_DIGITS];
+	uint64_t zinv[L_ECC_MAX_DIGITS];
+	uint64_t zinv2[L_ECC_MAX_DIGITS];
+	unsigned int k, i;
+
+	z = l_malloc(n * sizeof(*z));
+	acc = l_malloc(n * sizeof(*acc));
+	infinity = l_malloc(n * sizeof(*infinity));
+
+	for (k = 0; k < n; k++) {
+		const struct l_ecc_point *p = points[k];
+		uint64_t bits = 0;
+
+		memset(z[k], 0, nd * 8);
+		infinity[k] = 0;
+
+		/* Affine points are simply treated as z = 1 */
+		if (p->projective) {
+			for (i = 0; i < nd; i++) {
+				z[k][i] = p->z[i];
+				bits |= p->z[i];
+			}
+
+			/* All ones if z = 0, use z = 1 to keep the product valid */
+			infinity[k] = -((((bits >> 1) | (bits & 1)) - 1) >> 63);
+		}
+
+		z[k][0] |= infinity[k] & 1;
+		z[k][0] |= !p->projective;
+
+		if (k)
+			_vli_mod_mult_fast(acc[k], acc[k - 1], z[k],
+						curve->p, nd);
+		else
+			memcpy(acc[0], z[0], nd * 8);
+	}
+
+	_vli_mod_inv_prime(inv, acc[n - 1], curve->p, nd);
+
+	for (k = n; k-- > 0;) {
+		struct l_ecc_point *p = points[k];
+
+		if (k) {
+			_vli_mod_mult_fast(zinv, inv, acc[k - 1], curve->p, nd);
+			_vli_mod_mult_fast(inv, inv, z[k], curve->p, nd);
+		} else
+			memcpy(zinv, inv, nd * 8);
+
+		if (!p->projective)
+			continue;
+
+		_vli_mod_square_fast(zinv2, zinv, curve->p, nd);
+		_vli_mod_mult_fast(p->x, p->x, zinv2, curve->p, nd);
+		_vli_mod_mult_fast(zinv2, zinv2, zinv, curve->p, nd);
+		_vli_mod_mult_fast(p->y, p->y, zinv2, curve->p, nd);
+
+		for (i = 0; i < nd; i++) {
+			p->x[i] &= ~infinity[k];
+			p->y[i] &= ~infinity[k];
+		}
+
+		explicit_bzero(p->z, nd * 8);
+		p->projective = false;
+	}
+
+	explicit_bzero(z, n * sizeof(*z));
+	explicit_bzero(acc, n * sizeof(*acc));
+	l_free(z);
+	l_free(acc);
+	l_free(infinity);
+}
+
+/*
+ * Points produced by the *_projective functions are normalized when their
+ * coordinates are needed.  The caller's point is never modified, a
+ * projective one is normalized into @tmp instead.
+ */
+const struct l_ecc_point *_ecc_point_affine(const struct l_ecc_point *p,
+						struct l_ecc_point *tmp)
+{
+	struct l_ecc_point *copy = tmp;
+
+	if (likely(!p->projective))
+		return p;
+
+	*tmp = *p;
+	ecc_points_normalize(&copy, 1);
+
+	return tmp;
+}
+
+/*
+ * Returns affine copies of @points, normalized with a single inversion, if
+ * any of them is projective, NULL otherwise
+ */
+static struct l_ecc_point **ecc_points_affine_copy(
+				const struct l_ecc_point *const *points,
+				unsigned int n)
+{
+	struct l_ecc_point **copies;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		if (points[i]->projective)
+			break;
+
+	if (likely(i == n))
+		return NULL;
+
+	copies = l_new(struct l_ecc_point *, n);
+
+	for (i = 0; i < n; i++)
+		copies[i] = l_memdup(points[i], sizeof(struct l_ecc_point));
+
+	ecc_points_normalize(copies, n);
+
+	return copies;
+}
+
+static void ecc_points_free_copy(struct l_ecc_point **copies, unsigned int n)
+{
+	unsigned int i;
+
+	if (!copies)
+		return;
+
+	for (i = 0; i < n; i++)
+		l_free(copies[i]);
+
+	l_free(copies);
+}
+
+/*
+ * r = 2 * p using the exception-free doubling formula for a = -3 curves
+ * from Renes, Costello, Batina, Algorithm 6
+ */
+static void ecc_proj_point_double(struct ecc_proj_point *r,
+					const struct ecc_proj_point *p,
+					const struct l_ecc_curve *curve)
+{
+	const uint64_t *prime = curve->p;
+	unsigned int nd = curve->ndigits;
+	uint64_t t0[L_ECC_MAX_DIGITS];
+	uint64_t t1[L_ECC_MAX_DIGITS];
+	uint64_t t2[L_ECC_MAX_DIGITS];
+	uint64_t t3[L_ECC_MAX_DIGITS];
+	uint64_t x3[L_ECC_MAX_DIGITS];
+	uint64_t y3[L_ECC_MAX_DIGITS];
+	uint64_t z3[L_ECC_MAX_DIGITS];
+
+	_vli_mod_square_fast(t0, p->x, prime, nd);
+	_vli_mod_square_fast(t1, p->y, prime, nd);
+	_vli_mod_square_fast(t2, p->z, prime, nd);
+	_vli_mod_mult_fast(t3, p->x, p->y, prime, nd);
+	_vli_mod_add(t3, t3, t3, prime, nd);
+	_vli_mod_mult_fast(z3, p->x, p->z, prime, nd);
+	_vli_mod_add(z3, z3, z3, prime, nd);
+	_vli_mod_mult_fast(y3, curve->b, t2, prime, nd);
+	_vli_mod_sub(y3, y3, z3, prime, nd);
+	_vli_mod_add(x3, y3, y3, prime, nd);
+	_vli_mod_add(y3, x3, y3, prime, nd);
+	_vli_mod_sub(x3, t1, y3, prime, nd);
+	_vli_mod_add(y3, t1, y3, prime, nd);
+	_vli_mod_mult_fast(y3, x3, y3, prime, nd);
+	_vli_mod_mult_fast(x3, x3, t3, prime, nd);
+	_vli_mod_add(t3, t2, t2, prime, nd);
+	_vli_mod_add(t2, t2, t3, prime, nd);
+	_vli_mod_mult_fast(z3, curve->b, z3, prime, nd);
+	_vli_mod_sub(z3, z3, t2, prime, nd);
+	_vli_mod_sub(z3, z3, t0, prime, nd);
+	_vli_mod_add(t3, z3, z3, prime, nd);
+	_vli_mod_add(z3, z3, t3, prime, nd);
+	_vli_mod_add(t3, t0, t0, prime, nd);
+	_vli_mod_add(t0, t3, t0, prime, nd);
+	_vli_mod_sub(t0, t0, t2, prime, nd);
+	_vli_mod_mult_fast(t0, t0, z3, prime, nd);
+	_vli_mod_add(y3, y3, t0, prime, nd);
+	_vli_mod_mult_fast(t0, p->y, p->z, prime, nd);
+	_vli_mod_add(t0, t0, t0, prime, nd);
+	_vli_mod_mult_fast(z3, t0, z3, prime, nd);
+	_vli_mod_sub(x3, x3, z3, prime, nd);
+	_vli_mod_mult_fast(z3, t0, t1, prime, nd);
+	_vli_mod_add(z3, z3, z3, prime, nd);
+	_vli_mod_add(z3, z3, z3, prime, nd);
+
+	memcpy(r->x, x3, nd * 8);
+	memcpy(r->y, y3, nd * 8);
+	memcpy(r->z, z3, nd * 8);
+}
+
+static void ecc_proj_point_from_affine(struct ecc_proj_point *r,
+					const struct l_ecc_point *p)
+{
+	memset(r, 0, sizeof(*r));
+
+	/* The point at infinity is kept as x = y = 0 in affine form */
+	if (_ecc_point_is_zero(p)) {
+		r->y[0] = 1;
+		return;
+	}
+
+	memcpy(r->x, p->x, p->curve->ndigits * 8);
+	memcpy(r->y, p->y, p->curve->ndigits * 8);
+	r->z[0] = 1;
+}
+
+/*
+ * Multi-scalar multiplication window size.  Each term gets a table of
+ * 2^MSM_WINDOW_BITS points, all scanned for every window so that the
+ * access pattern is independent of the scalars.
+ */
+#define MSM_WINDOW_BITS		4
+#define MSM_WINDOW_POINTS	(1 << MSM_WINDOW_BITS)
+
+/*
+ * result = sum(scalars[i] * points[i]) using interleaved fixed windows
+ * (Straus' method).  The doublings are shared between all the terms and
+ * only a single inversion is needed at the end.  Runs in constant time
+ * with respect to the scalars.
+ */
+static void ecc_points_mult_sum(struct l_ecc_point *result,
+				const struct l_ecc_curve *curve,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n)
+{
+	unsigned int nd = curve->ndigits;
+	unsigned int n_windows = nd * 64 / MSM_WINDOW_BITS;
+	struct ecc_proj_point *tables;
+	struct ecc_proj_point r;
+	struct ecc_proj_point q;
+	uint64_t zinv[L_ECC_MAX_DIGITS];
+	unsigned int t, w, j, i;
+
+	tables = l_malloc(n * MSM_WINDOW_POINTS * sizeof(*tables));
+
+	/* Table t holds j * points[t] for j = 0 ... 15 */
+	for (t = 0; t < n; t++) {
+		struct ecc_proj_point *table = tables + t * MSM_WINDOW_POINTS;
+
+		memset(&table[0], 0, sizeof(table[0]));
+		table[0].y[0] = 1;
+		ecc_proj_point_from_affine(&table[1], points[t]);
+
+		for (j = 2; j < MSM_WINDOW_POINTS; j++)
+			ecc_proj_point_add(&table[j], &table[j - 1], &table[1],
+						curve);
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.y[0] = 1;
+
+	for (w = n_windows; w-- > 0;) {
+		unsigned int shift = (w * MSM_WINDOW_BITS) % 64;
+
+		for (j = 0; j < MSM_WINDOW_BITS; j++)
+			ecc_proj_point_double(&r, &r, curve);
+
+		for (t = 0; t < n; t++) {
+			const struct ecc_proj_point *table =
+					tables + t * MSM_WINDOW_POINTS;
+			uint64_t d = (scalars[t]->c[w * MSM_WINDOW_BITS / 64] >>
+					shift) & (MSM_WINDOW_POINTS - 1);
+
+			memset(&q, 0, sizeof(q));
+
+			for (j = 0; j < MSM_WINDOW_POINTS; j++) {
+				uint64_t mask = -(((d ^ j) - 1) >> 63);
+
+				for (i = 0; i < nd; i++) {
+					q.x[i] |= table[j].x[i] & mask;
+					q.y[i] |= table[j].y[i] & mask;
+					q.z[i] |= table[j].z[i] & mask;
+				}
+			}
+
+			ecc_proj_point_add(&r, &r, &q, curve);
+		}
+	}
+
+	/* An identity result has z = 0 and maps to x = y = 0 */
+	_vli_mod_inv_prime(zinv, r.z, curve->p, nd);
+	_vli_mod_mult_fast(result->x, r.x, zinv, curve->p, nd);
+	_vli_mod_mult_fast(result->y, r.y, zinv, curve->p, nd);
+
+	explicit_bzero(&q, sizeof(q));
+	l_free(tables);
+}
+
+/* wNAF window size for the variable time version, 8 odd multiples */
+#define MSM_WNAF_BITS		5
+#define MSM_WNAF_POINTS		(1 << (MSM_WNAF_BITS - 2))
+#define MSM_WNAF_MAX_LEN	(L_ECC_MAX_DIGITS * 64 + 1)
+
+/*
+ * Compute the width-w non-adjacent form of scalar, least significant digit
+ * first.  Every non-zero digit is odd and in the range [-15, 15].
+ */
+static unsigned int ecc_wnaf(int8_t *naf, const uint64_t *scalar,
+				unsigned int ndigits)
+{
+	uint64_t k[L_ECC_MAX_DIGITS + 1];
+	unsigned int len = 0;
+	unsigned int i;
+
+	memcpy(k, scalar, ndigits * 8);
+	k[ndigits] = 0;
+
+	while (true) {
+		int d = 0;
+
+		for (i = 0; i <= ndigits; i++)
+			if (k[i])
+				break;
+
+		if (i > ndigits)
+			break;
+
+		if (k[0] & 1) {
+			d = k[0] & ((1 << MSM_WNAF_BITS) - 1);
+
+			if (d >= 1 << (MSM_WNAF_BITS - 1))
+				d -= 1 << MSM_WNAF_BITS;
+
+			/* k -= d, only a negative d can carry */
+			k[0] -= d;
+
+			if (d < 0 && k[0] < (uint64_t) -d) {
+				for (i = 1; i <= ndigits; i++)
+					if (++k[i])
+						break;
+			}
+		}
+
+		naf[len++] = d;
+		_vli_rshift1(k, ndigits + 1);
+	}
+
+	return len;
+}
+
+/* Point in Jacobian coordinates, (X / Z^2, Y / Z^3), Z = 0 is the identity */
+struct ecc_jacobian_point {
+	uint64_t x[L_ECC_MAX_DIGITS];
+	uint64_t y[L_ECC_MAX_DIGITS];
+	uint64_t z[L_ECC_MAX_DIGITS];
+};
+
+/*
+ * r += (x2, y2) for an affine point, mixed Jacobian-affine addition.  Not
+ * constant time, doubling and the identity are handled by branching.
+ */
+static void ecc_jacobian_point_add_affine(struct ecc_jacobian_point *r,
+					const uint64_t *x2, const uint64_t *y2,
+					const struct l_ecc_curve *curve)
+{
+	static const uint64_t zero[L_ECC_MAX_DIGITS];
+	const uint64_t *prime = curve->p;
+	unsigned int nd = curve->ndigits;
+	uint64_t z1z1[L_ECC_MAX_DIGITS];
+	uint64_t u2[L_ECC_MAX_DIGITS];
+	uint64_t s2[L_ECC_MAX_DIGITS];
+	uint64_t h[L_ECC_MAX_DIGITS];
+	uint64_t hh[L_ECC_MAX_DIGITS];
+	uint64_t hhh[L_ECC_MAX_DIGITS];
+	uint64_t v[L_ECC_MAX_DIGITS];
+	uint64_t rr[L_ECC_MAX_DIGITS];
+
+	if (!_vli_cmp(r->z, zero, nd)) {
+		memcpy(r->x, x2, nd * 8);
+		memcpy(r->y, y2, nd * 8);
+		memset(r->z, 0, nd * 8);
+		r->z[0] = 1;
+		return;
+	}
+
+	_vli_mod_square_fast(z1z1, r->z, prime, nd);
+	_vli_mod_mult_fast(u2, x2, z1z1, prime, nd);
+	_vli_mod_mult_fast(s2, y2, r->z, prime, nd);
+	_vli_mod_mult_fast(s2, s2, z1z1, prime, nd);
+	_vli_mod_sub(h, u2, r->x, prime, nd);
+	_vli_mod_sub(rr, s2, r->y, prime, nd);
+
+	if (!_vli_cmp(h, zero, nd)) {
+		if (!_vli_cmp(rr, zero, nd))
+			_ecc_point_double_jacobian(r->x, r->y, r->z,
+							prime, nd);
+		else
+			memset(r->z, 0, nd * 8);
+
+		return;
+	}
+
+	_vli_mod_square_fast(hh, h, prime, nd);
+	_vli_mod_mult_fast(hhh, h, hh, prime, nd);
+	_vli_mod_mult_fast(v, r->x, hh, prime, nd);
+
+	/* x3 = r^2 - h^3 - 2 * v */
+	_vli_mod_square_fast(r->x, rr, prime, nd);
+	_vli_mod_sub(r->x, r->x, hhh, prime, nd);
+	_vli_mod_sub(r->x, r->x, v, prime, nd);
+	_vli_mod_sub(r->x, r->x, v, prime, nd);
+
+	/* y3 = r * (v - x3) - y1 * h^3 */
+	_vli_mod_sub(v, v, r->x, prime, nd);
+	_vli_mod_mult_fast(v, rr, v, prime, nd);
+	_vli_mod_mult_fast(hhh, r->y, hhh, prime, nd);
+	_vli_mod_sub(r->y, v, hhh, prime, nd);
+
+	/* z3 = z1 * h */
+	_vli_mod_mult_fast(r->z, r->z, h, prime, nd);
+}
+
+/*
+ * Variable time version of ecc_points_mult_sum using interleaved wNAF in
+ * Jacobian coordinates.  The odd multiples are converted to affine with a
+ * single shared inversion so that mixed additions can be used.  Only for
+ * use when the scalars are public, e.g. signature verification.
+ */
+static void ecc_points_mult_sum_vartime(struct l_ecc_point *result,
+				const struct l_ecc_curve *curve,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n)
+{
+	static const uint64_t zero[L_ECC_MAX_DIGITS];
+	unsigned int nd = curve->ndigits;
+	struct ecc_proj_point *proj;
+	uint64_t (*acc)[L_ECC_MAX_DIGITS];
+	uint64_t (*affine)[2][L_ECC_MAX_DIGITS];
+	uint64_t inv[L_ECC_MAX_DIGITS];
+	uint64_t zinv[L_ECC_MAX_DIGITS];
+	uint64_t neg_y[L_ECC_MAX_DIGITS];
+	struct ecc_proj_point p2;
+	struct ecc_jacobian_point r;
+	int8_t (*naf)[MSM_WNAF_MAX_LEN];
+	unsigned int *naf_len;
+	unsigned int n_entries = n * MSM_WNAF_POINTS;
+	unsigned int max_len = 0;
+	unsigned int t, j, k;
+
+	proj = l_malloc(n_entries * sizeof(*proj));
+	acc = l_malloc(n_entries * sizeof(*acc));
+	affine = l_malloc(n_entries * sizeof(*affine));
+	naf = l_malloc(n * sizeof(*naf));
+	naf_len = l_new(unsigned int, n);
+
+	/*
+	 * Table t holds (2j + 1) * points[t] for j = 0 ... 7.  Terms with the
+	 * point at infinity contribute nothing, give them an empty wNAF and a
+	 * z = 1 table so that the batched inversion below stays valid.
+	 */
+	for (t = 0; t < n; t++) {
+		struct ecc_proj_point *table = proj + t * MSM_WNAF_POINTS;
+
+		ecc_proj_point_from_affine(&table[0], points[t]);
+
+		if (_ecc_point_is_zero(points[t])) {
+			table[0].z[0] = 1;
+
+			for (j = 1; j < MSM_WNAF_POINTS; j++)
+				table[j] = table[0];
+
+			continue;
+		}
+
+		ecc_proj_point_double(&p2, &table[0], curve);
+
+		for (j = 1; j < MSM_WNAF_POINTS; j++)
+			ecc_proj_point_add(&table[j], &table[j - 1], &p2,
+						curve);
+
+		naf_len[t] = ecc_wnaf(naf[t], scalars[t]->c, nd);
+
+		if (naf_len[t] > max_len)
+			max_len = naf_len[t];
+	}
+
+	memcpy(acc[0], proj[0].z, nd * 8);
+
+	for (k = 1; k < n_entries; k++)
+		_vli_mod_mult_fast(acc[k], acc[k - 1], proj[k].z,
+					curve->p, nd);
+
+	_vli_mod_inv(inv, acc[n_entries - 1], curve->p, nd);
+
+	for (k = n_entries; k-- > 0;) {
+		if (k) {
+			_vli_mod_mult_fast(zinv, inv, acc[k - 1], curve->p, nd);
+			_vli_mod_mult_fast(inv, inv, proj[k].z, curve->p, nd);
+		} else
+			memcpy(zinv, inv, nd * 8);
+
+		_vli_mod_mult_fast(affine[k][0], proj[k].x, zinv, curve->p, nd);
+		_vli_mod_mult_fast(affine[k][1], proj[k].y, zinv, curve->p, nd);
+	}
+
+	memset(&r, 0, sizeof(r));
+
+	for (j = max_len; j-- > 0;) {
+		_ecc_point_double_jacobian(r.x, r.y, r.z, curve->p, nd);
+
+		for (t = 0; t < n; t++) {
+			const uint64_t (*entry)[L_ECC_MAX_DIGITS];
+			int d;
+
+			if (j >= naf_len[t] || !naf[t][j])
+				continue;
+
+			d = naf[t][j];
+			k = t * MSM_WNAF_POINTS + (d < 0 ? -d : d) / 2;
+			entry = affine[k];
+
+			if (d > 0) {
+				ecc_jacobian_point_add_affine(&r, entry[0],
+							entry[1], curve);
+				continue;
+			}
+
+			_vli_mod_sub(neg_y, zero, entry[1], curve->p, nd);
+			ecc_jacobian_point_add_affine(&r, entry[0], neg_y,
+							curve);
+		}
+	}
+
+	if (!_vli_cmp(r.z, zero, nd)) {
+		memset(result->x, 0, nd * 8);
+		memset(result->y, 0, nd * 8);
+	} else {
+		_vli_mod_inv(zinv, r.z, curve->p, nd);
+		_vli_mod_square_fast(inv, zinv, curve->p, nd);
+		_vli_mod_mult_fast(result->x, r.x, inv, curve->p, nd);
+		_vli_mod_mult_fast(inv, inv, zinv, curve->p, nd);
+		_vli_mod_mult_fast(result->y, r.y, inv, curve->p, nd);
+	}
+
+	l_free(naf_len);
+	l_free(naf);
+	l_free(affine);
+	l_free(acc);
+	l_free(proj);
+}
+
 /* result = (base ^ exp) % p */
 void _vli_mod_exp(uint64_t *result, const uint64_t *base, const uint64_t *exp,
 			const uint64_t *mod, unsigned int ndigits)
@@ -525,6 +1389,18 @@ LIB_EXPORT struct l_ecc_point *l_ecc_point_from_data(
 	if (!data)
 		return NULL;
 
+	/* Montgomery curve points are just the u-coordinate */
+	if (curve->montgomery) {
+		if (type != L_ECC_POINT_TYPE_FULL || len != bytes)
+			return NULL;
+
+		p = l_ecc_point_new(curve);
+		ecc_le2native(p->x, data, curve->ndigits);
+		p->x[curve->ndigits - 1] &= ~(1ull << 63);
+
+		return p;
+	}
+
 	/* Verify the data length matches a full point or X coordinate */
 	if (type == L_ECC_POINT_TYPE_FULL) {
 		if (len != bytes * 2)
@@ -613,6 +1489,9 @@ LIB_EXPORT struct l_ecc_point *l_ecc_point_from_sswu(
 	bool l;
 	struct l_ecc_point *P;
 
+	if (unlikely(curve->montgomery))
+		return NULL;
+
 	/*
 	 * m = (z^2 * u^4 + z * u^2) modulo p
 	 * u2z = u^2 * z
@@ -714,9 +1593,18 @@ LIB_EXPORT const struct l_ecc_curve *l_ecc_point_get_curve(
 LIB_EXPORT ssize_t l_ecc_point_get_x(const struct l_ecc_point *p, void *x,
 					size_t xlen)
 {
+	struct l_ecc_point tmp;
+
 	if (xlen < p->curve->ndigits * 8)
 		return -EMSGSIZE;
 
+	if (p->curve->montgomery) {
+		ecc_native2le(x, p->x, p->curve->ndigits);
+		return p->curve->ndigits * 8;
+	}
+
+	p = _ecc_point_affine(p, &tmp);
+
 	_ecc_native2be(x, p->x, p->curve->ndigits);
 
 	return p->curve->ndigits * 8;
@@ -725,9 +1613,16 @@ LIB_EXPORT ssize_t l_ecc_point_get_x(const struct l_ecc_point *p, void *x,
 LIB_EXPORT ssize_t l_ecc_point_get_y(const struct l_ecc_point *p, void *y,
 					size_t ylen)
 {
+	struct l_ecc_point tmp;
+
 	if (ylen < p->curve->ndigits * 8)
 		return -EMSGSIZE;
 
+	if (p->curve->montgomery)
+		return -ENOTSUP;
+
+	p = _ecc_point_affine(p, &tmp);
+
 	_ecc_native2be(y, p->y, p->curve->ndigits);
 
 	return p->curve->ndigits * 8;
@@ -735,15 +1630,27 @@ LIB_EXPORT ssize_t l_ecc_point_get_y(const struct l_ecc_point *p, void *y,
 
 LIB_EXPORT bool l_ecc_point_y_isodd(const struct l_ecc_point *p)
 {
+	struct l_ecc_point tmp;
+
+	p = _ecc_point_affine(p, &tmp);
+
 	return p->y[0] & 1;
 }
 
 LIB_EXPORT ssize_t l_ecc_point_get_data(const struct l_ecc_point *p, void *buf,
 					size_t len)
 {
+	struct l_ecc_point tmp;
+
+	/* Montgomery curve points only carry the u-coordinate */
+	if (p->curve->montgomery)
+		return l_ecc_point_get_x(p, buf, len);
+
 	if (len < (p->curve->ndigits * 8) * 2)
 		return -EMSGSIZE;
 
+	p = _ecc_point_affine(p, &tmp);
+
 	_ecc_native2be(buf, (uint64_t *) p->x, p->curve->ndigits);
 	_ecc_native2be(buf + (p->curve->ndigits * 8), (uint64_t *) p->y,
 				p->curve->ndigits);
@@ -758,6 +1665,7 @@ LIB_EXPORT void l_ecc_point_free(struct l_ecc_point *p)
 
 	explicit_bzero(p->x, p->curve->ndigits * 8);
 	explicit_bzero(p->y, p->curve->ndigits * 8);
+	explicit_bzero(p->z, p->curve->ndigits * 8);
 	l_free(p);
 }
 
@@ -795,6 +1703,12 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new(
 	if (!buf)
 		return c;
 
+	/* X25519 private keys are any 32 bytes, clamped when used */
+	if (curve->montgomery) {
+		ecc_le2native(c->c, buf, curve->ndigits);
+		return c;
+	}
+
 	_ecc_be2native(c->c, buf, curve->ndigits);
 
 	if (!_vli_is_zero_or_one(c->c, curve->ndigits) &&
@@ -827,7 +1741,7 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_modp(
 	uint64_t tmp[2 * L_ECC_MAX_DIGITS];
 	unsigned int ndigits = len / 8;
 
-	if (!bytes)
+	if (!bytes || curve->montgomery)
 		return NULL;
 
 	if (len % 8)
@@ -862,7 +1776,7 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_modn(
 	uint64_t tmp[2 * L_ECC_MAX_DIGITS];
 	unsigned int ndigits = len / 8;
 
-	if (!bytes)
+	if (!bytes || curve->montgomery)
 		return NULL;
 
 	if (len % 8)
@@ -902,7 +1816,7 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_reduced_1_to_n(
 	uint64_t tmp[L_ECC_MAX_DIGITS];
 	struct l_ecc_scalar *c;
 
-	if (!buf)
+	if (!buf || curve->montgomery)
 		return NULL;
 
 	if (len != curve->ndigits * 8)
@@ -930,11 +1844,16 @@ LIB_EXPORT struct l_ecc_scalar *l_ecc_scalar_new_random(
 
 	l_getrandom(r, curve->ndigits * 8);
 
+	/* Any value is a valid X25519 private key after clamping */
+	if (curve->montgomery)
+		goto done;
+
 	while (_vli_cmp(r, curve->p, curve->ndigits) > 0 ||
 			_vli_cmp(r, curve->n, curve->ndigits) > 0 ||
 			_vli_is_zero_or_one(r, curve->ndigits))
 		l_getrandom(r, curve->ndigits * 8);
 
+done:
 	return _ecc_constant_new(curve, r, curve->ndigits * 8);
 }
 
@@ -944,7 +1863,10 @@ LIB_EXPORT ssize_t l_ecc_scalar_get_data(const struct l_ecc_scalar *c,
 	if (len < c->curve->ndigits * 8)
 		return -EMSGSIZE;
 
-	_ecc_native2be(buf, (uint64_t *) c->c, c->curve->ndigits);
+	if (c->curve->montgomery)
+		ecc_native2le(buf, c->c, c->curve->ndigits);
+	else
+		_ecc_native2be(buf, (uint64_t *) c->c, c->curve->ndigits);
 
 	return c->curve->ndigits * 8;
 }
@@ -966,6 +1888,9 @@ LIB_EXPORT bool l_ecc_scalar_add(struct l_ecc_scalar *ret,
 	if (unlikely(!ret || !a || !b || !mod))
 		return false;
 
+	if (unlikely(a->curve->montgomery))
+		return false;
+
 	_vli_mod_add(ret->c, a->c, b->c, mod->c, a->curve->ndigits);
 
 	return true;
@@ -975,10 +1900,40 @@ LIB_EXPORT bool l_ecc_point_multiply(struct l_ecc_point *ret,
 					const struct l_ecc_scalar *scalar,
 					const struct l_ecc_point *point)
 {
+	struct l_ecc_point tmp;
+
 	if (unlikely(!ret || !scalar || !point))
 		return false;
 
+	if (scalar->curve->montgomery) {
+		_x25519_mult(ret->x, scalar->c, point->x);
+		return true;
+	}
+
+	point = _ecc_point_affine(point, &tmp);
 	_ecc_point_mult(ret, point, scalar->c, NULL, scalar->curve->p);
+	ret->projective = false;
+
+	return true;
+}
+
+/*
+ * Same as l_ecc_point_multiply but the result is left in projective form,
+ * saving the final inversion.  Use l_ecc_points_normalize to convert many
+ * such results at once, otherwise the point is normalized on first use.
+ */
+LIB_EXPORT bool l_ecc_point_multiply_projective(struct l_ecc_point *ret,
+					const struct l_ecc_scalar *scalar,
+					const struct l_ecc_point *point)
+{
+	struct l_ecc_point tmp;
+
+	if (unlikely(!ret || !scalar || !point || point->curve->montgomery))
+		return false;
+
+	point = _ecc_point_affine(point, &tmp);
+	_ecc_point_mult_jacobian(ret, point, scalar->c);
+	ret->projective = true;
 
 	return true;
 }
@@ -989,29 +1944,252 @@ LIB_EXPORT bool l_ecc_point_multiply_g(struct l_ecc_point *ret,
 	if (unlikely(!ret || !scalar))
 		return false;
 
-	_ecc_point_mult(ret, &scalar->curve->g, scalar->c, NULL,
-						scalar->curve->p);
+	if (scalar->curve->montgomery) {
+		_x25519_mult(ret->x, scalar->c, scalar->curve->g.x);
+		return true;
+	}
+
+	_ecc_point_mult_g(ret, scalar->curve, scalar->c);
+	ret->projective = false;
 
 	return true;
 }
 
+LIB_EXPORT bool l_ecc_point_multiply_g_projective(struct l_ecc_point *ret,
+					const struct l_ecc_scalar *scalar)
+{
+	if (unlikely(!ret || !scalar || ret->curve != scalar->curve ||
+			scalar->curve->montgomery))
+		return false;
+
+	_ecc_point_mult_g_jacobian(ret, scalar->c);
+	ret->projective = true;
+
+	return true;
+}
+
+/*
+ * Convert all the points to affine form with a single field inversion,
+ * constant time with respect to the point coordinates.  All the points must
+ * be on the same curve, points already in affine form are left untouched.
+ */
+LIB_EXPORT bool l_ecc_points_normalize(struct l_ecc_point **points,
+					unsigned int n)
+{
+	unsigned int i;
+
+	if (unlikely(!points || !n || !points[0] ||
+			points[0]->curve->montgomery))
+		return false;
+
+	for (i = 0; i < n; i++)
+		if (unlikely(!points[i] || points[i]->curve != points[0]->curve))
+			return false;
+
+	ecc_points_normalize(points, n);
+
+	return true;
+}
+
+static bool ecc_points_mult_sum_valid(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n)
+{
+	const struct l_ecc_curve *curve;
+	unsigned int i;
+
+	if (unlikely(!ret || !scalars || !points || !n))
+		return false;
+
+	curve = ret->curve;
+
+	if (unlikely(curve->montgomery))
+		return false;
+
+	for (i = 0; i < n; i++) {
+		if (unlikely(!scalars[i] || !points[i]))
+			return false;
+
+		if (unlikely(scalars[i]->curve != curve ||
+				points[i]->curve != curve))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * ret = sum(scalars[i] * points[i]) for i = 0 ... n - 1, constant time with
+ * respect to the scalars.
+ */
+LIB_EXPORT bool l_ecc_points_multiply_sum(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n)
+{
+	struct l_ecc_point **copies;
+
+	if (!ecc_points_mult_sum_valid(ret, scalars, points, n))
+		return false;
+
+	copies = ecc_points_affine_copy(points, n);
+	if (copies)
+		points = (const struct l_ecc_point *const *) copies;
+
+	ecc_points_mult_sum(ret, ret->curve, scalars, points, n);
+	ret->projective = false;
+	ecc_points_free_copy(copies, n);
+
+	return true;
+}
+
+/*
+ * Same as l_ecc_points_multiply_sum but the running time depends on the
+ * scalars.  Only use when all the inputs are public.
+ */
+LIB_EXPORT bool l_ecc_points_multiply_sum_vartime(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n)
+{
+	struct l_ecc_point **copies;
+
+	if (!ecc_points_mult_sum_valid(ret, scalars, points, n))
+		return false;
+
+	copies = ecc_points_affine_copy(points, n);
+	if (copies)
+		points = (const struct l_ecc_point *const *) copies;
+
+	ecc_points_mult_sum_vartime(ret, ret->curve, scalars, points, n);
+	ret->projective = false;
+	ecc_points_free_copy(copies, n);
+
+	return true;
+}
+
+/* Loads a big-endian integer of up to ndigits words, e.g. a DER INTEGER */
+static bool ecc_load_be_int(uint64_t *out, const uint8_t *buf, size_t len,
+				unsigned int ndigits)
+{
+	uint64_t tmp[L_ECC_MAX_DIGITS] = {};
+
+	while (len && !*buf) {
+		buf++;
+		len--;
+	}
+
+	if (len > ndigits * 8)
+		return false;
+
+	memcpy((uint8_t *) tmp + ndigits * 8 - len, buf, len);
+	_ecc_be2native(out, tmp, ndigits);
+
+	return true;
+}
+
+/*
+ * ECDSA signature check as in SEC 1, Section 4.1.4.  Everything involved
+ * is public so the variable time multi-scalar multiplication is used for
+ * u1 * G + u2 * Q.
+ */
+bool _ecc_ecdsa_verify(const struct l_ecc_point *q,
+			const uint8_t *hash, size_t hash_len,
+			const uint8_t *r, size_t r_len,
+			const uint8_t *s, size_t s_len)
+{
+	static const uint64_t zero[L_ECC_MAX_DIGITS];
+	const struct l_ecc_curve *curve = q->curve;
+	unsigned int nd = curve->ndigits;
+	uint64_t rv[L_ECC_MAX_DIGITS];
+	uint64_t sv[L_ECC_MAX_DIGITS];
+	uint64_t e[L_ECC_MAX_DIGITS];
+	uint64_t w[L_ECC_MAX_DIGITS];
+	struct l_ecc_scalar u1 = { .curve = curve };
+	struct l_ecc_scalar u2 = { .curve = curve };
+	const struct l_ecc_scalar *scalars[] = { &u1, &u2 };
+	const struct l_ecc_point *points[] = { &curve->g, q };
+	struct l_ecc_point res = { .curve = curve };
+	struct l_ecc_point tmp;
+
+	if (unlikely(curve->montgomery))
+		return false;
+
+	if (!ecc_load_be_int(rv, r, r_len, nd) ||
+			!ecc_load_be_int(sv, s, s_len, nd))
+		return false;
+
+	if (!_vli_cmp(rv, zero, nd) || _vli_cmp(curve->n, rv, nd) <= 0 ||
+			!_vli_cmp(sv, zero, nd) ||
+			_vli_cmp(curve->n, sv, nd) <= 0)
+		return false;
+
+	/* e is the leftmost bits of the hash, as many as n has */
+	if (hash_len > nd * 8)
+		hash_len = nd * 8;
+
+	ecc_load_be_int(e, hash, hash_len, nd);
+
+	if (_vli_cmp(e, curve->n, nd) >= 0)
+		_vli_sub(e, e, curve->n, nd);
+
+	points[1] = _ecc_point_affine(q, &tmp);
+
+	_vli_mod_inv(w, sv, curve->n, nd);
+	_vli_mod_mult_slow(u1.c, e, w, curve->n, nd);
+	_vli_mod_mult_slow(u2.c, rv, w, curve->n, nd);
+
+	ecc_points_mult_sum_vartime(&res, curve, scalars, points, 2);
+
+	if (_ecc_point_is_zero(&res))
+		return false;
+
+	if (_vli_cmp(res.x, curve->n, nd) >= 0)
+		_vli_sub(res.x, res.x, curve->n, nd);
+
+	return !memcmp(res.x, rv, nd * 8);
+}
+
+/* ret = a * p + b * q */
+LIB_EXPORT bool l_ecc_point_multiply_add(struct l_ecc_point *ret,
+					const struct l_ecc_scalar *a,
+					const struct l_ecc_point *p,
+					const struct l_ecc_scalar *b,
+					const struct l_ecc_point *q)
+{
+	const struct l_ecc_scalar *scalars[] = { a, b };
+	const struct l_ecc_point *points[] = { p, q };
+
+	return l_ecc_points_multiply_sum(ret, scalars, points, 2);
+}
+
 LIB_EXPORT bool l_ecc_point_add(struct l_ecc_point *ret,
 					const struct l_ecc_point *a,
 					const struct l_ecc_point *b)
 {
-	if (unlikely(!ret || !a || !b))
+	struct l_ecc_point tmp_a;
+	struct l_ecc_point tmp_b;
+
+	if (unlikely(!ret || !a || !b || a->curve->montgomery))
 		return false;
 
+	a = _ecc_point_affine(a, &tmp_a);
+	b = _ecc_point_affine(b, &tmp_b);
 	_ecc_point_add(ret, a, b, a->curve->p);
+	ret->projective = false;
 
 	return true;
 }
 
 LIB_EXPORT bool l_ecc_point_inverse(struct l_ecc_point *p)
 {
-	if (unlikely(!p))
+	if (unlikely(!p || p->curve->montgomery))
 		return false;
 
+	if (p->projective)
+		ecc_points_normalize(&p, 1);
+
 	_vli_mod_sub(p->y, p->curve->p, p->y, p->curve->p, p->curve->ndigits);
 
 	return true;
@@ -1021,7 +2199,7 @@ LIB_EXPORT bool l_ecc_scalar_multiply(struct l_ecc_scalar *ret,
 					const struct l_ecc_scalar *a,
 					const struct l_ecc_scalar *b)
 {
-	if (unlikely(!ret || !a || !b))
+	if (unlikely(!ret || !a || !b || a->curve->montgomery))
 		return false;
 
 	_vli_mod_mult_fast(ret->c, a->c, b->c, a->curve->p, a->curve->ndigits);
@@ -1031,7 +2209,7 @@ LIB_EXPORT bool l_ecc_scalar_multiply(struct l_ecc_scalar *ret,
 
 LIB_EXPORT int l_ecc_scalar_legendre(struct l_ecc_scalar *value)
 {
-	if (unlikely(!value))
+	if (unlikely(!value || value->curve->montgomery))
 		return -1;
 
 	return _vli_legendre(value->c, value->curve->p, value->curve->ndigits);
@@ -1040,7 +2218,7 @@ LIB_EXPORT int l_ecc_scalar_legendre(struct l_ecc_scalar *value)
 LIB_EXPORT bool l_ecc_scalar_sum_x(struct l_ecc_scalar *ret,
 					const struct l_ecc_scalar *x)
 {
-	if (unlikely(!ret || !x))
+	if (unlikely(!ret || !x || x->curve->montgomery))
 		return false;
 
 	ecc_compute_y_sqr(x->curve, ret->c, x->c);
@@ -1060,14 +2238,24 @@ LIB_EXPORT bool l_ecc_scalars_are_equal(const struct l_ecc_scalar *a,
 LIB_EXPORT bool l_ecc_points_are_equal(const struct l_ecc_point *a,
 						const struct l_ecc_point *b)
 {
+	struct l_ecc_point tmp_a;
+	struct l_ecc_point tmp_b;
+
 	if (unlikely(!a || !b))
 		return false;
 
+	a = _ecc_point_affine(a, &tmp_a);
+	b = _ecc_point_affine(b, &tmp_b);
+
 	return ((memcmp(a->x, b->x, a->curve->ndigits * 8) == 0) &&
 			(memcmp(a->y, b->y, a->curve->ndigits * 8) == 0));
 }
 
 LIB_EXPORT bool l_ecc_point_is_infinity(const struct l_ecc_point *p)
 {
+	struct l_ecc_point tmp;
+
+	p = _ecc_point_affine(p, &tmp);
+
 	return _ecc_point_is_zero(p);
 }
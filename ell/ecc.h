@@ -88,8 +88,27 @@ bool l_ecc_point_multiply(struct l_ecc_point *ret,
 				const struct l_ecc_point *point);
 bool l_ecc_point_multiply_g(struct l_ecc_point *ret,
 				const struct l_ecc_scalar *scalar);
+bool l_ecc_point_multiply_projective(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *scalar,
+				const struct l_ecc_point *point);
+bool l_ecc_point_multiply_g_projective(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *scalar);
+bool l_ecc_points_normalize(struct l_ecc_point **points, unsigned int n);
 bool l_ecc_point_add(struct l_ecc_point *ret, const struct l_ecc_point *a,
 				const struct l_ecc_point *b);
+bool l_ecc_point_multiply_add(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *a,
+				const struct l_ecc_point *p,
+				const struct l_ecc_scalar *b,
+				const struct l_ecc_point *q);
+bool l_ecc_points_multiply_sum(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n);
+bool l_ecc_points_multiply_sum_vartime(struct l_ecc_point *ret,
+				const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n);
 bool l_ecc_point_inverse(struct l_ecc_point *p);
 
 /* extra operations needed for SAE */
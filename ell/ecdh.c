@@ -45,6 +45,14 @@ LIB_EXPORT bool l_ecdh_generate_key_pair(const struct l_ecc_curve *curve,
 	if (unlikely(!curve || !out_private || !out_public))
 		return false;
 
+	/* RFC 7748, Section 6.1: the public key is X25519(k, 9) */
+	if (curve->montgomery) {
+		*out_private = l_ecc_scalar_new_random(curve);
+		*out_public = l_ecc_point_new(curve);
+		_x25519_mult((*out_public)->x, (*out_private)->c, curve->g.x);
+		return true;
+	}
+
 	_ecc_calculate_p2(curve, p2);
 
 	*out_public = l_ecc_point_new(curve);
@@ -52,8 +60,7 @@ LIB_EXPORT bool l_ecdh_generate_key_pair(const struct l_ecc_curve *curve,
 	while (!compliant && iter++ < ECDH_MAX_ITERATIONS) {
 		*out_private = l_ecc_scalar_new_random(curve);
 
-		_ecc_point_mult(*out_public, &curve->g, (*out_private)->c,
-					NULL, curve->p);
+		_ecc_point_mult_g(*out_public, curve, (*out_private)->c);
 
 		/* ensure public key is compliant */
 		if (_vli_cmp((*out_public)->y, p2, curve->ndigits) >= 0) {
@@ -72,22 +79,58 @@ LIB_EXPORT bool l_ecdh_generate_key_pair(const struct l_ecc_curve *curve,
 	return true;
 }
 
+static bool ecdh_x25519_shared_secret(const struct l_ecc_scalar *private_key,
+					const struct l_ecc_point *other_public,
+					struct l_ecc_scalar **secret)
+{
+	const struct l_ecc_curve *curve = private_key->curve;
+	uint64_t k[L_ECC_MAX_DIGITS];
+	uint64_t bits = 0;
+	unsigned int i;
+
+	_x25519_mult(k, private_key->c, other_public->x);
+
+	/*
+	 * RFC 7748, Section 6.1: check for the all-zero output, which is
+	 * what a small order peer public key produces
+	 */
+	for (i = 0; i < curve->ndigits; i++)
+		bits |= k[i];
+
+	if (!bits)
+		return false;
+
+	*secret = _ecc_constant_new(curve, k, curve->ndigits * 8);
+	explicit_bzero(k, sizeof(k));
+
+	return true;
+}
+
 LIB_EXPORT bool l_ecdh_generate_shared_secret(
 				const struct l_ecc_scalar *private_key,
 				const struct l_ecc_point *other_public,
 				struct l_ecc_scalar **secret)
 {
-	const struct l_ecc_curve *curve = private_key->curve;
+	const struct l_ecc_curve *curve;
 	struct l_ecc_scalar *z;
 	struct l_ecc_point *product;
+	struct l_ecc_point tmp;
 
 	if (unlikely(!private_key || !other_public || !secret))
 		return false;
 
+	curve = private_key->curve;
+
+	if (curve->montgomery)
+		return ecdh_x25519_shared_secret(private_key, other_public,
+							secret);
+
 	z = l_ecc_scalar_new_random(curve);
 
 	product = l_ecc_point_new(curve);
 
+	/* The multiplication below needs an affine peer point */
+	other_public = _ecc_point_affine(other_public, &tmp);
 	_ecc_point_mult(product, other_public, private_key->c, z->c, curve->p);
 
 	*secret = _ecc_constant_new(curve, product->x, curve->ndigits * 8);
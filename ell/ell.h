@@ -54,3 +54,4 @@
 #include <ell/sysctl.h>
 #include <ell/minheap.h>
 #include <ell/notifylist.h>
+#include <ell/pcap.h>
@@ -22,6 +22,7 @@
 #include "netlink.h"
 #include "netlink-private.h"
 #include "notifylist.h"
+#include "pcap-private.h"
 #include "genl.h"
 
 #define GENL_DEBUG(fmt, args...)	\
@@ -71,6 +72,7 @@ struct l_genl {
 	l_genl_debug_func_t debug_callback;
 	l_genl_destroy_func_t debug_destroy;
 	void *debug_data;
+	struct l_pcap *pcap;
 
 	bool in_family_watch_notify : 1;
 	bool in_unicast_watch_notify : 1;
@@ -792,9 +794,14 @@ static bool can_write_data(struct l_io *io, void *user_data)
 		return false;
 	}
 
-	l_util_hexdump(false, data, bytes_written,
+	if (unlikely(genl->debug_callback))
+		l_util_hexdump(false, data, bytes_written,
 				genl->debug_callback, genl->debug_data);
 
+	if (unlikely(genl->pcap))
+		pcap_write_netlink(genl->pcap, false, NETLINK_GENERIC,
+					data, bytes_written);
+
 	l_queue_push_tail(genl->pending_list, request);
 
 	return false;
@@ -946,9 +953,14 @@ static bool received_data(struct l_io *io, void *user_data)
 
 	nlmsg_len = bytes_read;
 
-	l_util_hexdump(true, buf, nlmsg_len,
+	if (unlikely(genl->debug_callback))
+		l_util_hexdump(true, buf, nlmsg_len,
 				genl->debug_callback, genl->debug_data);
 
+	if (unlikely(genl->pcap))
+		pcap_write_netlink(genl->pcap, true, NETLINK_GENERIC,
+					buf, nlmsg_len);
+
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
 					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
 		struct nl_pktinfo pktinfo;
@@ -1117,6 +1129,25 @@ LIB_EXPORT bool l_genl_set_debug(struct l_genl *genl,
 	return true;
 }
 
+/**
+ * l_genl_set_pcap:
+ * @genl: genl object
+ * @pcap: capture file created for %L_PCAP_LINK_NETLINK or NULL
+ *
+ * Writes all messages sent and received to @pcap, which is not owned by
+ * @genl.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_genl_set_pcap(struct l_genl *genl, struct l_pcap *pcap)
+{
+	if (unlikely(!genl))
+		return false;
+
+	genl->pcap = pcap;
+	return true;
+}
+
 static void dump_family_callback(struct l_genl_msg *msg, void *user_data)
 {
 	struct l_genl *genl = user_data;
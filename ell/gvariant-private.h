@@ -32,6 +32,9 @@ struct dbus_builder *_gvariant_builder_new(void *body, size_t body_size);
 void _gvariant_builder_free(struct dbus_builder *builder);
 bool _gvariant_builder_append_basic(struct dbus_builder *builder,
 					char type, const void *value);
+bool _gvariant_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data,
+					uint32_t n_elem);
 bool _gvariant_builder_mark(struct dbus_builder *builder);
 bool _gvariant_builder_rewind(struct dbus_builder *builder);
 char *_gvariant_builder_finish(struct dbus_builder *builder,
@@ -28,7 +28,6 @@
 
 static const char *simple_types = "sogybnqiuxtdh";
 static const char *variable_types = "sogav";
-static const char *fixed_types = "bynqhiuxtd";
 
 /*
  * The alignment of a container type is equal to the largest alignment of
@@ -198,22 +197,52 @@ int _gvariant_num_children(const char *sig)
 	return num_children;
 }
 
-int _gvariant_get_alignment(const char *sig)
+/*
+ * Lays out the complete types of @sig as if they were the members of a
+ * structure, returning the alignment and, if all members are fixed size,
+ * the fixed size of the sequence.
+ */
+static bool sequence_layout(const char *sig, int *out_alignment,
+				int *out_size)
 {
-	int max_alignment = 1, alignment;
-	const char *s = sig;
+	struct dbus_type_info buf[255];
+	const struct dbus_type_info *types;
+	size_t len = strlen(sig);
+	unsigned int p;
+	int max_alignment = 1;
+	int size = 0;
 
-	/* 8 is the largest alignment possible, so quit if we reach it */
-	while (*s && max_alignment != 8) {
-		s = validate_next_type(s, &alignment);
-		if (!s)
-			return 0;
+	types = _dbus_signature_get_types(sig, len, buf);
+	if (!types)
+		return false;
+
+	for (p = 0; p < len; p += types[p].len) {
+		if (types[p].gvariant_alignment > max_alignment)
+			max_alignment = types[p].gvariant_alignment;
+
+		if (size < 0 || !types[p].gvariant_size) {
+			size = -1;
+			continue;
+		}
 
-		if (alignment > max_alignment)
-			max_alignment = alignment;
+		size = align_len(size, types[p].gvariant_alignment);
+		size += types[p].gvariant_size;
 	}
 
-	return max_alignment;
+	*out_alignment = max_alignment;
+	*out_size = size < 0 ? 0 : align_len(size, max_alignment);
+
+	return true;
+}
+
+int _gvariant_get_alignment(const char *sig)
+{
+	int alignment, size;
+
+	if (!sequence_layout(sig, &alignment, &size))
+		return 0;
+
+	return alignment;
 }
 
 bool _gvariant_is_fixed_size(const char *sig)
@@ -230,56 +259,10 @@ bool _gvariant_is_fixed_size(const char *sig)
 
 int _gvariant_get_fixed_size(const char *sig)
 {
-	const char *s = sig;
-	const char *p;
-	int size = 0;
-	int alignment;
-	int max_alignment = 1;
-	int r;
-
-	while (*s) {
-		if (strchr(variable_types, *s))
-			return 0;
-
-		if (strchr(fixed_types, *s)) {
-			alignment = get_basic_alignment(*s);
-
-			if (alignment > max_alignment)
-				max_alignment = alignment;
-
-			size = align_len(size, alignment);
-			size += get_basic_fixed_size(*s);
-			s++;
-			continue;
-		}
-
-		if (*s == '}' || *s == ')')
-			break;
+	int alignment, size;
 
-		p = validate_next_type(s, &alignment);
-
-		if (!p)
-			return 0;
-
-		if (alignment > max_alignment)
-			max_alignment = alignment;
-
-		size = align_len(size, alignment);
-
-		/* Handle special case of unit type */
-		if (s[0] == '(' && s[1] == ')')
-			r = 1;
-		else
-			r = _gvariant_get_fixed_size(s + 1);
-
-		if (r == 0)
-			return 0;
-
-		size += r;
-		s = p;
-	}
-
-	size = align_len(size, max_alignment);
+	if (!sequence_layout(sig, &alignment, &size))
+		return 0;
 
 	return size;
 }
@@ -336,6 +319,20 @@ static inline void write_word_le(void *p, size_t value, size_t sz) {
 	memcpy(p, &x, sz);
 }
 
+static const struct dbus_type_info *get_type_info(
+					struct l_dbus_message *message,
+					const char *sig, size_t len,
+					struct dbus_type_info *buf)
+{
+	const struct dbus_type_info *types;
+
+	types = _dbus_message_get_type_info(message, sig, len);
+	if (types)
+		return types;
+
+	return _dbus_signature_get_types(sig, len, buf);
+}
+
 static bool gvariant_iter_init_internal(struct l_dbus_message_iter *iter,
 					struct l_dbus_message *message,
 					enum dbus_container_type type,
@@ -343,69 +340,57 @@ static bool gvariant_iter_init_internal(struct l_dbus_message_iter *iter,
 					const char *sig_end, const void *data,
 					size_t len)
 {
-	const char *p;
+	size_t sig_len = sig_end ? (size_t) (sig_end - sig_start) :
+							strlen(sig_start);
+	struct dbus_type_info buf[255];
+	const struct dbus_type_info *types;
+	unsigned int p;
 	int i;
 	int v;
-	char subsig[256];
 	unsigned int num_variable = 0;
 	unsigned int offset_len = offset_length(len, 0);
 	size_t last_offset;
 	struct gvariant_type_info {
-		uint8_t sig_start;
-		uint8_t sig_end;
 		bool fixed_size : 1;
 		unsigned int alignment : 4;
 		size_t end;		/* Index past the end of the type */
 	} *children;
 	int n_children;
 
-	if (sig_end) {
-		size_t len = sig_end - sig_start;
-		memcpy(subsig, sig_start, len);
-		subsig[len] = '\0';
-	} else
-		strcpy(subsig, sig_start);
+	if (sig_len > 255)
+		return false;
 
 	iter->message = message;
 	iter->sig_start = sig_start;
-	iter->sig_len = strlen(subsig);
+	iter->sig_len = sig_len;
 	iter->sig_pos = 0;
 	iter->data = data;
 	iter->len = len;
 	iter->pos = 0;
 
-	if (subsig[0] != '\0') {
-		n_children = _gvariant_num_children(subsig);
-		if (n_children < 0)
+	if (sig_len) {
+		types = get_type_info(message, sig_start, sig_len, buf);
+		if (!types)
 			return false;
 
+		for (p = 0, n_children = 0; p < sig_len; p += types[p].len)
+			n_children += 1;
+
 		children = l_new(struct gvariant_type_info, n_children);
 	} else {
+		types = NULL;
 		n_children = 0;
 
 		children = NULL;
 	}
 
-	for (p = sig_start, i = 0; i < n_children; i++) {
-		int alignment;
-		size_t size;
-		size_t len;
-
-		children[i].sig_start = p - sig_start;
-		p = validate_next_type(p, &alignment);
-		children[i].sig_end = p - sig_start;
-
-		len = children[i].sig_end - children[i].sig_start;
-		memcpy(subsig, sig_start + children[i].sig_start, len);
-		subsig[len] = '\0';
+	for (p = 0, i = 0; i < n_children; p += types[p].len, i++) {
+		children[i].alignment = types[p].gvariant_alignment;
+		children[i].fixed_size = types[p].gvariant_size != 0;
 
-		children[i].alignment = alignment;
-		children[i].fixed_size = _gvariant_is_fixed_size(subsig);
-
-		if (children[i].fixed_size) {
-			size = _gvariant_get_fixed_size(subsig);
-			children[i].end = size;
-		} else if (i + 1 < n_children)
+		if (children[i].fixed_size)
+			children[i].end = types[p].gvariant_size;
+		else if (i + 1 < n_children)
 			num_variable += 1;
 	}
 
@@ -482,41 +467,41 @@ static const void *next_item(struct l_dbus_message_iter *iter,
 							size_t *out_item_size)
 {
 	const void *start;
-	const char *p;
-	char sig[256];
-	int alignment;
-	bool fixed_size;
+	const struct dbus_type_info *types;
+	struct dbus_type_info buf[255];
 	bool last_member;
 	unsigned int sig_len;
 	unsigned int offset_len;
 
-	memcpy(sig, iter->sig_start + iter->sig_pos,
-			iter->sig_len - iter->sig_pos);
-	sig[iter->sig_len - iter->sig_pos] = '\0';
+	if (iter->sig_pos >= iter->sig_len)
+		return NULL;
 
 	/*
-	 * Find the next type and make a note whether it is the last in the
-	 * structure.  Arrays will always have a single complete type, so
-	 * last_member will always be true.
+	 * Look up the whole signature, e.g. a variant's, rather than the
+	 * rest of it so that every item of the container uses the same key
 	 */
-	p = validate_next_type(sig, &alignment);
-	if (!p)
+	types = get_type_info(iter->message, iter->sig_start, iter->sig_len,
+				buf);
+	if (!types)
 		return NULL;
 
-	sig_len = p - sig;
-
-	last_member = *p == '\0';
-	sig[sig_len] = '\0';
+	types += iter->sig_pos;
 
-	fixed_size = _gvariant_is_fixed_size(sig);
+	/*
+	 * Find the next type and make a note whether it is the last in the
+	 * structure.  Arrays will always have a single complete type, so
+	 * last_member will always be true.
+	 */
+	sig_len = types[0].len;
+	last_member = iter->sig_pos + sig_len == iter->sig_len;
 
 	if (iter->container_type != DBUS_CONTAINER_TYPE_ARRAY)
 		iter->sig_pos += sig_len;
 
-	iter->pos = align_len(iter->pos, alignment);
+	iter->pos = align_len(iter->pos, types[0].gvariant_alignment);
 
-	if (fixed_size) {
-		*out_item_size = _gvariant_get_fixed_size(sig);
+	if (types[0].gvariant_size) {
+		*out_item_size = types[0].gvariant_size;
 		goto done;
 	}
 
@@ -1245,6 +1230,46 @@ bool _gvariant_builder_append_basic(struct dbus_builder *builder,
 	return true;
 }
 
+/*
+ * Append @n_elem elements of fixed size @type to the current array in a
+ * single step.  Arrays of fixed size elements carry no framing offsets so
+ * this is a plain copy of @data, which must not contain booleans or file
+ * descriptors.
+ */
+bool _gvariant_builder_append_fixed_array(struct dbus_builder *builder,
+					char type, const void *data,
+					uint32_t n_elem)
+{
+	struct container *container = l_queue_peek_head(builder->containers);
+	size_t start;
+	size_t len;
+
+	if (unlikely(!builder))
+		return false;
+
+	if (unlikely(type == 'b' || type == 'h'))
+		return false;
+
+	len = get_basic_fixed_size(type);
+	if (!len)
+		return false;
+
+	if (container->type != DBUS_CONTAINER_TYPE_ARRAY ||
+			container->signature[0] != type ||
+			container->signature[1] != '\0')
+		return false;
+
+	len *= n_elem;
+	start = grow_body(builder, len, get_basic_alignment(type));
+
+	if (len)
+		memcpy(builder->body + start, data, len);
+
+	container->variable_is_last = false;
+
+	return true;
+}
+
 bool _gvariant_builder_mark(struct dbus_builder *builder)
 {
 	struct container *container = l_queue_peek_head(builder->containers);
@@ -22,6 +22,7 @@
 #include "string.h"
 #include "random.h"
 #include "missing.h"
+#include "bignum-private.h"
 
 #ifndef KEYCTL_DH_COMPUTE
 #define KEYCTL_DH_COMPUTE 23
@@ -81,9 +82,35 @@ struct dh_params {
 
 static int32_t internal_keyring;
 
+static enum l_key_dh_engine dh_engine;
+static bool kernel_dh_unsupported;
+
+#define DH_TABLES_MAX	4
+
+struct dh_table {
+	uint8_t *prime;
+	size_t prime_len;
+	uint8_t *generator;
+	size_t generator_len;
+	struct bn_mont mont;
+	struct bn_comb *comb;
+};
+
+static bool dh_generator_tables;
+static struct dh_table *dh_tables[DH_TABLES_MAX];
+
+static unsigned long key_idx;
+
+/*
+ * L_KEY_RAW payloads stay in process memory so that the in-process DH
+ * engine needs no syscalls.  Their kernel key, if any operation needs
+ * one, is added on first use.
+ */
 struct l_key {
 	int type;
 	int32_t serial;
+	uint8_t *payload;
+	size_t payload_len;
 };
 
 struct l_keyring {
@@ -268,12 +295,39 @@ static bool setup_internal_keyring(void)
 	return true;
 }
 
+static int32_t key_add_to_kernel(struct l_key *key, const void *payload,
+					size_t payload_length)
+{
+	char *description;
+	long serial;
+
+	if (!internal_keyring && !setup_internal_keyring())
+		return -ENOKEY;
+
+	description = l_strdup_printf("ell-key-%lu", key_idx++);
+	serial = kernel_add_key(key_type_names[key->type], description,
+					payload, payload_length,
+					internal_keyring);
+	l_free(description);
+
+	if (serial > 0)
+		key->serial = serial;
+
+	return serial;
+}
+
+static int32_t key_get_serial(struct l_key *key)
+{
+	if (key->serial)
+		return key->serial;
+
+	return key_add_to_kernel(key, key->payload, key->payload_len);
+}
+
 LIB_EXPORT struct l_key *l_key_new(enum l_key_type type, const void *payload,
 					size_t payload_length)
 {
 	struct l_key *key;
-	char *description;
-	static unsigned long key_idx;
 
 	if (unlikely(!payload))
 		return NULL;
@@ -281,17 +335,16 @@ LIB_EXPORT struct l_key *l_key_new(enum l_key_type type, const void *payload,
 	if (unlikely((size_t)type >= L_ARRAY_SIZE(key_type_names)))
 		return NULL;
 
-	if (!internal_keyring && !setup_internal_keyring())
-		return NULL;
-
 	key = l_new(struct l_key, 1);
 	key->type = type;
-	description = l_strdup_printf("ell-key-%lu", key_idx++);
-	key->serial = kernel_add_key(key_type_names[type], description, payload,
-					payload_length, internal_keyring);
-	l_free(description);
 
-	if (key->serial < 0) {
+	if (type == L_KEY_RAW) {
+		key->payload = l_memdup(payload, payload_length);
+		key->payload_len = payload_length;
+		return key;
+	}
+
+	if (key_add_to_kernel(key, payload, payload_length) < 0) {
 		l_free(key);
 		key = NULL;
 	}
@@ -316,7 +369,13 @@ LIB_EXPORT void l_key_free(struct l_key *key)
 	 * key garbage collection and causes the quota used by the
 	 * key to be released sooner and more predictably.
 	 */
-	kernel_invalidate_key(key->serial);
+	if (key->serial)
+		kernel_invalidate_key(key->serial);
+
+	if (key->payload) {
+		explicit_bzero(key->payload, key->payload_len);
+		l_free(key->payload);
+	}
 
 	l_free(key);
 }
@@ -326,21 +385,36 @@ LIB_EXPORT void l_key_free_norevoke(struct l_key *key)
 	if (unlikely(!key))
 		return;
 
-	kernel_unlink_key(key->serial, internal_keyring);
+	if (key->serial)
+		kernel_unlink_key(key->serial, internal_keyring);
+
+	if (key->payload) {
+		explicit_bzero(key->payload, key->payload_len);
+		l_free(key->payload);
+	}
 
 	l_free(key);
 }
 
 LIB_EXPORT bool l_key_update(struct l_key *key, const void *payload, size_t len)
 {
-	long error;
-
 	if (unlikely(!key))
 		return false;
 
-	error = kernel_update_key(key->serial, payload, len);
+	if (key->serial && kernel_update_key(key->serial, payload, len) != 0)
+		return false;
 
-	return error == 0;
+	if (key->type != L_KEY_RAW)
+		return true;
+
+	if (key->payload) {
+		explicit_bzero(key->payload, key->payload_len);
+		l_free(key->payload);
+	}
+
+	key->payload = l_memdup(payload, len);
+	key->payload_len = len;
+	return true;
 }
 
 LIB_EXPORT bool l_key_extract(struct l_key *key, void *payload, size_t *len)
@@ -350,6 +424,19 @@ LIB_EXPORT bool l_key_extract(struct l_key *key, void *payload, size_t *len)
 	if (unlikely(!key))
 		return false;
 
+	if (key->type == L_KEY_RAW) {
+		if (key->payload_len > *len) {
+			explicit_bzero(payload, *len);
+			return false;
+		}
+
+		if (key->payload_len)
+			memcpy(payload, key->payload, key->payload_len);
+
+		*len = key->payload_len;
+		return true;
+	}
+
 	keylen = kernel_read_key(key->serial, payload, *len);
 
 	if (keylen < 0 || (size_t)keylen > *len) {
@@ -363,6 +450,9 @@ LIB_EXPORT bool l_key_extract(struct l_key *key, void *payload, size_t *len)
 
 LIB_EXPORT ssize_t l_key_get_payload_size(struct l_key *key)
 {
+	if (key->type == L_KEY_RAW)
+		return key->payload_len;
+
 	return kernel_read_key(key->serial, NULL, 0);
 }
 
@@ -417,7 +507,7 @@ LIB_EXPORT bool l_key_get_info(struct l_key *key, enum l_key_cipher_type cipher,
 			enum l_checksum_type checksum, size_t *bits,
 			bool *public)
 {
-	if (unlikely(!key))
+	if (unlikely(!key) || key_get_serial(key) < 0)
 		return false;
 
 	return !kernel_query_key(key->serial, lookup_cipher(cipher),
@@ -472,15 +562,177 @@ LIB_EXPORT struct l_key *l_key_generate_dh_private(const void *prime_buf,
 	return private;
 }
 
+static void dh_table_free(struct dh_table *table)
+{
+	explicit_bzero(table->comb, bn_comb_size(&table->mont));
+	l_free(table->comb);
+	l_free(table->prime);
+	l_free(table->generator);
+	l_free(table);
+}
+
+static bool dh_table_match(const struct dh_table *table,
+				const uint8_t *prime, size_t prime_len,
+				const uint8_t *generator, size_t generator_len)
+{
+	return table->prime_len == prime_len &&
+		table->generator_len == generator_len &&
+		!memcmp(table->prime, prime, prime_len) &&
+		!memcmp(table->generator, generator, generator_len);
+}
+
+/*
+ * Slots are filled once and published with a compare-and-swap, so that
+ * concurrent callers can share the tables.  A group that finds all slots
+ * taken by other groups goes without a table.
+ */
+static struct dh_table *dh_table_get(const uint8_t *prime, size_t prime_len,
+					const uint8_t *generator,
+					size_t generator_len)
+{
+	struct dh_table *table;
+	struct dh_table *expected;
+	uint64_t g[BN_MAX_DIGITS];
+	unsigned int i;
+
+	for (i = 0; i < DH_TABLES_MAX; i++) {
+		table = __atomic_load_n(&dh_tables[i], __ATOMIC_ACQUIRE);
+
+		if (!table)
+			break;
+
+		if (dh_table_match(table, prime, prime_len,
+					generator, generator_len))
+			return table;
+	}
+
+	if (i == DH_TABLES_MAX)
+		return NULL;
+
+	table = l_new(struct dh_table, 1);
+
+	if (!bn_mont_init(&table->mont, prime, prime_len) ||
+			!bn_from_be(g, table->mont.ndigits,
+					generator, generator_len)) {
+		l_free(table);
+		return NULL;
+	}
+
+	table->prime = l_memdup(prime, prime_len);
+	table->prime_len = prime_len;
+	table->generator = l_memdup(generator, generator_len);
+	table->generator_len = generator_len;
+	table->comb = l_malloc(bn_comb_size(&table->mont));
+	bn_comb_init(&table->mont, table->comb, g, prime_len * 8);
+
+	for (; i < DH_TABLES_MAX; i++) {
+		expected = NULL;
+
+		if (__atomic_compare_exchange_n(&dh_tables[i], &expected,
+						table, false,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE))
+			return table;
+
+		/* Lost the race, possibly to the same group */
+		if (dh_table_match(expected, prime, prime_len,
+					generator, generator_len))
+			break;
+	}
+
+	dh_table_free(table);
+	return i < DH_TABLES_MAX ? expected : NULL;
+}
+
+static bool dh_compute_software(struct l_key *base, struct l_key *private,
+				struct l_key *prime, bool fixed_base,
+				void *payload, size_t *len)
+{
+	const uint8_t *p = prime->payload;
+	size_t prime_len = prime->payload_len;
+	const uint8_t *base_buf = base->payload;
+	size_t base_len = base->payload_len;
+	const uint8_t *private_buf = private->payload;
+	size_t private_len = private->payload_len;
+	struct dh_table *table = NULL;
+	struct bn_mont mont;
+	uint64_t b[BN_MAX_DIGITS];
+	uint64_t r[BN_MAX_DIGITS];
+	bool ret = false;
+
+	if (prime->type != L_KEY_RAW || base->type != L_KEY_RAW ||
+			private->type != L_KEY_RAW ||
+			private_len > BN_MAX_DIGITS * 8)
+		return false;
+
+	while (prime_len && !*p) {
+		p++;
+		prime_len--;
+	}
+
+	/* Same as the kernel: the output is always as long as the prime */
+	if (*len < prime_len) {
+		if (*len == 0)
+			*len = prime_len;
+
+		goto done;
+	}
+
+	if (fixed_base && __atomic_load_n(&dh_generator_tables,
+							__ATOMIC_RELAXED))
+		table = dh_table_get(p, prime_len, base_buf, base_len);
+
+	if (table && bn_comb_exp(&table->mont, table->comb, r,
+					private_buf, private_len)) {
+		bn_to_be(payload, prime_len, r, table->mont.ndigits);
+		ret = true;
+		goto done;
+	}
+
+	if (!bn_mont_init(&mont, p, prime_len) ||
+			!bn_from_be(b, mont.ndigits, base_buf, base_len))
+		goto done;
+
+	bn_mod_exp_consttime(&mont, r, b, private_buf, private_len);
+	bn_to_be(payload, prime_len, r, mont.ndigits);
+	ret = true;
+
+done:
+	if (ret)
+		*len = prime_len;
+
+	explicit_bzero(r, sizeof(r));
+	return ret;
+}
+
 static bool compute_common(struct l_key *base, struct l_key *private,
-				struct l_key *prime, void *payload, size_t *len)
+				struct l_key *prime, bool fixed_base,
+				void *payload, size_t *len)
 {
 	long result_len;
 	bool usable_payload = *len != 0;
 
+	if (dh_engine == L_KEY_DH_ENGINE_SOFTWARE ||
+			(dh_engine == L_KEY_DH_ENGINE_AUTO &&
+			 __atomic_load_n(&kernel_dh_unsupported,
+						__ATOMIC_RELAXED)))
+		return dh_compute_software(base, private, prime, fixed_base,
+						payload, len);
+
+	if (key_get_serial(private) < 0 || key_get_serial(prime) < 0 ||
+			key_get_serial(base) < 0)
+		return false;
+
 	result_len = kernel_dh_compute(private->serial, prime->serial,
 					base->serial, payload, *len);
 
+	if (result_len == -EOPNOTSUPP && dh_engine == L_KEY_DH_ENGINE_AUTO) {
+		__atomic_store_n(&kernel_dh_unsupported, true,
+					__ATOMIC_RELAXED);
+		return dh_compute_software(base, private, prime, fixed_base,
+						payload, len);
+	}
+
 	if (result_len > 0) {
 		*len = result_len;
 		return usable_payload;
@@ -493,7 +745,7 @@ LIB_EXPORT bool l_key_compute_dh_public(struct l_key *generator,
 					struct l_key *prime,
 					void *payload, size_t *len)
 {
-	return compute_common(generator, private, prime, payload, len);
+	return compute_common(generator, private, prime, true, payload, len);
 }
 
 LIB_EXPORT bool l_key_compute_dh_secret(struct l_key *other_public,
@@ -501,7 +753,45 @@ LIB_EXPORT bool l_key_compute_dh_secret(struct l_key *other_public,
 					struct l_key *prime,
 					void *payload, size_t *len)
 {
-	return compute_common(other_public, private, prime, payload, len);
+	return compute_common(other_public, private, prime, false,
+				payload, len);
+}
+
+/*
+ * Selects what computes l_key_compute_dh_public() and
+ * l_key_compute_dh_secret() results.  L_KEY_DH_ENGINE_AUTO, the default,
+ * uses KEYCTL_DH_COMPUTE and falls back to the in-process engine if the
+ * kernel lacks CONFIG_KEY_DH_OPERATIONS.
+ */
+LIB_EXPORT void l_key_set_dh_engine(enum l_key_dh_engine engine)
+{
+	dh_engine = engine;
+}
+
+/*
+ * Lets the in-process engine keep a per-group table of generator powers,
+ * built on first use, which makes l_key_compute_dh_public() several
+ * times faster for about 64 * prime_len bytes per group.  The first four
+ * groups get a table.  Disabling frees all tables and must not race
+ * with DH computations.
+ */
+LIB_EXPORT void l_key_set_dh_generator_tables(bool enabled)
+{
+	unsigned int i;
+
+	__atomic_store_n(&dh_generator_tables, enabled, __ATOMIC_RELAXED);
+
+	if (enabled)
+		return;
+
+	for (i = 0; i < DH_TABLES_MAX; i++) {
+		struct dh_table *table = __atomic_exchange_n(&dh_tables[i],
+							NULL,
+							__ATOMIC_ACQ_REL);
+
+		if (table)
+			dh_table_free(table);
+	}
 }
 
 static int be_bignum_compare(const uint8_t *a, size_t a_len,
@@ -724,6 +1014,10 @@ LIB_EXPORT bool l_keyring_link(struct l_keyring *keyring,
 	if (unlikely(!keyring) || unlikely(!key))
 		return false;
 
+	/* Adding the kernel key on demand doesn't change the key's value */
+	if (key_get_serial((struct l_key *) key) < 0)
+		return false;
+
 	error = kernel_link_key(key->serial, keyring->serial);
 
 	return error == 0;
@@ -772,7 +1066,8 @@ LIB_EXPORT bool l_key_is_supported(uint32_t features)
 {
 	long result;
 
-	if (features & L_KEY_FEATURE_DH) {
+	if ((features & L_KEY_FEATURE_DH) &&
+			dh_engine == L_KEY_DH_ENGINE_KERNEL) {
 		result = syscall(__NR_keyctl, KEYCTL_DH_COMPUTE, NULL, "x", 1,
 					NULL);
 
@@ -38,6 +38,12 @@ enum l_keyring_restriction {
 	L_KEYRING_RESTRICT_ASYM_CHAIN,
 };
 
+enum l_key_dh_engine {
+	L_KEY_DH_ENGINE_AUTO = 0,
+	L_KEY_DH_ENGINE_KERNEL,
+	L_KEY_DH_ENGINE_SOFTWARE,
+};
+
 enum l_key_cipher_type {
 	L_KEY_RSA_PKCS1_V1_5,
 	L_KEY_RSA_RAW,
@@ -71,6 +77,9 @@ bool l_key_compute_dh_secret(struct l_key *other_public, struct l_key *private_k
 				struct l_key *prime,
 				void *payload, size_t *len);
 
+void l_key_set_dh_engine(enum l_key_dh_engine engine);
+void l_key_set_dh_generator_tables(bool enabled);
+
 bool l_key_validate_dh_payload(const void *payload, size_t len,
 				const void *prime_buf, size_t prime_len);
 
@@ -0,0 +1,12 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <stdint.h>
+
+void log_open_syslog(const char *path);
+void log_open_journal(const char *path);
+void log_set_clock(uint64_t (*clock)(void));
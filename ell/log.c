@@ -15,13 +15,19 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
 #include <fnmatch.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
 
 #include "queue.h"
 #include "log.h"
+#include "time.h"
+#include "useful.h"
 #include "private.h"
+#include "main-private.h"
+#include "log-private.h"
 
 struct debug_section {
 	struct l_debug_desc *start;
@@ -49,16 +55,93 @@ static void log_null(int priority, const char *file, const char *line,
 }
 
 static l_log_func_t log_func = log_null;
+
+/* Source location, lengths are 0 when not known at compile time */
+struct log_location {
+	const char *file;
+	const char *line;
+	const char *func;
+	size_t file_len;
+	size_t func_len;
+};
+
+/* Built-in socket backends, used instead of log_func when set */
+typedef void (*log_backend_t) (int priority, const struct log_location *loc,
+					const char *format, va_list ap);
+
+static log_backend_t log_backend;
 static const char *log_ident = "";
 static int log_fd = -1;
 static unsigned long log_pid;
 
+/*
+ * Asynchronous mode: the syslog and journal backends append complete
+ * datagrams to a ring of 8-byte aligned records and an idle callback
+ * sends them in batches with sendmmsg().  Records never wrap, a
+ * LOG_RECORD_WRAP length marks the unused end of the buffer.  Only the
+ * thread that enabled asynchronous mode, which runs the main loop, uses
+ * the ring.  Other threads send their messages directly, so no locking
+ * is involved.
+ */
+#define LOG_RECORD_WRAP		UINT32_MAX
+#define LOG_BATCH		32
+
+/* Leaves room for the dropped messages warning in an empty ring */
+#define LOG_RING_MIN_SIZE	1024
+
+struct log_ring {
+	uint8_t *buf;
+	size_t size;
+	size_t head;
+	size_t tail;
+	size_t used;
+	int idle_id;
+	bool idle;
+	bool watching;
+	bool flushing;
+};
+
+static struct log_ring *log_ring;
+static __thread bool log_ring_thread;
+static unsigned long log_dropped;
+static unsigned long log_dropped_reported;
+
+/* Per call site rate limiting, call sites sharing a slot evict each other */
+#define LOG_RATE_SLOTS		256
+
+struct log_rate_slot {
+	const char *file;
+	const char *line;
+	const char *func;
+	uint64_t start;
+	unsigned int count;
+	unsigned int suppressed;
+};
+
+static struct log_rate_slot *log_rate_slots;
+static unsigned int log_rate_burst;
+static uint64_t log_rate_interval;
+static uint64_t (*log_clock)(void) = l_time_now;
+
+static void log_ring_flush(bool wait);
+
 static inline void close_log(void)
 {
 	if (log_fd > 0) {
+		/* The backend is still needed to report dropped messages */
+		if (log_ring)
+			log_ring_flush(true);
+
+		if (log_ring && log_ring->watching) {
+			watch_remove(log_fd, true);
+			log_ring->watching = false;
+		}
+
 		close(log_fd);
 		log_fd = -1;
 	}
+
+	log_backend = NULL;
 }
 
 static int open_log(const char *path)
@@ -143,16 +226,292 @@ LIB_EXPORT void l_log_set_stderr(void)
 	log_func = log_stderr;
 }
 
-__attribute__((format(printf, 5, 0)))
-static void log_syslog(int priority, const char *file, const char *line,
-			const char *func, const char *format, va_list ap)
+static size_t log_record_size(size_t len)
+{
+	return align_len(sizeof(uint32_t) + len, 8);
+}
+
+static void log_ring_release(struct log_ring *ring, size_t len)
 {
+	ring->tail += len;
+	ring->used -= len;
+
+	if (ring->tail == ring->size)
+		ring->tail = 0;
+
+	if (!ring->used)
+		ring->head = ring->tail = 0;
+}
+
+static size_t log_ring_peek(struct log_ring *ring, size_t offset,
+				uint8_t **data)
+{
+	uint32_t len;
+
+	memcpy(&len, ring->buf + offset, sizeof(len));
+	*data = ring->buf + offset + sizeof(len);
+
+	return len;
+}
+
+static void log_watch_cb(int fd, uint32_t events, void *user_data)
+{
+	log_ring_flush(false);
+}
+
+static void log_watch_destroy(void *user_data)
+{
+	if (log_ring)
+		log_ring->watching = false;
+}
+
+static void log_idle_cb(void *user_data)
+{
+	log_ring_flush(false);
+}
+
+static void log_idle_destroy(void *user_data)
+{
+	/* Either flushed or the main loop is going away */
+	if (!log_ring)
+		return;
+
+	log_ring->idle = false;
+
+	if (log_ring->used && !log_ring->watching)
+		log_ring_flush(true);
+}
+
+/*
+ * Sends queued records in batches.  Without @wait a full socket makes it
+ * wait for EPOLLOUT instead of blocking.
+ */
+static void log_ring_flush(bool wait)
+{
+	struct log_ring *ring = log_ring;
+	struct mmsghdr msgs[LOG_BATCH];
+	struct iovec iov[LOG_BATCH];
+	size_t lens[LOG_BATCH];
+	bool reported = false;
+
+	/* Messages logged while flushing are only queued */
+	ring->flushing = true;
+
+again:
+	while (ring->used) {
+		size_t offset = ring->tail;
+		size_t pending = ring->used;
+		unsigned int n = 0;
+		int r;
+
+		while (n < LOG_BATCH && pending) {
+			uint8_t *data;
+			uint32_t len = log_ring_peek(ring, offset, &data);
+
+			if (len == LOG_RECORD_WRAP) {
+				/* Only start a batch at the wrap point */
+				if (n)
+					break;
+
+				log_ring_release(ring, ring->size - offset);
+				offset = ring->tail;
+				pending = ring->used;
+				continue;
+			}
+
+			iov[n].iov_base = data;
+			iov[n].iov_len = len;
+			memset(&msgs[n], 0, sizeof(msgs[n]));
+			msgs[n].msg_hdr.msg_iov = &iov[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			lens[n] = log_record_size(len);
+			offset += lens[n];
+			pending -= lens[n];
+			n++;
+
+			if (offset == ring->size)
+				break;
+		}
+
+		if (!n)
+			continue;
+
+		r = sendmmsg(log_fd, msgs, n, wait ? 0 : MSG_DONTWAIT);
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r < 0 && errno == EAGAIN) {
+			if (!ring->watching && watch_add(log_fd, EPOLLOUT,
+						log_watch_cb, NULL,
+						log_watch_destroy) == 0)
+				ring->watching = true;
+
+			if (ring->watching) {
+				ring->flushing = false;
+				return;
+			}
+
+			wait = true;
+			continue;
+		}
+
+		/* The first message is undeliverable, count it as dropped */
+		if (r <= 0) {
+			log_dropped += 1;
+			r = 1;
+		}
+
+		for (n = 0; n < (unsigned int) r; n++)
+			log_ring_release(ring, lens[n]);
+	}
+
+	/*
+	 * Reported through the ring, so it goes out with this flush.  Only
+	 * once per flush, if the warning itself is dropped or can't be
+	 * delivered that gets reported by the next flush.
+	 */
+	if (!reported && log_dropped != log_dropped_reported) {
+		unsigned long n = log_dropped - log_dropped_reported;
+
+		reported = true;
+		log_dropped_reported = log_dropped;
+		l_log(L_LOG_WARNING, "%lu log messages dropped", n);
+
+		/* Not queued, so not reported either */
+		if (log_dropped != log_dropped_reported)
+			log_dropped_reported -= n;
+
+		goto again;
+	}
+
+	ring->flushing = false;
+
+	if (ring->watching) {
+		watch_remove(log_fd, true);
+		ring->watching = false;
+	}
+
+	if (ring->idle) {
+		ring->idle = false;
+		idle_remove(ring->idle_id);
+	}
+}
+
+static void log_send(const struct iovec *iov, unsigned int iovlen)
+{
+	struct log_ring *ring = log_ring;
 	struct msghdr msg;
+	size_t len = 0;
+	size_t need;
+	size_t avail;
+	uint32_t len32;
+	unsigned int i;
+	uint8_t *p;
+
+	if (!log_ring_thread || !ring) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = (struct iovec *) iov;
+		msg.msg_iovlen = iovlen;
+
+		sendmsg(log_fd, &msg, 0);
+		return;
+	}
+
+	for (i = 0; i < iovlen; i++)
+		len += iov[i].iov_len;
+
+	need = log_record_size(len);
+
+	if (!ring->used)
+		avail = ring->size;
+	else if (ring->head > ring->tail) {
+		avail = ring->size - ring->head;
+
+		/* Wrap if the record only fits at the start of the buffer */
+		if (avail < need && need <= ring->tail) {
+			len32 = LOG_RECORD_WRAP;
+			memcpy(ring->buf + ring->head, &len32, sizeof(len32));
+			ring->used += avail;
+			ring->head = 0;
+			avail = ring->tail;
+		}
+	} else
+		avail = ring->tail - ring->head;
+
+	if (need > avail) {
+		log_dropped += 1;
+		return;
+	}
+
+	len32 = len;
+	memcpy(ring->buf + ring->head, &len32, sizeof(len32));
+	p = ring->buf + ring->head + sizeof(len32);
+
+	for (i = 0; i < iovlen; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+
+	ring->head += need;
+	ring->used += need;
+
+	if (ring->head == ring->size)
+		ring->head = 0;
+
+	if (ring->idle || ring->watching || ring->flushing)
+		return;
+
+	ring->idle_id = idle_add(log_idle_cb, NULL,
+					IDLE_FLAG_NO_WARN_DANGLING,
+					log_idle_destroy);
+	ring->idle = ring->idle_id >= 0;
+
+	/* No main loop to flush from */
+	if (!ring->idle)
+		log_ring_flush(true);
+}
+
+/* Formatted messages longer than this go through the heap */
+#define LOG_LINE_MAX		1024
+
+static __thread char log_line[LOG_LINE_MAX];
+
+__attribute__((format(printf, 2, 0)))
+static int log_format(char **str, const char *format, va_list ap)
+{
+	va_list aq;
+	int len;
+
+	va_copy(aq, ap);
+	len = vsnprintf(log_line, sizeof(log_line), format, aq);
+	va_end(aq);
+
+	if (len < 0)
+		return len;
+
+	if ((size_t) len < sizeof(log_line)) {
+		*str = log_line;
+		return len;
+	}
+
+	return vasprintf(str, format, ap);
+}
+
+static void log_format_done(char *str)
+{
+	if (str != log_line)
+		free(str);
+}
+
+__attribute__((format(printf, 3, 0)))
+static void log_syslog(int priority, const struct log_location *loc,
+				const char *format, va_list ap)
+{
 	struct iovec iov[2];
 	char hdr[64], *str;
 	int hdr_len, str_len;
 
-	str_len = vasprintf(&str, format, ap);
+	str_len = log_format(&str, format, ap);
 	if (str_len < 0)
 		return;
 
@@ -164,13 +523,9 @@ static void log_syslog(int priority, const char *file, const char *line,
 	iov[1].iov_base = str;
 	iov[1].iov_len  = str_len;
 
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 2;
+	log_send(iov, 2);
 
-	sendmsg(log_fd, &msg, 0);
-
-	free(str);
+	log_format_done(str);
 }
 
 /**
@@ -179,29 +534,34 @@ static void log_syslog(int priority, const char *file, const char *line,
  * Enable logging to syslog.
  **/
 LIB_EXPORT void l_log_set_syslog(void)
+{
+	log_open_syslog("/dev/log");
+}
+
+void log_open_syslog(const char *path)
 {
 	close_log();
 
-	if (open_log("/dev/log") < 0) {
+	if (open_log(path) < 0) {
 		log_func = log_null;
 		return;
 	}
 
 	log_pid = getpid();
 
-	log_func = log_syslog;
+	log_func = log_null;
+	log_backend = log_syslog;
 }
 
-__attribute__((format(printf, 5, 0)))
-static void log_journal(int priority, const char *file, const char *line,
-			const char *func, const char *format, va_list ap)
+__attribute__((format(printf, 3, 0)))
+static void log_journal(int priority, const struct log_location *loc,
+				const char *format, va_list ap)
 {
-	struct msghdr msg;
 	struct iovec iov[12];
 	char prio[16], *str;
 	int prio_len, str_len;
 
-	str_len = vasprintf(&str, format, ap);
+	str_len = log_format(&str, format, ap);
 	if (str_len < 0)
 		return;
 
@@ -215,30 +575,26 @@ static void log_journal(int priority, const char *file, const char *line,
 	iov[2].iov_len  = prio_len;
 	iov[3].iov_base = "CODE_FILE=";
 	iov[3].iov_len  = 10;
-	iov[4].iov_base = (char *) file;
-	iov[4].iov_len  = strlen(file);
+	iov[4].iov_base = (char *) loc->file;
+	iov[4].iov_len  = loc->file_len ?: strlen(loc->file);
 	iov[5].iov_base = "\n";
 	iov[5].iov_len  = 1;
 	iov[6].iov_base = "CODE_LINE=";
 	iov[6].iov_len  = 10;
-	iov[7].iov_base = (char *) line;
-	iov[7].iov_len  = strlen(line);
+	iov[7].iov_base = (char *) loc->line;
+	iov[7].iov_len  = strlen(loc->line);
 	iov[8].iov_base = "\n";
 	iov[8].iov_len  = 1;
 	iov[9].iov_base = "CODE_FUNC=";
 	iov[9].iov_len  = 10;
-	iov[10].iov_base = (char *) func;
-	iov[10].iov_len  = strlen(func);
+	iov[10].iov_base = (char *) loc->func;
+	iov[10].iov_len  = loc->func_len ?: strlen(loc->func);
 	iov[11].iov_base = "\n";
 	iov[11].iov_len  = 1;
 
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 12;
-
-	sendmsg(log_fd, &msg, 0);
+	log_send(iov, 12);
 
-	free(str);
+	log_format_done(str);
 }
 
 /**
@@ -247,17 +603,179 @@ static void log_journal(int priority, const char *file, const char *line,
  * Enable logging to journal.
  **/
 LIB_EXPORT void l_log_set_journal(void)
+{
+	log_open_journal("/run/systemd/journal/socket");
+}
+
+void log_open_journal(const char *path)
 {
 	close_log();
 
-	if (open_log("/run/systemd/journal/socket") < 0) {
+	if (open_log(path) < 0) {
 		log_func = log_null;
 		return;
 	}
 
 	log_pid = getpid();
 
-	log_func = log_journal;
+	log_func = log_null;
+	log_backend = log_journal;
+}
+
+/**
+ * l_log_set_async:
+ * @buffer_size: size of the message buffer in bytes, 0 to disable
+ *
+ * Makes the syslog and journal backends queue messages in a buffer of
+ * @buffer_size bytes, sent in batches from the main loop, rather than
+ * blocking on a send per message.  Messages that don't fit in the
+ * buffer are dropped, counted and reported in a warning once there's
+ * room again.  Without a running main loop messages are sent right
+ * away.  Disabling sends out any queued messages first.
+ *
+ * Call this from the thread that runs the main loop.  Only messages
+ * logged from that thread are queued, other threads keep sending theirs
+ * directly.  Buffers smaller than 1024 bytes are enlarged to that size.
+ **/
+LIB_EXPORT void l_log_set_async(size_t buffer_size)
+{
+	if (log_ring) {
+		struct log_ring *ring = log_ring;
+
+		if (log_fd > 0)
+			log_ring_flush(true);
+
+		if (ring->watching)
+			watch_remove(log_fd, true);
+
+		log_ring = NULL;
+
+		if (ring->idle)
+			idle_remove(ring->idle_id);
+
+		l_free(ring->buf);
+		l_free(ring);
+	}
+
+	log_ring_thread = buffer_size > 0;
+
+	if (!buffer_size)
+		return;
+
+	if (buffer_size < LOG_RING_MIN_SIZE)
+		buffer_size = LOG_RING_MIN_SIZE;
+
+	log_ring = l_new(struct log_ring, 1);
+	log_ring->size = align_len(buffer_size, 8);
+	log_ring->buf = l_malloc(log_ring->size);
+}
+
+/**
+ * l_log_flush:
+ *
+ * Sends out the messages queued in asynchronous mode, blocking if needed.
+ **/
+LIB_EXPORT void l_log_flush(void)
+{
+	if (log_ring_thread && log_ring && log_fd > 0)
+		log_ring_flush(true);
+}
+
+/**
+ * l_log_get_dropped:
+ *
+ * Returns: The number of messages dropped in asynchronous mode so far
+ **/
+LIB_EXPORT unsigned long l_log_get_dropped(void)
+{
+	return log_dropped;
+}
+
+/* Lets unit tests move time forward for the rate limiting */
+void log_set_clock(uint64_t (*clock)(void))
+{
+	log_clock = clock ? clock : l_time_now;
+}
+
+/**
+ * l_log_set_rate_limit:
+ * @burst: messages allowed per call site and interval, 0 to disable
+ * @interval_ms: length of the interval in milliseconds
+ *
+ * Limits how many messages each l_log() call site can produce in an
+ * interval.  The number of suppressed messages is logged once the
+ * interval is over and the call site logs again.
+ **/
+LIB_EXPORT void l_log_set_rate_limit(unsigned int burst,
+					unsigned int interval_ms)
+{
+	l_free(log_rate_slots);
+	log_rate_slots = NULL;
+	log_rate_burst = burst;
+	log_rate_interval = (uint64_t) interval_ms * 1000;
+
+	if (burst)
+		log_rate_slots = l_new(struct log_rate_slot, LOG_RATE_SLOTS);
+}
+
+__attribute__((format(printf, 3, 0)))
+static void log_dispatch(int priority, const struct log_location *loc,
+				const char *format, va_list ap)
+{
+	if (log_backend)
+		log_backend(priority, loc, format, ap);
+	else
+		log_func(priority, loc->file, loc->line, loc->func, format, ap);
+}
+
+__attribute__((format(printf, 3, 4)))
+static void log_call(int priority, const struct log_location *loc,
+				const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	log_dispatch(priority, loc, format, ap);
+	va_end(ap);
+}
+
+static bool log_rate_limited(const struct log_location *loc)
+{
+	const char *file = loc->file;
+	const char *line = loc->line;
+	uintptr_t key = (uintptr_t) file ^ ((uintptr_t) line >> 3);
+	struct log_rate_slot *slot;
+	uint64_t now = log_clock();
+
+	key ^= key >> 16;
+	slot = &log_rate_slots[(key ^ (key >> 8)) % LOG_RATE_SLOTS];
+
+	if (slot->file != file || slot->line != line ||
+			now - slot->start >= log_rate_interval) {
+		struct log_location prev = {
+			.file = slot->file,
+			.line = slot->line,
+			.func = slot->func,
+		};
+
+		if (slot->suppressed)
+			log_call(L_LOG_WARNING, &prev,
+					"%s:%s: %u log messages suppressed\n",
+					prev.file, prev.line, slot->suppressed);
+
+		slot->file = file;
+		slot->line = line;
+		slot->func = loc->func;
+		slot->start = now;
+		slot->count = 0;
+		slot->suppressed = 0;
+	}
+
+	if (++slot->count <= log_rate_burst)
+		return false;
+
+	slot->suppressed++;
+	return true;
 }
 
 /**
@@ -275,10 +793,50 @@ LIB_EXPORT void l_log_with_location(int priority,
 				const char *file, const char *line,
 				const char *func, const char *format, ...)
 {
+	struct log_location loc = {
+		.file = file,
+		.line = line,
+		.func = func,
+	};
+	va_list ap;
+
+	if (log_rate_slots && log_rate_limited(&loc))
+		return;
+
+	va_start(ap, format);
+	log_dispatch(priority, &loc, format, ap);
+	va_end(ap);
+}
+
+/**
+ * l_log_with_desc:
+ * @priority: priority level
+ * @desc: debug descriptor of the call site
+ * @line: source line
+ * @format: format string
+ * @...: format arguments
+ *
+ * Like l_log_with_location(), taking the source file and function and
+ * their lengths from @desc.
+ **/
+LIB_EXPORT void l_log_with_desc(int priority,
+				const struct l_debug_desc *desc,
+				const char *line, const char *format, ...)
+{
+	struct log_location loc = {
+		.file = desc->file,
+		.line = line,
+		.func = desc->func,
+		.file_len = desc->file_len,
+		.func_len = desc->func_len,
+	};
 	va_list ap;
 
+	if (log_rate_slots && log_rate_limited(&loc))
+		return;
+
 	va_start(ap, format);
-	log_func(priority, file, line, func, format, ap);
+	log_dispatch(priority, &loc, format, ap);
 	va_end(ap);
 }
 
@@ -10,6 +10,7 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +32,11 @@ void l_log_set_stderr(void);
 void l_log_set_syslog(void);
 void l_log_set_journal(void);
 
+void l_log_set_async(size_t buffer_size);
+void l_log_flush(void);
+unsigned long l_log_get_dropped(void);
+void l_log_set_rate_limit(unsigned int burst, unsigned int interval_ms);
+
 void l_log_with_location(int priority, const char *file, const char *line,
 				const char *func, const char *format, ...)
 				__attribute__((format(printf, 5, 6)));
@@ -45,8 +51,15 @@ struct l_debug_desc {
 #define L_DEBUG_FLAG_DEFAULT (0)
 #define L_DEBUG_FLAG_PRINT   (1 << 0)
 	unsigned int flags;
+	/* Lengths of file and func, 0 if not known */
+	unsigned short file_len;
+	unsigned short func_len;
 } __attribute__((aligned(8)));
 
+void l_log_with_desc(int priority, const struct l_debug_desc *desc,
+				const char *line, const char *format, ...)
+				__attribute__((format(printf, 4, 5)));
+
 /*
  * Set the retain attribute so that the section cannot be discarded by ld
  * --gc-sections -z start-stop-gc. Older compilers would warn for the unknown
@@ -59,10 +72,13 @@ _Pragma("GCC diagnostic ignored \"-Wattributes\"") \
 	__attribute__((used, retain, section("__ell_debug"), aligned(8))) = { \
 		.file = __FILE__, .func = __func__, \
 		.flags = L_DEBUG_FLAG_DEFAULT, \
+		.file_len = sizeof(__FILE__) - 1, \
+		.func_len = sizeof(__func__) - 1, \
 	}; \
 _Pragma("GCC diagnostic pop") \
 	if (symbol.flags & L_DEBUG_FLAG_PRINT) \
-		l_log(L_LOG_DEBUG, "%s:%s() " format, __FILE__, \
+		l_log_with_desc(L_LOG_DEBUG, &symbol, L_STRINGIFY(__LINE__), \
+					"%s:%s() " format "\n", __FILE__, \
 					__func__ , ##__VA_ARGS__); \
 } while (0)
 
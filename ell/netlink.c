@@ -21,6 +21,7 @@
 #include "private.h"
 #include "netlink-private.h"
 #include "netlink.h"
+#include "pcap-private.h"
 
 struct command {
 	unsigned int id;
@@ -39,6 +40,7 @@ struct notify {
 
 struct l_netlink {
 	uint32_t pid;
+	int protocol;
 	struct l_io *io;
 	uint32_t next_seq;
 	struct l_queue *command_queue;
@@ -51,6 +53,7 @@ struct l_netlink {
 	l_netlink_debug_func_t debug_handler;
 	l_netlink_destroy_func_t debug_destroy;
 	void *debug_data;
+	struct l_pcap *pcap;
 };
 
 static void destroy_command(void *data)
@@ -110,9 +113,14 @@ static bool can_write_data(struct l_io *io, void *user_data)
 		return true;
 	}
 
-	l_util_hexdump(false, hdr, hdr->nlmsg_len,
+	if (unlikely(netlink->debug_handler))
+		l_util_hexdump(false, hdr, hdr->nlmsg_len,
 				netlink->debug_handler, netlink->debug_data);
 
+	if (unlikely(netlink->pcap))
+		pcap_write_netlink(netlink->pcap, false, netlink->protocol,
+					hdr, hdr->nlmsg_len);
+
 	l_hashmap_insert(netlink->command_pending,
 				L_UINT_TO_PTR(hdr->nlmsg_seq), command);
 
@@ -269,9 +277,14 @@ static bool can_read_data(struct l_io *io, void *user_data)
 	if (len < 0)
 		return false;
 
-	l_util_hexdump(true, buffer, len, netlink->debug_handler,
+	if (unlikely(netlink->debug_handler))
+		l_util_hexdump(true, buffer, len, netlink->debug_handler,
 						netlink->debug_data);
 
+	if (unlikely(netlink->pcap))
+		pcap_write_netlink(netlink->pcap, true, netlink->protocol,
+					buffer, len);
+
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
 					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
 		struct nl_pktinfo *pktinfo;
@@ -362,6 +375,7 @@ LIB_EXPORT struct l_netlink *l_netlink_new(int protocol)
 	netlink = l_new(struct l_netlink, 1);
 
 	netlink->pid = pid;
+	netlink->protocol = protocol;
 	netlink->next_seq = 1;
 	netlink->next_command_id = 1;
 	netlink->next_notify_id = 1;
@@ -612,6 +626,26 @@ LIB_EXPORT bool l_netlink_set_debug(struct l_netlink *netlink,
 	return true;
 }
 
+/**
+ * l_netlink_set_pcap:
+ * @netlink: netlink object
+ * @pcap: capture file created for %L_PCAP_LINK_NETLINK or NULL
+ *
+ * Writes all messages sent and received to @pcap, which is not owned by
+ * @netlink.
+ *
+ * Returns: true on success
+ **/
+LIB_EXPORT bool l_netlink_set_pcap(struct l_netlink *netlink,
+					struct l_pcap *pcap)
+{
+	if (unlikely(!netlink))
+		return false;
+
+	netlink->pcap = pcap;
+	return true;
+}
+
 /*
  * Parses extended error info from the extended ack.  It is assumed that the
  * caller has already checked the type of @nlmsg and it is of type NLMSG_ERROR.
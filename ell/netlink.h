@@ -46,6 +46,10 @@ bool l_netlink_set_debug(struct l_netlink *netlink,
 			l_netlink_debug_func_t function,
 			void *user_data, l_netlink_destroy_func_t destroy);
 
+struct l_pcap;
+
+bool l_netlink_set_pcap(struct l_netlink *netlink, struct l_pcap *pcap);
+
 struct l_netlink_message *l_netlink_message_new(uint16_t type, uint16_t flags);
 struct l_netlink_message *l_netlink_message_new_sized(uint16_t type,
 							uint16_t flags,
@@ -0,0 +1,18 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+struct l_pcap;
+
+bool pcap_write_netlink(struct l_pcap *pcap, bool in, uint16_t protocol,
+				const void *data, size_t len);
+bool pcap_write_dbus(struct l_pcap *pcap, const void *header,
+				size_t header_size, const void *body,
+				size_t body_size);
@@ -0,0 +1,210 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "pcap.h"
+#include "pcap-private.h"
+#include "private.h"
+#include "useful.h"
+
+/**
+ * SECTION:pcap
+ * @short_description: Packet capture files
+ *
+ * Writes netlink and D-Bus traffic to pcap files.  This is much cheaper
+ * than hexdumps through a debug handler and the files can be read with
+ * the usual tools.
+ */
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_SNAPLEN		262144
+
+#define LINKTYPE_LINUX_SLL	113
+#define LINKTYPE_DBUS		231
+
+#define SLL_PKTTYPE_HOST	0
+#define SLL_PKTTYPE_OUTGOING	4
+#define SLL_HATYPE_NETLINK	824
+
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+} __attribute__ ((packed));
+
+struct pcap_record_header {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+} __attribute__ ((packed));
+
+/* Linux cooked capture header, all fields big endian */
+struct pcap_sll_header {
+	uint16_t pkttype;
+	uint16_t hatype;
+	uint16_t halen;
+	uint8_t addr[8];
+	uint16_t protocol;
+} __attribute__ ((packed));
+
+struct l_pcap {
+	int fd;
+	enum l_pcap_link link;
+};
+
+/**
+ * l_pcap_new:
+ * @path: file to create, an existing file is truncated
+ * @link: kind of traffic the file is for
+ *
+ * Creates a capture file to be attached with l_netlink_set_pcap(),
+ * l_genl_set_pcap() or l_dbus_set_pcap() depending on @link.
+ *
+ * Returns: a newly allocated #l_pcap object or NULL on failure
+ **/
+LIB_EXPORT struct l_pcap *l_pcap_new(const char *path, enum l_pcap_link link)
+{
+	struct pcap_file_header hdr = {
+		.magic = PCAP_MAGIC,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = PCAP_SNAPLEN,
+	};
+	struct l_pcap *pcap;
+	int fd;
+
+	if (unlikely(!path))
+		return NULL;
+
+	switch (link) {
+	case L_PCAP_LINK_NETLINK:
+		hdr.linktype = LINKTYPE_LINUX_SLL;
+		break;
+	case L_PCAP_LINK_DBUS:
+		hdr.linktype = LINKTYPE_DBUS;
+		break;
+	default:
+		return NULL;
+	}
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return NULL;
+
+	if (L_TFR(write(fd, &hdr, sizeof(hdr))) != sizeof(hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	pcap = l_new(struct l_pcap, 1);
+	pcap->fd = fd;
+	pcap->link = link;
+
+	return pcap;
+}
+
+/**
+ * l_pcap_free:
+ * @pcap: capture file
+ *
+ * Closes the capture file.  It must not be attached to any object anymore.
+ **/
+LIB_EXPORT void l_pcap_free(struct l_pcap *pcap)
+{
+	if (!pcap)
+		return;
+
+	close(pcap->fd);
+	l_free(pcap);
+}
+
+static bool pcap_write(struct l_pcap *pcap, struct iovec *iov,
+					unsigned int n_iov)
+{
+	struct pcap_record_header hdr;
+	struct timespec ts;
+	size_t len = 0;
+	size_t incl_len = 0;
+	unsigned int i;
+
+	for (i = 1; i < n_iov; i++)
+		len += iov[i].iov_len;
+
+	/* Readers reject records longer than the snaplen, cut them short */
+	for (i = 1; i < n_iov; i++) {
+		if (iov[i].iov_len > PCAP_SNAPLEN - incl_len)
+			iov[i].iov_len = PCAP_SNAPLEN - incl_len;
+
+		incl_len += iov[i].iov_len;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	hdr.ts_sec = ts.tv_sec;
+	hdr.ts_usec = ts.tv_nsec / 1000;
+	hdr.incl_len = incl_len;
+	hdr.orig_len = len;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+
+	/* One record per call, records from a single writev() don't mix */
+	return L_TFR(writev(pcap->fd, iov, n_iov)) ==
+					(ssize_t) (sizeof(hdr) + incl_len);
+}
+
+bool pcap_write_netlink(struct l_pcap *pcap, bool in, uint16_t protocol,
+				const void *data, size_t len)
+{
+	struct pcap_sll_header sll = {
+		.pkttype = L_CPU_TO_BE16(in ? SLL_PKTTYPE_HOST :
+						SLL_PKTTYPE_OUTGOING),
+		.hatype = L_CPU_TO_BE16(SLL_HATYPE_NETLINK),
+		.protocol = L_CPU_TO_BE16(protocol),
+	};
+	struct iovec iov[3];
+
+	if (pcap->link != L_PCAP_LINK_NETLINK)
+		return false;
+
+	iov[1].iov_base = &sll;
+	iov[1].iov_len = sizeof(sll);
+	iov[2].iov_base = (void *) data;
+	iov[2].iov_len = len;
+
+	return pcap_write(pcap, iov, 3);
+}
+
+bool pcap_write_dbus(struct l_pcap *pcap, const void *header,
+				size_t header_size, const void *body,
+				size_t body_size)
+{
+	struct iovec iov[3];
+
+	if (pcap->link != L_PCAP_LINK_DBUS)
+		return false;
+
+	iov[1].iov_base = (void *) header;
+	iov[1].iov_len = header_size;
+	iov[2].iov_base = (void *) body;
+	iov[2].iov_len = body_size;
+
+	return pcap_write(pcap, iov, 3);
+}
@@ -0,0 +1,29 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef __ELL_PCAP_H
+#define __ELL_PCAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct l_pcap;
+
+enum l_pcap_link {
+	L_PCAP_LINK_NETLINK,
+	L_PCAP_LINK_DBUS,
+};
+
+struct l_pcap *l_pcap_new(const char *path, enum l_pcap_link link);
+void l_pcap_free(struct l_pcap *pcap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ELL_PCAP_H */
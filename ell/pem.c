@@ -110,9 +110,11 @@ static bool is_end_boundary(const void *buf, size_t buf_len,
 	return true;
 }
 
-const char *pem_next(const void *buf, size_t buf_len, char **type_label,
-				size_t *base64_len,
-				const char **endp, bool strict)
+static const char *pem_next_block(const void *buf, size_t buf_len,
+					const char **out_label,
+					size_t *out_label_len,
+					size_t *base64_len,
+					const char **endp, bool strict)
 {
 	const char *buf_ptr = buf;
 	const char *base64_data = NULL, *eol;
@@ -141,8 +143,8 @@ const char *pem_next(const void *buf, size_t buf_len, char **type_label,
 				break;
 		} else if (start && is_end_boundary(buf_ptr, eol - buf_ptr,
 							label, label_len)) {
-			if (type_label)
-				*type_label = l_strndup(label, label_len);
+			*out_label = label;
+			*out_label_len = label_len;
 
 			if (base64_len)
 				*base64_len = buf_ptr - base64_data;
@@ -176,6 +178,22 @@ const char *pem_next(const void *buf, size_t buf_len, char **type_label,
 	return NULL;
 }
 
+const char *pem_next(const void *buf, size_t buf_len, char **type_label,
+				size_t *base64_len,
+				const char **endp, bool strict)
+{
+	const char *label;
+	size_t label_len;
+	const char *base64_data;
+
+	base64_data = pem_next_block(buf, buf_len, &label, &label_len,
+					base64_len, endp, strict);
+	if (base64_data && type_label)
+		*type_label = l_strndup(label, label_len);
+
+	return base64_data;
+}
+
 uint8_t *pem_load_buffer(const void *buf, size_t buf_len,
 				char **out_type_label, size_t *out_len,
 				char **out_headers, const char **out_endp)
@@ -398,60 +416,108 @@ int pem_write_certificate_chain(const struct l_certchain *chain,
 	return err < 0 ? err : 0;
 }
 
+/*
+ * Finds the next CERTIFICATE block.  Returns NULL with *endp set to NULL
+ * at the end of the data, or with *endp set on any other block or error.
+ */
+static const char *pem_next_certificate(const char *ptr, const char *end,
+					size_t *base64_len, const char **endp)
+{
+	const char *base64;
+	const char *label;
+	size_t label_len;
+
+	base64 = pem_next_block(ptr, end - ptr, &label, &label_len,
+				base64_len, endp, false);
+	if (!base64)
+		return NULL;
+
+	if (label_len != strlen("CERTIFICATE") ||
+			memcmp(label, "CERTIFICATE", label_len)) {
+		*endp = end;
+		return NULL;
+	}
+
+	return base64;
+}
+
+struct pem_block {
+	const char *base64;
+	size_t base64_len;
+};
+
+/*
+ * The certificate blocks are first all located so that their DER data
+ * can be placed in one arena sized from the total base64 length, then
+ * the base64 text is decoded straight into it.
+ */
 LIB_EXPORT struct l_queue *l_pem_load_certificate_list_from_data(
 						const void *buf, size_t len)
 {
 	const char *ptr, *end;
 	struct l_queue *list = NULL;
+	struct cert_arena *arena;
+	_auto_(l_free) struct pem_block *blocks = NULL;
+	unsigned int count = 0;
+	unsigned int i;
+	size_t max_der_len = 0;
 
 	ptr = buf;
 	end = buf + len;
 
 	while (ptr && ptr < end) {
-		uint8_t *der;
-		size_t der_len;
-		char *label = NULL;
-		struct l_cert *cert;
 		const char *base64;
 		size_t base64_len;
-		bool is_certificate;
 
-		base64 = pem_next(ptr, end - ptr, &label,
-					&base64_len, &ptr, false);
+		base64 = pem_next_certificate(ptr, end, &base64_len, &ptr);
 		if (!base64) {
 			if (!ptr)
 				break;
 
 			/* if ptr was not reset to NULL; parse error */
-			goto error;
+			return NULL;
 		}
 
-		is_certificate = !strcmp(label, "CERTIFICATE");
-		l_free(label);
+		/* Grow in powers of two */
+		if (!(count & (count - 1)))
+			blocks = l_realloc(blocks, (count ? count * 2 : 1) *
+						sizeof(struct pem_block));
 
-		if (!is_certificate)
-			goto error;
+		blocks[count].base64 = base64;
+		blocks[count++].base64_len = base64_len;
+		max_der_len += base64_len * 3 / 4;
+	}
 
-		der = l_base64_decode(base64, base64_len, &der_len);
-		if (!der)
-			goto error;
+	if (!count)
+		return NULL;
 
-		cert = l_cert_new_from_der(der, der_len);
-		l_free(der);
+	arena = cert_arena_new(count, max_der_len);
+	list = l_queue_new();
 
-		if (!cert)
+	for (i = 0; i < count; i++) {
+		ssize_t der_len;
+		struct l_cert *cert;
+
+		der_len = l_base64_decode_into(blocks[i].base64,
+						blocks[i].base64_len,
+						cert_arena_get_space(arena),
+						blocks[i].base64_len * 3 / 4);
+		if (der_len < 0)
 			goto error;
 
-		if (!list)
-			list = l_queue_new();
+		cert = cert_arena_add(arena, der_len);
+		if (!cert)
+			goto error;
 
 		l_queue_push_tail(list, cert);
 	}
 
+	cert_arena_done(arena);
 	return list;
 
 error:
 	l_queue_destroy(list, (l_queue_destroy_func_t) l_cert_free);
+	cert_arena_done(arena);
 	return NULL;
 }
 
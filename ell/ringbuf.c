@@ -12,7 +12,11 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 
 #include "private.h"
@@ -24,6 +28,11 @@
  * @short_description: Ring Buffer support
  *
  * Ring Buffer support
+ *
+ * A ring buffer created with l_ringbuf_new_mapped() maps its storage twice
+ * back to back, so any readable or writable region is contiguous in memory
+ * and can be used in place with l_ringbuf_peek_all(), l_ringbuf_reserve()
+ * and l_ringbuf_commit().
  */
 
 /**
@@ -38,6 +47,7 @@ struct l_ringbuf {
 	size_t out;
 	l_ringbuf_tracing_func_t in_tracing;
 	void *in_data;
+	int fd;
 };
 
 #define RINGBUF_RESET 0
@@ -79,10 +89,69 @@ LIB_EXPORT struct l_ringbuf *l_ringbuf_new(size_t size)
 	ringbuf->size = real_size;
 	ringbuf->in = RINGBUF_RESET;
 	ringbuf->out = RINGBUF_RESET;
+	ringbuf->fd = -1;
 
 	return ringbuf;
 }
 
+/**
+ * l_ringbuf_new_mapped:
+ * @size: Minimum size of the ring buffer.
+ *
+ * Create a new ring buffer backed by a memfd that is mapped twice in a row.
+ * The size is rounded up to a power of two of at least the page size.  All
+ * of the stored data and all of the free space is always contiguous.
+ *
+ * Returns: a newly allocated #l_ringbuf object or NULL on failure
+ **/
+LIB_EXPORT struct l_ringbuf *l_ringbuf_new_mapped(size_t size)
+{
+	struct l_ringbuf *ringbuf;
+	size_t real_size;
+	uint8_t *addr;
+	int fd;
+
+	if (size < 2 || size > UINT_MAX / 2)
+		return NULL;
+
+	real_size = maxsize(align_power2(size), sysconf(_SC_PAGESIZE));
+
+	fd = memfd_create("ell-ringbuf", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, real_size) < 0)
+		goto close_fd;
+
+	/* Reserve the whole range first, then map the file over both halves */
+	addr = mmap(NULL, real_size * 2, PROT_NONE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		goto close_fd;
+
+	if (mmap(addr, real_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+			mmap(addr + real_size, real_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(addr, real_size * 2);
+		goto close_fd;
+	}
+
+	ringbuf = l_new(struct l_ringbuf, 1);
+	ringbuf->buffer = addr;
+	ringbuf->size = real_size;
+	ringbuf->in = RINGBUF_RESET;
+	ringbuf->out = RINGBUF_RESET;
+	ringbuf->fd = fd;
+
+	return ringbuf;
+
+close_fd:
+	close(fd);
+	return NULL;
+}
+
 /**
  * l_ringbuf_free:
  * @ringbuf: Ring Buffer object
@@ -94,10 +163,40 @@ LIB_EXPORT void l_ringbuf_free(struct l_ringbuf *ringbuf)
 	if (!ringbuf)
 		return;
 
-	l_free(ringbuf->buffer);
+	if (ringbuf->fd >= 0) {
+		munmap(ringbuf->buffer, ringbuf->size * 2);
+		close(ringbuf->fd);
+	} else
+		l_free(ringbuf->buffer);
+
 	l_free(ringbuf);
 }
 
+/* Number of bytes that can be accessed at @offset without wrapping */
+static inline size_t ringbuf_nowrap(struct l_ringbuf *ringbuf, size_t offset)
+{
+	if (ringbuf->fd >= 0)
+		return ringbuf->size;
+
+	return ringbuf->size - offset;
+}
+
+static void ringbuf_trace_in(struct l_ringbuf *ringbuf, size_t offset,
+								size_t len)
+{
+	size_t end;
+
+	if (!ringbuf->in_tracing || !len)
+		return;
+
+	end = minsize(len, ringbuf_nowrap(ringbuf, offset));
+	ringbuf->in_tracing(ringbuf->buffer + offset, end, ringbuf->in_data);
+
+	if (len > end)
+		ringbuf->in_tracing(ringbuf->buffer, len - end,
+							ringbuf->in_data);
+}
+
 /**
  * l_ringbuf_set_input_tracing:
  * @ringbuf: Ring Buffer object
@@ -203,12 +302,42 @@ LIB_EXPORT void *l_ringbuf_peek(struct l_ringbuf *ringbuf, size_t offset,
 
 	if (len_nowrap) {
 		size_t len = ringbuf->in - ringbuf->out;
-		*len_nowrap = minsize(len, ringbuf->size - offset);
+		*len_nowrap = minsize(len, ringbuf_nowrap(ringbuf, offset));
 	}
 
 	return ringbuf->buffer + offset;
 }
 
+/**
+ * l_ringbuf_peek_all:
+ * @ringbuf: Ring Buffer object
+ * @len: Number of stored bytes
+ *
+ * Returns all of the stored data as a single contiguous region.  This always
+ * succeeds for ring buffers created with l_ringbuf_new_mapped().  For other
+ * ring buffers NULL is returned if the data wraps around.
+ *
+ * Returns: Pointer into ring buffer internal storage or NULL
+ **/
+LIB_EXPORT void *l_ringbuf_peek_all(struct l_ringbuf *ringbuf, size_t *len)
+{
+	size_t offset;
+	size_t used;
+
+	if (!ringbuf || !len)
+		return NULL;
+
+	offset = ringbuf->out & (ringbuf->size - 1);
+	used = ringbuf->in - ringbuf->out;
+
+	if (used > ringbuf_nowrap(ringbuf, offset))
+		return NULL;
+
+	*len = used;
+
+	return ringbuf->buffer + offset;
+}
+
 /**
  * l_ringbuf_write:
  * @ringbuf: Ring Buffer object
@@ -234,7 +363,7 @@ LIB_EXPORT ssize_t l_ringbuf_write(struct l_ringbuf *ringbuf, int fd)
 
 	/* Grab data from buffer starting at offset until the end */
 	offset = ringbuf->out & (ringbuf->size - 1);
-	end = minsize(len, ringbuf->size - offset);
+	end = minsize(len, ringbuf_nowrap(ringbuf, offset));
 
 	iov[0].iov_base = ringbuf->buffer + offset;
 	iov[0].iov_len = end;
@@ -243,7 +372,7 @@ LIB_EXPORT ssize_t l_ringbuf_write(struct l_ringbuf *ringbuf, int fd)
 	iov[1].iov_base = ringbuf->buffer;
 	iov[1].iov_len = len - end;
 
-	consumed = writev(fd, iov, 2);
+	consumed = writev(fd, iov, iov[1].iov_len ? 2 : 1);
 	if (consumed < 0)
 		return -1;
 
@@ -306,7 +435,8 @@ LIB_EXPORT int l_ringbuf_printf(struct l_ringbuf *ringbuf,
 LIB_EXPORT int l_ringbuf_vprintf(struct l_ringbuf *ringbuf,
 						const char *format, va_list ap)
 {
-	size_t avail;
+	size_t avail, offset, end;
+	va_list aq;
 	char *str;
 	int len;
 
@@ -318,6 +448,25 @@ LIB_EXPORT int l_ringbuf_vprintf(struct l_ringbuf *ringbuf,
 	if (!avail)
 		return -1;
 
+	/*
+	 * Format in place if the string fits before wrapping, the space for
+	 * the terminating NUL is needed as well but is not committed
+	 */
+	offset = ringbuf->in & (ringbuf->size - 1);
+	end = minsize(avail, ringbuf_nowrap(ringbuf, offset));
+
+	va_copy(aq, ap);
+	len = vsnprintf(ringbuf->buffer + offset, end, format, aq);
+	va_end(aq);
+
+	if (len < 0)
+		return -1;
+
+	if ((size_t) len < end) {
+		l_ringbuf_commit(ringbuf, len);
+		return len;
+	}
+
 	len = vasprintf(&str, format, ap);
 	if (len < 0)
 		return -1;
@@ -334,6 +483,64 @@ LIB_EXPORT int l_ringbuf_vprintf(struct l_ringbuf *ringbuf,
 	return len;
 }
 
+/**
+ * l_ringbuf_reserve:
+ * @ringbuf: Ring Buffer object
+ * @len: Number of bytes to reserve
+ *
+ * Returns a contiguous region of @len bytes of free space to be filled in
+ * place.  The data becomes part of the ring buffer once l_ringbuf_commit()
+ * is called.  For ring buffers not created with l_ringbuf_new_mapped() this
+ * fails if the free space wraps around before @len bytes.
+ *
+ * Returns: Pointer into ring buffer internal storage or NULL
+ **/
+LIB_EXPORT void *l_ringbuf_reserve(struct l_ringbuf *ringbuf, size_t len)
+{
+	size_t avail;
+	size_t offset;
+
+	if (!ringbuf)
+		return NULL;
+
+	avail = ringbuf->size - ringbuf->in + ringbuf->out;
+	offset = ringbuf->in & (ringbuf->size - 1);
+
+	if (len > avail || len > ringbuf_nowrap(ringbuf, offset))
+		return NULL;
+
+	return ringbuf->buffer + offset;
+}
+
+/**
+ * l_ringbuf_commit:
+ * @ringbuf: Ring Buffer object
+ * @len: Number of bytes to commit
+ *
+ * Adds @len bytes written into the region returned by l_ringbuf_reserve()
+ * to the ring buffer.
+ *
+ * Returns: Whether the bytes were committed
+ **/
+LIB_EXPORT bool l_ringbuf_commit(struct l_ringbuf *ringbuf, size_t len)
+{
+	size_t offset;
+
+	if (!ringbuf)
+		return false;
+
+	offset = ringbuf->in & (ringbuf->size - 1);
+
+	if (len > ringbuf->size - ringbuf->in + ringbuf->out ||
+			len > ringbuf_nowrap(ringbuf, offset))
+		return false;
+
+	ringbuf_trace_in(ringbuf, offset, len);
+	ringbuf->in += len;
+
+	return true;
+}
+
 /**
  * l_ringbuf_read:
  * @ringbuf: Ring Buffer object
@@ -359,7 +566,7 @@ LIB_EXPORT ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd)
 
 	/* Determine how much to consume before wrapping */
 	offset = ringbuf->in & (ringbuf->size - 1);
-	end = minsize(avail, ringbuf->size - offset);
+	end = minsize(avail, ringbuf_nowrap(ringbuf, offset));
 
 	iov[0].iov_base = ringbuf->buffer + offset;
 	iov[0].iov_len = end;
@@ -368,21 +575,11 @@ LIB_EXPORT ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd)
 	iov[1].iov_base = ringbuf->buffer;
 	iov[1].iov_len = avail - end;
 
-	consumed = readv(fd, iov, 2);
+	consumed = readv(fd, iov, iov[1].iov_len ? 2 : 1);
 	if (consumed < 0)
 		return -1;
 
-	if (ringbuf->in_tracing) {
-		size_t len = minsize((size_t) consumed, end);
-
-		ringbuf->in_tracing(ringbuf->buffer + offset, len,
-							ringbuf->in_data);
-
-		if (consumed - len > 0)
-			ringbuf->in_tracing(ringbuf->buffer, consumed - len,
-							ringbuf->in_data);
-	}
-
+	ringbuf_trace_in(ringbuf, offset, consumed);
 	ringbuf->in += consumed;
 
 	return consumed;
@@ -417,24 +614,113 @@ LIB_EXPORT ssize_t l_ringbuf_append(struct l_ringbuf *ringbuf,
 
 	/* Determine how much to append before wrapping */
 	offset = ringbuf->in & (ringbuf->size - 1);
-	end = minsize(len, ringbuf->size - offset);
+	end = minsize(len, minsize(avail, ringbuf_nowrap(ringbuf, offset)));
 	memcpy(ringbuf->buffer + offset, data, end);
 
-	if (ringbuf->in_tracing)
-		ringbuf->in_tracing(ringbuf->buffer + offset, end,
-						ringbuf->in_data);
-
 	left = minsize(avail - end, len - end);
 
-	if (left > 0) {
+	if (left > 0)
 		memcpy(ringbuf->buffer, data + end, left);
 
-		if (ringbuf->in_tracing)
-			ringbuf->in_tracing(ringbuf->buffer, left,
-						ringbuf->in_data);
-	}
-
+	ringbuf_trace_in(ringbuf, offset, end + left);
 	ringbuf->in += end + left;
 
 	return (end + left);
 }
+
+/**
+ * l_ringbuf_read_fd:
+ * @ringbuf: Ring Buffer object
+ * @fd: file descriptor to read from
+ * @len: Maximum number of bytes to read
+ *
+ * Reads up to @len bytes from @fd into the ring buffer.  For ring buffers
+ * created with l_ringbuf_new_mapped() data from a pipe is moved with
+ * splice() without passing through user space.  Other file descriptors are
+ * read directly into the free space.
+ *
+ * Returns: Number of bytes read or -1 if the read failed.
+ **/
+LIB_EXPORT ssize_t l_ringbuf_read_fd(struct l_ringbuf *ringbuf, int fd,
+								size_t len)
+{
+	size_t avail, offset;
+	ssize_t consumed;
+
+	if (!ringbuf || fd < 0)
+		return -1;
+
+	avail = ringbuf->size - ringbuf->in + ringbuf->out;
+	if (!avail)
+		return -1;
+
+	offset = ringbuf->in & (ringbuf->size - 1);
+	len = minsize(len, avail);
+
+	if (ringbuf->fd < 0)
+		len = minsize(len, ringbuf->size - offset);
+	else {
+		/* splice() goes through the file, which ends after one copy */
+		loff_t off = offset;
+
+		consumed = splice(fd, NULL, ringbuf->fd, &off,
+				minsize(len, ringbuf->size - offset),
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (consumed >= 0)
+			goto done;
+
+		if (errno != EINVAL)
+			return -1;
+	}
+
+	consumed = L_TFR(read(fd, ringbuf->buffer + offset, len));
+	if (consumed < 0)
+		return -1;
+
+done:
+	ringbuf_trace_in(ringbuf, offset, consumed);
+	ringbuf->in += consumed;
+
+	return consumed;
+}
+
+/**
+ * l_ringbuf_write_fd:
+ * @ringbuf: Ring Buffer object
+ * @fd: file descriptor to write to
+ * @len: Maximum number of bytes to write
+ *
+ * Writes up to @len bytes from the ring buffer to @fd with a single write
+ * and drains them.  For ring buffers created with l_ringbuf_new_mapped()
+ * this never has to stop at the wrap around.
+ *
+ * Returns: Number of bytes written or -1 if the write failed.
+ **/
+LIB_EXPORT ssize_t l_ringbuf_write_fd(struct l_ringbuf *ringbuf, int fd,
+								size_t len)
+{
+	size_t offset;
+	ssize_t consumed;
+
+	if (!ringbuf || fd < 0)
+		return -1;
+
+	len = minsize(len, ringbuf->in - ringbuf->out);
+	if (!len)
+		return 0;
+
+	/*
+	 * Not spliced, a pipe would keep referencing the pages and see them
+	 * change once the space is reused
+	 */
+	offset = ringbuf->out & (ringbuf->size - 1);
+	len = minsize(len, ringbuf_nowrap(ringbuf, offset));
+
+	consumed = L_TFR(write(fd, ringbuf->buffer + offset, len));
+	if (consumed < 0)
+		return -1;
+
+	l_ringbuf_drain(ringbuf, consumed);
+
+	return consumed;
+}
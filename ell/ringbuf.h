@@ -22,6 +22,7 @@ typedef void (*l_ringbuf_tracing_func_t)(const void *buf, size_t count,
 struct l_ringbuf;
 
 struct l_ringbuf *l_ringbuf_new(size_t size);
+struct l_ringbuf *l_ringbuf_new_mapped(size_t size);
 void l_ringbuf_free(struct l_ringbuf *ringbuf);
 
 bool l_ringbuf_set_input_tracing(struct l_ringbuf *ringbuf,
@@ -33,6 +34,7 @@ size_t l_ringbuf_len(struct l_ringbuf *ringbuf);
 size_t l_ringbuf_drain(struct l_ringbuf *ringbuf, size_t count);
 void *l_ringbuf_peek(struct l_ringbuf *ringbuf, size_t offset,
 							size_t *len_nowrap);
+void *l_ringbuf_peek_all(struct l_ringbuf *ringbuf, size_t *len);
 ssize_t l_ringbuf_write(struct l_ringbuf *ringbuf, int fd);
 
 size_t l_ringbuf_avail(struct l_ringbuf *ringbuf);
@@ -46,6 +48,12 @@ ssize_t l_ringbuf_read(struct l_ringbuf *ringbuf, int fd);
 ssize_t l_ringbuf_append(struct l_ringbuf *ringbuf,
 					const void *data, size_t len);
 
+void *l_ringbuf_reserve(struct l_ringbuf *ringbuf, size_t len);
+bool l_ringbuf_commit(struct l_ringbuf *ringbuf, size_t len);
+
+ssize_t l_ringbuf_read_fd(struct l_ringbuf *ringbuf, int fd, size_t len);
+ssize_t l_ringbuf_write_fd(struct l_ringbuf *ringbuf, int fd, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
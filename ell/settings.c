@@ -32,13 +32,27 @@
 #include "utf8.h"
 #include "string.h"
 #include "queue.h"
+#include "random.h"
 #include "settings.h"
 #include "private.h"
 #include "missing.h"
 #include "pem-private.h"
+#include "siphash-private.h"
 
+/*
+ * With l_settings_load_from_file_mapped() the key and the raw value are
+ * slices of a private copy of the file, shared with clones.  The
+ * nul-terminated value is only copied out on first access, or replaced
+ * on modification.
+ */
 struct setting_data {
-	char *key;
+	unsigned int hash;
+	bool key_mapped;
+	struct group_data *group;
+	const char *key;
+	size_t key_len;
+	const char *raw;
+	size_t raw_len;
 	char *value;
 };
 
@@ -49,26 +63,297 @@ struct embedded_group_data {
 	char data[];
 };
 
+/*
+ * src_start and src_len locate the group, up to the next group, in the
+ * file that the settings were last loaded from or saved to.  src_len
+ * is reset when the group is modified.  src_blank is set when the range
+ * already ends with the blank line that separates groups.
+ */
 struct group_data {
+	unsigned int hash;
+	bool src_newline;
+	bool src_blank;
 	char *name;
 	struct l_queue *settings;
+	off_t src_start;
+	size_t src_len;
+};
+
+struct settings_source {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+};
+
+/*
+ * Open addressing hash index over the groups or the keys of all groups.
+ * The l_queues still define the order, the index only points to the
+ * first entry of each name as that is what a queue search would find.
+ */
+struct index_slot {
+	unsigned int hash;
+	void *entry;
+};
+
+struct settings_index {
+	struct index_slot *slots;
+	unsigned int mask;
+	unsigned int count;
 };
 
 struct l_settings {
+	uint8_t hash_key[16];
 	l_settings_debug_cb_t debug_handler;
 	l_settings_destroy_cb_t debug_destroy;
 	void *debug_data;
 	struct l_queue *groups;
 	struct l_queue *embedded_groups;
+	struct settings_index group_index;
+	struct settings_index key_index;
+	struct l_queue *files;
+	struct settings_source *source;
+};
+
+struct settings_file {
+	int ref_count;
+	char data[];
 };
 
+typedef bool (*index_match_func_t)(const void *entry, const void *user_data);
+
+static void index_add_slot(struct settings_index *index, unsigned int hash,
+				void *entry)
+{
+	unsigned int i = hash & index->mask;
+
+	while (index->slots[i].entry)
+		i = (i + 1) & index->mask;
+
+	index->slots[i].hash = hash;
+	index->slots[i].entry = entry;
+}
+
+static void index_insert(struct settings_index *index, unsigned int hash,
+				void *entry)
+{
+	/* Keep the load factor at or below 3/4 */
+	if (!index->slots || (index->count + 1) * 4 > (index->mask + 1) * 3) {
+		struct index_slot *old = index->slots;
+		unsigned int size = old ? (index->mask + 1) * 2 : 16;
+		unsigned int i;
+
+		index->slots = l_new(struct index_slot, size);
+		index->mask = size - 1;
+
+		for (i = 0; old && i < size / 2; i++)
+			if (old[i].entry)
+				index_add_slot(index, old[i].hash,
+						old[i].entry);
+
+		l_free(old);
+	}
+
+	index_add_slot(index, hash, entry);
+	index->count++;
+}
+
+static void *index_lookup(const struct settings_index *index,
+				unsigned int hash, index_match_func_t match,
+				const void *user_data)
+{
+	unsigned int i;
+
+	if (!index->slots)
+		return NULL;
+
+	for (i = hash & index->mask; index->slots[i].entry;
+			i = (i + 1) & index->mask)
+		if (index->slots[i].hash == hash &&
+				match(index->slots[i].entry, user_data))
+			return index->slots[i].entry;
+
+	return NULL;
+}
+
+static void index_remove(struct settings_index *index, unsigned int hash,
+				const void *entry)
+{
+	unsigned int i, j;
+
+	if (!index->slots)
+		return;
+
+	for (i = hash & index->mask; index->slots[i].entry != entry;
+			i = (i + 1) & index->mask)
+		if (!index->slots[i].entry)
+			return;
+
+	/* Shift back the following entries that would probe past the hole */
+	for (j = (i + 1) & index->mask; index->slots[j].entry;
+			j = (j + 1) & index->mask) {
+		unsigned int home = index->slots[j].hash & index->mask;
+
+		if (((j - home) & index->mask) < ((j - i) & index->mask))
+			continue;
+
+		index->slots[i] = index->slots[j];
+		i = j;
+	}
+
+	index->slots[i].entry = NULL;
+	index->count--;
+}
+
+static void index_clear(struct settings_index *index)
+{
+	l_free(index->slots);
+	memset(index, 0, sizeof(*index));
+}
+
+/*
+ * Keyed so that a crafted file can't put all of its groups or keys in
+ * one probe chain.  Keys may be slices that aren't nul-terminated.
+ */
+static unsigned int settings_hash(const struct l_settings *settings,
+					const char *s, size_t len)
+{
+	uint64_t hash;
+
+	_siphash24((uint8_t *) &hash, (const uint8_t *) s, len,
+			settings->hash_key);
+	return hash;
+}
+
+static unsigned int key_hash(const struct l_settings *settings,
+				const struct group_data *group,
+				const char *key, size_t len)
+{
+	return settings_hash(settings, key, len) ^
+					(group->hash * 0x9e3779b1u);
+}
+
+struct key_lookup {
+	const struct group_data *group;
+	const char *key;
+	size_t len;
+};
+
+static bool group_match(const void *a, const void *b)
+{
+	const struct group_data *group = a;
+	const char *name = b;
+
+	return !strcmp(group->name, name);
+}
+
+static bool key_lookup_match(const void *a, const void *b)
+{
+	const struct setting_data *setting = a;
+	const struct key_lookup *lookup = b;
+
+	return setting->group == lookup->group &&
+		setting->key_len == lookup->len &&
+		!memcmp(setting->key, lookup->key, lookup->len);
+}
+
+static struct group_data *find_group(const struct l_settings *settings,
+					const char *name)
+{
+	return index_lookup(&settings->group_index,
+				settings_hash(settings, name, strlen(name)),
+				group_match, name);
+}
+
+static struct setting_data *find_key(const struct l_settings *settings,
+					const struct group_data *group,
+					const char *key)
+{
+	struct key_lookup lookup = { group, key, strlen(key) };
+
+	return index_lookup(&settings->key_index,
+				key_hash(settings, group, key, lookup.len),
+				key_lookup_match, &lookup);
+}
+
+static void index_group(struct l_settings *settings, struct group_data *group)
+{
+	if (!index_lookup(&settings->group_index, group->hash, group_match,
+				group->name))
+		index_insert(&settings->group_index, group->hash, group);
+}
+
+static void index_key(struct l_settings *settings, struct setting_data *pair)
+{
+	struct key_lookup lookup = { pair->group, pair->key, pair->key_len };
+
+	if (!index_lookup(&settings->key_index, pair->hash, key_lookup_match,
+				&lookup))
+		index_insert(&settings->key_index, pair->hash, pair);
+}
+
+static struct group_data *group_new(const struct l_settings *settings,
+					const char *name, size_t len)
+{
+	struct group_data *group = l_new(struct group_data, 1);
+
+	group->name = l_strndup(name, len);
+	group->hash = settings_hash(settings, name, len);
+	group->settings = l_queue_new();
+
+	return group;
+}
+
+static struct setting_data *setting_new(const struct l_settings *settings,
+					struct group_data *group,
+					const char *key, size_t len,
+					bool mapped)
+{
+	struct setting_data *pair = l_new(struct setting_data, 1);
+
+	pair->group = group;
+	pair->key_mapped = mapped;
+	pair->key = mapped ? key : l_strndup(key, len);
+	pair->key_len = len;
+	pair->hash = key_hash(settings, group, key, len);
+
+	return pair;
+}
+
+static const char *setting_get_value(struct setting_data *pair)
+{
+	if (!pair->value)
+		pair->value = l_strndup(pair->raw, pair->raw_len);
+
+	return pair->value;
+}
+
+static void setting_set_value(struct setting_data *pair, char *value)
+{
+	if (pair->value) {
+		explicit_bzero(pair->value, strlen(pair->value));
+		l_free(pair->value);
+	}
+
+	pair->value = value;
+	pair->raw = value;
+	pair->raw_len = strlen(value);
+}
+
 static void setting_destroy(void *data)
 {
 	struct setting_data *pair = data;
 
-	l_free(pair->key);
-	explicit_bzero(pair->value, strlen(pair->value));
-	l_free(pair->value);
+	if (!pair->key_mapped)
+		l_free((char *) pair->key);
+
+	if (pair->value) {
+		explicit_bzero(pair->value, strlen(pair->value));
+		l_free(pair->value);
+	}
+
 	l_free(pair);
 }
 
@@ -82,6 +367,48 @@ static void group_destroy(void *data)
 	l_free(group);
 }
 
+static struct settings_source *settings_source_new(const char *path,
+							const struct stat *st)
+{
+	struct settings_source *source = l_new(struct settings_source, 1);
+
+	source->path = l_strdup(path);
+	source->dev = st->st_dev;
+	source->ino = st->st_ino;
+	source->size = st->st_size;
+	source->mtime = st->st_mtim;
+	source->ctime = st->st_ctim;
+	return source;
+}
+
+static void settings_source_free(struct settings_source *source)
+{
+	if (!source)
+		return;
+
+	l_free(source->path);
+	l_free(source);
+}
+
+static void settings_file_unref(void *data)
+{
+	struct settings_file *file = data;
+
+	if (__atomic_sub_fetch(&file->ref_count, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	l_free(file);
+}
+
+static void settings_file_share(void *data, void *user_data)
+{
+	struct settings_file *file = data;
+	struct l_queue *files = user_data;
+
+	__atomic_fetch_add(&file->ref_count, 1, __ATOMIC_SEQ_CST);
+	l_queue_push_tail(files, file);
+}
+
 static void embedded_group_destroy(void *data)
 {
 	struct embedded_group_data *group = data;
@@ -95,37 +422,60 @@ LIB_EXPORT struct l_settings *l_settings_new(void)
 	struct l_settings *settings;
 
 	settings = l_new(struct l_settings, 1);
+
+	/* Without randomness the index still works, just with a known key */
+	l_getrandom(settings->hash_key, sizeof(settings->hash_key));
+
 	settings->groups = l_queue_new();
 	settings->embedded_groups = l_queue_new();
 
 	return settings;
 }
 
-static void copy_key_value_foreach(void *data, void *user_data)
+static void copy_key_value(const struct l_settings *settings,
+				struct group_data *group,
+				const struct setting_data *s)
 {
-	struct setting_data *s = data;
-	struct l_queue *settings = user_data;
-	struct setting_data *copy = l_new(struct setting_data, 1);
+	/* Unmodified settings keep pointing into the shared file copy */
+	bool shared = s->key_mapped && s->raw != s->value;
+	struct setting_data *copy = setting_new(settings, group, s->key,
+						s->key_len, shared);
 
-	copy->key = l_strdup(s->key);
-	copy->value = l_strdup(s->value);
+	if (shared) {
+		copy->raw = s->raw;
+		copy->raw_len = s->raw_len;
+	} else
+		setting_set_value(copy, l_strndup(s->raw, s->raw_len));
 
-	l_queue_push_head(settings, copy);
+	l_queue_push_head(group->settings, copy);
 }
 
 static void copy_group_foreach(void *data, void *user_data)
 {
 	struct group_data *group = data;
-	struct l_queue *groups = user_data;
-	struct group_data *copy = l_new(struct group_data, 1);
+	struct l_settings *settings = user_data;
+	struct group_data *copy = group_new(settings, group->name,
+						strlen(group->name));
+	const struct l_queue_entry *entry;
+
+	l_queue_push_head(settings->groups, copy);
+
+	for (entry = l_queue_get_entries(group->settings); entry;
+			entry = entry->next)
+		copy_key_value(settings, copy, entry->data);
+}
 
-	copy->name = l_strdup(group->name);
-	copy->settings = l_queue_new();
+static void index_group_foreach(void *data, void *user_data)
+{
+	struct group_data *group = data;
+	struct l_settings *settings = user_data;
+	const struct l_queue_entry *entry;
 
-	l_queue_push_head(groups, copy);
+	index_group(settings, group);
 
-	l_queue_foreach(group->settings, copy_key_value_foreach,
-				copy->settings);
+	for (entry = l_queue_get_entries(group->settings); entry;
+			entry = entry->next)
+		index_key(settings, entry->data);
 }
 
 static void copy_embedded_foreach(void *data, void *user_data)
@@ -151,7 +501,14 @@ LIB_EXPORT struct l_settings *l_settings_clone(
 
 	copy = l_settings_new();
 
-	l_queue_foreach(settings->groups, copy_group_foreach, copy->groups);
+	if (settings->files) {
+		copy->files = l_queue_new();
+		l_queue_foreach(settings->files, settings_file_share,
+					copy->files);
+	}
+
+	l_queue_foreach(settings->groups, copy_group_foreach, copy);
+	l_queue_foreach(copy->groups, index_group_foreach, copy);
 	l_queue_foreach(settings->embedded_groups, copy_embedded_foreach,
 				copy->embedded_groups);
 
@@ -168,6 +525,10 @@ LIB_EXPORT void l_settings_free(struct l_settings *settings)
 
 	l_queue_destroy(settings->groups, group_destroy);
 	l_queue_destroy(settings->embedded_groups, embedded_group_destroy);
+	index_clear(&settings->group_index);
+	index_clear(&settings->key_index);
+	l_queue_destroy(settings->files, settings_file_unref);
+	settings_source_free(settings->source);
 
 	l_free(settings);
 }
@@ -455,11 +816,9 @@ static bool parse_group(struct l_settings *settings, const char *data,
 		return false;
 	}
 
-	group = l_new(struct group_data, 1);
-	group->name = l_strndup(data + 1, end - 1);
-	group->settings = l_queue_new();
-
+	group = group_new(settings, data + 1, end - 1);
 	l_queue_push_tail(settings->groups, group);
+	index_group(settings, group);
 
 	return true;
 }
@@ -480,8 +839,6 @@ static unsigned int parse_key(struct l_settings *settings, const char *data,
 {
 	unsigned int i;
 	unsigned int end;
-	struct group_data *group;
-	struct setting_data *pair;
 
 	for (i = 0; i < len; i++) {
 		if (validate_key_character(data[i]))
@@ -506,204 +863,721 @@ static unsigned int parse_key(struct l_settings *settings, const char *data,
 		l_util_debug(settings->debug_handler, settings->debug_data,
 					"Garbage after Key on line %zd", line);
 
-		return 0;
-	}
+		return 0;
+	}
+
+	return end;
+}
+
+static bool parse_keyvalue(struct l_settings *settings, const char *data,
+				size_t len, size_t line, bool mapped)
+{
+	const char *equal = memchr(data, '=', len);
+	unsigned int key_len;
+	struct group_data *group;
+	struct setting_data *pair;
+
+	if (!equal) {
+		l_util_debug(settings->debug_handler, settings->debug_data,
+				"Delimiter '=' not found on line: %zd", line);
+		return false;
+	}
+
+	if (equal == data) {
+		l_util_debug(settings->debug_handler, settings->debug_data,
+					"Empty key on line: %zd", line);
+		return false;
+	}
+
+	key_len = parse_key(settings, data, equal - data, line);
+	if (!key_len)
+		return false;
+
+	equal += 1;
+	while (equal < data + len && l_ascii_isblank(*equal))
+		equal += 1;
+
+	len -= equal - data;
+
+	if (!l_utf8_validate(equal, len, NULL)) {
+		l_util_debug(settings->debug_handler, settings->debug_data,
+				"Invalid UTF8 in value on line: %zd", line);
+		return false;
+	}
+
+	group = l_queue_peek_tail(settings->groups);
+	pair = setting_new(settings, group, data, key_len, mapped);
+
+	if (mapped) {
+		pair->raw = equal;
+		pair->raw_len = len;
+	} else
+		setting_set_value(pair, l_strndup(equal, len));
+
+	l_queue_push_tail(group->settings, pair);
+	index_key(settings, pair);
+
+	return true;
+}
+
+static void close_group_range(struct group_data *group, const char *data,
+				size_t end)
+{
+	if (!group)
+		return;
+
+	group->src_len = end - group->src_start;
+	group->src_newline = data[end - 1] == '\n';
+	group->src_blank = group->src_len > 1 && data[end - 2] == '\n' &&
+				group->src_newline;
+}
+
+/*
+ * With @track the groups remember their byte ranges in @data so that
+ * l_settings_save_to_file() can copy them when they stay unmodified.
+ */
+static bool settings_load(struct l_settings *settings, const char *data,
+				size_t len, bool mapped, bool track)
+{
+	size_t pos = 0;
+	bool r = true;
+	bool has_group = false;
+	const char *eol;
+	size_t line = 1;
+	size_t line_len;
+	struct group_data *open = NULL;
+
+	if (unlikely(!settings || !data || !len))
+		return false;
+
+	while (pos < len && r) {
+		if (l_ascii_isblank(data[pos])) {
+			pos += 1;
+			continue;
+		}
+
+		if (data[pos] == '\n') {
+			line += 1;
+			pos += 1;
+			continue;
+		}
+
+		eol = memchr(data + pos, '\n', len - pos);
+		if (!eol)
+			eol = data + len;
+
+		line_len = eol - data - pos;
+
+		if (track && data[pos] == '[') {
+			close_group_range(open, data, pos);
+			open = NULL;
+		}
+
+		if (line_len > 1 && data[pos] == '[' && data[pos + 1] == '@') {
+			ssize_t ret;
+
+			ret = parse_embedded_group(settings, data + pos,
+							line_len, len - pos,
+							line);
+			if (ret < 0)
+				return false;
+
+			/*
+			 * This is the offset for the actual raw data, the
+			 * group line will be offset below
+			 */
+			pos += ret;
+		} else if (data[pos] == '[') {
+			r = parse_group(settings, data + pos, line_len, line);
+			if (r)
+				has_group = true;
+
+			if (r && track) {
+				open = l_queue_peek_tail(settings->groups);
+				open->src_start = pos;
+			}
+		} else if (data[pos] != '#') {
+			struct group_data *group;
+
+			if (!has_group)
+				return false;
+
+			r = parse_keyvalue(settings, data + pos, line_len,
+						line, mapped);
+
+			/* Keys after an embedded group land out of range */
+			group = l_queue_peek_tail(settings->groups);
+			if (group != open)
+				group->src_len = 0;
+		}
+
+		pos += line_len;
+	}
+
+	if (track)
+		close_group_range(open, data, len);
+
+	return r;
+}
+
+LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
+						const char *data, size_t len)
+{
+	if (unlikely(!settings))
+		return false;
+
+	settings_source_free(settings->source);
+	settings->source = NULL;
+
+	return settings_load(settings, data, len, false, false);
+}
+
+static void append_group(struct l_string *buf, const struct group_data *group)
+{
+	const struct l_queue_entry *setting_entry;
+
+	l_string_append_printf(buf, "[%s]\n", group->name);
+
+	setting_entry = l_queue_get_entries(group->settings);
+
+	while (setting_entry) {
+		struct setting_data *setting = setting_entry->data;
+
+		l_string_append_printf(buf, "%.*s=%.*s\n",
+					(int) setting->key_len, setting->key,
+					(int) setting->raw_len, setting->raw);
+		setting_entry = setting_entry->next;
+	}
+}
+
+static void append_embedded_groups(struct l_string *buf,
+					const struct l_settings *settings)
+{
+	const struct l_queue_entry *group_entry;
+
+	group_entry = l_queue_get_entries(settings->embedded_groups);
+
+	if (group_entry && l_queue_length(settings->groups) > 0)
+		l_string_append_c(buf, '\n');
+
+	while (group_entry) {
+		struct embedded_group_data *group = group_entry->data;
+
+		l_string_append_printf(buf, "[@%s@%s]\n%s",
+					group->type,
+					group->name,
+					group->data);
+		if (group_entry->next)
+			l_string_append_c(buf, '\n');
+
+		group_entry = group_entry->next;
+	}
+}
+
+LIB_EXPORT char *l_settings_to_data(const struct l_settings *settings,
+								size_t *len)
+{
+	struct l_string *buf;
+	char *ret;
+	const struct l_queue_entry *group_entry;
+
+	if (unlikely(!settings))
+		return NULL;
+
+	buf = l_string_new(255);
+
+	group_entry = l_queue_get_entries(settings->groups);
+	while (group_entry) {
+		append_group(buf, group_entry->data);
+
+		if (group_entry->next)
+			l_string_append_c(buf, '\n');
+
+		group_entry = group_entry->next;
+	}
+
+	append_embedded_groups(buf, settings);
+
+	ret = l_string_unwrap(buf);
+
+	if (len)
+		*len = strlen(ret);
+
+	return ret;
+}
+
+static int settings_write(int fd, const char *data, size_t len)
+{
+	while (len) {
+		ssize_t r = L_TFR(write(fd, data, len));
+
+		if (r < 0)
+			return -errno;
+
+		data += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+static int settings_flush(int fd, struct l_string **buf)
+{
+	unsigned int len = l_string_length(*buf);
+	char *data;
+	int r;
+
+	if (!len)
+		return 0;
+
+	data = l_string_unwrap(*buf);
+	r = settings_write(fd, data, len);
+	explicit_bzero(data, len);
+	l_free(data);
+	*buf = l_string_new(255);
+
+	return r;
+}
+
+/*
+ * Lets the kernel copy, or share the extents of, an unmodified range of
+ * the old file.  copy_file_range() moves the output file offset just
+ * like write() does.
+ */
+static int settings_copy_range(int in_fd, off_t offset, size_t len,
+				int out_fd)
+{
+	char buf[4096];
+
+#ifdef __NR_copy_file_range
+	while (len) {
+		loff_t in_offset = offset;
+		long r = syscall(__NR_copy_file_range, in_fd, &in_offset,
+					out_fd, NULL, len, 0);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r < 0 && (errno == ENOSYS || errno == EXDEV ||
+				errno == EINVAL || errno == EOPNOTSUPP))
+			break;
+
+		if (r < 0)
+			return -errno;
+
+		/* The old file was truncated */
+		if (r == 0)
+			return -EIO;
+
+		offset += r;
+		len -= r;
+	}
+#endif
+
+	while (len) {
+		ssize_t r = L_TFR(pread(in_fd, buf,
+					len < sizeof(buf) ? len : sizeof(buf),
+					offset));
+		int err;
+
+		if (r <= 0)
+			return r < 0 ? -errno : -EIO;
+
+		err = settings_write(out_fd, buf, r);
+		if (err < 0)
+			return err;
+
+		offset += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+static bool timespec_equal(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static int settings_open_source(const struct settings_source *source)
+{
+	struct stat st;
+	int fd;
+
+	if (!source)
+		return -1;
+
+	fd = open(source->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	/*
+	 * Only reuse the ranges if the file is still the one we parsed.
+	 * A rewrite in place keeps the inode and possibly the size, and a
+	 * replaced file can get the old inode number back, so the
+	 * timestamps have to match as well.
+	 */
+	if (fstat(fd, &st) < 0 || st.st_dev != source->dev ||
+			st.st_ino != source->ino ||
+			st.st_size != source->size ||
+			!timespec_equal(&st.st_mtim, &source->mtime) ||
+			!timespec_equal(&st.st_ctim, &source->ctime)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static char *settings_dir_name(const char *filename)
+{
+	const char *slash = strrchr(filename, '/');
+
+	return slash ? l_strndup(filename, slash - filename + 1) :
+			l_strdup(".");
+}
+
+static int settings_sync_dir(const char *dir)
+{
+	int fd;
+	int r = 0;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fsync(fd) < 0)
+		r = -errno;
+
+	close(fd);
+	return r;
+}
+
+struct settings_range {
+	off_t start;
+	size_t len;
+	bool blank;
+};
+
+/* One file of l_settings_save_to_files(), between write and rename */
+struct settings_save {
+	struct l_settings *settings;
+	const char *filename;
+	char *tmp_path;
+	int fd;
+	struct settings_range *ranges;
+};
+
+static void settings_save_discard(struct settings_save *save)
+{
+	if (save->fd >= 0)
+		L_TFR(close(save->fd));
+
+	if (save->tmp_path)
+		unlink(save->tmp_path);
+
+	l_free(save->tmp_path);
+	l_free(save->ranges);
+}
+
+/*
+ * Groups are separated by one blank line.  A copied range usually
+ * brings its own, anything else gets one added and accounted to the
+ * previous group so that adjacent ranges stay adjacent next time.
+ */
+static void settings_save_separate(struct l_string *buf,
+					struct settings_range *prev,
+					off_t *out)
+{
+	if (!prev || prev->blank)
+		return;
+
+	l_string_append_c(buf, '\n');
+	*out += 1;
+	prev->len += 1;
+	prev->blank = true;
+}
+
+/*
+ * Writes the settings to a new temporary file next to the target.  The
+ * file is left open so that a batch can sync all of them before
+ * renaming any.
+ */
+static int settings_save_write(struct settings_save *save)
+{
+	struct l_settings *settings = save->settings;
+	struct settings_range *ranges;
+	struct settings_range *prev = NULL;
+	struct l_string *buf;
+	const struct l_queue_entry *entry;
+	off_t out = 0;
+	off_t copy_start = 0;
+	size_t copy_len = 0;
+	unsigned int i;
+	int src_fd;
+	int fd;
+	int r = 0;
+
+	save->tmp_path = l_strdup_printf("%s.XXXXXX.tmp", save->filename);
+
+	fd = L_TFR(mkostemps(save->tmp_path, 4, O_CLOEXEC));
+	if (fd < 0) {
+		r = -errno;
+		l_free(save->tmp_path);
+		save->tmp_path = NULL;
+		return r;
+	}
+
+	save->fd = fd;
+	src_fd = settings_open_source(settings->source);
+	ranges = l_new(struct settings_range, l_queue_length(settings->groups));
+	save->ranges = ranges;
+	buf = l_string_new(255);
+
+	for (entry = l_queue_get_entries(settings->groups), i = 0;
+			entry && !r; entry = entry->next, i++) {
+		struct group_data *group = entry->data;
+		unsigned int before;
 
-	group = l_queue_peek_tail(settings->groups);
-	pair = l_new(struct setting_data, 1);
-	pair->key = l_strndup(data, end);
-	l_queue_push_head(group->settings, pair);
+		if (src_fd >= 0 && group->src_len) {
+			off_t copy_end = copy_start + copy_len;
 
-	return end;
-}
+			/* Merge with the previous range if adjacent */
+			if (copy_len && copy_end != group->src_start) {
+				r = settings_copy_range(src_fd, copy_start,
+							copy_len, fd);
+				copy_len = 0;
+			}
 
-static bool parse_value(struct l_settings *settings, const char *data,
-			size_t len, size_t line)
-{
-	unsigned int end = len;
-	struct group_data *group;
-	struct setting_data *pair;
+			if (!copy_len) {
+				settings_save_separate(buf, prev, &out);
 
-	group = l_queue_peek_tail(settings->groups);
-	pair = l_queue_pop_head(group->settings);
+				if (!r)
+					r = settings_flush(fd, &buf);
 
-	if (!l_utf8_validate(data, len, NULL)) {
-		l_util_debug(settings->debug_handler, settings->debug_data,
-				"Invalid UTF8 in value on line: %zd", line);
+				copy_start = group->src_start;
+			}
 
-		l_free(pair->key);
-		l_free(pair);
+			copy_len += group->src_len;
+			ranges[i].start = out;
+			ranges[i].len = group->src_len;
+			ranges[i].blank = group->src_blank;
+			out += group->src_len;
+			prev = &ranges[i];
 
-		return false;
-	}
+			if (group->src_newline)
+				continue;
 
-	pair->value = l_strndup(data, end);
-	l_queue_push_tail(group->settings, pair);
+			/* Only the last group in a file can lack it */
+			if (!r)
+				r = settings_copy_range(src_fd, copy_start,
+							copy_len, fd);
 
-	return true;
-}
+			copy_len = 0;
+			l_string_append_c(buf, '\n');
+			out += 1;
+			ranges[i].len += 1;
+			continue;
+		}
 
-static bool parse_keyvalue(struct l_settings *settings, const char *data,
-				size_t len, size_t line)
-{
-	const char *equal = memchr(data, '=', len);
+		if (copy_len && !r) {
+			r = settings_copy_range(src_fd, copy_start, copy_len,
+						fd);
+			copy_len = 0;
+		}
 
-	if (!equal) {
-		l_util_debug(settings->debug_handler, settings->debug_data,
-				"Delimiter '=' not found on line: %zd", line);
-		return false;
+		settings_save_separate(buf, prev, &out);
+
+		before = l_string_length(buf);
+		append_group(buf, group);
+		ranges[i].start = out;
+		ranges[i].len = l_string_length(buf) - before;
+		out += ranges[i].len;
+		prev = &ranges[i];
 	}
 
-	if (equal == data) {
-		l_util_debug(settings->debug_handler, settings->debug_data,
-					"Empty key on line: %zd", line);
-		return false;
+	if (copy_len && !r)
+		r = settings_copy_range(src_fd, copy_start, copy_len, fd);
+
+	if (!r) {
+		append_embedded_groups(buf, settings);
+		r = settings_flush(fd, &buf);
 	}
 
-	if (!parse_key(settings, data, equal - data, line))
-		return false;
+	l_string_free(buf);
 
-	equal += 1;
-	while (equal < data + len && l_ascii_isblank(*equal))
-		equal += 1;
+	if (src_fd >= 0)
+		close(src_fd);
 
-	return parse_value(settings, equal, len - (equal - data), line);
+	return r;
 }
 
-LIB_EXPORT bool l_settings_load_from_data(struct l_settings *settings,
-						const char *data, size_t len)
+static int settings_save_commit(struct settings_save *save)
 {
-	size_t pos = 0;
-	bool r = true;
-	bool has_group = false;
-	const char *eol;
-	size_t line = 1;
-	size_t line_len;
-
-	if (unlikely(!settings || !data || !len))
-		return false;
-
-	while (pos < len && r) {
-		if (l_ascii_isblank(data[pos])) {
-			pos += 1;
-			continue;
-		}
-
-		if (data[pos] == '\n') {
-			line += 1;
-			pos += 1;
-			continue;
-		}
+	struct l_settings *settings = save->settings;
+	const struct l_queue_entry *entry;
+	struct stat st;
+	unsigned int i;
+	int r;
 
-		eol = memchr(data + pos, '\n', len - pos);
-		if (!eol)
-			eol = data + len;
+	if (rename(save->tmp_path, save->filename) < 0)
+		return -errno;
 
-		line_len = eol - data - pos;
+	l_free(save->tmp_path);
+	save->tmp_path = NULL;
 
-		if (line_len > 1 && data[pos] == '[' && data[pos + 1] == '@') {
-			ssize_t ret;
+	/* The rename updates the ctime, so stat only now */
+	r = fstat(save->fd, &st);
+	L_TFR(close(save->fd));
+	save->fd = -1;
 
-			ret = parse_embedded_group(settings, data + pos,
-							line_len, len - pos,
-							line);
-			if (ret < 0)
-				return false;
+	settings_source_free(settings->source);
+	settings->source = NULL;
 
-			/*
-			 * This is the offset for the actual raw data, the
-			 * group line will be offset below
-			 */
-			pos += ret;
-		} else if (data[pos] == '[') {
-			r = parse_group(settings, data + pos, line_len, line);
-			if (r)
-				has_group = true;
-		} else if (data[pos] != '#') {
-			if (!has_group)
-				return false;
+	if (r < 0)
+		return 0;
 
-			r = parse_keyvalue(settings, data + pos, line_len,
-						line);
-		}
+	/* The new file is what unmodified groups get copied from next */
+	for (entry = l_queue_get_entries(settings->groups), i = 0;
+			entry; entry = entry->next, i++) {
+		struct group_data *group = entry->data;
 
-		pos += line_len;
+		group->src_start = save->ranges[i].start;
+		group->src_len = save->ranges[i].len;
+		group->src_blank = save->ranges[i].blank;
+		group->src_newline = true;
 	}
 
-	return r;
+	settings->source = settings_source_new(save->filename, &st);
+	return 0;
 }
 
-LIB_EXPORT char *l_settings_to_data(const struct l_settings *settings,
-								size_t *len)
+/* Syncs each distinct directory of @filenames once */
+static int settings_sync_dirs(const char **filenames, unsigned int n_files)
 {
-	struct l_string *buf;
-	char *ret;
-	const struct l_queue_entry *group_entry;
+	char **dirs = l_new(char *, n_files + 1);
+	unsigned int n_dirs = 0;
+	unsigned int i;
+	int r = 0;
 
-	if (unlikely(!settings))
-		return NULL;
+	for (i = 0; i < n_files; i++) {
+		char *dir = settings_dir_name(filenames[i]);
 
-	buf = l_string_new(255);
+		if (l_strv_contains(dirs, dir)) {
+			l_free(dir);
+			continue;
+		}
 
-	group_entry = l_queue_get_entries(settings->groups);
-	while (group_entry) {
-		struct group_data *group = group_entry->data;
-		const struct l_queue_entry *setting_entry;
+		dirs[n_dirs++] = dir;
+
+		if (!r)
+			r = settings_sync_dir(dir);
+	}
 
-		l_string_append_printf(buf, "[%s]\n", group->name);
+	l_strv_free(dirs);
+	return r;
+}
 
-		setting_entry = l_queue_get_entries(group->settings);
+/**
+ * l_settings_save_to_files:
+ * @settings: Array of settings objects
+ * @filenames: Destination filename for each of @settings
+ * @n_files: Number of entries in @settings and @filenames
+ * @flags: L_SETTINGS_SAVE_* flags
+ *
+ * Saves a batch of settings objects like l_settings_save_to_file() does
+ * for one.  All temporary files are written before any of them is
+ * renamed, and if writing any of them fails none of the targets are
+ * touched.  With L_SETTINGS_SAVE_SYNC all files are synced before the
+ * first rename and each directory involved is synced once after the
+ * last, instead of once per file.  If a rename fails the files after it
+ * are left as they were while the ones before it have been replaced.
+ *
+ * Returns: 0 if successful, a negative errno otherwise
+ **/
+LIB_EXPORT int l_settings_save_to_files(struct l_settings **settings,
+					const char **filenames,
+					unsigned int n_files, uint32_t flags)
+{
+	struct settings_save *saves;
+	unsigned int i;
+	int r = 0;
 
-		while (setting_entry) {
-			struct setting_data *setting = setting_entry->data;
+	if (unlikely(!settings || !filenames || !n_files))
+		return -EINVAL;
 
-			l_string_append_printf(buf, "%s=%s\n",
-						setting->key, setting->value);
-			setting_entry = setting_entry->next;
-		}
+	for (i = 0; i < n_files; i++)
+		if (unlikely(!settings[i] || !filenames[i]))
+			return -EINVAL;
 
-		if (group_entry->next)
-			l_string_append_c(buf, '\n');
+	saves = l_new(struct settings_save, n_files);
 
-		group_entry = group_entry->next;
+	for (i = 0; i < n_files; i++) {
+		saves[i].settings = settings[i];
+		saves[i].filename = filenames[i];
+		saves[i].fd = -1;
 	}
 
-	group_entry = l_queue_get_entries(settings->embedded_groups);
+	for (i = 0; i < n_files && !r; i++)
+		r = settings_save_write(&saves[i]);
 
-	if (group_entry && l_queue_length(settings->groups) > 0)
-		l_string_append_c(buf, '\n');
+	/* Start writeback on all of them before waiting on any */
+	if (!r && (flags & L_SETTINGS_SAVE_SYNC) && n_files > 1)
+		for (i = 0; i < n_files; i++)
+			sync_file_range(saves[i].fd, 0, 0,
+					SYNC_FILE_RANGE_WRITE);
 
-	while (group_entry) {
-		struct embedded_group_data *group = group_entry->data;
+	for (i = 0; i < n_files && !r &&
+			(flags & L_SETTINGS_SAVE_SYNC); i++)
+		if (fsync(saves[i].fd) < 0)
+			r = -errno;
 
-		l_string_append_printf(buf, "[@%s@%s]\n%s",
-					group->type,
-					group->name,
-					group->data);
-		if (group_entry->next)
-			l_string_append_c(buf, '\n');
+	for (i = 0; i < n_files && !r; i++)
+		r = settings_save_commit(&saves[i]);
 
-		group_entry = group_entry->next;
-	}
+	for (i = 0; i < n_files; i++)
+		settings_save_discard(&saves[i]);
 
-	ret = l_string_unwrap(buf);
+	l_free(saves);
 
-	if (len)
-		*len = strlen(ret);
+	if (!r && (flags & L_SETTINGS_SAVE_SYNC))
+		r = settings_sync_dirs(filenames, n_files);
 
-	return ret;
+	return r;
 }
 
-LIB_EXPORT bool l_settings_load_from_file(struct l_settings *settings,
-						const char *filename)
+/**
+ * l_settings_save_to_file:
+ * @settings: The settings object
+ * @filename: Destination filename
+ * @flags: L_SETTINGS_SAVE_* flags
+ *
+ * Writes @settings to @filename through a temporary file and rename,
+ * like l_file_set_contents() does with l_settings_to_data() output.
+ * Groups that haven't changed since the settings were loaded from, or
+ * last saved to, a file are copied from that file with
+ * copy_file_range() instead of being serialized again, comments
+ * included.  The whole file is still rewritten: only filesystems that
+ * share extents on copy, such as btrfs or XFS with reflink, avoid
+ * writing the copied bytes again, elsewhere the saving is in CPU time
+ * only.  With L_SETTINGS_SAVE_SYNC the file and its directory are
+ * synced before returning.  Use l_settings_save_to_files() to sync a
+ * batch of files together.
+ *
+ * Returns: 0 if successful, a negative errno otherwise
+ **/
+LIB_EXPORT int l_settings_save_to_file(struct l_settings *settings,
+					const char *filename, uint32_t flags)
 {
-	int fd;
-	struct stat st;
-	char *data;
-	bool r;
+	return l_settings_save_to_files(&settings, &filename, 1, flags);
+}
 
-	if (unlikely(!settings || !filename))
-		return false;
+static bool settings_map_file(struct l_settings *settings,
+				const char *filename, void **out,
+				struct stat *st)
+{
+	int fd;
+	void *data;
 
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
@@ -713,7 +1587,7 @@ LIB_EXPORT bool l_settings_load_from_file(struct l_settings *settings,
 		return false;
 	}
 
-	if (fstat(fd, &st) < 0) {
+	if (fstat(fd, st) < 0) {
 		l_util_debug(settings->debug_handler, settings->debug_data,
 				"Could not stat %s (%s)", filename,
 				strerror(errno));
@@ -723,12 +1597,13 @@ LIB_EXPORT bool l_settings_load_from_file(struct l_settings *settings,
 	}
 
 	/* Nothing to do, assume success */
-	if (st.st_size == 0) {
+	if (st->st_size == 0) {
 		close(fd);
+		*out = NULL;
 		return true;
 	}
 
-	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	data = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
 	if (data == MAP_FAILED) {
 		l_util_debug(settings->debug_handler, settings->debug_data,
 				"Could not mmap %s (%s)", filename,
@@ -738,14 +1613,149 @@ LIB_EXPORT bool l_settings_load_from_file(struct l_settings *settings,
 		return false;
 	}
 
-	r = l_settings_load_from_data(settings, data, st.st_size);
+	close(fd);
+	*out = data;
+	return true;
+}
+
+/*
+ * Remembers @filename as the file that unmodified groups can be copied
+ * from, as long as it is the only thing loaded.  Returns whether to
+ * track the group ranges.
+ */
+static bool settings_set_source(struct l_settings *settings,
+				const char *filename, const struct stat *st)
+{
+	bool empty = l_queue_isempty(settings->groups) && !settings->source;
+
+	settings_source_free(settings->source);
+	settings->source = NULL;
+
+	if (!empty)
+		return false;
+
+	settings->source = settings_source_new(filename, st);
+	return true;
+}
+
+LIB_EXPORT bool l_settings_load_from_file(struct l_settings *settings,
+						const char *filename)
+{
+	void *data;
+	struct stat st;
+	bool track;
+	bool r;
+
+	if (unlikely(!settings || !filename))
+		return false;
+
+	if (!settings_map_file(settings, filename, &data, &st))
+		return false;
+
+	if (!st.st_size)
+		return true;
 
+	track = settings_set_source(settings, filename, &st);
+	r = settings_load(settings, data, st.st_size, false, track);
 	munmap(data, st.st_size);
-	close(fd);
 
 	return r;
 }
 
+/*
+ * Reads @filename into a private buffer.  Settings loaded from it point
+ * into the buffer, so it must not change underneath them the way a
+ * shared mapping would when the file is truncated or rewritten in place.
+ */
+static struct settings_file *settings_read_file(struct l_settings *settings,
+						const char *filename,
+						struct stat *st)
+{
+	struct settings_file *file;
+	size_t len = 0;
+	ssize_t r;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		l_util_debug(settings->debug_handler, settings->debug_data,
+				"Could not open %s (%s)", filename,
+				strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, st) < 0) {
+		l_util_debug(settings->debug_handler, settings->debug_data,
+				"Could not stat %s (%s)", filename,
+				strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	file = l_malloc(sizeof(struct settings_file) + st->st_size);
+	file->ref_count = 1;
+
+	/* A file that changes size while read is taken as it was read */
+	while (len < (size_t) st->st_size) {
+		r = read(fd, file->data + len, st->st_size - len);
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r < 0) {
+			l_util_debug(settings->debug_handler,
+					settings->debug_data,
+					"Could not read %s (%s)", filename,
+					strerror(errno));
+			l_free(file);
+			close(fd);
+			return NULL;
+		}
+
+		if (!r)
+			break;
+
+		len += r;
+	}
+
+	close(fd);
+	st->st_size = len;
+	return file;
+}
+
+/*
+ * Like l_settings_load_from_file() but the file is read into a single
+ * buffer, and keys and values stay there until they are read or
+ * modified.  The buffer is shared with clones and kept until the last
+ * of them is freed.
+ */
+LIB_EXPORT bool l_settings_load_from_file_mapped(struct l_settings *settings,
+							const char *filename)
+{
+	struct settings_file *file;
+	struct stat st;
+	bool track;
+
+	if (unlikely(!settings || !filename))
+		return false;
+
+	file = settings_read_file(settings, filename, &st);
+	if (!file)
+		return false;
+
+	if (!st.st_size) {
+		l_free(file);
+		return true;
+	}
+
+	if (!settings->files)
+		settings->files = l_queue_new();
+
+	l_queue_push_tail(settings->files, file);
+
+	track = settings_set_source(settings, filename, &st);
+	return settings_load(settings, file->data, st.st_size, true, track);
+}
+
 LIB_EXPORT bool l_settings_set_debug(struct l_settings *settings,
 					l_settings_debug_cb_t callback,
 					void *user_data,
@@ -764,14 +1774,6 @@ LIB_EXPORT bool l_settings_set_debug(struct l_settings *settings,
 	return true;
 }
 
-static bool group_match(const void *a, const void *b)
-{
-	const struct group_data *group = a;
-	const char *name = b;
-
-	return !strcmp(group->name, name);
-}
-
 struct gather_data {
 	int cur;
 	char **v;
@@ -810,7 +1812,7 @@ LIB_EXPORT bool l_settings_has_group(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 
 	return !!group;
 }
@@ -820,7 +1822,8 @@ static bool key_match(const void *a, const void *b)
 	const struct setting_data *setting = a;
 	const char *key = b;
 
-	return !strcmp(setting->key, key);
+	return setting->key_len == strlen(key) &&
+		!memcmp(setting->key, key, setting->key_len);
 }
 
 static void gather_keys(void *data, void *user_data)
@@ -828,7 +1831,8 @@ static void gather_keys(void *data, void *user_data)
 	struct setting_data *setting_data = data;
 	struct gather_data *gather = user_data;
 
-	gather->v[gather->cur++] = l_strdup(setting_data->key);
+	gather->v[gather->cur++] = l_strndup(setting_data->key,
+						setting_data->key_len);
 }
 
 LIB_EXPORT char **l_settings_get_keys(const struct l_settings *settings,
@@ -841,7 +1845,7 @@ LIB_EXPORT char **l_settings_get_keys(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return NULL;
 
-	group_data = l_queue_find(settings->groups, group_match, group_name);
+	group_data = find_group(settings, group_name);
 	if (!group_data)
 		return NULL;
 
@@ -863,11 +1867,11 @@ LIB_EXPORT bool l_settings_has_key(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 	if (!group)
 		return false;
 
-	setting = l_queue_find(group->settings, key_match, key);
+	setting = find_key(settings, group, key);
 
 	return !!setting;
 }
@@ -882,15 +1886,15 @@ LIB_EXPORT const char *l_settings_get_value(const struct l_settings *settings,
 	if (unlikely(!settings))
 		return NULL;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 	if (!group)
 		return NULL;
 
-	setting = l_queue_find(group->settings, key_match, key);
+	setting = find_key(settings, group, key);
 	if (!setting)
 		return NULL;
 
-	return setting->value;
+	return setting_get_value(setting);
 }
 
 static bool validate_group_name(const char *group_name)
@@ -922,17 +1926,16 @@ LIB_EXPORT bool l_settings_add_group(struct l_settings *settings,
 		return false;
 	}
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 	if (group) {
 		l_util_debug(settings->debug_handler, settings->debug_data,
 				"Group %s exists", group_name);
 		return true;
 	}
 
-	group = l_new(struct group_data, 1);
-	group->name = l_strdup(group_name);
-	group->settings = l_queue_new();
+	group = group_new(settings, group_name, strlen(group_name));
 	l_queue_push_tail(settings->groups, group);
+	index_group(settings, group);
 	return true;
 }
 
@@ -966,30 +1969,28 @@ static bool set_value(struct l_settings *settings, const char *group_name,
 		goto error;
 	}
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 	if (!group) {
-		group = l_new(struct group_data, 1);
-		group->name = l_strdup(group_name);
-		group->settings = l_queue_new();
-
+		group = group_new(settings, group_name, strlen(group_name));
 		l_queue_push_tail(settings->groups, group);
+		index_group(settings, group);
 		goto add_pair;
 	}
 
-	pair = l_queue_find(group->settings, key_match, key);
+	pair = find_key(settings, group, key);
 	if (!pair) {
 add_pair:
-		pair = l_new(struct setting_data, 1);
-		pair->key = l_strdup(key);
-		pair->value = value;
+		pair = setting_new(settings, group, key, strlen(key), false);
+		setting_set_value(pair, value);
 		l_queue_push_tail(group->settings, pair);
+		index_key(settings, pair);
+		group->src_len = 0;
 
 		return true;
 	}
 
-	explicit_bzero(pair->value, strlen(pair->value));
-	l_free(pair->value);
-	pair->value = value;
+	setting_set_value(pair, value);
+	group->src_len = 0;
 
 	return true;
 
@@ -1426,16 +2427,32 @@ LIB_EXPORT bool l_settings_remove_group(struct l_settings *settings,
 					const char *group_name)
 {
 	struct group_data *group;
+	const struct l_queue_entry *entry;
 
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_remove_if(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 	if (!group)
 		return false;
 
+	index_remove(&settings->group_index, group->hash, group);
+	l_queue_remove(settings->groups, group);
+
+	for (entry = l_queue_get_entries(group->settings); entry;
+			entry = entry->next) {
+		struct setting_data *setting = entry->data;
+
+		index_remove(&settings->key_index, setting->hash, setting);
+	}
+
 	group_destroy(group);
 
+	/* A later group of the same name becomes visible */
+	group = l_queue_find(settings->groups, group_match, group_name);
+	if (group)
+		index_group(settings, group);
+
 	return true;
 }
 
@@ -1449,15 +2466,22 @@ LIB_EXPORT bool l_settings_remove_key(struct l_settings *settings,
 	if (unlikely(!settings))
 		return false;
 
-	group = l_queue_find(settings->groups, group_match, group_name);
+	group = find_group(settings, group_name);
 	if (!group)
 		return false;
 
-	setting = l_queue_remove_if(group->settings, key_match, key);
+	setting = find_key(settings, group, key);
 	if (!setting)
 		return false;
 
+	index_remove(&settings->key_index, setting->hash, setting);
+	l_queue_remove(group->settings, setting);
 	setting_destroy(setting);
+	group->src_len = 0;
+
+	setting = l_queue_find(group->settings, key_match, key);
+	if (setting)
+		index_key(settings, setting);
 
 	return true;
 }
@@ -33,6 +33,18 @@ char *l_settings_to_data(const struct l_settings *settings, size_t *len);
 
 bool l_settings_load_from_file(struct l_settings *settings,
 					const char *filename);
+bool l_settings_load_from_file_mapped(struct l_settings *settings,
+					const char *filename);
+
+enum l_settings_save_flag {
+	L_SETTINGS_SAVE_SYNC = 1 << 0,
+};
+
+int l_settings_save_to_file(struct l_settings *settings, const char *filename,
+				uint32_t flags);
+int l_settings_save_to_files(struct l_settings **settings,
+				const char **filenames, unsigned int n_files,
+				uint32_t flags);
 
 bool l_settings_set_debug(struct l_settings *settings,
 				l_settings_debug_cb_t callback,
@@ -34,18 +34,40 @@ struct test {
 
 static struct test *test_head;
 static struct test *test_tail;
+static bool test_benchmarks;
 
 /**
  * l_test_init:
  * @argc: pointer to @argc parameter of main() function
  * @argv: pointer to @argv parameter of main() function
  *
- * Initialize testing framework.
+ * Initialize testing framework.  A --bench argument, which is removed
+ * from @argv, or a non-empty ELL_TEST_BENCH environment variable enables
+ * the tests added with l_test_add_benchmark().
  **/
 LIB_EXPORT void l_test_init(int *argc, char ***argv)
 {
+	const char *env = getenv("ELL_TEST_BENCH");
+	int i;
+	int n = 1;
+
 	test_head = NULL;
 	test_tail = NULL;
+	test_benchmarks = env && *env;
+
+	for (i = 1; i < *argc; i++) {
+		if (!strcmp((*argv)[i], "--bench")) {
+			test_benchmarks = true;
+			continue;
+		}
+
+		(*argv)[n++] = (*argv)[i];
+	}
+
+	if (n < *argc)
+		(*argv)[n] = NULL;
+
+	*argc = n;
 
 	l_log_set_stderr();
 }
@@ -113,3 +135,21 @@ LIB_EXPORT void l_test_add(const char *name, l_test_func_t function,
 	if (!test_head)
 		test_head = test;
 }
+
+/**
+ * l_test_add_benchmark:
+ * @name: test name
+ * @function: test function
+ * @test_data: test data
+ *
+ * Add a benchmark.  Benchmarks only run when enabled in l_test_init(),
+ * so that a plain test run stays short.
+ **/
+LIB_EXPORT void l_test_add_benchmark(const char *name, l_test_func_t function,
+						const void *test_data)
+{
+	if (!test_benchmarks)
+		return;
+
+	l_test_add(name, function, test_data);
+}
@@ -19,6 +19,8 @@ int l_test_run(void);
 
 void l_test_add(const char *name, l_test_func_t function,
 					const void *test_data);
+void l_test_add_benchmark(const char *name, l_test_func_t function,
+					const void *test_data);
 
 #ifdef __cplusplus
 }
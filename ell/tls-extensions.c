@@ -319,6 +319,9 @@ static const uint8_t tls_dh14_prime[] = {
 };
 
 static const struct tls_named_group tls_group_pref[] = {
+#ifdef __SIZEOF_INT128__
+	{ "x25519", 29, TLS_GROUP_TYPE_EC },
+#endif
 	{ "secp256r1", 23, TLS_GROUP_TYPE_EC },
 	{ "secp384r1", 24, TLS_GROUP_TYPE_EC },
 	{
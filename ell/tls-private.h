@@ -196,6 +196,7 @@ struct l_tls {
 	enum l_tls_version max_version;
 
 	struct l_queue *ca_certs;
+	struct l_cert_store *ca_store;	/* Not owned */
 	struct l_certchain *cert;
 	struct l_key *priv_key;
 	size_t priv_key_size;
@@ -501,12 +501,28 @@ static void tls_free_ecdhe_params(struct l_tls *tls)
 	l_free(params);
 }
 
+/*
+ * RFC 8422, Section 5.4.1: "For X25519 and X448, the contents are the byte
+ * string inputs and outputs of the corresponding functions defined in
+ * [RFC7748]", i.e. there's no point format octet.
+ */
+static bool tls_ecpoint_is_raw(const struct l_ecc_curve *curve)
+{
+	return l_ecc_curve_get_tls_group(curve) == 29;
+}
+
 static size_t tls_write_ecpoint(uint8_t *buf, size_t len,
 				const struct tls_named_group *curve,
 				const struct l_ecc_point *point)
 {
 	size_t point_bytes;
 
+	if (tls_ecpoint_is_raw(l_ecc_point_get_curve(point))) {
+		point_bytes = l_ecc_point_get_data(point, buf + 1, len - 1);
+		buf[0] = point_bytes;
+		return 1 + point_bytes;
+	}
+
 	/* RFC 8422, Section 5.4.1 */
 	point_bytes = l_ecc_point_get_data(point, buf + 2, len - 2);
 	buf[0] = 1 + point_bytes;		/* length */
@@ -579,6 +595,7 @@ static void tls_handle_ecdhe_server_key_xchg(struct l_tls *tls,
 	uint16_t namedcurve;
 	const uint8_t *server_ecdh_params_ptr = buf;
 	size_t point_bytes;
+	size_t expected_bytes;
 
 	/* RFC 8422, Section 5.4 */
 
@@ -607,20 +624,32 @@ static void tls_handle_ecdhe_server_key_xchg(struct l_tls *tls,
 
 	TLS_DEBUG("Negotiated %s", tls->negotiated_curve->name);
 
-	if (*buf < 1)
-		goto decode_error;
+	params = l_new(struct tls_ecdhe_params, 1);
+	params->curve = l_ecc_curve_from_tls_group(tls->negotiated_curve->id);
+	tls->pending.key_xchg_params = params;
 
-	point_bytes = *buf++ - 1;
+	if (tls_ecpoint_is_raw(params->curve)) {
+		point_bytes = *buf++;
+		len -= 1;
+		expected_bytes = l_ecc_curve_get_scalar_bytes(params->curve);
+	} else {
+		if (*buf < 1)
+			goto decode_error;
 
-	if (*buf != 4) {	/* uncompressed */
-		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
-				"Unsupported (deprecated?) PointConversionForm "
-				"%u", *buf);
-		return;
-	}
+		point_bytes = *buf++ - 1;
 
-	buf++;
-	len -= 2;
+		if (*buf != 4) {	/* uncompressed */
+			TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+					"Unsupported (deprecated?) "
+					"PointConversionForm %u", *buf);
+			return;
+		}
+
+		buf++;
+		len -= 2;
+		expected_bytes =
+			2 * l_ecc_curve_get_scalar_bytes(params->curve);
+	}
 
 	if (len < point_bytes)
 		goto decode_error;
@@ -630,19 +659,16 @@ static void tls_handle_ecdhe_server_key_xchg(struct l_tls *tls,
 	 * x and y parameters from the peer's public value satisfy the
 	 * curve equation, y^2 = x^3 + ax + b mod p."
 	 * This happens in l_ecc_point_from_data when the L_ECC_POINT_TYPE_FULL
-	 * format is used.
+	 * format is used.  X25519 public values need no validation, small
+	 * order points are caught when computing the shared secret.
 	 */
-	params = l_new(struct tls_ecdhe_params, 1);
-	params->curve = l_ecc_curve_from_tls_group(tls->negotiated_curve->id);
 	params->public = l_ecc_point_from_data(params->curve,
 						L_ECC_POINT_TYPE_FULL,
 						buf, point_bytes);
-	tls->pending.key_xchg_params = params;
 	buf += point_bytes;
 	len -= point_bytes;
 
-	if (!params->public || point_bytes !=
-			2 * l_ecc_curve_get_scalar_bytes(params->curve)) {
+	if (!params->public || point_bytes != expected_bytes) {
 		TLS_DISCONNECT(TLS_ALERT_DECODE_ERROR, 0,
 				"ServerKeyExchange.params.public decode error");
 		return;
@@ -741,21 +767,30 @@ static void tls_handle_ecdhe_client_key_xchg(struct l_tls *tls,
 
 	/* RFC 8422, Section 5.7 */
 
-	if (len < 2)
-		goto decode_error;
+	if (tls_ecpoint_is_raw(params->curve)) {
+		point_bytes = l_ecc_curve_get_scalar_bytes(params->curve);
 
-	if (*buf++ != 1 + point_bytes)
-		goto decode_error;
+		if (len < 1 || *buf++ != point_bytes)
+			goto decode_error;
 
-	if (*buf != 4) {	/* uncompressed */
-		TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
-				"Unsupported (deprecated?) PointConversionForm "
-				"%u", *buf);
-		return;
-	}
+		len -= 1;
+	} else {
+		if (len < 2)
+			goto decode_error;
 
-	buf++;
-	len -= 2;
+		if (*buf++ != 1 + point_bytes)
+			goto decode_error;
+
+		if (*buf != 4) {	/* uncompressed */
+			TLS_DISCONNECT(TLS_ALERT_ILLEGAL_PARAM, 0,
+					"Unsupported (deprecated?) "
+					"PointConversionForm %u", *buf);
+			return;
+		}
+
+		buf++;
+		len -= 2;
+	}
 
 	if (len != point_bytes)
 		goto decode_error;
@@ -1539,6 +1539,11 @@ static uint8_t tls_cert_type_pref[] = {
 	1, /* RSA_sign */
 };
 
+static bool tls_have_ca_certs(struct l_tls *tls)
+{
+	return tls->ca_certs || tls->ca_store;
+}
+
 static bool tls_send_certificate_request(struct l_tls *tls)
 {
 	uint8_t *buf, *ptr, *dn_ptr;
@@ -1547,6 +1552,10 @@ static bool tls_send_certificate_request(struct l_tls *tls)
 	unsigned int i;
 	size_t dn_total = 0;
 
+	/*
+	 * With a CA store the certificate_authorities list is left empty,
+	 * meaning any CA, rather than listing a whole system bundle.
+	 */
 	for (entry = l_queue_get_entries(tls->ca_certs); entry;
 			entry = entry->next) {
 		struct l_cert *ca_cert = entry->data;
@@ -2313,13 +2322,13 @@ static void tls_handle_client_hello(struct l_tls *tls,
 			return;
 
 	/* TODO: don't bother if configured to not authenticate client */
-	if (tls->pending.cipher_suite->signature && tls->ca_certs)
+	if (tls->pending.cipher_suite->signature && tls_have_ca_certs(tls))
 		if (!tls_send_certificate_request(tls))
 			return;
 
 	tls_send_server_hello_done(tls);
 
-	if (tls->pending.cipher_suite->signature && tls->ca_certs)
+	if (tls->pending.cipher_suite->signature && tls_have_ca_certs(tls))
 		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_CERTIFICATE);
 	else
 		TLS_SET_STATE(TLS_HANDSHAKE_WAIT_KEY_EXCHANGE);
@@ -2510,6 +2519,7 @@ static void tls_handle_certificate(struct l_tls *tls,
 	const uint8_t *der;
 	bool dummy;
 	const char *error_str;
+	bool verified;
 	char *subject_str;
 
 	if (len < 3)
@@ -2567,13 +2577,19 @@ static void tls_handle_certificate(struct l_tls *tls,
 	 * Validate the certificate chain's consistency and validate it
 	 * against our CAs if we have any.
 	 */
-	if (!l_certchain_verify(certchain, tls->ca_certs, &error_str)) {
-		if (tls->ca_certs) {
+	if (tls->ca_store)
+		verified = l_certchain_verify_store(certchain, tls->ca_store,
+							&error_str);
+	else
+		verified = l_certchain_verify(certchain, tls->ca_certs,
+						&error_str);
+
+	if (!verified) {
+		if (tls_have_ca_certs(tls)) {
 			TLS_DISCONNECT(TLS_ALERT_BAD_CERT, 0,
 					"Peer certchain verification failed "
-					"consistency check%s: %s",
-					tls->ca_certs ?
-					" or against local CA certs" : "",
+					"consistency check or against local "
+					"CA certs: %s",
 					error_str);
 
 			return;
@@ -2823,8 +2839,8 @@ static void tls_handle_certificate_verify(struct l_tls *tls,
 	 *   - If we received an (expected) Certificate Verify, we must have
 	 *     sent a Certificate Request.
 	 *   - If we sent a Certificate Request that's because
-	 *     tls->ca_certs is non-NULL.
-	 *   - If tls->ca_certs is non-NULL then tls_handle_certificate
+	 *     we have CA certificates.
+	 *   - If we have CA certificates then tls_handle_certificate
 	 *     will have checked the whole certificate chain to be valid and
 	 *     additionally trusted by our CAs if known.
 	 *   - Additionally cipher_suite->signature->verify has just confirmed
@@ -3289,7 +3305,7 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 		 * certificate is now verified regardless of the key exchange
 		 * method, based on the following logic:
 		 *
-		 *  - tls->ca_certs is non-NULL so tls_handle_certificate
+		 *  - we have CA certificates so tls_handle_certificate
 		 *    (always called on the client) must have veritifed the
 		 *    server's certificate chain to be valid and additionally
 		 *    trusted by our CA.
@@ -3318,7 +3334,8 @@ static void tls_handle_handshake(struct l_tls *tls, int type,
 		 * message confirms their identity hasn't changed.
 		 */
 		if (tls->cipher_suite[0]->signature &&
-				((!tls->server && !resuming && tls->ca_certs) ||
+				((!tls->server && !resuming &&
+				  tls_have_ca_certs(tls)) ||
 				 (resuming && tls->session_peer_identity)))
 			tls->peer_authenticated = true;
 
@@ -3641,6 +3658,8 @@ LIB_EXPORT void l_tls_reset(struct l_tls *tls)
 
 LIB_EXPORT bool l_tls_set_cacert(struct l_tls *tls, struct l_queue *ca_certs)
 {
+	tls->ca_store = NULL;
+
 	if (tls->ca_certs) {
 		l_queue_destroy(tls->ca_certs,
 				(l_queue_destroy_func_t) l_cert_free);
@@ -3660,6 +3679,14 @@ LIB_EXPORT bool l_tls_set_cacert(struct l_tls *tls, struct l_queue *ca_certs)
 	return true;
 }
 
+LIB_EXPORT bool l_tls_set_cacert_store(struct l_tls *tls,
+					struct l_cert_store *store)
+{
+	l_tls_set_cacert(tls, NULL);
+	tls->ca_store = store;
+	return true;
+}
+
 LIB_EXPORT bool l_tls_set_auth_data(struct l_tls *tls,
 					struct l_certchain *certchain,
 					struct l_key *priv_key)
@@ -24,6 +24,7 @@ struct l_key;
 struct l_certchain;
 struct l_queue;
 struct l_settings;
+struct l_cert_store;
 
 enum l_tls_alert_desc {
 	TLS_ALERT_CLOSE_NOTIFY		= 0,
@@ -97,6 +98,14 @@ void l_tls_handle_rx(struct l_tls *tls, const uint8_t *data, size_t len);
  */
 bool l_tls_set_cacert(struct l_tls *tls, struct l_queue *ca_certs);
 
+/*
+ * Alternatively take the CA certificates from a store, which is not
+ * copied and has to outlive the l_tls object.  This replaces any CA
+ * certificates set with l_tls_set_cacert and vice versa.  Signatures
+ * are checked in-process so keyctl support is not needed.
+ */
+bool l_tls_set_cacert_store(struct l_tls *tls, struct l_cert_store *store);
+
 /*
  * If we are to be authenticated, supply our certificate and private key.
  * On the client this is optional.  On success, the l_tls object takes
@@ -12,16 +12,24 @@
 #define _GNU_SOURCE
 #include <limits.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "uintset.h"
 #include "useful.h"
+#include "log.h"
 #include "private.h"
 
 #define BITS_PER_LONG (sizeof(unsigned long) * 8)
+#define LONGS_PER_VEC (16 / sizeof(unsigned long))
 
-static inline int __ffz(unsigned long word)
-{
-	return __builtin_ctzl(~word);
-}
+/*
+ * Summary levels needed for 2^24 entries to end in a single top word: three
+ * with 64-bit longs, four with 32-bit longs
+ */
+#define UINTSET_MAX_SIZE	(1U << 24)
+#define UINTSET_MAX_LEVELS	(__SIZEOF_LONG__ == 8 ? 3 : 4)
 
 static inline int __fls(unsigned long word)
 {
@@ -33,130 +41,234 @@ static inline int __ffs(unsigned long word)
 	return __builtin_ctzl(word);
 }
 
-static unsigned long find_first_zero_bit(const unsigned long *addr,
-							unsigned long size,
-							unsigned long start)
+/*
+ * Level 0 of both maps is the bitmap itself.  Bit n of every level above
+ * is set if word n of the level below has any bit set (used) or all bits
+ * set (full).  Each level has BITS_PER_LONG times fewer words and the top
+ * one has a single word, so searches take one word per level.  Bits past
+ * the last word of the level below are set in the full map so that they
+ * are never searched.
+ */
+struct l_uintset {
+	unsigned long *bits;
+	uint32_t size;
+	uint32_t min;
+	uint32_t max;
+	uint32_t count;
+	unsigned int levels;
+	size_t n_words;
+	uint32_t words[UINTSET_MAX_LEVELS + 1];
+	unsigned long *used[UINTSET_MAX_LEVELS + 1];
+	unsigned long *full[UINTSET_MAX_LEVELS + 1];
+};
+
+/*
+ * Finds the first bit at or after @bit that is set in @map, or clear if
+ * @flip is ~0UL.  Walks up the levels until a word has a candidate and
+ * then back down, picking the first candidate of each word.
+ */
+static uint32_t find_next(const struct l_uintset *set,
+				unsigned long * const *map, unsigned long flip,
+				uint32_t bit)
 {
-	unsigned long i;
-	unsigned long mask = ~0UL << (start & (BITS_PER_LONG - 1));
-	unsigned long p;
+	unsigned int level = 0;
+	unsigned long word;
+	uint32_t idx;
 
-	for (i = start / BITS_PER_LONG; i * BITS_PER_LONG < size; i++) {
-		p = addr[i];
+	while (true) {
+		idx = bit / BITS_PER_LONG;
 
-		if (mask) {
-			p |= ~mask;
-			mask = 0;
-		}
+		if (idx >= set->words[level])
+			return set->size;
+
+		word = (map[level][idx] ^ flip) &
+					(~0UL << (bit % BITS_PER_LONG));
+		if (word)
+			break;
 
-		if (p == ~0UL)
-			continue;
+		if (level == set->levels)
+			return set->size;
 
-		return i * BITS_PER_LONG + __ffz(p);
+		bit = idx + 1;
+		level += 1;
 	}
 
-	return size;
-}
+	bit = idx * BITS_PER_LONG + __ffs(word);
 
-static unsigned long find_first_bit(const unsigned long *addr,
-							unsigned long size)
-{
-	unsigned long result = 0;
-	unsigned long tmp;
+	while (level--)
+		bit = bit * BITS_PER_LONG + __ffs(map[level][bit] ^ flip);
 
-	while (size >= BITS_PER_LONG) {
-		tmp = *addr;
-		addr += 1;
+	/* The unused bits of the last word look clear */
+	return minsize(bit, set->size);
+}
 
-		if (tmp)
-			goto found;
+static uint32_t find_last(const struct l_uintset *set)
+{
+	unsigned int level = set->levels;
+	uint32_t bit;
 
-		result += BITS_PER_LONG;
-		size -= BITS_PER_LONG;
-	}
+	if (!set->count)
+		return set->size;
 
-	if (!size)
-		return result;
+	bit = __fls(set->used[level][0]) - 1;
 
-	tmp = *addr;
-	if (!tmp)
-		return result + size;
+	while (level--)
+		bit = bit * BITS_PER_LONG + __fls(set->used[level][bit]) - 1;
 
-found:
-	return result + __ffs(tmp);
+	return bit;
 }
 
-static unsigned long find_last_bit(const unsigned long *addr, unsigned int size)
+static void uintset_set(struct l_uintset *set, uint32_t bit)
 {
-	unsigned long words;
-	unsigned long tmp;
-	long i;
+	unsigned long *word = &set->bits[bit / BITS_PER_LONG];
+	unsigned long mask = 1UL << (bit % BITS_PER_LONG);
+	unsigned int level;
+	uint32_t idx;
+	bool was_empty;
+	bool is_full;
+
+	if (*word & mask)
+		return;
 
-	/* Bits out of bounds are always zero, start at last word */
-	words = (size + BITS_PER_LONG - 1) / BITS_PER_LONG;
+	was_empty = !*word;
+	*word |= mask;
+	is_full = *word == ~0UL;
+	set->count += 1;
+
+	for (level = 1, idx = bit / BITS_PER_LONG;
+			level <= set->levels && was_empty;
+			level++, idx /= BITS_PER_LONG) {
+		word = &set->used[level][idx / BITS_PER_LONG];
+		was_empty = !*word;
+		*word |= 1UL << (idx % BITS_PER_LONG);
+	}
 
-	for (i = words - 1; i >= 0; i -= 1) {
-		tmp = addr[i];
+	for (level = 1, idx = bit / BITS_PER_LONG;
+			level <= set->levels && is_full;
+			level++, idx /= BITS_PER_LONG) {
+		word = &set->full[level][idx / BITS_PER_LONG];
+		*word |= 1UL << (idx % BITS_PER_LONG);
+		is_full = *word == ~0UL;
+	}
+}
 
-		if (!tmp)
-			continue;
+static void uintset_clear(struct l_uintset *set, uint32_t bit)
+{
+	unsigned long *word = &set->bits[bit / BITS_PER_LONG];
+	unsigned long mask = 1UL << (bit % BITS_PER_LONG);
+	unsigned int level;
+	uint32_t idx;
+	bool was_full;
+	bool is_empty;
+
+	if (!(*word & mask))
+		return;
 
-		return i * BITS_PER_LONG + __fls(tmp) - 1;
+	was_full = *word == ~0UL;
+	*word &= ~mask;
+	is_empty = !*word;
+	set->count -= 1;
+
+	for (level = 1, idx = bit / BITS_PER_LONG;
+			level <= set->levels && was_full;
+			level++, idx /= BITS_PER_LONG) {
+		word = &set->full[level][idx / BITS_PER_LONG];
+		was_full = *word == ~0UL;
+		*word &= ~(1UL << (idx % BITS_PER_LONG));
 	}
 
-	/* Not found */
-	return size;
+	for (level = 1, idx = bit / BITS_PER_LONG;
+			level <= set->levels && is_empty;
+			level++, idx /= BITS_PER_LONG) {
+		word = &set->used[level][idx / BITS_PER_LONG];
+		*word &= ~(1UL << (idx % BITS_PER_LONG));
+		is_empty = !*word;
+	}
 }
 
-static unsigned long find_next_bit(const unsigned long *addr,
-							unsigned long size,
-							unsigned long bit)
+static uint32_t bits_popcount(const unsigned long *bits, uint32_t n)
 {
-	unsigned long mask;
-	unsigned long offset;
+	uint32_t count = 0;
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128i m1 = _mm_set1_epi8(0x55);
+	const __m128i m2 = _mm_set1_epi8(0x33);
+	const __m128i m4 = _mm_set1_epi8(0x0f);
+	__m128i sum = _mm_setzero_si128();
+	uint64_t sums[2];
+
+	/* Per byte counts, summed up with psadbw */
+	for (; i + LONGS_PER_VEC <= n; i += LONGS_PER_VEC) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (bits + i));
+
+		v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+		v = _mm_add_epi8(_mm_and_si128(v, m2),
+				_mm_and_si128(_mm_srli_epi64(v, 2), m2));
+		v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+	}
 
-	if (bit >= size)
-		return size;
+	_mm_storeu_si128((__m128i *) sums, sum);
+	count = sums[0] + sums[1];
+#endif
 
-	addr += bit / BITS_PER_LONG;
-	offset = bit % BITS_PER_LONG;
-	bit -= offset;
+	for (; i < n; i++)
+		count += __builtin_popcountl(bits[i]);
 
-	if (offset) {
-		mask = *addr & ~(~0UL >> (BITS_PER_LONG - offset));
-		if (mask)
-			return bit + __ffs(mask);
+	return count;
+}
 
-		bit += BITS_PER_LONG;
-		addr++;
-	}
+/* r = a & (b ^ flip) */
+static void bits_and(unsigned long *r, const unsigned long *a,
+			const unsigned long *b, unsigned long flip, uint32_t n)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128i vflip = _mm_set1_epi32(flip ? -1 : 0);
 
-	for (size -= bit; size >= BITS_PER_LONG;
-			size -= BITS_PER_LONG, bit += BITS_PER_LONG, addr++) {
-		if (!*addr)
-			continue;
+	for (; i + LONGS_PER_VEC <= n; i += LONGS_PER_VEC) {
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
 
-		return bit + __ffs(*addr);
+		vb = _mm_xor_si128(vb, vflip);
+		_mm_storeu_si128((__m128i *) (r + i), _mm_and_si128(va, vb));
 	}
+#endif
 
-	if (!size)
-		return bit;
+	for (; i < n; i++)
+		r[i] = a[i] & (b[i] ^ flip);
+}
 
-	mask = *addr & (~0UL >> (BITS_PER_LONG - size));
-	if (mask)
-		bit += __ffs(mask);
-	else
-		bit += size;
+/* Recomputes the count and the summary levels from the bitmap */
+static void uintset_update(struct l_uintset *set)
+{
+	unsigned int level;
+	uint32_t i;
 
-	return bit;
-}
+	set->count = bits_popcount(set->bits, set->words[0]);
 
-struct l_uintset {
-	unsigned long *bits;
-	uint16_t size;
-	uint32_t min;
-	uint32_t max;
-};
+	for (level = 1; level <= set->levels; level++) {
+		unsigned long *used = set->used[level];
+		unsigned long *full = set->full[level];
+		uint32_t n = set->words[level - 1];
+
+		memset(used, 0, set->words[level] * sizeof(unsigned long));
+		memset(full, 0, set->words[level] * sizeof(unsigned long));
+
+		for (i = 0; i < n; i++) {
+			unsigned long bit = 1UL << (i % BITS_PER_LONG);
+
+			if (set->used[level - 1][i])
+				used[i / BITS_PER_LONG] |= bit;
+
+			if (set->full[level - 1][i] == ~0UL)
+				full[i / BITS_PER_LONG] |= bit;
+		}
+
+		if (n % BITS_PER_LONG)
+			full[n / BITS_PER_LONG] |= ~0UL << (n % BITS_PER_LONG);
+	}
+}
 
 /**
  * l_uintset_new_from_range:
@@ -164,8 +276,8 @@ struct l_uintset {
  * @max: The maximum value of the set of numbers contained
  *
  * Creates a new empty collection of unsigned integers.  The size of the set
- * is limited to roughly 2^16 entries.  @min and @max give the minimum and
- * maximum elements of the set.
+ * is limited to 2^24 entries.  @min and @max give the minimum and maximum
+ * elements of the set.
  *
  * Returns: A newly allocated l_uintset object, and NULL otherwise.
  **/
@@ -174,17 +286,49 @@ LIB_EXPORT struct l_uintset *l_uintset_new_from_range(uint32_t min,
 {
 	struct l_uintset *ret;
 	unsigned int size = max - min + 1;
+	unsigned long *words;
+	unsigned int level;
+	uint32_t n;
 
-	if (size > USHRT_MAX)
+	if (size > UINTSET_MAX_SIZE)
 		return NULL;
 
 	ret = l_new(struct l_uintset, 1);
-	ret->bits = l_new(unsigned long,
-				(size + BITS_PER_LONG - 1) / BITS_PER_LONG);
 	ret->size = size;
 	ret->min = min;
 	ret->max = max;
 
+	n = (size + BITS_PER_LONG - 1) / BITS_PER_LONG;
+	ret->words[0] = n;
+	ret->n_words = n;
+
+	while (n > 1) {
+		if (L_WARN_ON(ret->levels == UINTSET_MAX_LEVELS)) {
+			l_free(ret);
+			return NULL;
+		}
+
+		n = (n + BITS_PER_LONG - 1) / BITS_PER_LONG;
+		ret->levels += 1;
+		ret->words[ret->levels] = n;
+		ret->n_words += n * 2;
+	}
+
+	/* The bitmap and all summary levels share one allocation */
+	words = l_new(unsigned long, ret->n_words);
+	ret->bits = words;
+	ret->used[0] = words;
+	ret->full[0] = words;
+	words += ret->words[0];
+
+	for (level = 1; level <= ret->levels; level++) {
+		ret->used[level] = words;
+		ret->full[level] = words + ret->words[level];
+		words += ret->words[level] * 2;
+	}
+
+	uintset_update(ret);
+
 	return ret;
 }
 
@@ -193,8 +337,8 @@ LIB_EXPORT struct l_uintset *l_uintset_new_from_range(uint32_t min,
  * @size: The maximum size of the set
  *
  * Creates a new empty collection of unsigned integers.  The size of the set
- * is limited to roughly 2^16 entries.  The set is created with minimum value
- * of 1 and maximum value equal to size.
+ * is limited to 2^24 entries.  The set is created with minimum value of 1
+ * and maximum value equal to size.
  *
  * Returns: A newly allocated l_uintset object, and NULL otherwise.
  **/
@@ -231,21 +375,16 @@ LIB_EXPORT void l_uintset_free(struct l_uintset *set)
  **/
 LIB_EXPORT bool l_uintset_take(struct l_uintset *set, uint32_t number)
 {
-	uint32_t offset;
+	uint32_t bit;
 
 	if (unlikely(!set))
 		return false;
 
-	offset = (number - set->min) / BITS_PER_LONG;
-
-	number -= set->min;
-
-	if (number > set->size)
+	bit = number - set->min;
+	if (bit >= set->size)
 		return false;
 
-	number %= BITS_PER_LONG;
-
-	set->bits[offset] &= ~(1UL << number);
+	uintset_clear(set, bit);
 
 	return true;
 }
@@ -265,7 +404,6 @@ LIB_EXPORT bool l_uintset_take(struct l_uintset *set, uint32_t number)
 LIB_EXPORT bool l_uintset_put(struct l_uintset *set, uint32_t number)
 {
 	uint32_t bit;
-	uint32_t offset;
 
 	if (unlikely(!set))
 		return false;
@@ -274,8 +412,7 @@ LIB_EXPORT bool l_uintset_put(struct l_uintset *set, uint32_t number)
 	if (bit >= set->size)
 		return false;
 
-	offset = bit / BITS_PER_LONG;
-	set->bits[offset] |= 1UL << (bit % BITS_PER_LONG);
+	uintset_set(set, bit);
 
 	return true;
 }
@@ -351,7 +488,7 @@ LIB_EXPORT uint32_t l_uintset_find_unused_min(struct l_uintset *set)
 	if (unlikely(!set))
 		return UINT_MAX;
 
-	bit = find_first_zero_bit(set->bits, set->size, 0);
+	bit = find_next(set, set->full, ~0UL, 0);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -380,9 +517,9 @@ LIB_EXPORT uint32_t l_uintset_find_unused(struct l_uintset *set, uint32_t start)
 	if (start < set->min || start > set->max)
 		return set->max + 1;
 
-	bit = find_first_zero_bit(set->bits, set->size, start - set->min);
+	bit = find_next(set, set->full, ~0UL, start - set->min);
 	if (bit >= set->size)
-		bit = find_first_zero_bit(set->bits, set->size, 0);
+		bit = find_next(set, set->full, ~0UL, 0);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -404,7 +541,7 @@ LIB_EXPORT uint32_t l_uintset_find_max(struct l_uintset *set)
 	if (unlikely(!set))
 		return UINT_MAX;
 
-	bit = find_last_bit(set->bits, set->size);
+	bit = find_last(set);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -426,7 +563,7 @@ LIB_EXPORT uint32_t l_uintset_find_min(struct l_uintset *set)
 	if (unlikely(!set))
 		return UINT_MAX;
 
-	bit = find_first_bit(set->bits, set->size);
+	bit = find_next(set, set->used, 0, 0);
 
 	if (bit >= set->size)
 		return set->max + 1;
@@ -446,14 +583,23 @@ LIB_EXPORT void l_uintset_foreach(const struct l_uintset *set,
 					l_uintset_foreach_func_t function,
 					void *user_data)
 {
-	unsigned int bit;
+	uint32_t bit;
 
 	if (unlikely(!set || !function))
 		return;
 
-	for (bit = find_first_bit(set->bits, set->size); bit < set->size;
-			bit = find_next_bit(set->bits, set->size, bit + 1))
-		function(set->min + bit, user_data);
+	/* Only the words with bits set are visited */
+	for (bit = find_next(set, set->used, 0, 0); bit < set->size;
+			bit = find_next(set, set->used, 0, bit)) {
+		unsigned long word = set->bits[bit / BITS_PER_LONG];
+
+		bit -= bit % BITS_PER_LONG;
+
+		for (; word; word &= word - 1)
+			function(set->min + bit + __ffs(word), user_data);
+
+		bit += BITS_PER_LONG;
+	}
 }
 
 /**
@@ -466,16 +612,14 @@ LIB_EXPORT void l_uintset_foreach(const struct l_uintset *set,
 LIB_EXPORT struct l_uintset *l_uintset_clone(const struct l_uintset *original)
 {
 	struct l_uintset *clone;
-	size_t bitmap_size;
 
 	if (unlikely(!original))
 		return NULL;
 
-	bitmap_size = sizeof(unsigned long) *
-		((original->size + BITS_PER_LONG - 1) / BITS_PER_LONG);
-
 	clone = l_uintset_new_from_range(original->min, original->max);
-	memcpy(clone->bits, original->bits, bitmap_size);
+	memcpy(clone->bits, original->bits,
+				original->n_words * sizeof(unsigned long));
+	clone->count = original->count;
 
 	return clone;
 }
@@ -497,8 +641,6 @@ LIB_EXPORT struct l_uintset *l_uintset_intersect(const struct l_uintset *set_a,
 						const struct l_uintset *set_b)
 {
 	struct l_uintset *intersection;
-	uint32_t offset;
-	uint32_t offset_max;
 
 	if (unlikely(!set_a || !set_b))
 		return NULL;
@@ -507,12 +649,9 @@ LIB_EXPORT struct l_uintset *l_uintset_intersect(const struct l_uintset *set_a,
 		return NULL;
 
 	intersection = l_uintset_new_from_range(set_a->min, set_a->max);
-
-	offset_max = (set_a->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
-	for (offset = 0; offset < offset_max; offset++)
-		intersection->bits[offset] =
-				set_a->bits[offset] & set_b->bits[offset];
+	bits_and(intersection->bits, set_a->bits, set_b->bits, 0,
+							set_a->words[0]);
+	uintset_update(intersection);
 
 	return intersection;
 }
@@ -532,8 +671,6 @@ LIB_EXPORT struct l_uintset *l_uintset_subtract(const struct l_uintset *set_a,
 						const struct l_uintset *set_b)
 {
 	struct l_uintset *subtraction;
-	uint32_t offset;
-	uint32_t offset_max;
 
 	if (unlikely(!set_a || !set_b))
 		return NULL;
@@ -543,13 +680,10 @@ LIB_EXPORT struct l_uintset *l_uintset_subtract(const struct l_uintset *set_a,
 
 	subtraction = l_uintset_new_from_range(set_a->min, set_a->max);
 
-	offset_max = (set_a->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
 	/* Subtract by: set_a & ~set_b */
-	for (offset = 0; offset < offset_max; offset++) {
-		subtraction->bits[offset] =
-				set_a->bits[offset] & ~(set_b->bits[offset]);
-	}
+	bits_and(subtraction->bits, set_a->bits, set_b->bits, ~0UL,
+							set_a->words[0]);
+	uintset_update(subtraction);
 
 	return subtraction;
 }
@@ -562,20 +696,10 @@ LIB_EXPORT struct l_uintset *l_uintset_subtract(const struct l_uintset *set_a,
  */
 LIB_EXPORT bool l_uintset_isempty(const struct l_uintset *set)
 {
-	uint16_t i;
-	uint32_t offset_max;
-
 	if (unlikely(!set))
 		return true;
 
-	offset_max = (set->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
-	for (i = 0; i < offset_max; i++) {
-		if (set->bits[i])
-			return false;
-	}
-
-	return true;
+	return !set->count;
 }
 
 /**
@@ -587,17 +711,8 @@ LIB_EXPORT bool l_uintset_isempty(const struct l_uintset *set)
  */
 LIB_EXPORT uint32_t l_uintset_size(const struct l_uintset *set)
 {
-	uint16_t i;
-	uint32_t offset_max;
-	uint32_t count = 0;
-
 	if (unlikely(!set))
 		return 0;
 
-	offset_max = (set->size + BITS_PER_LONG - 1) / BITS_PER_LONG;
-
-	for (i = 0; i < offset_max; i++)
-		count += __builtin_popcountl(set->bits[i]);
-
-	return count;
+	return set->count;
 }
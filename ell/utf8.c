@@ -11,8 +11,13 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <wchar.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "strv.h"
 #include "utf8.h"
 #include "private.h"
@@ -125,15 +130,45 @@ static inline bool __attribute__ ((always_inline))
 	return true;
 }
 
-/**
- * l_utf8_get_codepoint
- * @str: a pointer to codepoint data
- * @len: maximum bytes to read
- * @cp: destination for codepoint
- *
- * Returns: number of bytes read, or -1 for invalid coddepoint
- **/
-LIB_EXPORT int l_utf8_get_codepoint(const char *str, size_t len, wchar_t *cp)
+#define ONES64		0x0101010101010101ULL
+#define HIGHS64		0x8080808080808080ULL
+
+/*
+ * Returns the number of leading bytes of @str that are ASCII and not NUL,
+ * looking at up to @len bytes.
+ */
+static size_t ascii_span(const char *str, size_t len)
+{
+	size_t i = 0;
+	uint64_t w;
+
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+		__m128i z = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+
+		if (_mm_movemask_epi8(_mm_or_si128(v, z)))
+			break;
+	}
+#endif
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&w, str + i, 8);
+
+		/* High bit set in any byte, or any byte zero */
+		if ((w | ((w - ONES64) & ~w)) & HIGHS64)
+			break;
+	}
+
+	for (; i < len; i++)
+		if ((signed char) str[i] <= 0)
+			break;
+
+	return i;
+}
+
+static inline int __attribute__ ((always_inline))
+			get_codepoint(const char *str, size_t len, wchar_t *cp)
 {
 	static const wchar_t mins[3] = { 1 << 7, 1 << 11, 1 << 16 };
 	unsigned int expect_bytes;
@@ -179,6 +214,19 @@ error:
 	return -1;
 }
 
+/**
+ * l_utf8_get_codepoint
+ * @str: a pointer to codepoint data
+ * @len: maximum bytes to read
+ * @cp: destination for codepoint
+ *
+ * Returns: number of bytes read, or -1 for invalid coddepoint
+ **/
+LIB_EXPORT int l_utf8_get_codepoint(const char *str, size_t len, wchar_t *cp)
+{
+	return get_codepoint(str, len, cp);
+}
+
 /**
  * l_utf8_validate:
  * @str: a pointer to character data
@@ -199,7 +247,12 @@ LIB_EXPORT bool l_utf8_validate(const char *str, size_t len, const char **end)
 	wchar_t val;
 
 	while (pos < len && str[pos]) {
-		ret = l_utf8_get_codepoint(str + pos, len - pos, &val);
+		if ((signed char) str[pos] > 0) {
+			pos += ascii_span(str + pos, len - pos);
+			continue;
+		}
+
+		ret = get_codepoint(str + pos, len - pos, &val);
 
 		if (ret < 0)
 			goto error;
@@ -228,18 +281,32 @@ error:
  **/
 LIB_EXPORT size_t l_utf8_strlen(const char *str)
 {
+	size_t len = strlen(str);
 	size_t l = 0;
-	size_t i;
-	unsigned char b;
+	size_t i = 0;
+	uint64_t w;
 
-	for (i = 0; str[i]; i++) {
-		b = str[i];
+	/* Count the continuation bytes, 10xxxxxx */
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (str + i));
 
-		if ((b >> 6) == 2)
-			l += 1;
+		/* As signed, 0x80 - 0xbf are the values below -64 */
+		v = _mm_cmplt_epi8(v, _mm_set1_epi8(-64));
+		l += __builtin_popcount(_mm_movemask_epi8(v));
+	}
+#endif
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&w, str + i, 8);
+		l += __builtin_popcountll(w & ~(w << 1) & HIGHS64);
 	}
 
-	return i - l;
+	for (; i < len; i++)
+		if (((unsigned char) str[i] >> 6) == 2)
+			l += 1;
+
+	return len - l;
 }
 
 static inline int __attribute__ ((always_inline))
@@ -257,7 +324,7 @@ static inline int __attribute__ ((always_inline))
 	return 4;
 }
 
-static inline uint16_t __attribute__ ((always_inline))
+static inline wchar_t __attribute__ ((always_inline))
 			surrogate_value(uint16_t h, uint16_t l)
 {
 	return 0x10000 + (h - 0xd800) * 0x400 + l - 0xdc00;
@@ -389,7 +456,8 @@ next:
 LIB_EXPORT void *l_utf8_to_utf16(const char *utf8, size_t *out_size)
 {
 	const char *c;
-	wchar_t wc;
+	const char *end;
+	wchar_t wc = 0;
 	int len;
 	uint16_t *utf16;
 	size_t n_utf16;
@@ -398,10 +466,18 @@ LIB_EXPORT void *l_utf8_to_utf16(const char *utf8, size_t *out_size)
 		return NULL;
 
 	c = utf8;
+	end = utf8 + strlen(utf8);
 	n_utf16 = 0;
 
-	while (*c) {
-		len = l_utf8_get_codepoint(c, 4, &wc);
+	while (c < end) {
+		if ((signed char) *c > 0) {
+			len = ascii_span(c, end - c);
+			n_utf16 += len;
+			c += len;
+			continue;
+		}
+
+		len = get_codepoint(c, end - c, &wc);
 		if (len < 0)
 			return NULL;
 
@@ -417,12 +493,17 @@ LIB_EXPORT void *l_utf8_to_utf16(const char *utf8, size_t *out_size)
 	c = utf8;
 	n_utf16 = 0;
 
-	while (*c) {
-		len = l_utf8_get_codepoint(c, 4, &wc);
+	while (c < end) {
+		if ((signed char) *c > 0) {
+			utf16[n_utf16++] = *c++;
+			continue;
+		}
+
+		len = get_codepoint(c, end - c, &wc);
 
 		if (wc >= 0x10000) {
-			utf16[n_utf16++] = (wc - 0x1000) / 0x400 + 0xd800;
-			utf16[n_utf16++] = (wc - 0x1000) % 0x400 + 0xdc00;
+			utf16[n_utf16++] = (wc - 0x10000) / 0x400 + 0xd800;
+			utf16[n_utf16++] = (wc - 0x10000) % 0x400 + 0xdc00;
 		} else
 			utf16[n_utf16++] = wc;
 
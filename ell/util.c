@@ -17,6 +17,10 @@
 #include <errno.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "utf8.h"
 #include "util.h"
 #include "useful.h"
@@ -343,22 +347,51 @@ LIB_EXPORT bool l_streq0(const char *a, const char *b)
 	return a == b || (a && b && !strcmp(a, b));
 }
 
+static void hex_encode(char *str, const uint8_t *buf, size_t len,
+				const char hexdigits[static 16])
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i digit0 = _mm_set1_epi8('0');
+	/* From '0' + 10 to the first letter, in the case of @hexdigits */
+	const __m128i alpha = _mm_set1_epi8(hexdigits[10] - '0' - 10);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (buf + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+		__m128i a = _mm_unpacklo_epi8(hi, lo);
+		__m128i b = _mm_unpackhi_epi8(hi, lo);
+
+		a = _mm_add_epi8(_mm_add_epi8(a, digit0),
+				_mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+		b = _mm_add_epi8(_mm_add_epi8(b, digit0),
+				_mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+
+		_mm_storeu_si128((__m128i *) (str + i * 2), a);
+		_mm_storeu_si128((__m128i *) (str + i * 2 + 16), b);
+	}
+#endif
+
+	for (; i < len; i++) {
+		str[(i * 2) + 0] = hexdigits[buf[i] >> 4];
+		str[(i * 2) + 1] = hexdigits[buf[i] & 0xf];
+	}
+}
+
 static char *hexstring_common(const unsigned char *buf, size_t len,
 				const char hexdigits[static 16])
 {
 	char *str;
-	size_t i;
 
 	if (unlikely(!buf) || unlikely(!len))
 		return NULL;
 
 	str = l_malloc(len * 2 + 1);
-
-	for (i = 0; i < len; i++) {
-		str[(i * 2) + 0] = hexdigits[buf[i] >> 4];
-		str[(i * 2) + 1] = hexdigits[buf[i] & 0xf];
-	}
-
+	hex_encode(str, buf, len, hexdigits);
 	str[len * 2] = '\0';
 
 	return str;
@@ -368,7 +401,7 @@ static char *hexstringv_common(const struct iovec *iov, size_t n_iov,
 				const char hexdigits[static 16])
 {
 	char *str;
-	size_t i, j, c;
+	size_t i, c;
 	size_t len;
 
 	if (unlikely(!iov || !n_iov))
@@ -381,12 +414,8 @@ static char *hexstringv_common(const struct iovec *iov, size_t n_iov,
 	c = 0;
 
 	for (i = 0; i < n_iov; i++) {
-		const uint8_t *buf = iov[i].iov_base;
-
-		for (j = 0; j < iov[i].iov_len; j++) {
-			str[c++] = hexdigits[buf[j] >> 4];
-			str[c++] = hexdigits[buf[j] & 0xf];
-		}
+		hex_encode(str + c, iov[i].iov_base, iov[i].iov_len, hexdigits);
+		c += iov[i].iov_len * 2;
 	}
 
 	str[len * 2] = '\0';
@@ -454,6 +483,76 @@ LIB_EXPORT char *l_util_hexstringv_upper(const struct iovec *iov, size_t n_iov)
 	return hexstringv_common(iov, n_iov, hexdigits);
 }
 
+/* Digit value + 1, 0 for anything that isn't a hex digit */
+static const uint8_t hex_table[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+#ifdef __SSE2__
+/* Converts 16 hex digits to nibbles, false if any isn't a hex digit */
+static bool hex_nibbles(__m128i *v)
+{
+	__m128i lower = _mm_or_si128(*v, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(*v, _mm_set1_epi8('/')),
+				_mm_cmplt_epi8(*v, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(
+				_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+				_mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+		return false;
+
+	*v = _mm_or_si128(
+		_mm_and_si128(digit, _mm_sub_epi8(*v, _mm_set1_epi8('0'))),
+		_mm_and_si128(alpha,
+			_mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+	return true;
+}
+
+/* Combines pairs of nibbles in each 16-bit lane, high nibble first */
+static __m128i hex_pairs(__m128i v)
+{
+	__m128i hi = _mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0xff)), 4);
+
+	return _mm_or_si128(hi, _mm_srli_epi16(v, 8));
+}
+#endif
+
+/* Decodes @len hex digits, @len must be even */
+static bool hex_decode(const char *str, size_t len, uint8_t *out)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	for (; i + 32 <= len; i += 32) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (str + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (str + i + 16));
+
+		if (!hex_nibbles(&a) || !hex_nibbles(&b))
+			return false;
+
+		_mm_storeu_si128((__m128i *) (out + i / 2),
+				_mm_packus_epi16(hex_pairs(a), hex_pairs(b)));
+	}
+#endif
+
+	for (; i < len; i += 2) {
+		uint8_t hi = hex_table[(uint8_t) str[i]];
+		uint8_t lo = hex_table[(uint8_t) str[i + 1]];
+
+		if (!hi || !lo)
+			return false;
+
+		out[i / 2] = (hi - 1) << 4 | (lo - 1);
+	}
+
+	return true;
+}
+
 /**
  * l_util_from_hexstring:
  * @str: Null-terminated string containing the hex-encoded bytes
@@ -465,98 +564,115 @@ LIB_EXPORT char *l_util_hexstringv_upper(const struct iovec *iov, size_t n_iov)
 LIB_EXPORT unsigned char *l_util_from_hexstring(const char *str,
 							size_t *out_len)
 {
-	size_t i, j;
 	size_t len;
-	char c;
 	unsigned char *buf;
 
 	if (unlikely(!str))
 		return NULL;
 
-	for (i = 0; str[i]; i++) {
-		c = str[i];
+	len = strlen(str);
+	if (!len || (len % 2) != 0)
+		return NULL;
 
-		if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') ||
-				(c >= 'a' && c <= 'f'))
-			continue;
+	buf = l_malloc(len / 2);
 
+	if (!hex_decode(str, len, buf)) {
+		l_free(buf);
 		return NULL;
 	}
 
-	if (!i)
-		return NULL;
+	if (out_len)
+		*out_len = len / 2;
 
-	if ((i % 2) != 0)
-		return NULL;
+	return buf;
+}
 
-	len = i;
-	buf = l_malloc(i >> 1);
+/**
+ * l_util_from_hexstring_into:
+ * @str: Null-terminated string containing the hex-encoded bytes
+ * @out: buffer for the decoded bytes
+ * @out_size: size of @out
+ *
+ * Decodes @str like l_util_from_hexstring() without allocating.
+ *
+ * Returns: The number of bytes decoded, -EINVAL if @str is empty or not
+ * a valid hex string or -ENOSPC if @out is too small.
+ **/
+LIB_EXPORT ssize_t l_util_from_hexstring_into(const char *str, void *out,
+							size_t out_size)
+{
+	size_t len;
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = str[i];
+	if (unlikely(!str))
+		return -EINVAL;
+
+	len = strlen(str);
+	if (!len || (len % 2) != 0)
+		return -EINVAL;
+
+	if (len / 2 > out_size)
+		return -ENOSPC;
 
-		if (c >= '0' && c <= '9')
-			buf[j] = c - '0';
-		else if (c >= 'A' && c <= 'F')
-			buf[j] = 10 + c - 'A';
-		else if (c >= 'a' && c <= 'f')
-			buf[j] = 10 + c - 'a';
+	if (!hex_decode(str, len, out))
+		return -EINVAL;
+
+	return len / 2;
+}
 
-		i += 1;
-		c = str[i];
+/* Formats up to 16 bytes, str[0] is left for the direction marker */
+static void hexdump_line(char str[static 68], const uint8_t *buf, size_t len)
+{
+	static const char hexdigits[] = "0123456789abcdef";
+	size_t i;
 
-		if (c >= '0' && c <= '9')
-			buf[j] = buf[j] * 16 + c - '0';
-		else if (c >= 'A' && c <= 'F')
-			buf[j] = buf[j] * 16 + 10 + c - 'A';
-		else if (c >= 'a' && c <= 'f')
-			buf[j] = buf[j] * 16 + 10 + c - 'a';
+	for (i = 0; i < len; i++) {
+		str[(i * 3) + 1] = ' ';
+		str[(i * 3) + 2] = hexdigits[buf[i] >> 4];
+		str[(i * 3) + 3] = hexdigits[buf[i] & 0xf];
+		str[i + 51] = l_ascii_isprint(buf[i]) ? buf[i] : '.';
 	}
 
-	if (out_len)
-		*out_len = j;
+	for (; i < 16; i++) {
+		str[(i * 3) + 1] = ' ';
+		str[(i * 3) + 2] = ' ';
+		str[(i * 3) + 3] = ' ';
+		str[i + 51] = ' ';
+	}
 
-	return buf;
+	str[49] = ' ';
+	str[50] = ' ';
+	str[67] = '\0';
 }
 
-static void hexdump(const char dir, const unsigned char *buf, size_t len,
+/* Lines can span iovecs, the callback gets one line at a time */
+static void hexdump(char dir, const struct iovec *iov, size_t n_iov,
 			l_util_hexdump_func_t function, void *user_data)
 {
-	static const char hexdigits[] = "0123456789abcdef";
 	char str[68];
-	size_t i;
-
-	if (unlikely(!len))
-		return;
+	uint8_t line[16];
+	size_t n = 0;
+	size_t i, j;
 
 	str[0] = dir;
 
-	for (i = 0; i < len; i++) {
-		str[((i % 16) * 3) + 1] = ' ';
-		str[((i % 16) * 3) + 2] = hexdigits[buf[i] >> 4];
-		str[((i % 16) * 3) + 3] = hexdigits[buf[i] & 0xf];
-		str[(i % 16) + 51] = l_ascii_isprint(buf[i]) ? buf[i] : '.';
-
-		if ((i + 1) % 16 == 0) {
-			str[49] = ' ';
-			str[50] = ' ';
-			str[67] = '\0';
+	for (i = 0; i < n_iov; i++) {
+		const uint8_t *buf = iov[i].iov_base;
+
+		for (j = 0; j < iov[i].iov_len; j++) {
+			line[n++] = buf[j];
+
+			if (n < 16)
+				continue;
+
+			hexdump_line(str, line, n);
 			function(str, user_data);
 			str[0] = ' ';
+			n = 0;
 		}
 	}
 
-	if (i % 16 > 0) {
-		size_t j;
-		for (j = (i % 16); j < 16; j++) {
-			str[(j * 3) + 1] = ' ';
-			str[(j * 3) + 2] = ' ';
-			str[(j * 3) + 3] = ' ';
-			str[j + 51] = ' ';
-		}
-		str[49] = ' ';
-		str[50] = ' ';
-		str[67] = '\0';
+	if (n) {
+		hexdump_line(str, line, n);
 		function(str, user_data);
 	}
 }
@@ -564,21 +680,26 @@ static void hexdump(const char dir, const unsigned char *buf, size_t len,
 LIB_EXPORT void l_util_hexdump(bool in, const void *buf, size_t len,
 			l_util_hexdump_func_t function, void *user_data)
 {
+	struct iovec iov = { .iov_base = (void *) buf, .iov_len = len };
+
 	if (likely(!function))
 		return;
 
-	hexdump(in ? '<' : '>', buf, len, function, user_data);
+	hexdump(in ? '<' : '>', &iov, 1, function, user_data);
 }
 
 LIB_EXPORT void l_util_hexdump_two(bool in, const void *buf1, size_t len1,
 			const void *buf2, size_t len2,
 			l_util_hexdump_func_t function, void *user_data)
 {
+	struct iovec iov1 = { .iov_base = (void *) buf1, .iov_len = len1 };
+	struct iovec iov2 = { .iov_base = (void *) buf2, .iov_len = len2 };
+
 	if (likely(!function))
 		return;
 
-	hexdump(in ? '<' : '>', buf1, len1, function, user_data);
-	hexdump(' ', buf2, len2, function, user_data);
+	hexdump(in ? '<' : '>', &iov1, 1, function, user_data);
+	hexdump(' ', &iov2, 1, function, user_data);
 }
 
 LIB_EXPORT void l_util_hexdumpv(bool in, const struct iovec *iov,
@@ -586,61 +707,13 @@ LIB_EXPORT void l_util_hexdumpv(bool in, const struct iovec *iov,
 					l_util_hexdump_func_t function,
 					void *user_data)
 {
-	static const char hexdigits[] = "0123456789abcdef";
-	char str[68];
-	size_t i;
-	size_t len;
-	size_t c;
-	const uint8_t *buf;
-
 	if (likely(!function))
 		return;
 
 	if (unlikely(!iov || !n_iov))
 		return;
 
-	str[0] = in ? '<' : '>';
-
-	for (i = 0, len = 0; i < n_iov; i++)
-		len += iov[i].iov_len;
-
-	c = 0;
-	buf = iov[0].iov_base;
-
-	for (i = 0; i < len; i++, c++) {
-		if (c == iov[0].iov_len) {
-			c = 0;
-			iov += 1;
-			buf = iov[0].iov_base;
-		}
-
-		str[((i % 16) * 3) + 1] = ' ';
-		str[((i % 16) * 3) + 2] = hexdigits[buf[c] >> 4];
-		str[((i % 16) * 3) + 3] = hexdigits[buf[c] & 0xf];
-		str[(i % 16) + 51] = l_ascii_isprint(buf[c]) ? buf[c] : '.';
-
-		if ((i + 1) % 16 == 0) {
-			str[49] = ' ';
-			str[50] = ' ';
-			str[67] = '\0';
-			function(str, user_data);
-			str[0] = ' ';
-		}
-	}
-
-	if (i % 16 > 0) {
-		size_t j;
-		for (j = (i % 16); j < 16; j++) {
-			str[(j * 3) + 1] = ' ';
-			str[(j * 3) + 2] = ' ';
-			str[(j * 3) + 3] = ' ';
-			str[j + 51] = ' ';
-		}
-		str[49] = ' ';
-		str[50] = ' ';
-		str[67] = '\0';
-		function(str, user_data);
-	}
+	hexdump(in ? '<' : '>', iov, n_iov, function, user_data);
 }
 
 LIB_EXPORT void l_util_debug(l_util_hexdump_func_t function, void *user_data,
@@ -10,6 +10,8 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
+#include <stdio.h>
 
 #include <ell/ell.h>
 
@@ -151,6 +153,78 @@ static void test_base64_encode(const void *data)
 	l_free(encoded);
 }
 
+static void test_base64_decode_into(const void *data)
+{
+	uint8_t buf[300];
+	uint8_t out[300];
+	unsigned int i;
+	size_t len;
+
+	assert(l_base64_decode_into(decode_1.input, strlen(decode_1.input),
+					out, 9) == 9);
+	assert(!memcmp(out, decode_output_1, 9));
+	assert(l_base64_decode_into(decode_1.input, strlen(decode_1.input),
+					out, 8) == -ENOSPC);
+	assert(l_base64_decode_into("cGxl*XN1", 8, out, 6) == -EINVAL);
+	assert(l_base64_decode_into("cGxl=XN1", 8, out, 6) == -EINVAL);
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7 + 3;
+
+	/* Both the whole group and the byte at a time paths */
+	for (len = 0; len < sizeof(buf); len++) {
+		char *encoded = l_base64_encode(buf, len, 8 * (len % 9));
+		size_t encoded_len = strlen(encoded);
+
+		assert(l_base64_decode_into(encoded, encoded_len, out,
+						encoded_len * 3 / 4) ==
+						(ssize_t) len);
+		assert(!memcmp(out, buf, len));
+		l_free(encoded);
+	}
+}
+
+#define BENCH_SIZE	(1024 * 1024)
+
+static void bench_base64(const void *data)
+{
+	uint8_t *buf = l_malloc(BENCH_SIZE);
+	uint64_t start, encode, decode;
+	char *encoded;
+	unsigned int i;
+	size_t len;
+
+	for (i = 0; i < BENCH_SIZE; i++)
+		buf[i] = i * 7 + 3;
+
+	start = l_time_now();
+
+	for (i = 0; i < 10; i++) {
+		encoded = l_base64_encode(buf, BENCH_SIZE, 64);
+		l_free(encoded);
+	}
+
+	encode = l_time_now() - start;
+	encoded = l_base64_encode(buf, BENCH_SIZE, 64);
+	start = l_time_now();
+
+	for (i = 0; i < 10; i++) {
+		uint8_t *decoded = l_base64_decode(encoded, strlen(encoded),
+							&len);
+
+		assert(decoded && len == BENCH_SIZE);
+		l_free(decoded);
+	}
+
+	decode = l_time_now() - start;
+
+	printf("base64: encode %.0f MB/s, decode %.0f MB/s\n",
+			10.0 * BENCH_SIZE / encode, 10.0 * BENCH_SIZE / decode);
+
+	l_free(encoded);
+	l_free(buf);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -170,5 +244,9 @@ int main(int argc, char *argv[])
 	l_test_add("base64/encode/test3", test_base64_encode, &encode_3);
 	l_test_add("base64/encode/test4", test_base64_encode, &encode_4);
 
+	l_test_add("base64/decode_into", test_base64_decode_into, NULL);
+
+	l_test_add_benchmark("base64/benchmark", bench_base64, NULL);
+
 	return l_test_run();
 }
@@ -11,6 +11,7 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <stdio.h>
 #include <math.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -2669,6 +2670,212 @@ static void check_complex_5(const void *data)
 	l_dbus_message_unref(msg);
 }
 
+static void compare_message_body(struct l_dbus_message *msg1,
+					struct l_dbus_message *msg2)
+{
+	const void *body1, *body2;
+	size_t size1, size2;
+
+	assert(!strcmp(l_dbus_message_get_signature(msg1),
+				l_dbus_message_get_signature(msg2)));
+
+	body1 = _dbus_message_get_body(msg1, &size1);
+	body2 = _dbus_message_get_body(msg2, &size2);
+	assert(size1 == size2);
+	assert(!memcmp(body1, body2, size1));
+}
+
+static void builder_fixed_array(const void *data)
+{
+	static const uint64_t t[] = { 1, 0xffffffffffffffffULL, 3 };
+	static const uint8_t y[] = { 0x10, 0x20, 0x30, 0x40, 0x50 };
+	struct l_dbus_message *msg1 = build_message(data);
+	struct l_dbus_message *msg2 = build_message(data);
+	struct l_dbus_message_builder *builder;
+	struct l_dbus_message_iter iter;
+	const uint8_t *array;
+	uint32_t n_elem;
+	uint8_t b = 0xff;
+
+	assert(l_dbus_message_set_arguments(msg1, "yatay", b,
+						3, t[0], t[1], t[2],
+						5, y[0], y[1], y[2], y[3], y[4]));
+
+	builder = l_dbus_message_builder_new(msg2);
+	assert(builder);
+
+	assert(l_dbus_message_builder_append_basic(builder, 'y', &b));
+	assert(l_dbus_message_builder_append_fixed_array(builder, 't', t, 3));
+	assert(l_dbus_message_builder_append_fixed_array(builder, 'y', y, 5));
+	assert(!l_dbus_message_builder_append_fixed_array(builder, 's', y, 5));
+
+	assert(l_dbus_message_builder_finalize(builder));
+	l_dbus_message_builder_destroy(builder);
+
+	compare_message_body(msg1, msg2);
+
+	l_dbus_message_unref(msg1);
+	l_dbus_message_unref(msg2);
+
+	msg1 = build_message(data);
+	msg2 = build_message(data);
+
+	assert(l_dbus_message_set_arguments(msg1, "ay", 5,
+						y[0], y[1], y[2], y[3], y[4]));
+	assert(l_dbus_message_set_fixed_array(msg2, 'y', y, 5));
+	assert(!l_dbus_message_set_fixed_array(msg2, 'y', y, 5));
+
+	compare_message_body(msg1, msg2);
+
+	assert(l_dbus_message_get_arguments(msg2, "ay", &iter));
+	assert(l_dbus_message_iter_get_fixed_array(&iter, &array, &n_elem));
+	assert(n_elem == 5);
+	assert(!memcmp(array, y, 5));
+
+	l_dbus_message_unref(msg1);
+	l_dbus_message_unref(msg2);
+}
+
+#define BENCH_ARRAY_SIZE	(1024 * 1024)
+
+static uint64_t bench_append_ay(uint8_t version, const uint8_t *data,
+								bool bulk)
+{
+	struct l_dbus_message *msg;
+	struct l_dbus_message_builder *builder;
+	uint64_t start;
+	uint64_t elapsed;
+	unsigned int i;
+
+	msg = _dbus_message_new_method_call(version, "org.test", "/test",
+						"org.test", "Bench");
+	builder = l_dbus_message_builder_new(msg);
+	assert(builder);
+
+	start = l_time_now();
+
+	if (bulk)
+		assert(l_dbus_message_builder_append_fixed_array(builder, 'y',
+						data, BENCH_ARRAY_SIZE));
+	else {
+		assert(l_dbus_message_builder_enter_array(builder, "y"));
+
+		for (i = 0; i < BENCH_ARRAY_SIZE; i++)
+			assert(l_dbus_message_builder_append_basic(builder,
+								'y', data + i));
+
+		assert(l_dbus_message_builder_leave_array(builder));
+	}
+
+	assert(l_dbus_message_builder_finalize(builder));
+	elapsed = l_time_diff(start, l_time_now());
+
+	l_dbus_message_builder_destroy(builder);
+	l_dbus_message_unref(msg);
+
+	return elapsed;
+}
+
+static void bench_fixed_array(const void *data)
+{
+	uint8_t *buf = l_malloc(BENCH_ARRAY_SIZE);
+	uint8_t version;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_ARRAY_SIZE; i++)
+		buf[i] = i;
+
+	for (version = 1; version <= 2; version++) {
+		uint64_t element = bench_append_ay(version, buf, false);
+		uint64_t bulk = bench_append_ay(version, buf, true);
+
+		printf("1 MiB ay, %s: per element %.2f ms, "
+				"fixed array %.2f ms\n",
+				version == 1 ? "dbus1" : "gvariant",
+				element / 1000.0, bulk / 1000.0);
+	}
+
+	l_free(buf);
+}
+
+static struct l_dbus_message *receive_method_call(
+					struct _dbus_message_pool *pool,
+					uint32_t serial)
+{
+	struct l_dbus_message *call, *msg;
+	void *header, *body;
+	size_t header_size, body_size;
+
+	call = _dbus_message_new_method_call(1, "org.test", "/test",
+						"org.test", "Echo");
+	assert(call);
+	assert(l_dbus_message_set_arguments(call, "s", "ping"));
+	_dbus_message_set_serial(call, serial);
+
+	header = _dbus_message_get_header(call, &header_size);
+	body = _dbus_message_get_body(call, &body_size);
+
+	msg = dbus_message_build(pool,
+			memcpy(_dbus_message_pool_alloc(pool, header_size),
+				header, header_size), header_size,
+			memcpy(_dbus_message_pool_alloc(pool, body_size),
+				body, body_size), body_size,
+			NULL, 0);
+	assert(msg);
+
+	l_dbus_message_unref(call);
+
+	return msg;
+}
+
+static void pool_reply_header(const void *data)
+{
+	struct _dbus_message_pool *pool = _dbus_message_pool_new();
+	uint32_t serial;
+
+	for (serial = 1; serial <= 4; serial++) {
+		struct l_dbus_message *call, *reply, *ref, *ref_call;
+		const char *str;
+		void *header, *ref_header;
+		size_t header_size, ref_header_size;
+
+		call = receive_method_call(pool, serial);
+		ref_call = receive_method_call(NULL, serial);
+
+		reply = l_dbus_message_new_method_return(call);
+		ref = l_dbus_message_new_method_return(ref_call);
+
+		if (serial & 1) {
+			assert(l_dbus_message_set_arguments(reply, "s",
+								"pong"));
+			assert(l_dbus_message_set_arguments(ref, "s", "pong"));
+		} else {
+			assert(l_dbus_message_set_arguments(reply, "u",
+								serial));
+			assert(l_dbus_message_set_arguments(ref, "u", serial));
+		}
+
+		header = _dbus_message_get_header(reply, &header_size);
+		ref_header = _dbus_message_get_header(ref, &ref_header_size);
+		assert(header_size == ref_header_size);
+		assert(!memcmp(header, ref_header, header_size));
+
+		assert(_dbus_message_get_reply_serial(reply) == serial);
+
+		if (serial & 1) {
+			assert(l_dbus_message_get_arguments(reply, "s", &str));
+			assert(!strcmp(str, "pong"));
+		}
+
+		l_dbus_message_unref(call);
+		l_dbus_message_unref(ref_call);
+		l_dbus_message_unref(reply);
+		l_dbus_message_unref(ref);
+	}
+
+	_dbus_message_pool_unref(pool);
+}
+
 static void builder_rewind(const void *data)
 {
 	struct l_dbus_message *msg = build_message(data);
@@ -2952,6 +3159,13 @@ int main(int argc, char *argv[])
 	l_test_add("Message Builder Rewind Complex 1", builder_rewind,
 						&message_data_complex_1);
 
+	l_test_add("Message Builder Fixed Array", builder_fixed_array,
+						&message_data_array_2);
+	l_test_add_benchmark("Message Builder Fixed Array benchmark",
+				bench_fixed_array, NULL);
+
+	l_test_add("Pooled Reply Header", pool_reply_header, NULL);
+
 	l_test_add("FDs (parse)", message_fds_parse, NULL);
 	l_test_add("FDs (build)", message_fds_build, NULL);
 
@@ -186,6 +186,7 @@ static bool test_string_getter(struct l_dbus *dbus,
 
 static bool setter_called;
 static bool int_optional;
+static unsigned int int_getter_calls;
 
 static struct l_dbus_message *test_string_setter(struct l_dbus *dbus,
 					struct l_dbus_message *message,
@@ -216,6 +217,8 @@ static bool test_int_getter(struct l_dbus *dbus,
 {
 	uint32_t u;
 
+	int_getter_calls++;
+
 	if (int_optional)
 		return false;
 
@@ -845,6 +848,69 @@ static void test_object_manager_get(struct l_dbus *dbus, void *test_data)
 						NULL, NULL));
 }
 
+static unsigned int om_getter_calls;
+
+static void object_manager_cached_callback(struct l_dbus_message *message,
+						void *user_data)
+{
+	/* Answered from the cache without calling any getters */
+	test_assert(int_getter_calls == om_getter_calls);
+
+	object_manager_callback(message, user_data);
+}
+
+static void test_object_manager_get_cached(struct l_dbus *dbus,
+						void *test_data)
+{
+	struct l_dbus_message *call =
+		l_dbus_message_new_method_call(dbus, "org.test",
+					ROOT_PATH,
+					"org.freedesktop.DBus.ObjectManager",
+					"GetManagedObjects");
+
+	om_getter_calls = int_getter_calls;
+
+	test_assert(call);
+	test_assert(l_dbus_message_set_arguments(call, ""));
+
+	test_assert(l_dbus_send_with_reply(dbus, call,
+					object_manager_cached_callback,
+					NULL, NULL));
+}
+
+static void object_manager_changed_callback(struct l_dbus_message *message,
+						void *user_data)
+{
+	/* The getters are called again after the invalidation */
+	test_assert(int_getter_calls > om_getter_calls);
+
+	object_manager_callback(message, user_data);
+}
+
+static void test_object_manager_get_changed(struct l_dbus *dbus,
+						void *test_data)
+{
+	struct l_dbus_message *call =
+		l_dbus_message_new_method_call(dbus, "org.test",
+					ROOT_PATH,
+					"org.freedesktop.DBus.ObjectManager",
+					"GetManagedObjects");
+
+	/* The previous reply must not be reused after a property change */
+	int_optional = false;
+	test_assert(l_dbus_property_changed(dbus, ROOT_PATH"/test",
+						"org.test", "Integer"));
+
+	om_getter_calls = int_getter_calls;
+
+	test_assert(call);
+	test_assert(l_dbus_message_set_arguments(call, ""));
+
+	test_assert(l_dbus_send_with_reply(dbus, call,
+					object_manager_changed_callback,
+					NULL, NULL));
+}
+
 static struct l_timeout *om_signal_timeout;
 
 static void om_signal_timeout_callback(struct l_timeout *timeout,
@@ -963,6 +1029,11 @@ static void test_run(void)
 		return;
 	}
 
+	if (!l_dbus_object_manager_set_cache(dbus, ROOT_PATH, true)) {
+		l_info("Unable to enable the Object Manager cache");
+		return;
+	}
+
 	l_dbus_add_signal_watch(dbus, "org.test", ROOT_PATH,
 				"org.freedesktop.DBus.ObjectManager",
 				NULL, L_DBUS_MATCH_NONE,
@@ -987,6 +1058,10 @@ int main(int argc, char *argv[])
 	test_add("Property changed signals", test_property_signals, NULL);
 	test_add("org.freedesktop.DBus.ObjectManager get",
 			test_object_manager_get, NULL);
+	test_add("org.freedesktop.DBus.ObjectManager get cached",
+			test_object_manager_get_cached, NULL);
+	test_add("org.freedesktop.DBus.ObjectManager get after change",
+			test_object_manager_get_changed, NULL);
 	test_add("org.freedesktop.DBus.ObjectManager signals",
 			test_object_manager_signals, NULL);
 
@@ -0,0 +1,595 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <ell/ell.h>
+
+static struct l_dbus *server_conn;
+static struct l_dbus *client;
+static bool server_connected;
+static bool reply_received;
+static bool pool_stats_seen;
+
+static void do_debug(const char *str, void *user_data)
+{
+	const char *prefix = user_data;
+
+	if (l_str_has_prefix(str, "message pool: "))
+		pool_stats_seen = true;
+
+	l_info("%s%s", prefix, str);
+}
+
+#define test_assert(cond)	\
+	do {	\
+		if (!(cond)) {	\
+			l_info("TEST FAILED in %s at %s:%i: %s",	\
+				__func__, __FILE__, __LINE__,	\
+				L_STRINGIFY(cond));	\
+			l_main_quit();	\
+			return;	\
+		}	\
+	} while (0)
+
+static struct l_dbus_message *echo_method(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	struct l_dbus_message *reply;
+	const char *str;
+
+	if (!l_dbus_message_get_arguments(message, "s", &str))
+		return l_dbus_message_new_error(message,
+						"org.test.InvalidArguments",
+						NULL);
+
+	reply = l_dbus_message_new_method_return(message);
+	l_dbus_message_set_arguments(reply, "s", str);
+
+	return reply;
+}
+
+static void setup_test_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_method(interface, "Echo", 0, echo_method,
+				"s", "s", "reply", "text");
+}
+
+static void server_connect(struct l_dbus_server *server, struct l_dbus *dbus,
+							void *user_data)
+{
+	server_connected = true;
+	server_conn = dbus;
+
+	l_dbus_set_debug(dbus, do_debug, "[SERVER] ", NULL);
+
+	test_assert(l_dbus_register_interface(dbus, "org.test.Peer",
+						setup_test_interface, NULL,
+						false));
+	test_assert(l_dbus_object_add_interface(dbus, "/test",
+						"org.test.Peer", NULL));
+}
+
+static void echo_setup(struct l_dbus_message *message, void *user_data)
+{
+	l_dbus_message_set_arguments(message, "s", "ping");
+}
+
+static void echo_callback(struct l_dbus_message *message, void *user_data)
+{
+	const char *str;
+
+	test_assert(!l_dbus_message_is_error(message));
+	test_assert(l_dbus_message_get_arguments(message, "s", &str));
+	test_assert(!strcmp(str, "ping"));
+
+	reply_received = true;
+	l_main_quit();
+}
+
+static void client_ready(void *user_data)
+{
+	test_assert(server_connected);
+
+	test_assert(l_dbus_method_call(client, "org.test", "/test",
+					"org.test.Peer", "Echo",
+					echo_setup, echo_callback,
+					NULL, NULL));
+}
+
+static void test_timeout(struct l_timeout *timeout, void *user_data)
+{
+	l_main_quit();
+}
+
+static void test_peer_method_call(const void *data)
+{
+	struct l_dbus_server *server;
+	struct l_timeout *timeout;
+	char address[64];
+
+	assert(l_main_init());
+
+	l_log_set_stderr();
+
+	snprintf(address, sizeof(address),
+			"unix:abstract=ell-test-dbus-server-%d", getpid());
+
+	server = l_dbus_server_new(address);
+	assert(server);
+	assert(l_dbus_server_get_guid(server));
+	assert(l_dbus_server_set_connect_handler(server, server_connect,
+								NULL, NULL));
+
+	client = l_dbus_new(address);
+	assert(client);
+
+	l_dbus_set_debug(client, do_debug, "[CLIENT] ", NULL);
+	l_dbus_set_ready_handler(client, client_ready, NULL, NULL);
+
+	timeout = l_timeout_create(5, test_timeout, NULL, NULL);
+
+	l_main_run();
+
+	assert(server_connected);
+	assert(reply_received);
+
+	assert(l_dbus_debug_stats(server_conn));
+	assert(pool_stats_seen);
+
+	l_timeout_remove(timeout);
+	l_dbus_destroy(client);
+	l_dbus_destroy(server_conn);
+	l_dbus_server_destroy(server);
+
+	l_main_exit();
+}
+
+static void pipelined_connect(struct l_dbus_server *server,
+					struct l_dbus *dbus, void *user_data)
+{
+	struct l_dbus_message *signal;
+
+	server_connected = true;
+	server_conn = dbus;
+
+	/* Sent right away, before the auth responses could have been */
+	signal = l_dbus_message_new_signal(dbus, "/test", "org.test.Peer",
+						"Ping");
+	l_dbus_message_set_arguments(signal, "");
+	l_dbus_send(dbus, signal);
+}
+
+static int connect_raw(const char *name)
+{
+	struct sockaddr_un addr;
+	socklen_t len;
+	int fd;
+
+	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	assert(fd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path + 1, name);
+	len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(name);
+	assert(connect(fd, (struct sockaddr *) &addr, len) == 0);
+
+	return fd;
+}
+
+struct pipelined_auth {
+	const char *request;
+	const char *response;
+};
+
+static const struct pipelined_auth pipelined_initial = {
+	.request = "%cAUTH EXTERNAL %s\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n",
+	.response = "OK %s\r\nAGREE_UNIX_FD\r\n",
+};
+
+static const struct pipelined_auth pipelined_data = {
+	.request = "%cAUTH EXTERNAL\r\nDATA %s\r\n"
+			"NEGOTIATE_UNIX_FD\r\nBEGIN\r\n",
+	.response = "DATA\r\nOK %s\r\nAGREE_UNIX_FD\r\n",
+};
+
+static void test_pipelined_auth(const void *data)
+{
+	const struct pipelined_auth *test = data;
+	struct l_dbus_server *server;
+	char name[64];
+	char address[80];
+	char uid[12];
+	char *hexuid;
+	char *request;
+	char *expected;
+	char buf[512];
+	size_t len = 0;
+	unsigned int i;
+	ssize_t r;
+	int fd;
+
+	assert(l_main_init());
+
+	snprintf(name, sizeof(name), "ell-test-dbus-server-%d", getpid());
+	snprintf(address, sizeof(address), "unix:abstract=%s", name);
+
+	server = l_dbus_server_new(address);
+	assert(server);
+	assert(l_dbus_server_set_connect_handler(server, pipelined_connect,
+								NULL, NULL));
+
+	/* All of the handshake in one go, the way sd-bus sends it */
+	snprintf(uid, sizeof(uid), "%u", geteuid());
+	hexuid = l_util_hexstring(uid, strlen(uid));
+	request = l_strdup_printf(test->request, '\0', hexuid);
+	l_free(hexuid);
+
+	fd = connect_raw(name);
+	assert(send(fd, request, strlen(request + 1) + 1, 0) ==
+					(ssize_t) strlen(request + 1) + 1);
+	l_free(request);
+
+	expected = l_strdup_printf(test->response,
+					l_dbus_server_get_guid(server));
+
+	/* The responses come first, then the whole signal */
+	for (i = 0; i < 50 && len < strlen(expected) + 16; i++) {
+		l_main_iterate(100);
+
+		r = recv(fd, buf + len, sizeof(buf) - len, MSG_DONTWAIT);
+		if (r > 0)
+			len += r;
+	}
+
+	assert(server_connected);
+	assert(len >= strlen(expected) + 16);
+	assert(!memcmp(buf, expected, strlen(expected)));
+	assert(buf[strlen(expected)] == 'l' || buf[strlen(expected)] == 'B');
+	l_free(expected);
+
+	close(fd);
+	l_dbus_destroy(server_conn);
+	l_dbus_server_destroy(server);
+	server_connected = false;
+
+	l_main_exit();
+}
+
+/* Runs the main loop until the server closes @fd, or gives up after 5s */
+static bool wait_closed(int fd)
+{
+	unsigned int i;
+	char c;
+
+	for (i = 0; i < 50; i++) {
+		l_main_iterate(100);
+
+		if (recv(fd, &c, 1, MSG_DONTWAIT) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void test_auth_timeout(const void *data)
+{
+	struct l_dbus_server *server;
+	char name[64];
+	char address[80];
+	char c;
+	int fd;
+
+	assert(l_main_init());
+
+	snprintf(name, sizeof(name), "ell-test-dbus-server-%d", getpid());
+	snprintf(address, sizeof(address), "unix:abstract=%s", name);
+
+	server = l_dbus_server_new(address);
+	assert(server);
+	assert(l_dbus_server_set_auth_limits(server, 100, 16));
+
+	/* Starts authenticating but never finishes */
+	fd = connect_raw(name);
+	assert(send(fd, "\0AUTH\r\n", 7, 0) == 7);
+	assert(wait_closed(fd));
+	assert(recv(fd, &c, 1, MSG_DONTWAIT) == 0);
+
+	close(fd);
+	l_dbus_server_destroy(server);
+
+	l_main_exit();
+}
+
+#define MAX_PENDING	4
+
+static void test_max_pending(const void *data)
+{
+	struct l_dbus_server *server;
+	char name[64];
+	char address[80];
+	int fds[MAX_PENDING + 1];
+	unsigned int i;
+	char c;
+
+	assert(l_main_init());
+
+	snprintf(name, sizeof(name), "ell-test-dbus-server-%d", getpid());
+	snprintf(address, sizeof(address), "unix:abstract=%s", name);
+
+	server = l_dbus_server_new(address);
+	assert(server);
+	assert(l_dbus_server_set_auth_limits(server, 0, MAX_PENDING));
+
+	for (i = 0; i < MAX_PENDING; i++) {
+		fds[i] = connect_raw(name);
+		l_main_iterate(0);
+	}
+
+	/* One too many, closed without being read from */
+	fds[MAX_PENDING] = connect_raw(name);
+	assert(wait_closed(fds[MAX_PENDING]));
+
+	for (i = 0; i < MAX_PENDING; i++)
+		assert(recv(fds[i], &c, 1, MSG_DONTWAIT) < 0 &&
+							errno == EAGAIN);
+
+	/* Room again once one of them is gone */
+	close(fds[0]);
+
+	for (i = 0; i < 10; i++)
+		l_main_iterate(10);
+
+	fds[0] = connect_raw(name);
+
+	for (i = 0; i < 10; i++)
+		l_main_iterate(10);
+
+	assert(recv(fds[0], &c, 1, MSG_DONTWAIT) < 0 && errno == EAGAIN);
+
+	for (i = 0; i <= MAX_PENDING; i++)
+		close(fds[i]);
+
+	l_dbus_server_destroy(server);
+
+	l_main_exit();
+}
+
+#define BENCH_CALLS	20000
+#define BENCH_WINDOW	64
+
+struct echo_bench {
+	struct l_dbus *client;
+	const char *destination;
+	unsigned int remaining;
+	unsigned int pending;
+	unsigned int ready;
+	bool done;
+};
+
+/* l_main_run() can only be used once per l_main_init() */
+static void bench_loop(struct echo_bench *bench)
+{
+	bench->done = false;
+
+	while (!bench->done)
+		l_main_iterate(l_main_prepare());
+}
+
+static void bench_echo_send(struct echo_bench *bench);
+
+static void bench_echo_reply(struct l_dbus_message *message, void *user_data)
+{
+	struct echo_bench *bench = user_data;
+
+	assert(!l_dbus_message_is_error(message));
+	bench->pending--;
+
+	if (bench->remaining)
+		bench_echo_send(bench);
+	else if (!bench->pending)
+		bench->done = true;
+}
+
+static void bench_echo_send(struct echo_bench *bench)
+{
+	bench->remaining--;
+	bench->pending++;
+
+	assert(l_dbus_method_call(bench->client, bench->destination, "/test",
+					"org.test.Peer", "Echo", echo_setup,
+					bench_echo_reply, bench, NULL));
+}
+
+/* Runs BENCH_CALLS Echo calls with @window of them in flight at once */
+static double bench_echo_run(struct echo_bench *bench, unsigned int window)
+{
+	uint64_t start;
+	unsigned int i;
+
+	bench->remaining = BENCH_CALLS;
+	start = l_time_now();
+
+	for (i = 0; i < window; i++)
+		bench_echo_send(bench);
+
+	bench_loop(bench);
+	assert(!bench->remaining && !bench->pending);
+
+	return l_time_diff(start, l_time_now()) / (double) BENCH_CALLS;
+}
+
+static void bench_echo(struct echo_bench *bench, const char *name)
+{
+	double latency = bench_echo_run(bench, 1);
+	double pipelined = bench_echo_run(bench, BENCH_WINDOW);
+
+	printf("%s: %.1f us per call, %.0f calls/s with %u in flight\n",
+			name, latency, 1000000.0 / pipelined, BENCH_WINDOW);
+}
+
+static void bench_ready(void *user_data)
+{
+	struct echo_bench *bench = user_data;
+
+	if (!--bench->ready)
+		bench->done = true;
+}
+
+static void bench_server_connect(struct l_dbus_server *server,
+					struct l_dbus *dbus, void *user_data)
+{
+	server_conn = dbus;
+
+	assert(l_dbus_register_interface(dbus, "org.test.Peer",
+						setup_test_interface, NULL,
+						false));
+	assert(l_dbus_object_add_interface(dbus, "/test", "org.test.Peer",
+								NULL));
+}
+
+static void bench_peer(void)
+{
+	struct echo_bench bench = { .destination = "org.test", .ready = 1 };
+	struct l_dbus_server *server;
+	char address[64];
+
+	snprintf(address, sizeof(address),
+			"unix:abstract=ell-test-dbus-server-%d", getpid());
+
+	server = l_dbus_server_new(address);
+	assert(server);
+	assert(l_dbus_server_set_connect_handler(server, bench_server_connect,
+								NULL, NULL));
+
+	bench.client = l_dbus_new(address);
+	assert(bench.client);
+	l_dbus_set_ready_handler(bench.client, bench_ready, &bench, NULL);
+	bench_loop(&bench);
+
+	bench_echo(&bench, "peer-to-peer");
+
+	l_dbus_destroy(bench.client);
+	l_dbus_destroy(server_conn);
+	l_dbus_server_destroy(server);
+}
+
+static void bench_name_acquired(struct l_dbus *dbus, bool success,
+					bool queued, void *user_data)
+{
+	assert(success);
+	bench_ready(user_data);
+}
+
+static pid_t bench_start_daemon(const char *address)
+{
+	char *arg = l_strdup_printf("--address=%s", address);
+	char *prg_argv[] = { "dbus-daemon", "--nopidfile", "--nofork",
+				"--config-file=" UNITDIR "dbus.conf", arg,
+				NULL };
+	char *prg_envp[] = { NULL };
+	pid_t pid;
+
+	pid = fork();
+	assert(pid >= 0);
+
+	if (!pid) {
+		execvpe(prg_argv[0], prg_argv, prg_envp);
+		_exit(EXIT_FAILURE);
+	}
+
+	l_free(arg);
+	return pid;
+}
+
+static void bench_daemon(void)
+{
+	struct echo_bench bench = { .destination = "org.test", .ready = 3 };
+	struct l_dbus *service = NULL;
+	char address[64];
+	unsigned int i;
+	pid_t pid;
+
+	snprintf(address, sizeof(address),
+			"unix:path=/tmp/ell-test-dbus-server-%d", getpid());
+	pid = bench_start_daemon(address);
+
+	for (i = 0; i < 10 && !service; i++) {
+		usleep(200 * 1000);
+		service = l_dbus_new(address);
+	}
+
+	if (!service) {
+		printf("dbus-daemon: not available\n");
+		goto done;
+	}
+
+	assert(l_dbus_register_interface(service, "org.test.Peer",
+						setup_test_interface, NULL,
+						false));
+	assert(l_dbus_object_add_interface(service, "/test", "org.test.Peer",
+								NULL));
+	l_dbus_set_ready_handler(service, bench_ready, &bench, NULL);
+	assert(l_dbus_name_acquire(service, "org.test", false, false, false,
+					bench_name_acquired, &bench));
+
+	bench.client = l_dbus_new(address);
+	assert(bench.client);
+	l_dbus_set_ready_handler(bench.client, bench_ready, &bench, NULL);
+	bench_loop(&bench);
+
+	bench_echo(&bench, "dbus-daemon");
+
+	l_dbus_destroy(bench.client);
+	l_dbus_destroy(service);
+
+done:
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+static void test_echo_bench(const void *data)
+{
+	assert(l_main_init());
+
+	bench_peer();
+	bench_daemon();
+
+	l_main_exit();
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Peer-to-peer method call", test_peer_method_call, NULL);
+	l_test_add("Pipelined authentication", test_pipelined_auth,
+							&pipelined_initial);
+	l_test_add("Pipelined authentication with DATA", test_pipelined_auth,
+							&pipelined_data);
+	l_test_add("Authentication timeout", test_auth_timeout, NULL);
+	l_test_add("Pending connection limit", test_max_pending, NULL);
+	l_test_add_benchmark("Echo benchmark", test_echo_bench, NULL);
+
+	return l_test_run();
+}
@@ -10,6 +10,7 @@
 #endif
 
 #include <assert.h>
+#include <string.h>
 
 #include <ell/ell.h>
 #include "ell/dbus-private.h"
@@ -136,6 +137,73 @@ static void test_bus_name(const void *test_data)
 	assert(valid == test->valid);
 }
 
+static void test_signature_compile(const void *test_data)
+{
+	static const char *sig = "ya{sv}(ybt)a(ai)()";
+	struct dbus_signature_info *info;
+	const struct dbus_type_info *t;
+
+	info = _dbus_signature_compile(sig);
+	assert(info);
+	assert(info->len == strlen(sig));
+	t = info->types;
+
+	assert(t[0].type == 'y' && t[0].len == 1);
+	assert(t[0].alignment == 1 && t[0].gvariant_size == 1);
+
+	assert(t[1].type == 'a' && t[1].len == 5);
+	assert(t[1].alignment == 4 && t[1].gvariant_alignment == 8);
+	assert(t[1].gvariant_size == 0);
+
+	assert(t[2].type == '{' && t[2].len == 4);
+	assert(t[3].type == 's' && t[3].alignment == 4);
+	assert(t[4].type == 'v' && t[4].gvariant_alignment == 8);
+
+	assert(t[6].type == '(' && t[6].len == 5);
+	assert(t[6].alignment == 8 && t[6].gvariant_alignment == 8);
+	assert(t[6].gvariant_size == 16);
+	assert(t[8].type == 'b' && t[8].alignment == 4);
+	assert(t[8].gvariant_size == 1);
+
+	assert(t[11].type == 'a' && t[11].len == 5);
+	assert(t[11].gvariant_alignment == 4);
+	assert(t[12].type == '(' && t[12].gvariant_size == 0);
+
+	assert(t[16].type == '(' && t[16].len == 2);
+	assert(t[16].gvariant_size == 1);
+
+	_dbus_signature_info_unref(info);
+
+	assert(!_dbus_signature_compile("a"));
+	assert(!_dbus_signature_compile("(ss"));
+	assert(!_dbus_signature_compile("a{vs}"));
+	assert(!_dbus_signature_compile("a{sss}"));
+}
+
+static void test_signature_cache(const void *test_data)
+{
+	static const char *sig = "a{sv}(ybt)";
+	char copy[16];
+	struct dbus_type_info buf[255];
+	const struct dbus_type_info *t1, *t2;
+
+	t1 = _dbus_signature_get_types(sig, strlen(sig), buf);
+	assert(t1 && t1 != buf);
+	assert(t1[0].type == 'a' && t1[0].len == 5);
+	assert(t1[5].type == '(' && t1[5].gvariant_size == 16);
+
+	/* Found by content, and a prefix is a different signature */
+	strcpy(copy, sig);
+	t2 = _dbus_signature_get_types(copy, strlen(sig), buf);
+	assert(t2 == t1);
+
+	t2 = _dbus_signature_get_types(sig, 5, buf);
+	assert(t2 && t2 != t1);
+	assert(t2[0].type == 'a' && t2[0].len == 5);
+
+	assert(!_dbus_signature_get_types("a{vs}", 5, buf));
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -178,5 +246,8 @@ int main(int argc, char *argv[])
 	l_test_add("Bus Name Test 6", test_bus_name, &bus_name_test6);
 	l_test_add("Bus Name Test 7", test_bus_name, &bus_name_test7);
 
+	l_test_add("Signature Compile", test_signature_compile, NULL);
+	l_test_add("Signature Cache", test_signature_cache, NULL);
+
 	return l_test_run();
 }
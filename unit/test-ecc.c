@@ -9,6 +9,7 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
@@ -411,6 +412,516 @@ static void run_test_compressed_points(const void *arg)
 	}
 }
 
+static void run_test_field_ops(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		unsigned int ndigits = curve->ndigits;
+
+		for (j = 0; j < 256; j++) {
+			uint64_t product[2 * L_ECC_MAX_DIGITS];
+			uint64_t fast[L_ECC_MAX_DIGITS];
+			uint64_t slow[L_ECC_MAX_DIGITS];
+			struct l_ecc_scalar *r = l_ecc_scalar_new_random(curve);
+
+			l_getrandom(product, sizeof(product));
+			product[2 * ndigits - 1] >>= 1;
+
+			assert(_vli_mmod_fast(fast, product, curve->p,
+						ndigits));
+			_vli_mmod_slow(slow, product, curve->p, ndigits);
+			assert(!memcmp(fast, slow, ndigits * 8));
+
+			_vli_mod_inv_prime(fast, r->c, curve->p, ndigits);
+			_vli_mod_inv(slow, r->c, curve->p, ndigits);
+			assert(!memcmp(fast, slow, ndigits * 8));
+
+			l_ecc_scalar_free(r);
+		}
+	}
+}
+
+static int ref_cmp(const uint64_t *a, const uint64_t *b, unsigned int ndigits)
+{
+	while (ndigits--)
+		if (a[ndigits] != b[ndigits])
+			return a[ndigits] > b[ndigits] ? 1 : -1;
+
+	return 0;
+}
+
+static void run_test_vli_cmp_add_sub(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		unsigned int nd = curve->ndigits;
+		uint64_t pm1[L_ECC_MAX_DIGITS];
+		uint64_t one[L_ECC_MAX_DIGITS] = { 1 };
+		uint64_t zero[L_ECC_MAX_DIGITS] = { 0 };
+		uint64_t r[L_ECC_MAX_DIGITS];
+
+		memcpy(pm1, curve->p, sizeof(pm1));
+		pm1[0] -= 1;
+
+		assert(_vli_cmp(curve->p, curve->p, nd) == 0);
+		assert(_vli_cmp(curve->p, pm1, nd) == 1);
+		assert(_vli_cmp(pm1, curve->p, nd) == -1);
+		assert(_vli_cmp(one, zero, nd) == 1);
+		assert(_vli_cmp(zero, curve->p, nd) == -1);
+
+		/* (p - 1) + 1 wraps to 0, 0 - 1 wraps to p - 1 */
+		_vli_mod_add(r, pm1, one, curve->p, nd);
+		assert(!memcmp(r, zero, nd * 8));
+		_vli_mod_sub(r, zero, one, curve->p, nd);
+		assert(!memcmp(r, pm1, nd * 8));
+		_vli_mod_add(r, pm1, pm1, curve->p, nd);
+		_vli_mod_sub(r, r, pm1, curve->p, nd);
+		assert(!memcmp(r, pm1, nd * 8));
+
+		for (j = 0; j < 256; j++) {
+			struct l_ecc_scalar *a = l_ecc_scalar_new_random(curve);
+			struct l_ecc_scalar *b = l_ecc_scalar_new_random(curve);
+			uint64_t sum[L_ECC_MAX_DIGITS];
+
+			/* Equal high digits for some, so that low ones count */
+			if (j & 1)
+				memcpy(b->c + 1, a->c + 1, (nd - 1) * 8);
+
+			assert(_vli_cmp(a->c, b->c, nd) ==
+					ref_cmp(a->c, b->c, nd));
+
+			_vli_mod_add(sum, a->c, b->c, curve->p, nd);
+			assert(_vli_cmp(sum, curve->p, nd) < 0);
+			_vli_mod_sub(r, sum, b->c, curve->p, nd);
+			assert(!memcmp(r, a->c, nd * 8));
+
+			l_ecc_scalar_free(a);
+			l_ecc_scalar_free(b);
+		}
+	}
+}
+
+static void check_point_mult_g(const struct l_ecc_curve *curve,
+					const uint64_t *c)
+{
+	struct l_ecc_scalar *scalar;
+	struct l_ecc_point *fixed = l_ecc_point_new(curve);
+	struct l_ecc_point *ladder = l_ecc_point_new(curve);
+
+	scalar = _ecc_constant_new(curve, c, curve->ndigits * 8);
+	assert(scalar);
+
+	assert(l_ecc_point_multiply_g(fixed, scalar));
+	_ecc_point_mult(ladder, &curve->g, scalar->c, NULL, curve->p);
+	assert(l_ecc_points_are_equal(fixed, ladder));
+
+	l_ecc_scalar_free(scalar);
+	l_ecc_point_free(fixed);
+	l_ecc_point_free(ladder);
+}
+
+static void run_test_point_mult_g(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		uint64_t c[L_ECC_MAX_DIGITS] = { 1 };
+		struct l_ecc_scalar *scalar;
+		struct l_ecc_point *point = l_ecc_point_new(curve);
+		struct l_ecc_point *neg_g = l_ecc_point_new(curve);
+
+		/*
+		 * The Co-Z ladder gets 1 * G and (n - 1) * G wrong, compare
+		 * those against G and -G directly.
+		 */
+		scalar = _ecc_constant_new(curve, c, curve->ndigits * 8);
+		assert(l_ecc_point_multiply_g(point, scalar));
+		assert(l_ecc_points_are_equal(point, &curve->g));
+		l_ecc_scalar_free(scalar);
+
+		memcpy(c, curve->n, sizeof(c));
+		c[0] -= 1;
+		memcpy(neg_g->x, curve->g.x, sizeof(neg_g->x));
+		memcpy(neg_g->y, curve->g.y, sizeof(neg_g->y));
+		assert(l_ecc_point_inverse(neg_g));
+
+		scalar = _ecc_constant_new(curve, c, curve->ndigits * 8);
+		assert(l_ecc_point_multiply_g(point, scalar));
+		assert(l_ecc_points_are_equal(point, neg_g));
+		l_ecc_scalar_free(scalar);
+
+		l_ecc_point_free(point);
+		l_ecc_point_free(neg_g);
+
+		/* Scalars with runs of zero windows */
+		memset(c, 0, sizeof(c));
+		c[curve->ndigits - 1] = 0x0f00000000000000ull;
+		c[0] = 0xf000000000000001ull;
+		check_point_mult_g(curve, c);
+
+		for (j = 0; j < 32; j++) {
+			struct l_ecc_scalar *r = l_ecc_scalar_new_random(curve);
+
+			check_point_mult_g(curve, r->c);
+			l_ecc_scalar_free(r);
+		}
+	}
+}
+
+static void run_bench_point_mult_g(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		struct l_ecc_scalar *scalar = l_ecc_scalar_new_random(curve);
+		struct l_ecc_point *point = l_ecc_point_new(curve);
+		uint64_t start, ladder, fixed;
+
+		/* Make sure the table setup isn't part of the measurement */
+		l_ecc_point_multiply_g(point, scalar);
+
+		start = l_time_now();
+
+		for (j = 0; j < 200; j++)
+			_ecc_point_mult(point, &curve->g, scalar->c, NULL,
+						curve->p);
+
+		ladder = l_time_diff(start, l_time_now());
+		start = l_time_now();
+
+		for (j = 0; j < 200; j++)
+			l_ecc_point_multiply_g(point, scalar);
+
+		fixed = l_time_diff(start, l_time_now());
+
+		printf("%s keygen: ladder %.0f ops/s, fixed-base %.0f ops/s\n",
+			l_ecc_curve_get_name(curve),
+			200 * 1000000.0 / (ladder ? ladder : 1),
+			200 * 1000000.0 / (fixed ? fixed : 1));
+
+		l_ecc_scalar_free(scalar);
+		l_ecc_point_free(point);
+	}
+}
+
+static struct l_ecc_point *random_point(const struct l_ecc_curve *curve)
+{
+	struct l_ecc_scalar *s = l_ecc_scalar_new_random(curve);
+	struct l_ecc_point *p = l_ecc_point_new(curve);
+
+	assert(l_ecc_point_multiply_g(p, s));
+	l_ecc_scalar_free(s);
+
+	return p;
+}
+
+static void check_multiply_sum(const struct l_ecc_scalar *const *scalars,
+				const struct l_ecc_point *const *points,
+				unsigned int n,
+				const struct l_ecc_point *expect)
+{
+	const struct l_ecc_curve *curve = l_ecc_point_get_curve(expect);
+	struct l_ecc_point *r = l_ecc_point_new(curve);
+
+	assert(l_ecc_points_multiply_sum(r, scalars, points, n));
+	assert(l_ecc_points_are_equal(r, expect));
+
+	memset(r->x, 0, sizeof(r->x));
+	memset(r->y, 0, sizeof(r->y));
+	assert(l_ecc_points_multiply_sum_vartime(r, scalars, points, n));
+	assert(l_ecc_points_are_equal(r, expect));
+
+	l_ecc_point_free(r);
+}
+
+static void run_test_multiply_sum(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j, t;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		struct l_ecc_scalar *scalars[3];
+		struct l_ecc_point *points[3];
+		struct l_ecc_point *expect = l_ecc_point_new(curve);
+		struct l_ecc_point *tmp = l_ecc_point_new(curve);
+		uint64_t c[L_ECC_MAX_DIGITS];
+
+		for (j = 0; j < 16; j++) {
+			for (t = 0; t < 3; t++) {
+				scalars[t] = l_ecc_scalar_new_random(curve);
+				points[t] = random_point(curve);
+			}
+
+			/* Compare against separate ladders */
+			assert(l_ecc_point_multiply(expect, scalars[0],
+							points[0]));
+			assert(l_ecc_point_multiply(tmp, scalars[1],
+							points[1]));
+			assert(l_ecc_point_add(expect, expect, tmp));
+
+			assert(l_ecc_point_multiply_add(tmp,
+						scalars[0], points[0],
+						scalars[1], points[1]));
+			assert(l_ecc_points_are_equal(tmp, expect));
+			check_multiply_sum((void *) scalars, (void *) points,
+						2, expect);
+
+			assert(l_ecc_point_multiply(tmp, scalars[2],
+							points[2]));
+			assert(l_ecc_point_add(expect, expect, tmp));
+			check_multiply_sum((void *) scalars, (void *) points,
+						3, expect);
+
+			for (t = 0; t < 3; t++) {
+				l_ecc_scalar_free(scalars[t]);
+				l_ecc_point_free(points[t]);
+			}
+		}
+
+		/*
+		 * Scalars with long runs of one bits exercise the wNAF carry,
+		 * a * P + (n - a) * P is the point at infinity.
+		 */
+		points[0] = random_point(curve);
+		points[1] = l_ecc_point_clone(points[0]);
+
+		memset(c, 0xff, sizeof(c));
+		c[curve->ndigits - 1] = 0x0fffffffffffffffull;
+		scalars[0] = _ecc_constant_new(curve, c, curve->ndigits * 8);
+
+		memcpy(c, curve->n, sizeof(c));
+		_vli_sub(c, c, scalars[0]->c, curve->ndigits);
+		scalars[1] = _ecc_constant_new(curve, c, curve->ndigits * 8);
+
+		memset(expect->x, 0, sizeof(expect->x));
+		memset(expect->y, 0, sizeof(expect->y));
+		check_multiply_sum((void *) scalars, (void *) points, 2,
+					expect);
+
+		/* A single term matches the ladder */
+		assert(l_ecc_point_multiply(expect, scalars[0], points[0]));
+		check_multiply_sum((void *) scalars, (void *) points, 1,
+					expect);
+
+		/* Terms with the point at infinity contribute nothing */
+		l_ecc_point_free(points[1]);
+		points[1] = l_ecc_point_new(curve);
+		check_multiply_sum((void *) scalars, (void *) points, 2,
+					expect);
+
+		for (t = 0; t < 2; t++) {
+			l_ecc_scalar_free(scalars[t]);
+			l_ecc_point_free(points[t]);
+		}
+
+		l_ecc_point_free(expect);
+		l_ecc_point_free(tmp);
+	}
+}
+
+static void run_bench_multiply_sum(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		const struct l_ecc_scalar *scalars[2];
+		const struct l_ecc_point *points[2];
+		struct l_ecc_scalar *a = l_ecc_scalar_new_random(curve);
+		struct l_ecc_scalar *b = l_ecc_scalar_new_random(curve);
+		struct l_ecc_point *p = random_point(curve);
+		struct l_ecc_point *q = random_point(curve);
+		struct l_ecc_point *r = l_ecc_point_new(curve);
+		struct l_ecc_point *tmp = l_ecc_point_new(curve);
+		uint64_t start, ladders, straus, vartime;
+
+		scalars[0] = a;
+		scalars[1] = b;
+		points[0] = p;
+		points[1] = q;
+
+		start = l_time_now();
+
+		for (j = 0; j < 100; j++) {
+			l_ecc_point_multiply(r, a, p);
+			l_ecc_point_multiply(tmp, b, q);
+			l_ecc_point_add(r, r, tmp);
+		}
+
+		ladders = l_time_diff(start, l_time_now());
+		start = l_time_now();
+
+		for (j = 0; j < 100; j++)
+			l_ecc_point_multiply_add(r, a, p, b, q);
+
+		straus = l_time_diff(start, l_time_now());
+		start = l_time_now();
+
+		for (j = 0; j < 100; j++)
+			l_ecc_points_multiply_sum_vartime(r, scalars, points,
+									2);
+
+		vartime = l_time_diff(start, l_time_now());
+
+		printf("%s aP + bQ: two ladders %.0f ops/s, "
+			"interleaved %.0f ops/s, vartime %.0f ops/s\n",
+			l_ecc_curve_get_name(curve),
+			100 * 1000000.0 / (ladders ? ladders : 1),
+			100 * 1000000.0 / (straus ? straus : 1),
+			100 * 1000000.0 / (vartime ? vartime : 1));
+
+		l_ecc_scalar_free(a);
+		l_ecc_scalar_free(b);
+		l_ecc_point_free(p);
+		l_ecc_point_free(q);
+		l_ecc_point_free(r);
+		l_ecc_point_free(tmp);
+	}
+}
+
+static void run_test_points_normalize(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		struct l_ecc_point *batch[17];
+		struct l_ecc_point *expect[17];
+		struct l_ecc_point *base = random_point(curve);
+		struct l_ecc_scalar *zero;
+		uint64_t c[L_ECC_MAX_DIGITS] = { 0 };
+		uint8_t buf[L_ECC_POINT_MAX_BYTES];
+		uint8_t expect_buf[L_ECC_POINT_MAX_BYTES];
+		ssize_t len;
+
+		for (j = 0; j < 16; j++) {
+			struct l_ecc_scalar *s = l_ecc_scalar_new_random(curve);
+
+			batch[j] = l_ecc_point_new(curve);
+			expect[j] = l_ecc_point_new(curve);
+
+			/* Mix ladder and fixed-base results, one affine point */
+			if (j == 5) {
+				assert(l_ecc_point_multiply(batch[j], s, base));
+				assert(l_ecc_point_multiply(expect[j], s,
+								base));
+			} else if (j & 1) {
+				assert(l_ecc_point_multiply_projective(batch[j],
+								s, base));
+				assert(l_ecc_point_multiply(expect[j], s,
+								base));
+			} else {
+				assert(l_ecc_point_multiply_g_projective(
+								batch[j], s));
+				assert(l_ecc_point_multiply_g(expect[j], s));
+			}
+
+			l_ecc_scalar_free(s);
+		}
+
+		/* 0 * G is the point at infinity */
+		zero = _ecc_constant_new(curve, c, curve->ndigits * 8);
+		batch[16] = l_ecc_point_new(curve);
+		expect[16] = l_ecc_point_new(curve);
+		assert(l_ecc_point_multiply_g_projective(batch[16], zero));
+		l_ecc_scalar_free(zero);
+
+		assert(l_ecc_points_normalize(batch, 17));
+
+		for (j = 0; j < 17; j++) {
+			assert(!batch[j]->projective);
+			assert(l_ecc_points_are_equal(batch[j], expect[j]));
+		}
+
+		assert(l_ecc_point_is_infinity(batch[16]));
+
+		/* Unnormalized points are converted on first use */
+		zero = l_ecc_scalar_new_random(curve);
+		assert(l_ecc_point_multiply_projective(batch[0], zero, base));
+		assert(l_ecc_point_multiply(expect[0], zero, base));
+		l_ecc_scalar_free(zero);
+
+		len = l_ecc_point_get_data(batch[0], buf, sizeof(buf));
+		assert(len == (ssize_t) curve->ndigits * 16);
+		assert(l_ecc_point_get_data(expect[0], expect_buf,
+						sizeof(expect_buf)) == len);
+		assert(!memcmp(buf, expect_buf, len));
+
+		for (j = 0; j < 17; j++) {
+			l_ecc_point_free(batch[j]);
+			l_ecc_point_free(expect[j]);
+		}
+
+		l_ecc_point_free(base);
+	}
+}
+
+static void run_bench_points_normalize(const void *arg)
+{
+	const unsigned int *groups = l_ecc_supported_ike_groups();
+	unsigned int i, j;
+
+	for (i = 0; groups[i]; i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_ike_group(groups[i]);
+		struct l_ecc_scalar *s = l_ecc_scalar_new_random(curve);
+		struct l_ecc_point *base = random_point(curve);
+		struct l_ecc_point *points[64];
+		uint64_t start, single, batch;
+
+		for (j = 0; j < 64; j++) {
+			points[j] = l_ecc_point_new(curve);
+			l_ecc_point_multiply_projective(points[j], s, base);
+		}
+
+		start = l_time_now();
+
+		for (j = 0; j < 64; j++)
+			l_ecc_points_normalize(&points[j], 1);
+
+		single = l_time_diff(start, l_time_now());
+
+		for (j = 0; j < 64; j++)
+			l_ecc_point_multiply_projective(points[j], s, base);
+
+		start = l_time_now();
+		l_ecc_points_normalize(points, 64);
+		batch = l_time_diff(start, l_time_now());
+
+		printf("%s normalize 64 points: one by one %llu us, "
+			"batched %llu us\n",
+			l_ecc_curve_get_name(curve),
+			(unsigned long long) single,
+			(unsigned long long) batch);
+
+		for (j = 0; j < 64; j++)
+			l_ecc_point_free(points[j]);
+
+		l_ecc_point_free(base);
+		l_ecc_scalar_free(s);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -433,6 +944,18 @@ int main(int argc, char *argv[])
 	l_test_add("ECC reduce test", run_test_reduce, NULL);
 	l_test_add("ECC zero or one test", run_test_zero_or_one, NULL);
 	l_test_add("ECC compressed points", run_test_compressed_points, NULL);
+	l_test_add("ECC field operations", run_test_field_ops, NULL);
+	l_test_add("ECC vli compare, add and sub", run_test_vli_cmp_add_sub,
+			NULL);
+	l_test_add("ECC point mult G", run_test_point_mult_g, NULL);
+	l_test_add_benchmark("ECC point mult G benchmark",
+				run_bench_point_mult_g, NULL);
+	l_test_add("ECC multi-scalar mult", run_test_multiply_sum, NULL);
+	l_test_add_benchmark("ECC multi-scalar mult benchmark",
+				run_bench_multiply_sum, NULL);
+	l_test_add("ECC batch normalize", run_test_points_normalize, NULL);
+	l_test_add_benchmark("ECC batch normalize benchmark",
+				run_bench_points_normalize, NULL);
 
 	return l_test_run();
 }
@@ -9,6 +9,7 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <ell/ell.h>
@@ -200,15 +201,292 @@ static void test_vector_p384(const void *data)
 	l_ecc_scalar_free(b_shared);
 }
 
+static void hex32(uint8_t *out, const char *str)
+{
+	size_t len;
+	uint8_t *buf = l_util_from_hexstring(str, &len);
+
+	assert(buf && len == 32);
+	memcpy(out, buf, 32);
+	l_free(buf);
+}
+
+static void x25519(const struct l_ecc_curve *curve, uint8_t *out,
+			const uint8_t *k, const uint8_t *u)
+{
+	struct l_ecc_scalar *scalar = l_ecc_scalar_new(curve, k, 32);
+	struct l_ecc_point *point = l_ecc_point_from_data(curve,
+							L_ECC_POINT_TYPE_FULL,
+							u, 32);
+	struct l_ecc_point *result = l_ecc_point_new(curve);
+
+	assert(scalar && point);
+	assert(l_ecc_point_multiply(result, scalar, point));
+	assert(l_ecc_point_get_data(result, out, 32) == 32);
+
+	l_ecc_scalar_free(scalar);
+	l_ecc_point_free(point);
+	l_ecc_point_free(result);
+}
+
+struct x25519_vector {
+	const char *scalar;
+	const char *u;
+	const char *result;
+};
+
+/* RFC 7748, Section 5.2 */
+static const struct x25519_vector x25519_vectors[] = {
+	{
+		"a546e36bf0527c9d3b16154b82465edd"
+		"62144c0ac1fc5a18506a2244ba449ac4",
+		"e6db6867583030db3594c1a424b15f7c"
+		"726624ec26b3353b10a903a6d0ab1c4c",
+		"c3da55379de9c6908e94ea4df28d084f"
+		"32eccf03491c71f754b4075577a28552",
+	},
+	{
+		"4b66e9d4d1b4673c5ad22691957d6af5"
+		"c11b6421e0ea01d42ca4169e7918ba0d",
+		"e5210f12786811d3f4b7959d0538ae2c"
+		"31dbe7106fc03c3efc4cd549c715a493",
+		"95cbde9476e8907d7aade45cb4b873f8"
+		"8b595a68799fa152e6f8f7647aac7957",
+	},
+};
+
+static void test_x25519(const void *data)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_name("x25519");
+	uint8_t k[32] = { 9 };
+	uint8_t u[32] = { 9 };
+	uint8_t scalar[32];
+	uint8_t point[32];
+	uint8_t expect[32];
+	uint8_t out[32];
+	unsigned int i;
+
+	assert(curve);
+	assert(l_ecc_curve_from_tls_group(29) == curve);
+	assert(l_ecc_curve_get_ike_group(curve) == 0);
+
+	for (i = 0; i < L_ARRAY_SIZE(x25519_vectors); i++) {
+		hex32(scalar, x25519_vectors[i].scalar);
+		hex32(point, x25519_vectors[i].u);
+		hex32(expect, x25519_vectors[i].result);
+
+		x25519(curve, out, scalar, point);
+		assert(!memcmp(out, expect, 32));
+	}
+
+	/* RFC 7748, Section 5.2, iterated k = X25519(k, u), u = old k */
+	for (i = 0; i < 1000; i++) {
+		x25519(curve, out, k, u);
+		memcpy(u, k, 32);
+		memcpy(k, out, 32);
+
+		if (i)
+			continue;
+
+		hex32(expect, "422c8e7a6227d7bca1350b3e2bb7279f"
+				"7897b87bb6854b783c60e80311ae3079");
+		assert(!memcmp(k, expect, 32));
+	}
+
+	hex32(expect, "684cf59ba83309552800ef566f2f4d3c"
+			"1c3887c49360e3875f2eb94d99532c51");
+	assert(!memcmp(k, expect, 32));
+}
+
+/* RFC 7748, Section 6.1 */
+static void test_vector_x25519(const void *data)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_name("x25519");
+	uint8_t a_priv[32];
+	uint8_t a_pub[32];
+	uint8_t b_priv[32];
+	uint8_t b_pub[32];
+	uint8_t shared[32];
+	uint8_t buf[32] = {};
+	struct l_ecc_scalar *a_secret;
+	struct l_ecc_scalar *b_secret;
+	struct l_ecc_point *a_public = l_ecc_point_new(curve);
+	struct l_ecc_point *b_public = l_ecc_point_new(curve);
+	struct l_ecc_point *zero;
+	struct l_ecc_scalar *a_shared;
+	struct l_ecc_scalar *b_shared;
+
+	hex32(a_priv, "77076d0a7318a57d3c16c17251b26645"
+			"df4c2f87ebc0992ab177fba51db92c2a");
+	hex32(a_pub, "8520f0098930a754748b7ddcb43ef75a"
+			"0dbf3a0d26381af4eba4a98eaa9b4e6a");
+	hex32(b_priv, "5dab087e624a8a4b79e17f8b83800ee6"
+			"6f3bb1292618b6fd1c2f8b27ff88e0eb");
+	hex32(b_pub, "de9edb7d7b7dc1b4d35b61c2ece43537"
+			"3f8343c85b78674dadfc7e146f882b4f");
+	hex32(shared, "4a5d9d5ba4ce2de1728e3bf480350f25"
+			"e07e21c947d19e3376f09b3c1e161742");
+
+	a_secret = l_ecc_scalar_new(curve, a_priv, 32);
+	b_secret = l_ecc_scalar_new(curve, b_priv, 32);
+
+	assert(l_ecc_point_multiply_g(a_public, a_secret));
+	assert(l_ecc_point_get_data(a_public, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, a_pub, 32));
+
+	assert(l_ecc_point_multiply_g(b_public, b_secret));
+	assert(l_ecc_point_get_data(b_public, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, b_pub, 32));
+
+	assert(l_ecdh_generate_shared_secret(a_secret, b_public, &a_shared));
+	assert(l_ecdh_generate_shared_secret(b_secret, a_public, &b_shared));
+
+	assert(l_ecc_scalar_get_data(a_shared, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, shared, 32));
+	assert(l_ecc_scalar_get_data(b_shared, buf, sizeof(buf)) == 32);
+	assert(!memcmp(buf, shared, 32));
+
+	/* A small order public value must be rejected */
+	memset(buf, 0, sizeof(buf));
+	zero = l_ecc_point_from_data(curve, L_ECC_POINT_TYPE_FULL, buf, 32);
+	assert(zero);
+	assert(!l_ecdh_generate_shared_secret(a_secret, zero, &a_shared));
+	l_ecc_point_free(zero);
+
+	l_ecc_scalar_free(a_secret);
+	l_ecc_scalar_free(b_secret);
+	l_ecc_point_free(a_public);
+	l_ecc_point_free(b_public);
+	l_ecc_scalar_free(a_shared);
+	l_ecc_scalar_free(b_shared);
+}
+
+/*
+ * Peer points that are still in projective form, as produced by
+ * l_ecc_point_multiply_g_projective and l_ecc_point_add, must give the same
+ * shared secret as their affine form and must not be modified.
+ */
+static void test_projective(const void *data)
+{
+	const struct l_ecc_curve *curve = l_ecc_curve_from_ike_group(19);
+	struct l_ecc_scalar *private1;
+	struct l_ecc_scalar *private2;
+	struct l_ecc_point *public1;
+	struct l_ecc_point *public2;
+	struct l_ecc_point *projective;
+	struct l_ecc_point *sum;
+	struct l_ecc_point *affine;
+	struct l_ecc_scalar *secret1;
+	struct l_ecc_scalar *secret2;
+	uint8_t buf[64];
+
+	assert(l_ecdh_generate_key_pair(curve, &private1, &public1));
+	assert(l_ecdh_generate_key_pair(curve, &private2, &public2));
+
+	projective = l_ecc_point_new(curve);
+	assert(l_ecc_point_multiply_g_projective(projective, private2));
+	assert(projective->projective);
+
+	assert(l_ecdh_generate_shared_secret(private1, public2, &secret1));
+	assert(l_ecdh_generate_shared_secret(private1, projective, &secret2));
+	assert(!memcmp(secret1->c, secret2->c, 32));
+	assert(projective->projective);
+	l_ecc_scalar_free(secret1);
+	l_ecc_scalar_free(secret2);
+
+	/* Feed the result of a point addition on a projective input */
+	sum = l_ecc_point_new(curve);
+	assert(l_ecc_point_add(sum, projective, public1));
+	assert(projective->projective);
+
+	assert(l_ecc_point_get_data(sum, buf, sizeof(buf)) == 64);
+	affine = l_ecc_point_from_data(curve, L_ECC_POINT_TYPE_FULL,
+							buf, sizeof(buf));
+	assert(affine);
+
+	assert(l_ecdh_generate_shared_secret(private1, sum, &secret1));
+	assert(l_ecdh_generate_shared_secret(private1, affine, &secret2));
+	assert(!memcmp(secret1->c, secret2->c, 32));
+	l_ecc_scalar_free(secret1);
+	l_ecc_scalar_free(secret2);
+
+	l_ecc_point_free(affine);
+	l_ecc_point_free(sum);
+	l_ecc_point_free(projective);
+	l_ecc_scalar_free(private1);
+	l_ecc_scalar_free(private2);
+	l_ecc_point_free(public1);
+	l_ecc_point_free(public2);
+}
+
+static void bench_ecdh(const void *data)
+{
+	static const char *names[] = { "secp256r1", "x25519" };
+	unsigned int i, j;
+
+	for (i = 0; i < L_ARRAY_SIZE(names); i++) {
+		const struct l_ecc_curve *curve =
+					l_ecc_curve_from_name(names[i]);
+		struct l_ecc_scalar *private;
+		struct l_ecc_point *public;
+		struct l_ecc_scalar *other_private;
+		struct l_ecc_point *other_public;
+		struct l_ecc_scalar *secret;
+		uint64_t start, keygen, shared;
+
+		assert(l_ecdh_generate_key_pair(curve, &other_private,
+							&other_public));
+
+		start = l_time_now();
+
+		for (j = 0; j < 200; j++) {
+			assert(l_ecdh_generate_key_pair(curve, &private,
+								&public));
+			l_ecc_scalar_free(private);
+			l_ecc_point_free(public);
+		}
+
+		keygen = l_time_diff(start, l_time_now());
+		start = l_time_now();
+
+		for (j = 0; j < 200; j++) {
+			assert(l_ecdh_generate_shared_secret(other_private,
+							other_public, &secret));
+			l_ecc_scalar_free(secret);
+		}
+
+		shared = l_time_diff(start, l_time_now());
+
+		printf("%s: keygen %.0f ops/s, shared secret %.0f ops/s\n",
+			names[i], 200 * 1000000.0 / (keygen ? keygen : 1),
+			200 * 1000000.0 / (shared ? shared : 1));
+
+		l_ecc_scalar_free(other_private);
+		l_ecc_point_free(other_public);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
 
-	if (l_getrandom_is_supported())
+	if (l_getrandom_is_supported()) {
 		l_test_add("ECDH Basic", test_basic, NULL);
+		l_test_add("ECDH projective peer point", test_projective,
+									NULL);
+	}
 
 	l_test_add("ECDH test vector P256", test_vector_p256, NULL);
 	l_test_add("ECDH test vector P384", test_vector_p384, NULL);
 
+	if (l_ecc_curve_from_name("x25519")) {
+		l_test_add("X25519 RFC 7748 vectors", test_x25519, NULL);
+		l_test_add("ECDH test vector X25519", test_vector_x25519, NULL);
+
+		if (l_getrandom_is_supported())
+			l_test_add_benchmark("ECDH benchmark", bench_ecdh,
+								NULL);
+	}
+
 	return l_test_run();
 }
@@ -1497,6 +1497,32 @@ static void test_builder_fixed_array_1(const void *test_data)
 	FINISH_AND_CHECK_BUILT_RESULT();
 }
 
+static void test_builder_fixed_array_2(const void *test_data)
+{
+	const struct parser_data *test = test_data;
+	static const uint32_t u[] = { 20, 22 };
+	struct dbus_builder *builder;
+	bool ret;
+	BUILDER_TEST_HEADER();
+
+	builder = _gvariant_builder_new(NULL, 0);
+	assert(builder);
+
+	ret = _gvariant_builder_enter_array(builder, "u");
+	assert(ret);
+
+	ret = _gvariant_builder_append_fixed_array(builder, 'y', u, 2);
+	assert(!ret);
+
+	ret = _gvariant_builder_append_fixed_array(builder, 'u', u, 2);
+	assert(ret);
+
+	ret = _gvariant_builder_leave_array(builder);
+	assert(ret);
+
+	FINISH_AND_CHECK_BUILT_RESULT();
+}
+
 static void test_builder_dict_1(const void *test_data)
 {
 	const struct parser_data *test = test_data;
@@ -1922,6 +1948,8 @@ int main(int argc, char *argv[])
 
 	l_test_add("Builder Test Fixed Array 'au'", test_builder_fixed_array_1,
 					&fixed_array_1);
+	l_test_add("Builder Test Fixed Array 'au' (bulk)",
+				test_builder_fixed_array_2, &fixed_array_1);
 	l_test_add("Builder Test Fixed Dict 'a{ub}'", test_builder_dict_1,
 					&dict_1);
 	l_test_add("Builder Test Variable Array 'as'",
@@ -10,6 +10,7 @@
 #endif
 
 #include <assert.h>
+#include <stdio.h>
 
 #include <ell/ell.h>
 
@@ -352,6 +353,211 @@ static void test_dh(const void *data)
 	l_free(buffer);
 }
 
+static void test_dh_software(const void *data)
+{
+	l_key_set_dh_engine(L_KEY_DH_ENGINE_SOFTWARE);
+	test_dh(&dh_valid1);
+	test_dh(&dh_valid2);
+	test_dh(&dh_degenerate);
+
+	l_key_set_dh_generator_tables(true);
+	test_dh(&dh_valid1);
+	test_dh(&dh_valid2);
+	test_dh(&dh_degenerate);
+	l_key_set_dh_generator_tables(false);
+
+	l_key_set_dh_engine(L_KEY_DH_ENGINE_AUTO);
+}
+
+static const struct tls_named_group *dh_group(unsigned int i)
+{
+	const struct tls_named_group *group = tls_find_group(256 + i);
+
+	assert(group && group->type == TLS_GROUP_TYPE_FF);
+	return group;
+}
+
+static void dh_public(struct l_key *generator, struct l_key *private,
+			struct l_key *prime, size_t prime_len, uint8_t *out)
+{
+	size_t len = prime_len;
+
+	assert(l_key_compute_dh_public(generator, private, prime, out, &len));
+	assert(len == prime_len);
+}
+
+static void test_dh_engines(const void *data)
+{
+	bool kernel;
+	unsigned int i;
+
+	l_key_set_dh_engine(L_KEY_DH_ENGINE_KERNEL);
+	kernel = l_key_is_supported(L_KEY_FEATURE_DH);
+
+	/* ffdhe2048, ffdhe3072 and ffdhe4096 */
+	for (i = 0; i < 3; i++) {
+		const struct tls_named_group *group = dh_group(i);
+		size_t len = group->ff.prime_len;
+		uint8_t g = group->ff.generator;
+		struct l_key *prime = l_key_new(L_KEY_RAW, group->ff.prime,
+						len);
+		struct l_key *generator = l_key_new(L_KEY_RAW, &g, 1);
+		struct l_key *priv1 = l_key_generate_dh_private(
+							group->ff.prime, len);
+		struct l_key *priv2 = l_key_generate_dh_private(
+							group->ff.prime, len);
+		struct l_key *pub1;
+		uint8_t out1[len], out2[len], secret[len];
+		size_t secret_len;
+
+		assert(prime && generator && priv1 && priv2);
+
+		l_key_set_dh_engine(L_KEY_DH_ENGINE_SOFTWARE);
+		dh_public(generator, priv1, prime, len, out1);
+
+		l_key_set_dh_generator_tables(true);
+		dh_public(generator, priv1, prime, len, out2);
+		assert(!memcmp(out1, out2, len));
+		l_key_set_dh_generator_tables(false);
+
+		if (kernel) {
+			l_key_set_dh_engine(L_KEY_DH_ENGINE_KERNEL);
+			dh_public(generator, priv1, prime, len, out2);
+			assert(!memcmp(out1, out2, len));
+		}
+
+		/* g^(x1 * x2) both ways */
+		l_key_set_dh_engine(L_KEY_DH_ENGINE_SOFTWARE);
+		pub1 = l_key_new(L_KEY_RAW, out1, len);
+		assert(pub1);
+		dh_public(generator, priv2, prime, len, out2);
+		secret_len = len;
+		assert(l_key_compute_dh_secret(pub1, priv2, prime, secret,
+						&secret_len));
+		assert(secret_len == len);
+		l_key_free(pub1);
+
+		pub1 = l_key_new(L_KEY_RAW, out2, len);
+		assert(pub1);
+		secret_len = len;
+		assert(l_key_compute_dh_secret(pub1, priv1, prime, out1,
+						&secret_len));
+		assert(!memcmp(out1, secret, len));
+		l_key_free(pub1);
+
+		l_key_free(prime);
+		l_key_free(generator);
+		l_key_free(priv1);
+		l_key_free(priv2);
+	}
+
+	l_key_set_dh_engine(L_KEY_DH_ENGINE_AUTO);
+}
+
+static uint64_t bench_dh_run(struct l_key *generator, struct l_key *private,
+				struct l_key *prime, size_t len,
+				unsigned int n)
+{
+	uint8_t out[len];
+	uint64_t start = l_time_now();
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		dh_public(generator, private, prime, len, out);
+
+	return l_time_diff(start, l_time_now());
+}
+
+/* A fresh private key per operation, as in a TLS handshake */
+static uint64_t bench_dh_ephemeral_run(struct l_key *generator,
+					struct l_key *prime,
+					const uint8_t *prime_buf, size_t len,
+					unsigned int n)
+{
+	uint8_t out[len];
+	uint64_t start = l_time_now();
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct l_key *private = l_key_generate_dh_private(prime_buf,
+									len);
+
+		dh_public(generator, private, prime, len, out);
+		l_key_free(private);
+	}
+
+	return l_time_diff(start, l_time_now());
+}
+
+static void bench_dh(const void *data)
+{
+	bool kernel;
+	unsigned int i;
+
+	l_key_set_dh_engine(L_KEY_DH_ENGINE_KERNEL);
+	kernel = l_key_is_supported(L_KEY_FEATURE_DH);
+
+	for (i = 0; i < 3; i++) {
+		const struct tls_named_group *group = dh_group(i);
+		size_t len = group->ff.prime_len;
+		uint8_t g = group->ff.generator;
+		struct l_key *prime = l_key_new(L_KEY_RAW, group->ff.prime,
+						len);
+		struct l_key *generator = l_key_new(L_KEY_RAW, &g, 1);
+		struct l_key *private = l_key_generate_dh_private(
+							group->ff.prime, len);
+		unsigned int n = 20;
+		uint64_t keyctl = 0, keyctl_eph = 0, window, window_eph, comb;
+
+		if (kernel) {
+			l_key_set_dh_engine(L_KEY_DH_ENGINE_KERNEL);
+			keyctl = bench_dh_run(generator, private, prime,
+						len, n);
+			keyctl_eph = bench_dh_ephemeral_run(generator, prime,
+							group->ff.prime,
+							len, n);
+		}
+
+		l_key_set_dh_engine(L_KEY_DH_ENGINE_SOFTWARE);
+		window = bench_dh_run(generator, private, prime, len, n);
+		window_eph = bench_dh_ephemeral_run(generator, prime,
+							group->ff.prime,
+							len, n);
+
+		/* Build the table outside of the measurement */
+		l_key_set_dh_generator_tables(true);
+		bench_dh_run(generator, private, prime, len, 1);
+		comb = bench_dh_run(generator, private, prime, len, n);
+		l_key_set_dh_generator_tables(false);
+
+		if (kernel)
+			printf("%s: keyctl %.0f ops/s, ", group->name,
+				n * 1000000.0 / (keyctl ? keyctl : 1));
+		else
+			printf("%s: keyctl n/a, ", group->name);
+
+		printf("window %.0f ops/s, generator table %.0f ops/s\n",
+			n * 1000000.0 / (window ? window : 1),
+			n * 1000000.0 / (comb ? comb : 1));
+
+		if (kernel)
+			printf("%s ephemeral: keyctl %.0f ops/s, ",
+				group->name,
+				n * 1000000.0 / (keyctl_eph ? keyctl_eph : 1));
+		else
+			printf("%s ephemeral: keyctl n/a, ", group->name);
+
+		printf("window %.0f ops/s\n",
+			n * 1000000.0 / (window_eph ? window_eph : 1));
+
+		l_key_free(prime);
+		l_key_free(generator);
+		l_key_free(private);
+	}
+
+	l_key_set_dh_engine(L_KEY_DH_ENGINE_AUTO);
+}
+
 static void test_simple_keyring(const void *data)
 {
 	struct l_keyring *ring;
@@ -660,6 +866,10 @@ int main(int argc, char *argv[])
 		l_test_add("Diffie-Hellman 3", test_dh, &dh_degenerate);
 	}
 
+	l_test_add("Diffie-Hellman software", test_dh_software, NULL);
+	l_test_add("Diffie-Hellman engines", test_dh_engines, NULL);
+	l_test_add_benchmark("Diffie-Hellman benchmark", bench_dh, NULL);
+
 	l_test_add("simple keyring", test_simple_keyring, NULL);
 
 	if (l_key_is_supported(L_KEY_FEATURE_RESTRICT)) {
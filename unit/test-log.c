@@ -0,0 +1,500 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <ell/ell.h>
+
+#include "ell/log-private.h"
+
+static char sock_path[64];
+
+static int create_socket(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	snprintf(sock_path, sizeof(sock_path), "/tmp/ell-test-log-%d",
+								getpid());
+	unlink(sock_path);
+
+	fd = socket(PF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	assert(fd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sock_path);
+	assert(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+
+	return fd;
+}
+
+static int create_log_socket(void)
+{
+	int fd = create_socket();
+
+	log_open_syslog(sock_path);
+
+	return fd;
+}
+
+static void destroy_log_socket(int fd)
+{
+	l_log_set_null();
+	close(fd);
+	unlink(sock_path);
+}
+
+static ssize_t recv_line(int fd, char *buf, size_t len)
+{
+	ssize_t r = recv(fd, buf, len - 1, MSG_DONTWAIT);
+
+	if (r >= 0)
+		buf[r] = '\0';
+
+	return r;
+}
+
+/*
+ * Runs the main loop until @count messages have been read.  Each
+ * iteration waits for the next event, so this only gives up if nothing
+ * happens for a whole second.
+ */
+static unsigned int recv_async(int fd, unsigned int count, char lines[][256])
+{
+	unsigned int n = 0;
+	unsigned int i;
+
+	for (i = 0; i < 10 && n < count; i++) {
+		unsigned int before = n;
+
+		l_main_iterate(100);
+
+		while (n < count && recv_line(fd, lines[n], 256) > 0)
+			n++;
+
+		if (n > before)
+			i = 0;
+	}
+
+	return n;
+}
+
+/*
+ * Fills the receive queue of the log socket from another socket, however
+ * long the queue is, so that the next send from the log gets EAGAIN.
+ */
+static unsigned int fill_log_socket(void)
+{
+	struct sockaddr_un addr;
+	unsigned int n = 0;
+	int fd;
+
+	fd = socket(PF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	assert(fd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sock_path);
+	assert(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+
+	while (send(fd, "filler", 6, MSG_DONTWAIT) == 6)
+		n++;
+
+	assert(errno == EAGAIN);
+	close(fd);
+
+	return n;
+}
+
+static void test_sync(const void *data)
+{
+	int fd = create_log_socket();
+	char buf[256];
+
+	l_log(L_LOG_INFO, "sync message %d", 1);
+	assert(recv_line(fd, buf, sizeof(buf)) > 0);
+	assert(!strncmp(buf, "<6>", 3));
+	assert(strstr(buf, "sync message 1\n"));
+
+	destroy_log_socket(fd);
+}
+
+static void test_async(const void *data)
+{
+	char lines[20][256];
+	char buf[256];
+	unsigned int filler;
+	unsigned int i;
+	int fd;
+
+	assert(l_main_init());
+
+	fd = create_log_socket();
+	l_log_set_async(4096);
+	filler = fill_log_socket();
+
+	for (i = 0; i < 20; i++)
+		l_log(L_LOG_INFO, "async message %u", i);
+
+	/* The idle flush finds the queue full and waits for EPOLLOUT */
+	for (i = 0; i < 4; i++)
+		l_main_iterate(0);
+
+	for (i = 0; i < filler; i++) {
+		assert(recv_line(fd, buf, sizeof(buf)) == 6);
+		assert(!strcmp(buf, "filler"));
+	}
+
+	assert(recv_line(fd, buf, sizeof(buf)) < 0);
+	assert(recv_async(fd, 20, lines) == 20);
+
+	for (i = 0; i < 20; i++) {
+		snprintf(buf, sizeof(buf), "async message %u\n", i);
+		assert(strstr(lines[i], buf));
+	}
+
+	/* Disabling sends out what is still queued */
+	l_log(L_LOG_INFO, "last message");
+	l_log_set_async(0);
+	assert(recv_line(fd, buf, sizeof(buf)) > 0);
+	assert(strstr(buf, "last message\n"));
+
+	destroy_log_socket(fd);
+	assert(l_main_exit());
+}
+
+/* Makes a few messages fill the smallest buffer */
+static char pad[121];
+
+static void log_overflow(unsigned int count)
+{
+	unsigned int i;
+
+	memset(pad, 'x', sizeof(pad) - 1);
+
+	for (i = 0; i < count; i++)
+		l_log(L_LOG_INFO, "%s overflow message %u", pad, i);
+}
+
+static void test_overflow(const void *data)
+{
+	unsigned long dropped = l_log_get_dropped();
+	char lines[20][256];
+	char buf[256];
+	unsigned int n;
+	int fd;
+
+	assert(l_main_init());
+
+	fd = create_log_socket();
+	l_log_set_async(1024);
+	log_overflow(20);
+
+	dropped = l_log_get_dropped() - dropped;
+	assert(dropped > 0 && dropped < 20);
+
+	n = 20 - dropped + 1;
+	assert(recv_async(fd, n, lines) == n);
+	assert(strstr(lines[0], "overflow message 0\n"));
+	assert(strstr(lines[n - 1], "log messages dropped\n"));
+	assert(recv_line(fd, buf, sizeof(buf)) < 0);
+
+	l_log_set_async(0);
+	destroy_log_socket(fd);
+	assert(l_main_exit());
+}
+
+static void test_overflow_close(const void *data)
+{
+	unsigned long dropped = l_log_get_dropped();
+	char buf[256];
+	unsigned int n = 0;
+	int fd;
+
+	assert(l_main_init());
+
+	fd = create_log_socket();
+	l_log_set_async(1024);
+	log_overflow(8);
+
+	dropped = l_log_get_dropped() - dropped;
+	assert(dropped > 0 && dropped < 8);
+
+	/* Closing flushes, the warning still goes to the socket */
+	l_log_set_null();
+
+	while (recv_line(fd, buf, sizeof(buf)) > 0)
+		n++;
+
+	assert(n == 8 - dropped + 1);
+	assert(strstr(buf, "log messages dropped\n"));
+
+	l_log_set_async(0);
+	close(fd);
+	unlink(sock_path);
+	assert(l_main_exit());
+}
+
+static void test_small_buffer(const void *data)
+{
+	unsigned long dropped = l_log_get_dropped();
+	char buf[256];
+	int fd;
+
+	fd = create_log_socket();
+
+	/* Enlarged to hold a message, sent right away without a main loop */
+	l_log_set_async(16);
+	l_log(L_LOG_INFO, "small buffer");
+	assert(recv_line(fd, buf, sizeof(buf)) > 0);
+	assert(strstr(buf, "small buffer\n"));
+	assert(l_log_get_dropped() == dropped);
+
+	/* Nothing can be delivered, the warning is tried once per flush */
+	close(fd);
+	unlink(sock_path);
+	l_log(L_LOG_INFO, "undeliverable");
+	assert(l_log_get_dropped() == dropped + 2);
+	l_log_flush();
+	assert(l_log_get_dropped() == dropped + 3);
+
+	l_log_set_async(0);
+	l_log_set_null();
+}
+
+static void log_limited(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 10; i++)
+		l_log(L_LOG_INFO, "limited message %u", i);
+}
+
+static uint64_t fake_now;
+
+static uint64_t fake_clock(void)
+{
+	return fake_now;
+}
+
+static void test_rate_limit(const void *data)
+{
+	int fd = create_log_socket();
+	char expected[32];
+	char buf[256];
+	unsigned int i;
+
+	fake_now = 1000000;
+	log_set_clock(fake_clock);
+	l_log_set_rate_limit(3, 100);
+
+	log_limited();
+	l_log(L_LOG_INFO, "other call site");
+
+	for (i = 0; i < 3; i++) {
+		assert(recv_line(fd, buf, sizeof(buf)) > 0);
+		assert(strstr(buf, "limited message"));
+	}
+
+	assert(recv_line(fd, buf, sizeof(buf)) > 0);
+	assert(strstr(buf, "other call site\n"));
+	assert(recv_line(fd, buf, sizeof(buf)) < 0);
+
+	/* Still within the interval */
+	fake_now += 99 * 1000;
+	log_limited();
+	assert(recv_line(fd, buf, sizeof(buf)) < 0);
+
+	fake_now += 1000;
+	log_limited();
+
+	assert(recv_line(fd, buf, sizeof(buf)) > 0);
+	assert(strstr(buf, ": 17 log messages suppressed\n"));
+
+	for (i = 0; i < 3; i++) {
+		snprintf(expected, sizeof(expected), "limited message %u\n", i);
+		assert(recv_line(fd, buf, sizeof(buf)) > 0);
+		assert(strstr(buf, expected));
+	}
+
+	assert(recv_line(fd, buf, sizeof(buf)) < 0);
+
+	l_log_set_rate_limit(0, 0);
+	log_set_clock(NULL);
+	destroy_log_socket(fd);
+}
+
+static void test_journal(const void *data)
+{
+	int fd = create_socket();
+	const char *line;
+	char buf[4096];
+	char *str;
+
+	log_open_journal(sock_path);
+	l_debug_enable("*test_journal");
+
+	l_debug("journal message %d", 1);
+	assert(recv_line(fd, buf, sizeof(buf)) > 0);
+	assert(!strncmp(buf, "MESSAGE=", 8));
+	assert(strstr(buf, "test_journal() journal message 1\nPRIORITY=7\n"));
+	assert(strstr(buf, "\nCODE_FILE=" __FILE__ "\n"));
+	assert(strstr(buf, "\nCODE_FUNC=test_journal\n"));
+
+	l_debug_disable();
+
+	/* Longer than the preallocated line */
+	str = l_malloc(2001);
+	memset(str, 'x', 2000);
+	str[2000] = '\0';
+
+	/* Logged from the same line that CODE_LINE is taken from */
+	line = (l_warn("%s", str), "CODE_LINE=" L_STRINGIFY(__LINE__) "\n");
+	assert(recv_line(fd, buf, sizeof(buf)) == (ssize_t) (8 + 2001 + 11 +
+				strlen("CODE_FILE=" __FILE__ "\n") +
+				strlen(line) +
+				strlen("CODE_FUNC=test_journal\n")));
+	assert(!strncmp(buf + 8, str, 2000));
+	assert(strstr(buf, "\nPRIORITY=4\n"));
+	assert(strstr(buf, line));
+
+	l_free(str);
+	destroy_log_socket(fd);
+}
+
+#define BENCH_MESSAGES	50000
+
+static void bench_format(const void *data)
+{
+	uint64_t start;
+	unsigned int i;
+	char buf[512];
+	pid_t pid;
+	int fd;
+	int status;
+
+	assert(l_main_init());
+	fd = create_socket();
+	log_open_journal(sock_path);
+
+	pid = fork();
+	assert(pid >= 0);
+
+	if (!pid) {
+		while (recv(fd, buf, sizeof(buf), 0) >= 0)
+			;
+
+		_exit(0);
+	}
+
+	/* Only time the formatting, the messages are sent afterwards */
+	l_log_set_async(BENCH_MESSAGES * 256);
+	start = l_time_now();
+
+	for (i = 0; i < BENCH_MESSAGES; i++)
+		l_info("benchmark message %u of %u from %s", i,
+						BENCH_MESSAGES, "bench");
+
+	printf("%u journal messages formatted: %.0f msg/s\n",
+			BENCH_MESSAGES,
+			BENCH_MESSAGES * 1000000.0 / (l_time_now() - start));
+
+	l_log_set_async(0);
+	kill(pid, SIGTERM);
+	assert(waitpid(pid, &status, 0) == pid);
+
+	destroy_log_socket(fd);
+	assert(l_main_exit());
+}
+
+static double bench_run(bool async)
+{
+	uint64_t start;
+	unsigned int i;
+
+	start = l_time_now();
+
+	for (i = 0; i < BENCH_MESSAGES; i++) {
+		l_log(L_LOG_INFO, "benchmark message %u of %u", i,
+							BENCH_MESSAGES);
+
+		if (async && !(i % 64))
+			l_main_iterate(0);
+	}
+
+	l_log_flush();
+
+	return BENCH_MESSAGES * 1000000.0 / (l_time_now() - start);
+}
+
+static void bench_async(const void *data)
+{
+	double sync_rate, async_rate;
+	char buf[256];
+	pid_t pid;
+	int fd;
+	int status;
+
+	assert(l_main_init());
+	fd = create_log_socket();
+
+	pid = fork();
+	assert(pid >= 0);
+
+	if (!pid) {
+		while (recv(fd, buf, sizeof(buf), 0) >= 0)
+			;
+
+		_exit(0);
+	}
+
+	sync_rate = bench_run(false);
+
+	l_log_set_async(64 * 1024);
+	async_rate = bench_run(true);
+	l_log_set_async(0);
+
+	printf("%u messages: sync %.0f msg/s, async %.0f msg/s\n",
+			BENCH_MESSAGES, sync_rate, async_rate);
+
+	kill(pid, SIGTERM);
+	assert(waitpid(pid, &status, 0) == pid);
+
+	destroy_log_socket(fd);
+	assert(l_main_exit());
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Sync", test_sync, NULL);
+	l_test_add("Async", test_async, NULL);
+	l_test_add("Overflow", test_overflow, NULL);
+	l_test_add("Overflow on close", test_overflow_close, NULL);
+	l_test_add("Small buffer", test_small_buffer, NULL);
+	l_test_add("Rate limit", test_rate_limit, NULL);
+	l_test_add("Journal", test_journal, NULL);
+	l_test_add_benchmark("Benchmark", bench_async, NULL);
+	l_test_add_benchmark("Format benchmark", bench_format, NULL);
+
+	return l_test_run();
+}
@@ -0,0 +1,471 @@
+/*
+ * Embedded Linux library
+ * Copyright (C) 2026  The ell authors
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/genetlink.h>
+
+#include <ell/ell.h>
+
+#include "ell/pcap-private.h"
+
+static char pcap_path[64];
+
+static struct l_pcap *create_pcap(enum l_pcap_link link)
+{
+	struct l_pcap *pcap;
+
+	snprintf(pcap_path, sizeof(pcap_path), "/tmp/ell-test-pcap-%d",
+								getpid());
+
+	pcap = l_pcap_new(pcap_path, link);
+	assert(pcap);
+
+	return pcap;
+}
+
+static uint8_t *read_pcap(size_t *len)
+{
+	uint8_t *buf;
+
+	buf = l_file_get_contents(pcap_path, len);
+	assert(buf);
+	unlink(pcap_path);
+
+	return buf;
+}
+
+static const uint8_t *check_global_header(const uint8_t *buf,
+							uint32_t linktype)
+{
+	assert(l_get_u32(buf) == 0xa1b2c3d4);
+	assert(l_get_u16(buf + 4) == 2);
+	assert(l_get_u16(buf + 6) == 4);
+	assert(l_get_u32(buf + 20) == linktype);
+
+	return buf + 24;
+}
+
+static const uint8_t *check_record(const uint8_t *buf, uint32_t len)
+{
+	assert(l_get_u32(buf) != 0);
+	assert(l_get_u32(buf + 4) < 1000000);
+	assert(l_get_u32(buf + 8) == len);
+	assert(l_get_u32(buf + 12) == len);
+
+	return buf + 16;
+}
+
+static void test_netlink(const void *data)
+{
+	static const uint8_t msg1[] = { 0x14, 0x00, 0x00, 0x00, 0x12, 0x00,
+					0x01, 0x03, 0x01, 0x00, 0x00, 0x00,
+					0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+					0x00, 0x00 };
+	static const uint8_t msg2[] = { 0x10, 0x00, 0x00, 0x00, 0x03, 0x00,
+					0x02, 0x00, 0x01, 0x00, 0x00, 0x00,
+					0x00, 0x00, 0x00, 0x00 };
+	struct l_pcap *pcap = create_pcap(L_PCAP_LINK_NETLINK);
+	const uint8_t *p;
+	uint8_t *buf;
+	size_t len;
+
+	assert(pcap_write_netlink(pcap, false, NETLINK_ROUTE,
+							msg1, sizeof(msg1)));
+	assert(pcap_write_netlink(pcap, true, NETLINK_GENERIC,
+							msg2, sizeof(msg2)));
+	assert(!pcap_write_dbus(pcap, msg1, sizeof(msg1), NULL, 0));
+	l_pcap_free(pcap);
+
+	buf = read_pcap(&len);
+	assert(len == 24 + 2 * (16 + 16) + sizeof(msg1) + sizeof(msg2));
+
+	p = check_global_header(buf, 113);
+
+	p = check_record(p, 16 + sizeof(msg1));
+	assert(l_get_be16(p) == 4);
+	assert(l_get_be16(p + 2) == 824);
+	assert(l_get_be16(p + 14) == NETLINK_ROUTE);
+	assert(!memcmp(p + 16, msg1, sizeof(msg1)));
+	p += 16 + sizeof(msg1);
+
+	p = check_record(p, 16 + sizeof(msg2));
+	assert(l_get_be16(p) == 0);
+	assert(l_get_be16(p + 2) == 824);
+	assert(l_get_be16(p + 14) == NETLINK_GENERIC);
+	assert(!memcmp(p + 16, msg2, sizeof(msg2)));
+
+	l_free(buf);
+}
+
+static void test_dbus(const void *data)
+{
+	static const char header[] = "l\x01\x00\x01header";
+	static const char body[] = "body";
+	struct l_pcap *pcap = create_pcap(L_PCAP_LINK_DBUS);
+	const uint8_t *p;
+	uint8_t *buf;
+	size_t len;
+
+	assert(pcap_write_dbus(pcap, header, sizeof(header) - 1,
+						body, sizeof(body) - 1));
+	assert(pcap_write_dbus(pcap, header, sizeof(header) - 1, NULL, 0));
+	assert(!pcap_write_netlink(pcap, true, 0, body, sizeof(body)));
+	l_pcap_free(pcap);
+
+	buf = read_pcap(&len);
+	assert(len == 24 + 2 * 16 + 2 * (sizeof(header) - 1) +
+							sizeof(body) - 1);
+
+	p = check_global_header(buf, 231);
+
+	p = check_record(p, sizeof(header) - 1 + sizeof(body) - 1);
+	assert(!memcmp(p, header, sizeof(header) - 1));
+	assert(!memcmp(p + sizeof(header) - 1, body, sizeof(body) - 1));
+	p += sizeof(header) - 1 + sizeof(body) - 1;
+
+	p = check_record(p, sizeof(header) - 1);
+	assert(!memcmp(p, header, sizeof(header) - 1));
+
+	l_free(buf);
+}
+
+static void test_snaplen(const void *data)
+{
+	size_t msg_len = 300000;
+	uint8_t *msg = l_malloc(msg_len);
+	struct l_pcap *pcap = create_pcap(L_PCAP_LINK_NETLINK);
+	const uint8_t *p;
+	uint8_t *buf;
+	size_t len;
+
+	memset(msg, 0xaa, msg_len);
+	assert(pcap_write_netlink(pcap, true, NETLINK_ROUTE, msg, msg_len));
+	l_pcap_free(pcap);
+	l_free(msg);
+
+	buf = read_pcap(&len);
+	assert(len == 24 + 16 + 262144);
+
+	p = check_global_header(buf, 113);
+	assert(l_get_u32(buf + 16) == 262144);
+	assert(l_get_u32(p + 8) == 262144);
+	assert(l_get_u32(p + 12) == 16 + msg_len);
+
+	l_free(buf);
+}
+
+/*
+ * Goes through the records of a capture written by a live object and
+ * returns how many there were in each direction.  @type_offset locates
+ * the message type to be matched against @out_type and @in_type.
+ */
+static void count_records(const uint8_t *buf, size_t len, uint32_t linktype,
+				size_t type_offset, uint16_t out_type,
+				uint16_t in_type, unsigned int *n_out,
+				unsigned int *n_in)
+{
+	const uint8_t *p = check_global_header(buf, linktype);
+	const uint8_t *end = buf + len;
+
+	*n_out = 0;
+	*n_in = 0;
+
+	while (p < end) {
+		uint32_t incl_len;
+		uint16_t type;
+		bool in;
+
+		assert(p + 16 <= end);
+		incl_len = l_get_u32(p + 8);
+		assert(incl_len == l_get_u32(p + 12));
+		p += 16;
+		assert(p + incl_len <= end);
+		assert(incl_len > type_offset + 1);
+
+		/* D-Bus records have no direction, go by the message type */
+		if (linktype == 231) {
+			assert(p[0] == 'l');
+			type = p[type_offset];
+			in = type == in_type;
+		} else {
+			assert(l_get_be16(p + 2) == 824);
+			type = l_get_u16(p + type_offset);
+			in = l_get_be16(p) == 0;
+		}
+
+		if (in && type == in_type)
+			*n_in += 1;
+		else if (!in && type == out_type)
+			*n_out += 1;
+
+		p += incl_len;
+	}
+}
+
+static void capture_timeout(struct l_timeout *timeout, void *user_data)
+{
+	l_main_quit();
+}
+
+static void getlink_callback(int error, uint16_t type, const void *data,
+						uint32_t len, void *user_data)
+{
+	bool *done = user_data;
+
+	*done = true;
+	l_main_quit();
+}
+
+static void test_netlink_capture(const void *data)
+{
+	struct l_pcap *pcap = create_pcap(L_PCAP_LINK_NETLINK);
+	struct l_netlink_message *nlm;
+	struct l_netlink *netlink;
+	struct l_timeout *timeout;
+	struct ifinfomsg ifi;
+	unsigned int n_out, n_in;
+	bool done = false;
+	uint8_t *buf;
+	size_t len;
+
+	assert(l_main_init());
+
+	netlink = l_netlink_new(NETLINK_ROUTE);
+	assert(netlink);
+	assert(l_netlink_set_pcap(netlink, pcap));
+
+	nlm = l_netlink_message_new_sized(RTM_GETLINK, NLM_F_DUMP,
+							sizeof(ifi));
+	memset(&ifi, 0, sizeof(ifi));
+	l_netlink_message_add_header(nlm, &ifi, sizeof(ifi));
+	assert(l_netlink_send(netlink, nlm, getlink_callback, &done, NULL));
+
+	timeout = l_timeout_create(5, capture_timeout, NULL, NULL);
+	l_main_run();
+	l_timeout_remove(timeout);
+	assert(done);
+
+	l_netlink_destroy(netlink);
+	l_main_exit();
+	l_pcap_free(pcap);
+
+	buf = read_pcap(&len);
+	count_records(buf, len, 113, 16 + 4, RTM_GETLINK, RTM_NEWLINK,
+							&n_out, &n_in);
+	assert(n_out == 1);
+	assert(n_in >= 1);
+	l_free(buf);
+}
+
+static void genl_family_callback(const struct l_genl_family_info *info,
+							void *user_data)
+{
+	bool *done = user_data;
+
+	*done = info != NULL;
+	l_main_quit();
+}
+
+static void test_genl_capture(const void *data)
+{
+	struct l_pcap *pcap = create_pcap(L_PCAP_LINK_NETLINK);
+	struct l_timeout *timeout;
+	struct l_genl *genl;
+	unsigned int n_out, n_in;
+	bool done = false;
+	uint8_t *buf;
+	size_t len;
+
+	assert(l_main_init());
+
+	genl = l_genl_new();
+	assert(genl);
+	assert(l_genl_set_pcap(genl, pcap));
+	assert(l_genl_request_family(genl, "nlctrl", genl_family_callback,
+							&done, NULL));
+
+	timeout = l_timeout_create(5, capture_timeout, NULL, NULL);
+	l_main_run();
+	l_timeout_remove(timeout);
+	assert(done);
+
+	l_genl_unref(genl);
+	l_main_exit();
+	l_pcap_free(pcap);
+
+	/* Requests and replies both go through the nlctrl family id */
+	buf = read_pcap(&len);
+	count_records(buf, len, 113, 16 + 4, GENL_ID_CTRL, GENL_ID_CTRL,
+							&n_out, &n_in);
+	assert(n_out >= 1);
+	assert(n_in >= 1);
+	l_free(buf);
+}
+
+static struct l_dbus *server_conn;
+static struct l_dbus *client;
+static bool echo_done;
+
+static struct l_dbus_message *echo_method(struct l_dbus *dbus,
+						struct l_dbus_message *message,
+						void *user_data)
+{
+	return l_dbus_message_new_method_return(message);
+}
+
+static void setup_interface(struct l_dbus_interface *interface)
+{
+	l_dbus_interface_method(interface, "Echo", 0, echo_method, "", "");
+}
+
+static void server_connect(struct l_dbus_server *server, struct l_dbus *dbus,
+							void *user_data)
+{
+	server_conn = dbus;
+
+	assert(l_dbus_register_interface(dbus, "org.test.Pcap",
+						setup_interface, NULL, false));
+	assert(l_dbus_object_add_interface(dbus, "/test", "org.test.Pcap",
+								NULL));
+}
+
+static void echo_callback(struct l_dbus_message *message, void *user_data)
+{
+	echo_done = !l_dbus_message_is_error(message);
+	l_main_quit();
+}
+
+static void client_ready(void *user_data)
+{
+	assert(l_dbus_method_call(client, "org.test", "/test",
+					"org.test.Pcap", "Echo", NULL,
+					echo_callback, NULL, NULL));
+}
+
+static void test_dbus_capture(const void *data)
+{
+	struct l_pcap *pcap = create_pcap(L_PCAP_LINK_DBUS);
+	struct l_dbus_server *server;
+	struct l_timeout *timeout;
+	char address[64];
+	unsigned int n_out, n_in;
+	uint8_t *buf;
+	size_t len;
+
+	assert(l_main_init());
+
+	snprintf(address, sizeof(address),
+			"unix:abstract=ell-test-pcap-%d", getpid());
+
+	server = l_dbus_server_new(address);
+	assert(server);
+	assert(l_dbus_server_set_connect_handler(server, server_connect,
+								NULL, NULL));
+
+	client = l_dbus_new(address);
+	assert(client);
+	assert(l_dbus_set_pcap(client, pcap));
+	l_dbus_set_ready_handler(client, client_ready, NULL, NULL);
+
+	timeout = l_timeout_create(5, capture_timeout, NULL, NULL);
+	l_main_run();
+	l_timeout_remove(timeout);
+	assert(echo_done);
+
+	l_dbus_destroy(client);
+	l_dbus_destroy(server_conn);
+	l_dbus_server_destroy(server);
+	l_main_exit();
+	l_pcap_free(pcap);
+
+	/* Hello and Echo went out and their returns came back */
+	buf = read_pcap(&len);
+	count_records(buf, len, 231, 1, 1, 2, &n_out, &n_in);
+	assert(n_out == 2);
+	assert(n_in == 2);
+	l_free(buf);
+}
+
+static void test_invalid(const void *data)
+{
+	assert(!l_pcap_new(NULL, L_PCAP_LINK_NETLINK));
+	assert(!l_pcap_new("/nonexistent/ell.pcap", L_PCAP_LINK_NETLINK));
+	assert(!l_pcap_new("/tmp/ell.pcap", L_PCAP_LINK_DBUS + 1));
+
+	l_pcap_free(NULL);
+}
+
+#define BENCH_MESSAGES	20000
+#define BENCH_SIZE	1024
+
+static void hexdump_sink(const char *str, void *user_data)
+{
+	size_t *total = user_data;
+
+	*total += strlen(str);
+}
+
+static void bench_capture(const void *data)
+{
+	uint8_t msg[BENCH_SIZE];
+	struct l_pcap *pcap;
+	size_t total = 0;
+	uint64_t start;
+	double hexdump_rate, pcap_rate;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(msg); i++)
+		msg[i] = i;
+
+	start = l_time_now();
+
+	for (i = 0; i < BENCH_MESSAGES; i++)
+		l_util_hexdump(false, msg, sizeof(msg), hexdump_sink, &total);
+
+	hexdump_rate = BENCH_MESSAGES * 1000000.0 / (l_time_now() - start);
+	assert(total);
+
+	pcap = create_pcap(L_PCAP_LINK_NETLINK);
+	start = l_time_now();
+
+	for (i = 0; i < BENCH_MESSAGES; i++)
+		pcap_write_netlink(pcap, false, NETLINK_ROUTE,
+							msg, sizeof(msg));
+
+	pcap_rate = BENCH_MESSAGES * 1000000.0 / (l_time_now() - start);
+	l_pcap_free(pcap);
+	unlink(pcap_path);
+
+	printf("%u byte messages: hexdump %.0f msg/s, pcap %.0f msg/s\n",
+				BENCH_SIZE, hexdump_rate, pcap_rate);
+}
+
+int main(int argc, char *argv[])
+{
+	l_test_init(&argc, &argv);
+
+	l_test_add("Netlink", test_netlink, NULL);
+	l_test_add("D-Bus", test_dbus, NULL);
+	l_test_add("Snaplen", test_snaplen, NULL);
+	l_test_add("Invalid", test_invalid, NULL);
+	l_test_add("Netlink capture", test_netlink_capture, NULL);
+	l_test_add("Generic netlink capture", test_genl_capture, NULL);
+	l_test_add("D-Bus capture", test_dbus_capture, NULL);
+	l_test_add_benchmark("Benchmark", bench_capture, NULL);
+
+	return l_test_run();
+}
@@ -13,7 +13,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <assert.h>
+#include <sys/socket.h>
 
 #include <ell/ell.h>
 
@@ -201,6 +203,207 @@ static void test_append2(const void *unused)
 	l_ringbuf_free(rb);
 }
 
+static void test_mapped(const void *unused)
+{
+	static const uint8_t data[6] = { 1, 2, 3, 4, 5, 6 };
+	struct l_ringbuf *rb;
+	size_t capa;
+	size_t len;
+	uint8_t *ptr;
+	unsigned int i;
+
+	rb = l_ringbuf_new_mapped(100);
+	assert(rb != NULL);
+
+	capa = l_ringbuf_capacity(rb);
+	assert(capa == (size_t) sysconf(_SC_PAGESIZE));
+	assert(l_ringbuf_avail(rb) == capa);
+
+	/* Move the offsets so the data wraps around */
+	ptr = l_ringbuf_reserve(rb, capa - 3);
+	assert(ptr);
+	assert(l_ringbuf_commit(rb, capa - 3));
+	assert(l_ringbuf_drain(rb, capa - 3) == capa - 3);
+
+	assert(l_ringbuf_append(rb, data, sizeof(data)) == sizeof(data));
+
+	ptr = l_ringbuf_peek(rb, 0, &len);
+	assert(len == sizeof(data));
+	assert(!memcmp(ptr, data, sizeof(data)));
+
+	ptr = l_ringbuf_peek_all(rb, &len);
+	assert(len == sizeof(data));
+	assert(!memcmp(ptr, data, sizeof(data)));
+
+	/* The free space is contiguous as well */
+	assert(!l_ringbuf_reserve(rb, capa - sizeof(data) + 1));
+	ptr = l_ringbuf_reserve(rb, capa - sizeof(data));
+	assert(ptr);
+
+	for (i = 0; i < capa - sizeof(data); i++)
+		ptr[i] = i;
+
+	assert(!l_ringbuf_commit(rb, capa - sizeof(data) + 1));
+	assert(l_ringbuf_commit(rb, capa - sizeof(data)));
+	assert(l_ringbuf_avail(rb) == 0);
+	assert(l_ringbuf_printf(rb, "x") < 0);
+
+	ptr = l_ringbuf_peek_all(rb, &len);
+	assert(len == capa);
+	assert(!memcmp(ptr, data, sizeof(data)));
+
+	for (i = 0; i < capa - sizeof(data); i++)
+		assert(ptr[sizeof(data) + i] == (uint8_t) i);
+
+	l_ringbuf_drain(rb, capa - 2);
+	assert(l_ringbuf_printf(rb, "%s", "wrapped") == 7);
+
+	ptr = l_ringbuf_peek_all(rb, &len);
+	assert(len == 9);
+	assert(!memcmp(ptr + 2, "wrapped", 7));
+
+	l_ringbuf_free(rb);
+}
+
+static void test_reserve(const void *unused)
+{
+	struct l_ringbuf *rb;
+	size_t len;
+	char *ptr;
+
+	rb = l_ringbuf_new(16);
+	assert(rb != NULL);
+
+	ptr = l_ringbuf_reserve(rb, 12);
+	assert(ptr);
+	memcpy(ptr, "abcdefghijkl", 12);
+	assert(l_ringbuf_commit(rb, 12));
+	assert(l_ringbuf_drain(rb, 8) == 8);
+
+	/* Only 4 bytes left before the end of the buffer */
+	assert(!l_ringbuf_reserve(rb, 5));
+	assert(l_ringbuf_reserve(rb, 4) == ptr + 12);
+	assert(!l_ringbuf_commit(rb, 5));
+	assert(l_ringbuf_append(rb, "mnop", 4) == 4);
+
+	ptr = l_ringbuf_peek_all(rb, &len);
+	assert(len == 8);
+	assert(!memcmp(ptr, "ijklmnop", 8));
+
+	assert(l_ringbuf_append(rb, "qr", 2) == 2);
+	assert(!l_ringbuf_peek_all(rb, &len));
+
+	l_ringbuf_free(rb);
+}
+
+static void check_fd_io(struct l_ringbuf *rb, int fds[2])
+{
+	size_t capa = l_ringbuf_capacity(rb);
+	uint8_t buf[256];
+	size_t len;
+	uint8_t *ptr;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+
+	/* Leave the input offset close to the end */
+	assert(l_ringbuf_commit(rb, capa - 100));
+	assert(l_ringbuf_drain(rb, capa - 100) == capa - 100);
+
+	assert(write(fds[1], buf, sizeof(buf)) == sizeof(buf));
+	assert(l_ringbuf_read_fd(rb, fds[0], sizeof(buf)) > 0);
+
+	while (l_ringbuf_len(rb) < sizeof(buf))
+		assert(l_ringbuf_read_fd(rb, fds[0], sizeof(buf)) > 0);
+
+	ptr = l_ringbuf_peek_all(rb, &len);
+	assert(len == sizeof(buf));
+	assert(!memcmp(ptr, buf, sizeof(buf)));
+
+	while (l_ringbuf_len(rb))
+		assert(l_ringbuf_write_fd(rb, fds[1], SIZE_MAX) > 0);
+
+	memset(buf, 0, sizeof(buf));
+	assert(read(fds[0], buf, sizeof(buf)) == sizeof(buf));
+
+	for (i = 0; i < sizeof(buf); i++)
+		assert(buf[i] == i);
+}
+
+static void test_fd(const void *unused)
+{
+	struct l_ringbuf *rb;
+	int fds[2];
+
+	/* Pipes are spliced for mapped ring buffers */
+	assert(pipe(fds) == 0);
+
+	rb = l_ringbuf_new_mapped(4096);
+	assert(rb != NULL);
+	check_fd_io(rb, fds);
+	l_ringbuf_free(rb);
+
+	rb = l_ringbuf_new(4096);
+	assert(rb != NULL);
+	check_fd_io(rb, fds);
+	l_ringbuf_free(rb);
+
+	close(fds[0]);
+	close(fds[1]);
+
+	/* Sockets are read directly */
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	rb = l_ringbuf_new_mapped(4096);
+	assert(rb != NULL);
+	check_fd_io(rb, fds);
+	l_ringbuf_free(rb);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+#define BENCH_ROUNDS	1000000
+
+static double bench_run(struct l_ringbuf *rb)
+{
+	uint64_t start = l_time_now();
+	unsigned int i;
+	size_t len;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		l_ringbuf_printf(rb, "AT+CMUX=%u,%u,%u\r\n", i & 1, i, 127);
+
+		if (l_ringbuf_avail(rb) < 64) {
+			l_ringbuf_peek(rb, 0, &len);
+			l_ringbuf_drain(rb, l_ringbuf_len(rb));
+		}
+	}
+
+	return BENCH_ROUNDS * 1000000.0 / (l_time_now() - start);
+}
+
+static void bench_printf(const void *unused)
+{
+	struct l_ringbuf *rb;
+	double plain_rate, mapped_rate;
+
+	/* Not a multiple of the line length, so lines keep wrapping */
+	rb = l_ringbuf_new(4000);
+	assert(rb != NULL);
+	plain_rate = bench_run(rb);
+	l_ringbuf_free(rb);
+
+	rb = l_ringbuf_new_mapped(4000);
+	assert(rb != NULL);
+	mapped_rate = bench_run(rb);
+	l_ringbuf_free(rb);
+
+	printf("%u lines: plain %.0f lines/s, mapped %.0f lines/s\n",
+				BENCH_ROUNDS, plain_rate, mapped_rate);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -210,6 +413,10 @@ int main(int argc, char *argv[])
 	l_test_add("/ringbuf/printf", test_printf, NULL);
 	l_test_add("/ringbuf/append", test_append, NULL);
 	l_test_add("/ringbuf/append2", test_append2, NULL);
+	l_test_add("/ringbuf/mapped", test_mapped, NULL);
+	l_test_add("/ringbuf/reserve", test_reserve, NULL);
+	l_test_add("/ringbuf/fd", test_fd, NULL);
+	l_test_add_benchmark("/ringbuf/printf benchmark", bench_printf, NULL);
 
 	return l_test_run();
 }
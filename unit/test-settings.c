@@ -10,8 +10,14 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <limits.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <ell/ell.h>
 
@@ -414,6 +420,77 @@ static void test_load_from_file(const void *test_data)
 	l_settings_free(settings);
 }
 
+static void check_same_data(struct l_settings *settings,
+				struct l_settings *reference)
+{
+	char *data = l_settings_to_data(settings, NULL);
+	char *expected = l_settings_to_data(reference, NULL);
+
+	assert(!strcmp(data, expected));
+	l_free(data);
+	l_free(expected);
+}
+
+static void test_load_from_file_mapped(const void *test_data)
+{
+	struct l_settings *settings;
+	struct l_settings *reference;
+	struct l_settings *copy;
+	char dir[] = "/tmp/ell-test-settings-XXXXXX";
+	char *path;
+	char *contents;
+	size_t len;
+
+	settings = l_settings_new();
+	l_settings_set_debug(settings, settings_debug, NULL, NULL);
+	assert(l_settings_load_from_file_mapped(settings,
+						UNITDIR "settings.test"));
+
+	reference = l_settings_new();
+	assert(l_settings_load_from_file(reference, UNITDIR "settings.test"));
+	check_same_data(settings, reference);
+
+	/* Modified values are copied, the others still come from the map */
+	assert(l_settings_set_string(settings, "Foobar", "Key", "Changed"));
+	assert(l_settings_set_string(reference, "Foobar", "Key", "Changed"));
+	assert(!strcmp(l_settings_get_value(settings, "Foobar", "Key"),
+			"Changed"));
+	check_same_data(settings, reference);
+
+	copy = l_settings_clone(settings);
+	l_settings_free(settings);
+	settings = l_settings_clone(reference);
+	check_same_data(copy, settings);
+	l_settings_free(copy);
+	l_settings_free(settings);
+	l_settings_free(reference);
+
+	settings = l_settings_new();
+	l_settings_set_debug(settings, settings_debug, NULL, NULL);
+	assert(l_settings_load_from_file_mapped(settings,
+						UNITDIR "settings.test"));
+	test_settings(settings);
+	l_settings_free(settings);
+
+	/* The file may be truncated or rewritten in place while loaded */
+	assert(mkdtemp(dir));
+	path = l_strdup_printf("%s/mapped.conf", dir);
+	contents = l_file_get_contents(UNITDIR "settings.test", &len);
+	assert(contents);
+	assert(l_file_set_contents(path, contents, len) == 0);
+	l_free(contents);
+
+	settings = l_settings_new();
+	assert(l_settings_load_from_file_mapped(settings, path));
+	assert(truncate(path, 0) == 0);
+	test_settings(settings);
+	l_settings_free(settings);
+
+	unlink(path);
+	l_free(path);
+	rmdir(dir);
+}
+
 static void test_set_methods(const void *test_data)
 {
 	struct l_settings *settings;
@@ -588,12 +665,388 @@ static void test_clone(const void *data)
 	l_settings_free(settings);
 }
 
+static void test_duplicates(const void *data)
+{
+	static const char *raw_data =
+			"[g]\n"
+			"k=1\n"
+			"k=2\n"
+			"[h]\n"
+			"k=3\n"
+			"[g]\n"
+			"k=4\n";
+	struct l_settings *settings = l_settings_new();
+	char **keys;
+
+	assert(l_settings_load_from_data(settings, raw_data, strlen(raw_data)));
+
+	/* The first group and key of a name are the ones that are found */
+	assert(!strcmp(l_settings_get_value(settings, "g", "k"), "1"));
+	keys = l_settings_get_keys(settings, "g");
+	assert(l_strv_length(keys) == 2);
+	l_strv_free(keys);
+
+	assert(l_settings_remove_key(settings, "g", "k"));
+	assert(!strcmp(l_settings_get_value(settings, "g", "k"), "2"));
+	assert(l_settings_remove_key(settings, "g", "k"));
+	assert(!l_settings_has_key(settings, "g", "k"));
+
+	assert(l_settings_remove_group(settings, "g"));
+	assert(!strcmp(l_settings_get_value(settings, "g", "k"), "4"));
+	assert(!strcmp(l_settings_get_value(settings, "h", "k"), "3"));
+	assert(l_settings_remove_group(settings, "g"));
+	assert(!l_settings_has_group(settings, "g"));
+
+	assert(l_settings_set_int(settings, "g", "k", 5));
+	assert(!strcmp(l_settings_get_value(settings, "g", "k"), "5"));
+
+	l_settings_free(settings);
+}
+
+#define BENCH_GROUPS	5000
+#define BENCH_KEYS	10
+
+static void bench_load_lookup(const void *data)
+{
+	struct l_string *buf = l_string_new(BENCH_GROUPS * BENCH_KEYS * 24);
+	struct l_settings *settings;
+	char group[32], key[32];
+	uint64_t start, load, lookup;
+	size_t len;
+	char *raw;
+	unsigned int i, j;
+
+	for (i = 0; i < BENCH_GROUPS; i++) {
+		l_string_append_printf(buf, "[session-%u]\n", i);
+
+		for (j = 0; j < BENCH_KEYS; j++)
+			l_string_append_printf(buf, "Key%u=value%u\n", j, i);
+	}
+
+	raw = l_string_unwrap(buf);
+	len = strlen(raw);
+
+	start = l_time_now();
+	settings = l_settings_new();
+	assert(l_settings_load_from_data(settings, raw, len));
+	load = l_time_diff(start, l_time_now());
+
+	start = l_time_now();
+
+	for (i = 0; i < BENCH_GROUPS; i++) {
+		sprintf(group, "session-%u", i);
+
+		for (j = 0; j < BENCH_KEYS; j++) {
+			sprintf(key, "Key%u", j);
+			assert(l_settings_get_value(settings, group, key));
+		}
+	}
+
+	lookup = l_time_diff(start, l_time_now());
+
+	printf("%u keys in %u groups: load %.1f ms, lookup %.1f ns/key\n",
+		BENCH_GROUPS * BENCH_KEYS, BENCH_GROUPS, load / 1000.0,
+		lookup * 1000.0 / (BENCH_GROUPS * BENCH_KEYS));
+
+	l_settings_free(settings);
+	l_free(raw);
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "r");
+	char *data = l_malloc(65536);
+
+	assert(f);
+	*len = fread(data, 1, 65535, f);
+	data[*len] = '\0';
+	fclose(f);
+
+	return data;
+}
+
+static void check_file_matches(const char *path, struct l_settings *settings)
+{
+	struct l_settings *reloaded = l_settings_new();
+
+	assert(l_settings_load_from_file(reloaded, path));
+	check_same_data(reloaded, settings);
+	l_settings_free(reloaded);
+}
+
+static void test_save_to_file(const void *data)
+{
+	static const char *original =
+			"[Untouched]\n"
+			"# Kept as is\n"
+			"Key = Value\n"
+			"\n"
+			"[Changed]\n"
+			"Key=Value\n"
+			"Other=1\n"
+			"\n"
+			"[Last]\n"
+			"Key=Value";
+	char dir[] = "/tmp/ell-test-settings-XXXXXX";
+	char *path;
+	struct l_settings *settings;
+	char *contents;
+	char *again;
+	size_t len;
+	int fd;
+	const struct timespec old_times[2] = { { 1, 0 }, { 1, 0 } };
+
+	assert(mkdtemp(dir));
+	path = l_strdup_printf("%s/saved.conf", dir);
+	assert(l_file_set_contents(path, original, strlen(original)) == 0);
+
+	settings = l_settings_new();
+	assert(l_settings_load_from_file(settings, path));
+
+	/* Nothing changed, the file is copied over range by range */
+	assert(l_settings_save_to_file(settings, path, 0) == 0);
+	contents = read_file(path, &len);
+	assert(!strncmp(contents, original, strlen(original)));
+	assert(!strcmp(contents + strlen(original), "\n"));
+	l_free(contents);
+
+	assert(l_settings_set_int(settings, "Changed", "Other", 2));
+	assert(l_settings_set_string(settings, "New", "Key", "Value"));
+	assert(l_settings_save_to_file(settings, path,
+					L_SETTINGS_SAVE_SYNC) == 0);
+	contents = read_file(path, &len);
+	assert(strstr(contents, "# Kept as is\nKey = Value\n"));
+	assert(strstr(contents, "[Changed]\nKey=Value\nOther=2\n\n[Last]"));
+	check_file_matches(path, settings);
+
+	/* Ranges now refer to the file just written */
+	assert(l_settings_remove_key(settings, "Last", "Key"));
+	assert(l_settings_save_to_file(settings, path, 0) == 0);
+	again = read_file(path, &len);
+	assert(strstr(again, "# Kept as is\nKey = Value\n"));
+	assert(!strstr(again, "[Last]\nKey"));
+	check_file_matches(path, settings);
+	l_free(contents);
+	l_free(again);
+
+	/* Rewritten in place with the same size, only the mtime differs */
+	contents = read_file(path, &len);
+	memset(contents, '#', len);
+	fd = open(path, O_WRONLY);
+	assert(fd >= 0);
+	assert(pwrite(fd, contents, len, 0) == (ssize_t) len);
+	assert(futimens(fd, old_times) == 0);
+	close(fd);
+	l_free(contents);
+	assert(l_settings_save_to_file(settings, path, 0) == 0);
+	contents = read_file(path, &len);
+	assert(!strstr(contents, "# Kept as is"));
+	check_file_matches(path, settings);
+	l_free(contents);
+
+	/* Replaced behind our back, everything gets serialized */
+	assert(l_file_set_contents(path, "[X]\nY=Z\n", 8) == 0);
+	assert(l_settings_save_to_file(settings, path, 0) == 0);
+	contents = read_file(path, &len);
+	assert(!strstr(contents, "[X]"));
+	check_file_matches(path, settings);
+	l_free(contents);
+
+	l_settings_free(settings);
+	unlink(path);
+	l_free(path);
+	rmdir(dir);
+}
+
+static void test_save_to_files(const void *data)
+{
+	char dir[] = "/tmp/ell-test-settings-XXXXXX";
+	struct l_settings *settings[2];
+	char *paths[2];
+	unsigned int i;
+
+	assert(mkdtemp(dir));
+
+	for (i = 0; i < L_ARRAY_SIZE(settings); i++) {
+		paths[i] = l_strdup_printf("%s/batch%u.conf", dir, i);
+		settings[i] = l_settings_new();
+		assert(l_settings_set_uint(settings[i], "Group", "Key", i));
+	}
+
+	assert(l_settings_save_to_files(settings, (const char **) paths, 2,
+					L_SETTINGS_SAVE_SYNC) == 0);
+
+	for (i = 0; i < L_ARRAY_SIZE(settings); i++)
+		check_file_matches(paths[i], settings[i]);
+
+	/* A failed write leaves every target alone */
+	assert(l_settings_set_uint(settings[0], "Group", "Key", 5));
+	l_free(paths[1]);
+	paths[1] = l_strdup_printf("%s/missing/batch1.conf", dir);
+	assert(l_settings_save_to_files(settings, (const char **) paths, 2,
+					0) == -ENOENT);
+
+	for (i = 0; i < L_ARRAY_SIZE(settings); i++)
+		l_settings_free(settings[i]);
+
+	settings[0] = l_settings_new();
+	assert(l_settings_load_from_file(settings[0], paths[0]));
+	assert(l_settings_get_uint(settings[0], "Group", "Key", &i));
+	assert(i == 0);
+	l_settings_free(settings[0]);
+
+	unlink(paths[0]);
+	l_free(paths[0]);
+	l_free(paths[1]);
+	paths[1] = l_strdup_printf("%s/batch1.conf", dir);
+	unlink(paths[1]);
+	l_free(paths[1]);
+	rmdir(dir);
+}
+
+static size_t bench_heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 info = mallinfo2();
+
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+static void bench_save(const void *data)
+{
+	struct l_string *buf = l_string_new(BENCH_GROUPS * BENCH_KEYS * 24);
+	char dir[] = "/tmp/ell-test-settings-XXXXXX";
+	struct l_settings *settings;
+	uint64_t start, full, incremental;
+	char *path;
+	char *raw;
+	size_t len;
+	unsigned int i, j;
+
+	for (i = 0; i < BENCH_GROUPS; i++) {
+		l_string_append_printf(buf, "[session-%u]\n", i);
+
+		for (j = 0; j < BENCH_KEYS; j++)
+			l_string_append_printf(buf, "Key%u=value%u\n", j, i);
+
+		l_string_append_c(buf, '\n');
+	}
+
+	raw = l_string_unwrap(buf);
+	assert(mkdtemp(dir));
+	path = l_strdup_printf("%s/sessions", dir);
+	assert(l_file_set_contents(path, raw, strlen(raw)) == 0);
+	l_free(raw);
+
+	settings = l_settings_new();
+	assert(l_settings_load_from_file(settings, path));
+
+	/* What callers do today to persist one changed key */
+	assert(l_settings_set_uint(settings, "session-42", "Key0", 1));
+	start = l_time_now();
+	raw = l_settings_to_data(settings, &len);
+	assert(l_file_set_contents(path, raw, len) == 0);
+	full = l_time_diff(start, l_time_now());
+	l_free(raw);
+
+	l_settings_free(settings);
+	settings = l_settings_new();
+	assert(l_settings_load_from_file(settings, path));
+
+	assert(l_settings_set_uint(settings, "session-42", "Key0", 2));
+	start = l_time_now();
+	assert(l_settings_save_to_file(settings, path, 0) == 0);
+	incremental = l_time_diff(start, l_time_now());
+
+	printf("save one key of %u: full %.1f ms, incremental %.1f ms\n",
+		BENCH_GROUPS * BENCH_KEYS, full / 1000.0,
+		incremental / 1000.0);
+
+	l_settings_free(settings);
+	unlink(path);
+	l_free(path);
+	rmdir(dir);
+}
+
+#define BENCH_PROFILES	300
+
+static void bench_load_profiles(bool mapped, char **paths)
+{
+	struct l_settings *profiles[BENCH_PROFILES];
+	size_t heap = bench_heap_in_use();
+	uint64_t start = l_time_now();
+	uint64_t elapsed;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_PROFILES; i++) {
+		profiles[i] = l_settings_new();
+
+		if (mapped)
+			assert(l_settings_load_from_file_mapped(profiles[i],
+								paths[i]));
+		else
+			assert(l_settings_load_from_file(profiles[i],
+								paths[i]));
+	}
+
+	elapsed = l_time_diff(start, l_time_now());
+
+	printf("%u profiles %s: %.1f ms, heap %zu kB\n",
+		BENCH_PROFILES, mapped ? "mapped" : "copied",
+		elapsed / 1000.0, (bench_heap_in_use() - heap) / 1024);
+
+	for (i = 0; i < BENCH_PROFILES; i++)
+		l_settings_free(profiles[i]);
+}
+
+static void bench_profiles(const void *data)
+{
+	char dir[] = "/tmp/ell-test-settings-XXXXXX";
+	char *paths[BENCH_PROFILES];
+	unsigned int i;
+
+	assert(mkdtemp(dir));
+
+	for (i = 0; i < BENCH_PROFILES; i++) {
+		char *contents = l_strdup_printf("[Security]\n"
+			"EAP-Method=TLS\n"
+			"EAP-Identity=user%u@example.com\n"
+			"EAP-TLS-CACert=/var/lib/iwd/ca-%u.pem\n"
+			"EAP-TLS-ClientCert=/var/lib/iwd/client-%u.pem\n"
+			"EAP-TLS-ClientKey=/var/lib/iwd/client-%u.key\n"
+			"EAP-TLS-ClientKeyPassphrase=passphrase%u\n"
+			"PreSharedKey=%064x\n"
+			"\n[Settings]\n"
+			"AutoConnect=true\n"
+			"Hidden=false\n", i, i, i, i, i, i);
+
+		paths[i] = l_strdup_printf("%s/network-%u.8021x", dir, i);
+		assert(l_file_set_contents(paths[i], contents,
+						strlen(contents)) == 0);
+		l_free(contents);
+	}
+
+	bench_load_profiles(false, paths);
+	bench_load_profiles(true, paths);
+
+	for (i = 0; i < BENCH_PROFILES; i++) {
+		unlink(paths[i]);
+		l_free(paths[i]);
+	}
+
+	rmdir(dir);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
 
 	l_test_add("Load from Data", test_load_from_data, NULL);
 	l_test_add("Load from File", test_load_from_file, NULL);
+	l_test_add("Load from File mapped", test_load_from_file_mapped, NULL);
 	l_test_add("Set Methods", test_set_methods, NULL);
 	l_test_add("Export to Data 1", test_to_data, data2);
 	l_test_add("Invalid Data 1", test_invalid_data, no_group_data);
@@ -601,6 +1054,13 @@ int main(int argc, char *argv[])
 	l_test_add("Test valid ext group", test_valid_extended_group, NULL);
 	l_test_add("Test invalid ext group", test_invalid_extended_group, NULL);
 	l_test_add("Test clone", test_clone, NULL);
+	l_test_add("Duplicate groups and keys", test_duplicates, NULL);
+	l_test_add("Save to File", test_save_to_file, NULL);
+	l_test_add("Save to Files", test_save_to_files, NULL);
+	l_test_add_benchmark("Load and lookup benchmark", bench_load_lookup,
+				NULL);
+	l_test_add_benchmark("Profile load benchmark", bench_profiles, NULL);
+	l_test_add_benchmark("Save benchmark", bench_save, NULL);
 
 	return l_test_run();
 }
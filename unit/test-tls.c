@@ -11,6 +11,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <ell/ell.h>
@@ -210,8 +211,15 @@ static struct l_cert *load_cert_file(const char *filename)
 	return cert;
 }
 
+typedef bool (*verify_func_t)(struct l_certchain *chain,
+				struct l_queue *ca_certs, const char **error);
+
+static const verify_func_t verify_keyring = l_certchain_verify;
+static const verify_func_t verify_userspace = l_certchain_verify_userspace;
+
 static void test_certificates(const void *data)
 {
+	const verify_func_t verify = *(const verify_func_t *) data;
 	struct l_queue *cacert;
 	struct l_queue *wrongca;
 	struct l_queue *wrongca2;
@@ -245,20 +253,20 @@ static void test_certificates(const void *data)
 	expiredchain = l_pem_load_certificate_chain(CERTDIR "cert-expired.pem");
 	assert(expiredchain);
 
-	assert(!l_certchain_verify(chain, wrongca, NULL));
-	assert(l_certchain_verify(chain, cacert, NULL));
-	assert(l_certchain_verify(chain, NULL, NULL));
-	assert(l_certchain_verify(chain, twocas, NULL));
+	assert(!verify(chain, wrongca, NULL));
+	assert(verify(chain, cacert, NULL));
+	assert(verify(chain, NULL, NULL));
+	assert(verify(chain, twocas, NULL));
 
 	l_certchain_free(chain);
 
 	chain = l_pem_load_certificate_chain(CERTDIR "cert-chain.pem");
 	assert(chain);
 
-	assert(!l_certchain_verify(chain, wrongca2, NULL));
-	assert(l_certchain_verify(chain, cacert, NULL));
-	assert(l_certchain_verify(chain, NULL, NULL));
-	assert(l_certchain_verify(chain, twocas, NULL));
+	assert(!verify(chain, wrongca2, NULL));
+	assert(verify(chain, cacert, NULL));
+	assert(verify(chain, NULL, NULL));
+	assert(verify(chain, twocas, NULL));
 
 	l_certchain_free(chain);
 
@@ -272,10 +280,10 @@ static void test_certificates(const void *data)
 			load_cert_file(CERTDIR "cert-ca.pem"));
 	assert(chain);
 
-	assert(!l_certchain_verify(chain, wrongca, NULL));
-	assert(!l_certchain_verify(chain, cacert, NULL));
-	assert(!l_certchain_verify(chain, NULL, NULL));
-	assert(!l_certchain_verify(chain, twocas, NULL));
+	assert(!verify(chain, wrongca, NULL));
+	assert(!verify(chain, cacert, NULL));
+	assert(!verify(chain, NULL, NULL));
+	assert(!verify(chain, twocas, NULL));
 
 	l_certchain_free(chain);
 
@@ -287,11 +295,11 @@ static void test_certificates(const void *data)
 			load_cert_file(CERTDIR "cert-ca.pem"));
 	assert(chain);
 
-	assert(!l_certchain_verify(chain, wrongca2, NULL));
-	assert(l_certchain_verify(chain, cacert, NULL));
-	assert(l_certchain_verify(chain, NULL, NULL));
-	assert(l_certchain_verify(chain, twocas, NULL));
-	assert(l_certchain_verify(chain, mixedcas, NULL));
+	assert(!verify(chain, wrongca2, NULL));
+	assert(verify(chain, cacert, NULL));
+	assert(verify(chain, NULL, NULL));
+	assert(verify(chain, twocas, NULL));
+	assert(verify(chain, mixedcas, NULL));
 
 	l_certchain_free(chain);
 	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
@@ -303,21 +311,21 @@ static void test_certificates(const void *data)
 			load_cert_file(CERTDIR "cert-no-keyid.pem"));
 	assert(chain);
 
-	assert(!l_certchain_verify(chain, wrongca, NULL));
-	assert(l_certchain_verify(chain, cacert, NULL));
-	assert(l_certchain_verify(chain, NULL, NULL));
-	assert(!l_certchain_verify(chain, twocas, NULL));
+	assert(!verify(chain, wrongca, NULL));
+	assert(verify(chain, cacert, NULL));
+	assert(verify(chain, NULL, NULL));
+	assert(!verify(chain, twocas, NULL));
 
 	certchain_link_issuer(chain,
 			load_cert_file(CERTDIR "cert-ca2.pem"));
 
-	assert(!l_certchain_verify(chain, wrongca, NULL));
-	assert(l_certchain_verify(chain, cacert, NULL));
-	assert(l_certchain_verify(chain, NULL, NULL));
-	assert(!l_certchain_verify(chain, twocas, NULL));
-	assert(!l_certchain_verify(chain, mixedcas, NULL));
+	assert(!verify(chain, wrongca, NULL));
+	assert(verify(chain, cacert, NULL));
+	assert(verify(chain, NULL, NULL));
+	assert(!verify(chain, twocas, NULL));
+	assert(!verify(chain, mixedcas, NULL));
 
-	assert(!l_certchain_verify(expiredchain, NULL, NULL));
+	assert(!verify(expiredchain, NULL, NULL));
 
 	l_certchain_free(chain);
 	l_certchain_free(expiredchain);
@@ -330,6 +338,7 @@ static void test_certificates(const void *data)
 
 static void test_ec_certificates(const void *data)
 {
+	const verify_func_t verify = *(const verify_func_t *) data;
 	struct l_queue *cacert;
 	struct l_certchain *chain;
 
@@ -339,13 +348,477 @@ static void test_ec_certificates(const void *data)
 	chain = l_pem_load_certificate_chain(CERTDIR "ec-cert-server.pem");
 	assert(chain);
 
-	assert(l_certchain_verify(chain, cacert, NULL));
-	assert(l_certchain_verify(chain, NULL, NULL));
+	assert(verify(chain, cacert, NULL));
+	assert(verify(chain, NULL, NULL));
+
+	l_certchain_free(chain);
+	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
+}
+
+static void test_pss_certificates(const void *data)
+{
+	struct l_queue *cacert;
+	struct l_queue *wrongca;
+	struct l_certchain *chain;
+
+	cacert = l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	assert(cacert && !l_queue_isempty(cacert));
+
+	wrongca = l_pem_load_certificate_list(CERTDIR "cert-intca.pem");
+	assert(wrongca && !l_queue_isempty(wrongca));
+
+	chain = l_pem_load_certificate_chain(CERTDIR "cert-server-pss.pem");
+	assert(chain);
+
+	assert(l_certchain_verify_userspace(chain, cacert, NULL));
+	assert(!l_certchain_verify_userspace(chain, wrongca, NULL));
+
+	l_certchain_free(chain);
+	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
+	l_queue_destroy(wrongca, (l_queue_destroy_func_t) l_cert_free);
+}
+
+static void test_certificate_corrupt(const void *data)
+{
+	struct l_queue *cacert;
+	struct l_certchain *chain;
+	const uint8_t *der;
+	uint8_t *copy;
+	size_t len;
+	struct l_cert *leaf;
+
+	cacert = l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	assert(cacert && !l_queue_isempty(cacert));
+
+	chain = l_pem_load_certificate_chain(CERTDIR "cert-server.pem");
+	assert(chain);
+
+	/* Flip one bit in the leaf's signature */
+	der = l_cert_get_der_data(l_certchain_get_leaf(chain), &len);
+	copy = l_memdup(der, len);
+	copy[len - 1] ^= 0x01;
+	l_certchain_free(chain);
+
+	leaf = l_cert_new_from_der(copy, len);
+	assert(leaf);
+	chain = certchain_new_from_leaf(leaf);
+	assert(!l_certchain_verify_userspace(chain, cacert, NULL));
+
+	l_certchain_free(chain);
+	l_free(copy);
+	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
+}
+
+static void test_certchain_cache(const void *data)
+{
+	struct l_queue *cacert;
+	struct l_queue *wrongca;
+	struct l_certchain *chain;
+	struct l_certchain *chain2;
+	uint64_t hits, misses;
+	uint64_t hits2, misses2;
+
+	cacert = l_pem_load_certificate_list(CERTDIR "cert-ca.pem");
+	assert(cacert && !l_queue_isempty(cacert));
+
+	chain = certchain_new_from_leaf(
+			load_cert_file(CERTDIR "cert-entity-int.pem"));
+	certchain_link_issuer(chain,
+			load_cert_file(CERTDIR "cert-intca.pem"));
+
+	l_certchain_verify_cache_clear();
+	l_certchain_verify_cache_get_stats(&hits, &misses);
+	assert(hits == 0 && misses == 0);
+
+	/* CA -> intermediate and intermediate -> leaf */
+	assert(l_certchain_verify_userspace(chain, cacert, NULL));
+	l_certchain_verify_cache_get_stats(&hits, &misses);
+	assert(hits == 0 && misses == 2);
+
+	assert(l_certchain_verify_userspace(chain, cacert, NULL));
+	l_certchain_verify_cache_get_stats(&hits2, &misses2);
+	assert(hits2 == 2 && misses2 == 2);
+
+	/* Same links but loaded again, only the trust anchor must match */
+	chain2 = certchain_new_from_leaf(
+			load_cert_file(CERTDIR "cert-entity-int.pem"));
+	certchain_link_issuer(chain2,
+			load_cert_file(CERTDIR "cert-intca.pem"));
+	assert(l_certchain_verify_userspace(chain2, cacert, NULL));
+	l_certchain_verify_cache_get_stats(&hits, &misses);
+	assert(hits == 4 && misses == 2);
+
+	/* Cached links don't help with an unrelated trust anchor */
+	wrongca = l_pem_load_certificate_list(CERTDIR "ec-cert-ca.pem");
+	assert(wrongca && !l_queue_isempty(wrongca));
+	assert(!l_certchain_verify_userspace(chain2, wrongca, NULL));
+	assert(!l_certchain_verify(chain2, wrongca, NULL));
+	l_certchain_free(chain2);
+	l_queue_destroy(wrongca, (l_queue_destroy_func_t) l_cert_free);
+
+	if (l_key_is_supported(L_KEY_FEATURE_RESTRICT)) {
+		l_certchain_verify_cache_clear();
+		assert(l_certchain_verify(chain, cacert, NULL));
+		l_certchain_verify_cache_get_stats(&hits, &misses);
+		assert(hits == 0);
+
+		/* Fully cached now, no keyring needed */
+		assert(l_certchain_verify(chain, cacert, NULL));
+		assert(l_certchain_verify_userspace(chain, cacert, NULL));
+		l_certchain_verify_cache_get_stats(&hits2, &misses2);
+		assert(hits2 == 4 && misses2 == misses);
+	}
+
+	l_certchain_verify_cache_clear();
+	l_certchain_free(chain);
+	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
+}
+
+static void bench_certchain(const char *name, const char *ca_file,
+				const char *const *files)
+{
+	struct l_queue *cacert;
+	struct l_certchain *chain;
+	uint64_t start;
+	uint64_t elapsed;
+	unsigned int i;
+	unsigned int n = 200;
+
+	cacert = l_pem_load_certificate_list(ca_file);
+	assert(cacert && !l_queue_isempty(cacert));
+
+	chain = certchain_new_from_leaf(load_cert_file(files[0]));
+
+	for (i = 1; files[i]; i++)
+		certchain_link_issuer(chain, load_cert_file(files[i]));
+
+	start = l_time_now();
+
+	for (i = 0; i < n; i++) {
+		l_certchain_verify_cache_clear();
+		assert(l_certchain_verify_userspace(chain, cacert, NULL));
+	}
+
+	elapsed = l_time_diff(start, l_time_now());
+	printf("%s userspace: %u chains/s\n", name,
+			(unsigned int) (n * 1000000ull / (elapsed ?: 1)));
+
+	start = l_time_now();
+
+	for (i = 0; i < n; i++)
+		assert(l_certchain_verify_userspace(chain, cacert, NULL));
+
+	elapsed = l_time_diff(start, l_time_now());
+	printf("%s userspace cached: %u chains/s\n", name,
+			(unsigned int) (n * 1000000ull / (elapsed ?: 1)));
+
+	/* The kernel may not support every key type, compare when it does */
+	l_certchain_verify_cache_clear();
+
+	if (l_key_is_supported(L_KEY_FEATURE_RESTRICT) &&
+			l_certchain_verify(chain, cacert, NULL)) {
+		start = l_time_now();
+
+		for (i = 0; i < n; i++) {
+			l_certchain_verify_cache_clear();
+			assert(l_certchain_verify(chain, cacert, NULL));
+		}
+
+		elapsed = l_time_diff(start, l_time_now());
+		printf("%s keyring: %u chains/s\n", name,
+			(unsigned int) (n * 1000000ull / (elapsed ?: 1)));
+	}
+
+	l_certchain_verify_cache_clear();
 
 	l_certchain_free(chain);
 	l_queue_destroy(cacert, (l_queue_destroy_func_t) l_cert_free);
 }
 
+static void test_certchain_bench(const void *data)
+{
+	static const char *const rsa_chain[] = {
+		CERTDIR "cert-entity-int.pem",
+		CERTDIR "cert-intca.pem",
+		NULL
+	};
+	static const char *const ec_chain[] = {
+		CERTDIR "ec-cert-server.pem",
+		NULL
+	};
+
+	bench_certchain("RSA leaf + intermediate", CERTDIR "cert-ca.pem",
+			rsa_chain);
+	bench_certchain("ECDSA P-384 leaf", CERTDIR "ec-cert-ca.pem",
+			ec_chain);
+}
+
+static bool cert_der_eq(struct l_cert *a, struct l_cert *b)
+{
+	const uint8_t *der_a, *der_b;
+	size_t len_a, len_b;
+
+	der_a = l_cert_get_der_data(a, &len_a);
+	der_b = l_cert_get_der_data(b, &len_b);
+
+	return len_a == len_b && !memcmp(der_a, der_b, len_a);
+}
+
+static void test_cert_store(const void *data)
+{
+	struct l_cert_store *store;
+	struct l_cert *ca = load_cert_file(CERTDIR "cert-ca.pem");
+	struct l_cert *ca2 = load_cert_file(CERTDIR "cert-ca2.pem");
+	struct l_cert *intca = load_cert_file(CERTDIR "cert-intca.pem");
+	struct l_cert *leaf = load_cert_file(CERTDIR "cert-entity-int.pem");
+	struct l_cert *no_keyid = load_cert_file(CERTDIR "cert-no-keyid.pem");
+	struct l_certchain *chain;
+
+	store = l_cert_store_new();
+	assert(store);
+	assert(l_cert_store_get_count(store) == 0);
+
+	assert(l_cert_store_load_file(store, CERTDIR "cert-chain.pem"));
+	assert(l_cert_store_get_count(store) == 2);
+
+	/* Same file again and the same certificate in another file */
+	assert(l_cert_store_load_file(store, CERTDIR "cert-chain.pem"));
+	assert(l_cert_store_load_file(store, CERTDIR "cert-ca.pem"));
+	assert(l_cert_store_get_count(store) == 2);
+
+	/* DER file */
+	assert(l_cert_store_load_file(store, CERTDIR "cert-client.crt"));
+	assert(l_cert_store_get_count(store) == 3);
+
+	assert(!l_cert_store_load_file(store,
+					CERTDIR "cert-client-key-pkcs8.pem"));
+	assert(!l_cert_store_load_file(store, CERTDIR "nonexistent.pem"));
+	assert(l_cert_store_get_count(store) == 3);
+
+	assert(l_cert_store_load_file(store, CERTDIR "cert-ca2.pem"));
+	assert(l_cert_store_get_count(store) == 4);
+
+	assert(cert_der_eq(l_cert_store_find_issuer(store, leaf), intca));
+	assert(cert_der_eq(l_cert_store_find_issuer(store, intca), ca));
+	assert(cert_der_eq(l_cert_store_find_issuer(store, ca), ca));
+	assert(cert_der_eq(l_cert_store_find_issuer(store, no_keyid), ca2));
+
+	/* Intermediate from the store */
+	chain = certchain_new_from_leaf(leaf);
+	assert(l_certchain_verify_store(chain, store, NULL));
+
+	/* Intermediate and root in the chain */
+	certchain_link_issuer(chain, intca);
+	certchain_link_issuer(chain, ca);
+	assert(l_certchain_verify_store(chain, store, NULL));
+	l_certchain_free(chain);
+
+	chain = l_pem_load_certificate_chain(CERTDIR "ec-cert-server.pem");
+	assert(chain);
+	assert(!l_certchain_verify_store(chain, store, NULL));
+	l_certchain_free(chain);
+
+	l_cert_store_free(store);
+	l_cert_free(ca2);
+	l_cert_free(no_keyid);
+
+	/* Every certificate file in the directory, keys etc. are skipped */
+	store = l_cert_store_new();
+	assert(l_cert_store_load_dir(store, CERTDIR));
+	assert(l_cert_store_get_count(store) > 4);
+	assert(!l_cert_store_load_dir(store, CERTDIR "nonexistent"));
+	l_cert_store_free(store);
+}
+
+/* 1024-bit RSAPublicKey and a SHA-256 signature starting with 0x00 */
+static const uint8_t rsa_pubkey[] = {
+	0x30, 0x81, 0x89, 0x02, 0x81, 0x81, 0x00, 0xa6, 0xef, 0x77, 0x48, 0x8b,
+	0xa1, 0x3a, 0x0f, 0xa3, 0x86, 0x85, 0xec, 0x21, 0xa9, 0x55, 0x2d, 0x3a,
+	0x2b, 0xcd, 0x8f, 0x0a, 0x4c, 0xb7, 0x0a, 0xa5, 0xc3, 0x0a, 0x46, 0x67,
+	0x4e, 0xc5, 0xa6, 0xd5, 0xe4, 0xe4, 0x74, 0xe2, 0x16, 0xf2, 0x61, 0x09,
+	0xc4, 0xee, 0x8f, 0x22, 0x17, 0x35, 0x0c, 0xc3, 0x4e, 0xd2, 0x72, 0x45,
+	0x3d, 0x51, 0x6b, 0xe3, 0xe3, 0x2a, 0xc3, 0xd9, 0x8f, 0xa4, 0x54, 0x46,
+	0x75, 0xaf, 0xe2, 0xa0, 0xf1, 0x89, 0x60, 0xf1, 0x12, 0x76, 0x54, 0x93,
+	0x0b, 0x16, 0xa0, 0x95, 0xdc, 0xd8, 0x5c, 0x64, 0x79, 0xb5, 0x81, 0xce,
+	0xe1, 0x14, 0xa9, 0x38, 0xfa, 0x38, 0x01, 0xb0, 0x9d, 0xb0, 0x6d, 0x9a,
+	0xaf, 0x7a, 0xec, 0x6a, 0xeb, 0xb9, 0x6f, 0x68, 0x67, 0x09, 0x27, 0x1c,
+	0x58, 0x8a, 0xfc, 0xdc, 0x9d, 0x90, 0x3a, 0x74, 0xb8, 0x2b, 0x96, 0xcd,
+	0x05, 0x40, 0x7f, 0x02, 0x03, 0x01, 0x00, 0x01,
+};
+
+static const uint8_t rsa_digest[] = {
+	0x84, 0x76, 0x8d, 0xde, 0xe6, 0x59, 0xef, 0xea, 0xfd, 0xeb, 0x97, 0x2b,
+	0x55, 0x14, 0x31, 0x41, 0xbc, 0x23, 0xb6, 0xe3, 0x33, 0xc7, 0x0e, 0x8b,
+	0x68, 0xd2, 0x97, 0x74, 0xab, 0x09, 0xa5, 0x48,
+};
+
+static const uint8_t rsa_sig[] = {
+	0x00, 0xa6, 0xa2, 0x31, 0xc8, 0xc8, 0xca, 0x5f, 0x16, 0x43, 0x72, 0x14,
+	0xb8, 0x77, 0x33, 0x3b, 0xf9, 0x8c, 0x65, 0x2b, 0x77, 0x20, 0xa6, 0x3b,
+	0xdc, 0x8b, 0x84, 0xbd, 0x7e, 0x5b, 0x3d, 0x48, 0xef, 0xb6, 0x3c, 0xa8,
+	0x92, 0xb0, 0x01, 0xbb, 0x6b, 0x84, 0xa2, 0xf6, 0xee, 0x58, 0x5c, 0x3b,
+	0xa8, 0x8d, 0xa7, 0xf7, 0x28, 0x32, 0xf2, 0x38, 0x6d, 0x98, 0x50, 0x12,
+	0x72, 0xdf, 0x81, 0xcc, 0x1c, 0x98, 0x05, 0xed, 0x1a, 0x29, 0x84, 0xa9,
+	0xf1, 0x7a, 0x38, 0x33, 0x6d, 0x55, 0x58, 0x52, 0xb8, 0xac, 0xbf, 0xbb,
+	0x92, 0x2b, 0x44, 0x37, 0xa8, 0x83, 0x2e, 0x5a, 0x95, 0x0b, 0x7f, 0x03,
+	0xbc, 0x6e, 0x71, 0x8a, 0x0f, 0xba, 0xda, 0x41, 0x53, 0x37, 0x80, 0x48,
+	0x77, 0xc4, 0x62, 0xc9, 0x3b, 0x12, 0x49, 0xf5, 0x98, 0x76, 0x0b, 0x9f,
+	0xa2, 0x42, 0x1d, 0x17, 0xf2, 0xf1, 0x7c, 0xc6,
+};
+
+static void test_rsa_sig_len(const void *data)
+{
+	uint8_t sig[sizeof(rsa_sig) + 1];
+
+	assert(cert_rsa_pkcs1_verify(rsa_pubkey, sizeof(rsa_pubkey),
+					L_CHECKSUM_SHA256,
+					rsa_digest, sizeof(rsa_digest),
+					rsa_sig, sizeof(rsa_sig)));
+
+	/* Same integer value, but not the modulus length, RFC8017 8.2.2 */
+	assert(!cert_rsa_pkcs1_verify(rsa_pubkey, sizeof(rsa_pubkey),
+					L_CHECKSUM_SHA256,
+					rsa_digest, sizeof(rsa_digest),
+					rsa_sig + 1, sizeof(rsa_sig) - 1));
+
+	sig[0] = 0x00;
+	memcpy(sig + 1, rsa_sig, sizeof(rsa_sig));
+	assert(!cert_rsa_pkcs1_verify(rsa_pubkey, sizeof(rsa_pubkey),
+					L_CHECKSUM_SHA256,
+					rsa_digest, sizeof(rsa_digest),
+					sig, sizeof(sig)));
+}
+
+static void test_cert_store_truncated(const void *data)
+{
+	char path[] = "/tmp/ell-test-cert-store-XXXXXX";
+	struct l_cert *leaf = load_cert_file(CERTDIR "cert-entity-int.pem");
+	struct l_cert *intca = load_cert_file(CERTDIR "cert-intca.pem");
+	struct l_cert_store *store;
+	void *contents;
+	size_t len;
+	int fd;
+
+	contents = l_file_get_contents(CERTDIR "cert-chain.pem", &len);
+	assert(contents);
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	assert(write(fd, contents, len) == (ssize_t) len);
+	l_free(contents);
+
+	store = l_cert_store_new();
+	assert(l_cert_store_load_file(store, path));
+
+	/* The certificates are only decoded now, the file is gone */
+	assert(ftruncate(fd, 0) == 0);
+	close(fd);
+	unlink(path);
+
+	assert(cert_der_eq(l_cert_store_find_issuer(store, leaf), intca));
+
+	l_cert_store_free(store);
+	l_cert_free(leaf);
+	l_cert_free(intca);
+}
+
+/* Resident private memory, i.e. not counting the page cache */
+static long bench_rss_kb(void)
+{
+	FILE *f = fopen("/proc/self/statm", "r");
+	long size, resident, shared;
+
+	if (!f)
+		return 0;
+
+	if (fscanf(f, "%ld %ld %ld", &size, &resident, &shared) != 3)
+		resident = shared = 0;
+
+	fclose(f);
+	return (resident - shared) * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static bool bench_find_in_list(const void *a, const void *b)
+{
+	size_t len_a, len_b;
+	const uint8_t *dn_a = l_cert_get_dn((struct l_cert *) a, &len_a);
+	const uint8_t *dn_b = l_cert_get_dn((struct l_cert *) b, &len_b);
+
+	return len_a == len_b && !memcmp(dn_a, dn_b, len_a);
+}
+
+/*
+ * Loading the system bundle, then looking up every CA in it by name, with
+ * the indexed store and with the plain certificate list.
+ */
+static void test_cert_store_bench(const void *data)
+{
+	static const char *bundle = "/etc/ssl/certs/ca-certificates.crt";
+	struct l_cert_store *store;
+	struct l_queue *list;
+	const struct l_queue_entry *entry;
+	uint64_t start;
+	uint64_t load_us;
+	uint64_t find_us;
+	long rss;
+	unsigned int n;
+
+	if (access(bundle, R_OK) < 0) {
+		printf("%s not found, skipping\n", bundle);
+		return;
+	}
+
+	rss = bench_rss_kb();
+	start = l_time_now();
+	store = l_cert_store_new();
+	assert(l_cert_store_load_file(store, bundle));
+	load_us = l_time_diff(start, l_time_now());
+	printf("Store: %u certificates loaded in %u us, %li kB RSS\n",
+		l_cert_store_get_count(store), (unsigned int) load_us,
+		bench_rss_kb() - rss);
+
+	rss = bench_rss_kb();
+	start = l_time_now();
+	list = l_pem_load_certificate_list(bundle);
+	assert(list);
+	load_us = l_time_diff(start, l_time_now());
+	printf("List: %u certificates loaded in %u us, %li kB RSS\n",
+		l_queue_length(list), (unsigned int) load_us,
+		bench_rss_kb() - rss);
+
+	n = l_queue_length(list);
+
+	start = l_time_now();
+
+	for (entry = l_queue_get_entries(list); entry; entry = entry->next)
+		assert(l_cert_store_find_issuer(store, entry->data));
+
+	find_us = l_time_diff(start, l_time_now());
+	printf("Store: issuer lookup %u ns each (incl. first use decode)\n",
+		(unsigned int) (find_us * 1000 / n));
+
+	start = l_time_now();
+
+	for (entry = l_queue_get_entries(list); entry; entry = entry->next)
+		assert(l_cert_store_find_issuer(store, entry->data));
+
+	find_us = l_time_diff(start, l_time_now());
+	printf("Store: issuer lookup %u ns each\n",
+		(unsigned int) (find_us * 1000 / n));
+
+	start = l_time_now();
+
+	for (entry = l_queue_get_entries(list); entry; entry = entry->next)
+		assert(l_queue_find(list, bench_find_in_list, entry->data));
+
+	find_us = l_time_diff(start, l_time_now());
+	printf("List: linear lookup %u ns each\n",
+		(unsigned int) (find_us * 1000 / n));
+
+	l_queue_destroy(list, (l_queue_destroy_func_t) l_cert_free);
+	l_cert_store_free(store);
+}
+
 struct tls_conn_test {
 	const char *server_cert_path;
 	const char *server_key_path;
@@ -934,6 +1407,10 @@ int main(int argc, char *argv[])
 
 	l_test_init(&argc, &argv);
 
+	l_test_add("Certificate store truncated file",
+			test_cert_store_truncated, NULL);
+	l_test_add("RSA signature length", test_rsa_sig_len, NULL);
+
 	if (!l_checksum_is_supported(L_CHECKSUM_MD5, false) ||
 			!l_checksum_is_supported(L_CHECKSUM_SHA1, false) ||
 			!l_checksum_is_supported(L_CHECKSUM_SHA256, false) ||
@@ -955,10 +1432,27 @@ int main(int argc, char *argv[])
 			&tls12_prf_sha512_0);
 
 	if (l_key_is_supported(L_KEY_FEATURE_RESTRICT)) {
-		l_test_add("Certificate chains", test_certificates, NULL);
-		l_test_add("ECDSA Certificates", test_ec_certificates, NULL);
+		l_test_add("Certificate chains", test_certificates,
+				&verify_keyring);
+		l_test_add("ECDSA Certificates", test_ec_certificates,
+				&verify_keyring);
 	}
 
+	l_test_add("Certificate chains userspace", test_certificates,
+			&verify_userspace);
+	l_test_add("ECDSA Certificates userspace", test_ec_certificates,
+			&verify_userspace);
+	l_test_add("RSASSA-PSS Certificates userspace", test_pss_certificates,
+			NULL);
+	l_test_add("Corrupt signature userspace", test_certificate_corrupt,
+			NULL);
+	l_test_add("Certificate verify cache", test_certchain_cache, NULL);
+	l_test_add("Certificate store", test_cert_store, NULL);
+	l_test_add_benchmark("Certificate store benchmark",
+				test_cert_store_bench, NULL);
+	l_test_add_benchmark("Certificate chain benchmark",
+				test_certchain_bench, NULL);
+
 	if (!l_getrandom_is_supported()) {
 		printf("getrandom missing, skipping TLS connection tests...\n");
 		goto done;
@@ -11,6 +11,9 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
 
 #include <ell/ell.h>
 
@@ -429,6 +432,259 @@ static void test_uintset_subtract(const void *data)
 	l_uintset_free(set_a);
 }
 
+static void test_uintset_large(const void *data)
+{
+	struct l_uintset *set;
+
+	assert(!l_uintset_new_from_range(0, 1U << 24));
+
+	set = l_uintset_new_from_range(0, (1U << 24) - 1);
+	assert(set);
+
+	assert(l_uintset_find_min(set) == 1U << 24);
+	assert(l_uintset_find_max(set) == 1U << 24);
+	assert(l_uintset_put(set, (1U << 24) - 1));
+	assert(!l_uintset_put(set, 1U << 24));
+	assert(l_uintset_find_min(set) == (1U << 24) - 1);
+	assert(l_uintset_find_max(set) == (1U << 24) - 1);
+	assert(l_uintset_find_unused(set, (1U << 24) - 1) == 0);
+	assert(!l_uintset_take(set, 1U << 24));
+
+	l_uintset_free(set);
+}
+
+struct random_check {
+	const bool *model;
+	uint32_t min;
+	uint32_t next;
+};
+
+static void random_foreach(uint32_t number, void *user_data)
+{
+	struct random_check *check = user_data;
+
+	while (!check->model[check->next - check->min])
+		check->next++;
+
+	assert(number == check->next);
+	check->next++;
+}
+
+static uint32_t model_find(const bool *model, uint32_t size, uint32_t start,
+								bool value)
+{
+	uint32_t i;
+
+	for (i = start; i < size; i++)
+		if (model[i] == value)
+			return i;
+
+	return size;
+}
+
+static void check_random(struct l_uintset *set, const bool *model,
+						uint32_t min, uint32_t size)
+{
+	struct random_check check = { .model = model, .min = min, .next = min };
+	uint32_t count = 0;
+	uint32_t last = size;
+	uint32_t start;
+	uint32_t bit;
+	uint32_t i;
+
+	for (i = 0; i < size; i++) {
+		if (!model[i])
+			continue;
+
+		count++;
+		last = i;
+	}
+
+	assert(l_uintset_size(set) == count);
+	assert(l_uintset_isempty(set) == !count);
+	assert(l_uintset_find_max(set) == min + last);
+	assert(l_uintset_find_min(set) ==
+				min + model_find(model, size, 0, true));
+	assert(l_uintset_find_unused_min(set) ==
+				min + model_find(model, size, 0, false));
+
+	start = rand() % size;
+	bit = model_find(model, size, start, false);
+	if (bit == size)
+		bit = model_find(model, size, 0, false);
+
+	assert(l_uintset_find_unused(set, min + start) == min + bit);
+
+	l_uintset_foreach(set, random_foreach, &check);
+	assert(model_find(model, size, check.next - min, true) == size);
+}
+
+static void test_uintset_random(const void *data)
+{
+	static const uint32_t sizes[] = { 1, 63, 64, 65, 4095, 4096, 4097,
+						262145, 1U << 20 };
+	unsigned int n;
+
+	srand(42);
+
+	for (n = 0; n < L_ARRAY_SIZE(sizes); n++) {
+		uint32_t size = sizes[n];
+		uint32_t min = 1000;
+		struct l_uintset *set;
+		struct l_uintset *other;
+		struct l_uintset *result;
+		bool *model = l_new(bool, size);
+		bool *model_other = l_new(bool, size);
+		bool *model_result = l_new(bool, size);
+		unsigned int round;
+		uint32_t i;
+
+		set = l_uintset_new_from_range(min, min + size - 1);
+		other = l_uintset_new_from_range(min, min + size - 1);
+		assert(set && other);
+
+		/* Fill up completely then empty out again, in random order */
+		for (round = 0; round < 8; round++) {
+			bool put = round < 4;
+
+			for (i = 0; i < size / 2 + 1; i++) {
+				uint32_t bit = rand() % size;
+
+				if (put)
+					assert(l_uintset_put(set, min + bit));
+				else
+					assert(l_uintset_take(set, min + bit));
+
+				model[bit] = put;
+			}
+
+			check_random(set, model, min, size);
+		}
+
+		for (i = 0; i < size; i++) {
+			assert(l_uintset_put(set, min + i));
+			model[i] = true;
+		}
+
+		check_random(set, model, min, size);
+
+		for (i = 0; i < size; i += 3) {
+			assert(l_uintset_take(set, min + i));
+			model[i] = false;
+		}
+
+		for (i = 0; i < size; i += 2) {
+			assert(l_uintset_put(other, min + i));
+			model_other[i] = true;
+		}
+
+		check_random(set, model, min, size);
+
+		result = l_uintset_intersect(set, other);
+
+		for (i = 0; i < size; i++)
+			model_result[i] = model[i] && model_other[i];
+
+		check_random(result, model_result, min, size);
+		l_uintset_free(result);
+
+		result = l_uintset_subtract(set, other);
+
+		for (i = 0; i < size; i++)
+			model_result[i] = model[i] && !model_other[i];
+
+		check_random(result, model_result, min, size);
+		l_uintset_free(result);
+
+		result = l_uintset_clone(set);
+		check_random(result, model, min, size);
+		l_uintset_free(result);
+
+		l_uintset_free(other);
+		l_uintset_free(set);
+		l_free(model_result);
+		l_free(model_other);
+		l_free(model);
+	}
+}
+
+static void bench_count(uint32_t number, void *user_data)
+{
+	uint32_t *count = user_data;
+
+	*count += 1;
+}
+
+static void bench_uintset(const char *name, uint32_t size,
+						unsigned int density)
+{
+	struct l_uintset *set = l_uintset_new(size);
+	struct l_uintset *other = l_uintset_new(size);
+	struct l_uintset *result;
+	uint64_t start, alloc_time, ops_time;
+	unsigned int rounds = 0;
+	uint32_t count = 0;
+	uint32_t next;
+	uint32_t i;
+
+	/* Every density-th number stays free */
+	for (i = 1; i <= size; i++)
+		if (i % density)
+			l_uintset_put(set, i);
+
+	for (i = 1; i <= size; i += 7)
+		l_uintset_put(other, i);
+
+	/* Allocate the lowest free numbers like an id allocator would */
+	start = l_time_now();
+
+	while (true) {
+		next = l_uintset_find_unused_min(set);
+		if (next > size)
+			break;
+
+		l_uintset_put(set, next);
+		rounds++;
+	}
+
+	alloc_time = l_time_now() - start;
+
+	for (i = 1; i <= size; i += density)
+		l_uintset_take(set, i);
+
+	start = l_time_now();
+
+	for (i = 0; i < 100; i++) {
+		result = l_uintset_intersect(set, other);
+		count += l_uintset_size(result);
+		l_uintset_free(result);
+
+		result = l_uintset_subtract(set, other);
+		count += l_uintset_size(result);
+		l_uintset_free(result);
+
+		l_uintset_foreach(set, bench_count, &count);
+	}
+
+	ops_time = l_time_now() - start;
+	assert(count);
+
+	printf("%s, %u entries: %u allocations in %" PRIu64 " us, "
+			"100 x intersect + subtract + foreach in %" PRIu64
+			" us\n", name, size, rounds, alloc_time, ops_time);
+
+	l_uintset_free(other);
+	l_uintset_free(set);
+}
+
+static void test_uintset_benchmark(const void *data)
+{
+	bench_uintset("dense", USHRT_MAX, 1000);
+	bench_uintset("dense", 1U << 20, 1000);
+	bench_uintset("sparse", USHRT_MAX, 2);
+	bench_uintset("sparse", 1U << 20, 2);
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -449,6 +705,10 @@ int main(int argc, char *argv[])
 	l_test_add("l_uintset isempty", test_uintset_isempty, NULL);
 	l_test_add("l_uintset size", test_uintset_size, NULL);
 	l_test_add("l_uintset_subtract", test_uintset_subtract, NULL);
+	l_test_add("l_uintset large", test_uintset_large, NULL);
+	l_test_add("l_uintset random", test_uintset_random, NULL);
+	l_test_add_benchmark("l_uintset benchmark", test_uintset_benchmark,
+				NULL);
 
 	return l_test_run();
 }
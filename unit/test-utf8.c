@@ -11,6 +11,8 @@
 #endif
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <ell/ell.h>
 
@@ -891,6 +893,12 @@ static struct utf8_from_utf16_test utf8_from_utf16_test4 = {
 	.utf16_size = 8,
 };
 
+static struct utf8_from_utf16_test utf8_from_utf16_test5 = {
+	.utf16 = { 0x61, 0xd83d, 0xde00, 0x00 },
+	.utf16_size = 8,
+	.utf8 = "a\xf0\x9f\x98\x80",
+};
+
 static void test_utf8_from_utf16(const void *test_data)
 {
 	const struct utf8_from_utf16_test *test = test_data;
@@ -920,6 +928,137 @@ static void test_utf8_to_utf16(const void *test_data)
 	l_free(utf16);
 }
 
+static uint32_t lcg_state = 1;
+
+static uint32_t lcg_next(void)
+{
+	lcg_state = lcg_state * 1103515245 + 12345;
+	return lcg_state >> 8;
+}
+
+/* Mostly valid text with long ASCII runs and the occasional bad byte */
+static size_t random_utf8(char *buf, size_t max)
+{
+	static const char *pieces[] = {
+		"abcdefghijklmnopqrstuvwxyz0123456789", "\xce\xba",
+		"\xe4\xb8\xad", "\xf0\x9f\x98\x80", "\xef\xbf\xbf",
+		"\xed\xa0\x80", "\xc0\xaf", "\x80", "\xe4\xb8",
+	};
+	size_t len = 0;
+
+	while (len < max) {
+		uint32_t r = lcg_next() % 64;
+		const char *piece;
+		size_t n;
+
+		if (r == 0) {
+			buf[len++] = '\0';
+			continue;
+		}
+
+		/* Valid pieces come first, the last five are invalid */
+		piece = r < 56 ? pieces[r % 4] : pieces[4 + (r - 56) % 5];
+		n = strlen(piece);
+
+		/* ASCII runs of random length */
+		if (piece == pieces[0])
+			n = 1 + lcg_next() % n;
+
+		if (len + n > max)
+			break;
+
+		memcpy(buf + len, piece, n);
+		len += n;
+	}
+
+	return len;
+}
+
+static bool reference_validate(const char *str, size_t len,
+							const char **end)
+{
+	size_t pos = 0;
+	wchar_t val;
+	int ret;
+
+	while (pos < len && str[pos]) {
+		ret = l_utf8_get_codepoint(str + pos, len - pos, &val);
+		if (ret < 0)
+			break;
+
+		pos += ret;
+	}
+
+	*end = str + pos;
+	return pos == len;
+}
+
+static void test_utf8_validate_random(const void *data)
+{
+	char buf[257];
+	unsigned int i;
+
+	for (i = 0; i < 20000; i++) {
+		size_t len = random_utf8(buf, lcg_next() % 256);
+		const char *end1, *end2;
+		size_t count = 0;
+		size_t j;
+
+		assert(l_utf8_validate(buf, len, &end1) ==
+					reference_validate(buf, len, &end2));
+		assert(end1 == end2);
+
+		buf[len] = '\0';
+
+		for (j = 0; buf[j]; j++)
+			if (((unsigned char) buf[j] >> 6) != 2)
+				count++;
+
+		assert(l_utf8_strlen(buf) == count);
+	}
+}
+
+#define BENCH_SIZE	(1024 * 1024)
+
+static void bench_utf8_run(const char *name, const char *piece)
+{
+	size_t n = strlen(piece);
+	char *buf = l_malloc(BENCH_SIZE + 1);
+	uint64_t start, validate, strlen_time;
+	unsigned int i;
+	size_t len;
+
+	for (len = 0; len + n <= BENCH_SIZE; len += n)
+		memcpy(buf + len, piece, n);
+
+	buf[len] = '\0';
+
+	start = l_time_now();
+
+	for (i = 0; i < 20; i++)
+		assert(l_utf8_validate(buf, len, NULL));
+
+	validate = l_time_now() - start;
+	start = l_time_now();
+
+	for (i = 0; i < 20; i++)
+		assert(l_utf8_strlen(buf));
+
+	strlen_time = l_time_now() - start;
+
+	printf("%s: validate %.0f MB/s, strlen %.0f MB/s\n", name,
+			20.0 * len / validate, 20.0 * len / strlen_time);
+
+	l_free(buf);
+}
+
+static void bench_utf8(const void *data)
+{
+	bench_utf8_run("ASCII", "The quick brown fox jumps over the dog. ");
+	bench_utf8_run("CJK", "\xe4\xb8\xad\xe6\x96\x87\xe6\xb5\x8b"
+				"\xe8\xaf\x95\xe3\x80\x82 ");
+}
+
 static void test_ascii_toupper(const void *data)
 {
 	assert(l_ascii_toupper('c') == 'C');
@@ -1146,6 +1285,8 @@ int main(int argc, char *argv[])
 	l_test_add("Strlen UTF 1", test_utf8_strlen,
 					&utf8_strlen_test1);
 
+	l_test_add("Validate UTF random", test_utf8_validate_random, NULL);
+
 	l_test_add("utf8_from_utf16 1", test_utf8_from_utf16,
 					&utf8_from_utf16_test1);
 	l_test_add("utf8_from_utf16 2", test_utf8_from_utf16,
@@ -1154,16 +1295,22 @@ int main(int argc, char *argv[])
 					&utf8_from_utf16_test3);
 	l_test_add("utf8_from_utf16 4", test_utf8_from_utf16,
 					&utf8_from_utf16_test4);
+	l_test_add("utf8_from_utf16 5", test_utf8_from_utf16,
+					&utf8_from_utf16_test5);
 
 	l_test_add("utf8_to_utf16 1", test_utf8_to_utf16,
 					&utf8_from_utf16_test1);
 	l_test_add("utf8_to_utf16 2", test_utf8_to_utf16,
 					&utf8_from_utf16_test2);
+	l_test_add("utf8_to_utf16 5", test_utf8_to_utf16,
+					&utf8_from_utf16_test5);
 
 	l_test_add("ascii/toupper", test_ascii_toupper, NULL);
 	l_test_add("ascii/tolower", test_ascii_tolower, NULL);
 	l_test_add("ascii/strup", test_ascii_strup, NULL);
 	l_test_add("ascii/strdown", test_ascii_strdown, NULL);
 
+	l_test_add_benchmark("UTF-8 benchmark", bench_utf8, NULL);
+
 	return l_test_run();
 }
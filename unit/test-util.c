@@ -28,6 +28,47 @@ static void test_hexstring(const void *test_data)
 	l_free(hex);
 }
 
+static void hexdump_collect(const char *str, void *user_data)
+{
+	struct l_string *out = user_data;
+
+	l_string_append(out, str);
+	l_string_append_c(out, '\n');
+}
+
+static void test_hexdump(const void *test_data)
+{
+	static const char expected[] =
+		"> 45 6d 62 65 64 64 65 64 20 4c 69 6e 75 78 20 6c  "
+							"Embedded Linux l\n"
+		"  69 62 72 61 72 79 00 ff                          "
+							"ibrary..        \n";
+	static const char data[] = "Embedded Linux library\0\xff";
+	struct iovec iov[3];
+	struct l_string *out;
+	char *str;
+
+	out = l_string_new(256);
+	l_util_hexdump(false, data, sizeof(data) - 1, hexdump_collect, out);
+	str = l_string_unwrap(out);
+	assert(!strcmp(str, expected));
+	l_free(str);
+
+	/* Lines span iovec boundaries */
+	iov[0].iov_base = (void *) data;
+	iov[0].iov_len = 5;
+	iov[1].iov_base = (void *) data + 5;
+	iov[1].iov_len = 14;
+	iov[2].iov_base = (void *) data + 19;
+	iov[2].iov_len = sizeof(data) - 1 - 19;
+
+	out = l_string_new(256);
+	l_util_hexdumpv(false, iov, 3, hexdump_collect, out);
+	str = l_string_unwrap(out);
+	assert(!strcmp(str, expected));
+	l_free(str);
+}
+
 static void test_hexstringv(const void *test_data)
 {
 	unsigned char test1[] = { 0x74, 0x65, 0x73, 0x74, 0x00 };
@@ -80,6 +121,96 @@ static void test_from_hexstring(const void *test_data)
 	assert(!bytes);
 }
 
+static void test_hexstring_long(const void *test_data)
+{
+	uint8_t buf[100];
+	uint8_t out[100];
+	unsigned int i;
+	char *hex;
+	size_t len;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 37 + 11;
+
+	/* Lengths around the 16 byte blocks */
+	for (len = 1; len <= sizeof(buf); len++) {
+		uint8_t *bytes;
+		size_t out_len;
+
+		hex = len & 1 ? l_util_hexstring_upper(buf, len) :
+					l_util_hexstring(buf, len);
+		assert(strlen(hex) == len * 2);
+
+		for (i = 0; i < len; i++) {
+			char tmp[3];
+
+			snprintf(tmp, sizeof(tmp), len & 1 ? "%02X" : "%02x",
+					buf[i]);
+			assert(!memcmp(hex + i * 2, tmp, 2));
+		}
+
+		bytes = l_util_from_hexstring(hex, &out_len);
+		assert(bytes && out_len == len);
+		assert(!memcmp(bytes, buf, len));
+		l_free(bytes);
+
+		assert(l_util_from_hexstring_into(hex, out, len) ==
+							(ssize_t) len);
+		assert(!memcmp(out, buf, len));
+		assert(l_util_from_hexstring_into(hex, out, len - 1) ==
+								-ENOSPC);
+
+		/* A bad digit anywhere */
+		hex[(len * 7) % (len * 2)] = 'g';
+		assert(!l_util_from_hexstring(hex, &out_len));
+		hex[(len * 7) % (len * 2)] = '\x80';
+		assert(l_util_from_hexstring_into(hex, out, len) == -EINVAL);
+		l_free(hex);
+	}
+
+	assert(l_util_from_hexstring_into("", out, sizeof(out)) == -EINVAL);
+}
+
+#define BENCH_SIZE	(1024 * 1024)
+
+static void bench_hexstring(const void *test_data)
+{
+	uint8_t *buf = l_malloc(BENCH_SIZE);
+	uint64_t start, encode, decode;
+	unsigned int i;
+	char *hex;
+	size_t len;
+
+	for (i = 0; i < BENCH_SIZE; i++)
+		buf[i] = i * 37 + 11;
+
+	start = l_time_now();
+
+	for (i = 0; i < 10; i++) {
+		hex = l_util_hexstring(buf, BENCH_SIZE);
+		l_free(hex);
+	}
+
+	encode = l_time_now() - start;
+	hex = l_util_hexstring(buf, BENCH_SIZE);
+	start = l_time_now();
+
+	for (i = 0; i < 10; i++) {
+		uint8_t *bytes = l_util_from_hexstring(hex, &len);
+
+		assert(bytes && len == BENCH_SIZE);
+		l_free(bytes);
+	}
+
+	decode = l_time_now() - start;
+
+	printf("hex: encode %.0f MB/s, decode %.0f MB/s\n",
+			10.0 * BENCH_SIZE / encode, 10.0 * BENCH_SIZE / decode);
+
+	l_free(hex);
+	l_free(buf);
+}
+
 static void test_has_suffix(const void *test_data)
 {
 	const char *str = "string";
@@ -296,6 +427,8 @@ int main(int argc, char *argv[])
 	l_test_add("l_util_hexstring_upper", test_hexstring_upper, NULL);
 	l_test_add("l_util_hexstringv", test_hexstringv, NULL);
 	l_test_add("l_util_from_hexstring", test_from_hexstring, NULL);
+	l_test_add("l_util_hexstring long", test_hexstring_long, NULL);
+	l_test_add("l_util_hexdump", test_hexdump, NULL);
 
 	l_test_add("l_util_has_suffix", test_has_suffix, NULL);
 
@@ -313,5 +446,7 @@ int main(int argc, char *argv[])
 
 	l_test_add("roundup_pow_of_two", test_roundup_pow_of_two, NULL);
 
+	l_test_add_benchmark("hexstring benchmark", bench_hexstring, NULL);
+
 	return l_test_run();
 }